@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+	x0 - address in - crc out
+	x1 - byte count
+	x2 - address of a 1 KiB scratch area for the lookup table
+*/
+
+	.text
+	.arch	armv8-a
+
+_start:
+	/* build the table for polynomial 0x04c11db7, msb first */
+	mov		w3, #0x1db7
+	movk	w3, #0x04c1, lsl #16
+	mov		w4, #0
+table:
+	lsl		w5, w4, #24
+	mov		w6, #8
+table_bit:
+	lsl		w7, w5, #1
+	tst		w5, #0x80000000
+	eor		w5, w7, w3
+	csel	w5, w5, w7, ne
+	subs	w6, w6, #1
+	b.ne	table_bit
+	str		w5, [x2, x4, lsl #2]
+	add		w4, w4, #1
+	cmp		w4, #256
+	b.ne	table
+
+	mov		x3, x0
+	mov		w0, #0xffffffff	/* crc */
+	cbz		x1, end
+nbyte:
+	ldrb	w4, [x3], #1
+	eor		w4, w4, w0, lsr #24
+	ldr		w4, [x2, x4, lsl #2]
+	eor		w0, w4, w0, lsl #8
+	subs	x1, x1, #1
+	b.ne	nbyte
+end:
+	hlt		#0
+
+	.end
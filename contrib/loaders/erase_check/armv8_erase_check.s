@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+	parameters:
+	x0 - pointer to struct { uint64_t size_in_result_out, uint64_t addr }
+	w1 - value to check
+*/
+
+	.text
+	.arch	armv8-a
+
+BLOCK_SIZE_RESULT	= 0
+BLOCK_ADDRESS		= 8
+SIZEOF_STRUCT_BLOCK	= 16
+
+start:
+block_loop:
+	ldr		x2, [x0, #BLOCK_SIZE_RESULT]	/* get size in words */
+	cbz		x2, done
+
+	ldr		x3, [x0, #BLOCK_ADDRESS]	/* get address */
+
+word_loop:
+	ldr		w4, [x3], #4	/* read word */
+	cmp		w4, w1
+	b.ne	not_erased
+
+	subs	x2, x2, #1
+	b.ne	word_loop
+
+	mov		x4, #1		/* block is erased */
+save_result:
+	str		x4, [x0, #BLOCK_SIZE_RESULT]
+	add		x0, x0, #SIZEOF_STRUCT_BLOCK
+	b		block_loop
+
+not_erased:
+	mov		x4, #0
+	b		save_result
+
+done:
+	hlt		#0
+
+	.end
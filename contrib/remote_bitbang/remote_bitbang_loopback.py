@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+"""
+Loopback server for the OpenOCD remote_bitbang interface driver.
+
+TDO follows TDI, as if a wire connected them, SWDIO reads back the last
+value written, and everything else is acknowledged and ignored. The vector
+extension of the protocol is implemented, unless --no-vectors is given.
+
+There is no target behind it, the server is meant to measure the host side
+overhead of OpenOCD and of the remote_bitbang protocol, e.g. with
+tcl/tools/benchmark.tcl:
+
+    contrib/remote_bitbang/remote_bitbang_loopback.py --port 3335 &
+    openocd -c "set BENCHMARK_ADAPTER remote_bitbang" -f tools/benchmark.tcl
+    openocd -c "set BENCHMARK_ADAPTER remote_bitbang" \\
+            -c "set BENCHMARK_VECTORS on" -f tools/benchmark.tcl
+"""
+
+import argparse
+import socket
+
+
+def serve(conn, vectors):
+    tdi = 0
+    data = bytearray()
+    while True:
+        chunk = conn.recv(65536)
+        if not chunk:
+            return
+        data += chunk
+        reply = bytearray()
+        i = 0
+        while i < len(data):
+            c = data[i]
+            if vectors and c in (0x4a, 0x57):
+                # 'J' / 'W': vector, 16 bit length, flags, then the values
+                if i + 4 > len(data):
+                    break
+                bits = data[i + 1] | (data[i + 2] << 8)
+                flags = data[i + 3]
+                size = (bits + 7) // 8
+                out1 = 4
+                out2 = out1 + (size if flags & 1 else 0)
+                end = out2 + (size if flags & 2 else 0)
+                if i + end > len(data):
+                    break
+                if flags & 2:
+                    values = data[i + out2:i + end]
+                    last = bits - 1
+                    tdi = (values[last // 8] >> (last % 8)) & 1
+                else:
+                    values = bytes(size)
+                    tdi = 0
+                if flags & 4:
+                    reply += values
+                i += end
+                continue
+            if 0x30 <= c <= 0x37:
+                # '0' - '7': write tck, tms, tdi
+                tdi = c & 1
+            elif 0x64 <= c <= 0x67:
+                # 'd' - 'g': write swclk, swdio
+                tdi = (c - 0x64) & 1
+            elif c == 0x52:
+                # 'R': read tdo
+                reply.append(0x31 if tdi else 0x30)
+            elif c == 0x63:
+                # 'c': read swdio
+                reply.append(0x31 if tdi else 0x30)
+            elif c == 0x56 and vectors:
+                # 'V': vector extension, version 1
+                reply += b'V1'
+            elif c == 0x51:
+                # 'Q': quit
+                if reply:
+                    conn.sendall(reply)
+                return
+            i += 1
+        del data[:i]
+        if reply:
+            conn.sendall(reply)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='localhost', help='address to listen on')
+    parser.add_argument('--port', type=int, default=3335, help='TCP port to listen on')
+    parser.add_argument('--once', action='store_true', help='exit after the first connection')
+    parser.add_argument('--no-vectors', action='store_true',
+                        help='only implement the character protocol')
+    args = parser.parse_args()
+
+    with socket.create_server((args.host, args.port)) as server:
+        while True:
+            conn, _ = server.accept()
+            with conn:
+                conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                serve(conn, not args.no_vectors)
+            if args.once:
+                return
+
+
+if __name__ == '__main__':
+    main()
@@ -14,6 +14,7 @@
 #include "imp.h"
 #include "cc_lpf3_flash.h"
 #include <helper/bits.h>
+#include <helper/crc32.h>
 #include <helper/time_support.h>
 #include <target/arm_adi_v5.h>
 #include <target/armv7m.h>
@@ -26,27 +27,11 @@
  */
 static uint32_t cc_lpf3_calculate_crc(const uint8_t *data_ptr, uint32_t length)
 {
-	uint32_t data = 0, index = 0, acc = 0xFFFFFFFFU;
-	//The LUT is build by selecting every 16th entry in the precalculated CRC32
-	//table that has 256 entries.
-	static const uint32_t crc_rand32_lut[] = {
-		0x00000000U, 0x1DB71064U, 0x3B6E20C8U, 0x26D930ACU,
-		0x76DC4190U, 0x6B6B51F4U, 0x4DB26158U, 0x5005713CU,
-		0xEDB88320U, 0xF00F9344U, 0xD6D6A3E8U, 0xCB61B38CU,
-		0x9B64C2B0U, 0x86D3D2D4U, 0xA00AE278U, 0xBDBDF21CU
-	};
-	if (data_ptr)
-	{
-		while (length--) {
-			data = *data_ptr;
-			index = (acc & 0x0F) ^ (data & 0x0F);
-			acc = (acc >> 4) ^ crc_rand32_lut[index];
-			index = (acc & 0x0F) ^ (data >> 4);
-			acc = (acc >> 4) ^ crc_rand32_lut[index];
-			data_ptr++;
-		}
-	}
-	return (acc ^ 0xFFFFFFFFU);
+	if (!data_ptr)
+		return 0;
+
+	/* the usual reflected CRC32, with an inverted seed and result */
+	return crc32_le(CRC32_POLY_LE, 0xffffffff, data_ptr, length) ^ 0xffffffff;
 }
 
 
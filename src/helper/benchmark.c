@@ -0,0 +1,715 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Micro-benchmarks of the host side code, to measure the effect of
+ * optimizations and catch regressions without any debug adapter.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "benchmark.h"
+#include "binarybuffer.h"
+#include "command.h"
+#include "crc32.h"
+#include "log.h"
+#include "replacements.h"
+#include "time_support.h"
+
+/* A kernel measured by a benchmark, in its reference or current implementation */
+struct benchmark_workload {
+	const char *name;
+	void (*run)(void *data, bool ref);
+};
+
+/* The workloads of a benchmark subcommand and the data they work on */
+struct benchmark {
+	const struct benchmark_workload *workloads;
+	size_t num_workloads;
+	/* passed to the workloads */
+	void *data;
+	/* where the workloads write their result, compared between the two
+	 * implementations */
+	void *result;
+	size_t result_size;
+	/* data processed by a run, e.g. in MB for a rate in MB/s */
+	double amount;
+	const char *unit;
+};
+
+/* @returns the rate, in the unit of the benchmark, of @a iterations runs of a workload */
+static double benchmark_measure(const struct benchmark *bench,
+	const struct benchmark_workload *w, bool ref, unsigned int iterations)
+{
+	int64_t start = timeval_us();
+	for (unsigned int i = 0; i < iterations; i++)
+		w->run(bench->data, ref);
+	int64_t elapsed = timeval_us() - start;
+
+	if (elapsed <= 0)
+		elapsed = 1;
+
+	return bench->amount * iterations * 1e6 / elapsed;
+}
+
+/*
+ * Run each workload of a benchmark with both implementations, check that
+ * they give the same result and display their rates.
+ */
+static int benchmark_workloads(struct command_invocation *cmd,
+	const struct benchmark *bench, unsigned int iterations)
+{
+	uint8_t *expected = malloc(bench->result_size);
+	if (!expected) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = ERROR_OK;
+
+	command_print(cmd, "%-16s %15s %15s %8s", "workload", "reference", "current", "speedup");
+
+	for (size_t i = 0; i < bench->num_workloads; i++) {
+		const struct benchmark_workload *w = &bench->workloads[i];
+
+		/* both implementations must give the same result */
+		memset(bench->result, 0x5a, bench->result_size);
+		w->run(bench->data, true);
+		memcpy(expected, bench->result, bench->result_size);
+		memset(bench->result, 0x5a, bench->result_size);
+		w->run(bench->data, false);
+		if (memcmp(expected, bench->result, bench->result_size)) {
+			command_print(cmd, "%-16s results differ from the reference", w->name);
+			retval = ERROR_FAIL;
+			continue;
+		}
+
+		double ref = benchmark_measure(bench, w, true, iterations);
+		double cur = benchmark_measure(bench, w, false, iterations);
+		command_print(cmd, "%-16s %9.2f %s %9.2f %s %7.1fx", w->name,
+				ref, bench->unit, cur, bench->unit, cur / ref);
+	}
+
+	free(expected);
+
+	return retval;
+}
+
+/*
+ * Bit-at-a-time implementations of the binarybuffer kernels, as they were
+ * before the word-at-a-time rewrite. They are the reference both for the
+ * speed and for the result of "benchmark bitbuf".
+ */
+
+static void *ref_buf_set_buf(const void *_src, unsigned int src_start,
+	void *_dst, unsigned int dst_start, unsigned int len)
+{
+	const uint8_t *src = _src;
+	uint8_t *dst = _dst;
+	unsigned int i, sb, db, sq, dq, lb, lq;
+
+	sb = src_start / 8;
+	db = dst_start / 8;
+	sq = src_start % 8;
+	dq = dst_start % 8;
+	lb = len / 8;
+	lq = len % 8;
+
+	src += sb;
+	dst += db;
+
+	if ((sq == 0) && (dq == 0) && (lq == 0)) {
+		for (i = 0; i < lb; i++)
+			*dst++ = *src++;
+		return _dst;
+	}
+
+	for (i = 0; i < len; i++) {
+		if (((*src >> (sq & 7)) & 1) == 1)
+			*dst |= 1 << (dq & 7);
+		else
+			*dst &= ~(1 << (dq & 7));
+		if (sq++ == 7) {
+			sq = 0;
+			src++;
+		}
+		if (dq++ == 7) {
+			dq = 0;
+			dst++;
+		}
+	}
+
+	return _dst;
+}
+
+static bool ref_buf_cmp_mask(const uint8_t *buf1, const uint8_t *buf2,
+	const uint8_t *mask, unsigned int size)
+{
+	unsigned int last = size / 8;
+	for (unsigned int i = 0; i < last; i++) {
+		if ((buf1[i] & mask[i]) != (buf2[i] & mask[i]))
+			return true;
+	}
+	unsigned int trailing = size % 8;
+	if (!trailing)
+		return false;
+	uint8_t m = mask[last] & ((1 << trailing) - 1);
+	return (buf1[last] & m) != (buf2[last] & m);
+}
+
+static void ref_buffer_shr(uint8_t *buf, unsigned int buf_len, unsigned int count)
+{
+	unsigned int bytes_to_remove = count / 8;
+	unsigned int shift = count - (bytes_to_remove * 8);
+
+	for (unsigned int i = 0; i < (buf_len - 1); i++)
+		buf[i] = (buf[i] >> shift) | ((buf[i + 1] << (8 - shift)) & 0xff);
+
+	buf[(buf_len - 1)] = buf[(buf_len - 1)] >> shift;
+
+	if (bytes_to_remove) {
+		memmove(buf, &buf[bytes_to_remove], buf_len - bytes_to_remove);
+		memset(&buf[buf_len - bytes_to_remove], 0, bytes_to_remove);
+	}
+}
+
+/* Width of the fields unpacked by the "bit_copy queue" workload */
+#define BITBUF_FIELD_BITS 32
+
+struct bitbuf_bench {
+	unsigned int bits;
+	size_t bytes;
+	uint8_t *src;
+	/* same as src, except for the bits where mask is 0 */
+	uint8_t *cmp;
+	uint8_t *mask;
+	uint8_t *dst;
+};
+
+static void bitbuf_copy_aligned(void *data, bool ref)
+{
+	struct bitbuf_bench *b = data;
+
+	if (ref)
+		ref_buf_set_buf(b->src, 0, b->dst, 0, b->bits);
+	else
+		buf_set_buf(b->src, 0, b->dst, 0, b->bits);
+}
+
+static void bitbuf_copy_unaligned(void *data, bool ref)
+{
+	struct bitbuf_bench *b = data;
+
+	if (ref)
+		ref_buf_set_buf(b->src, 3, b->dst, 5, b->bits - 8);
+	else
+		buf_set_buf(b->src, 3, b->dst, 5, b->bits - 8);
+}
+
+static void bitbuf_copy_queue(void *data, bool ref)
+{
+	struct bitbuf_bench *b = data;
+
+	struct bit_copy_queue q;
+	unsigned int n = (b->bits - 8) / BITBUF_FIELD_BITS;
+
+	if (ref) {
+		for (unsigned int i = 0; i < n; i++)
+			ref_buf_set_buf(b->src, 7 + i * BITBUF_FIELD_BITS,
+					b->dst, 1 + i * BITBUF_FIELD_BITS, BITBUF_FIELD_BITS);
+		return;
+	}
+
+	bit_copy_queue_init(&q);
+	for (unsigned int i = 0; i < n; i++)
+		bit_copy_queued(&q, b->dst, 1 + i * BITBUF_FIELD_BITS,
+				b->src, 7 + i * BITBUF_FIELD_BITS, BITBUF_FIELD_BITS);
+	bit_copy_execute(&q);
+}
+
+static void bitbuf_cmp_mask(void *data, bool ref)
+{
+	struct bitbuf_bench *b = data;
+
+	if (ref)
+		b->dst[0] = ref_buf_cmp_mask(b->src, b->cmp, b->mask, b->bits);
+	else
+		b->dst[0] = buf_cmp_mask(b->src, b->cmp, b->mask, b->bits);
+}
+
+static void bitbuf_shr(struct bitbuf_bench *b, bool ref, unsigned int count)
+{
+	memcpy(b->dst, b->src, b->bytes);
+	if (ref)
+		ref_buffer_shr(b->dst, b->bytes, count);
+	else
+		buffer_shr(b->dst, b->bytes, count);
+}
+
+static void bitbuf_shr_1(void *data, bool ref)
+{
+	bitbuf_shr(data, ref, 1);
+}
+
+static void bitbuf_shr_13(void *data, bool ref)
+{
+	bitbuf_shr(data, ref, 13);
+}
+
+static const struct benchmark_workload bitbuf_workloads[] = {
+	{ "copy aligned", bitbuf_copy_aligned },
+	{ "copy unaligned", bitbuf_copy_unaligned },
+	{ "bit_copy queue", bitbuf_copy_queue },
+	{ "compare masked", bitbuf_cmp_mask },
+	{ "shift right 1", bitbuf_shr_1 },
+	{ "shift right 13", bitbuf_shr_13 },
+};
+
+/*
+ * Byte-at-a-time implementations of the kernels of the GDB packets, as
+ * they were before the vectorization. They are the reference both for the
+ * speed and for the result of "benchmark gdbpacket".
+ */
+
+static size_t ref_hexify(char *hex, const uint8_t *bin, size_t count)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	for (size_t i = 0; i < 2 * count; i++)
+		hex[i] = digits[(bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f];
+	hex[2 * count] = 0;
+
+	return 2 * count;
+}
+
+static size_t ref_unhexify(uint8_t *bin, const char *hex, size_t count)
+{
+	size_t i;
+	char tmp;
+
+	memset(bin, 0, count);
+
+	for (i = 0; i < 2 * count; i++) {
+		if (hex[i] >= 'a' && hex[i] <= 'f')
+			tmp = hex[i] - 'a' + 10;
+		else if (hex[i] >= 'A' && hex[i] <= 'F')
+			tmp = hex[i] - 'A' + 10;
+		else if (hex[i] >= '0' && hex[i] <= '9')
+			tmp = hex[i] - '0';
+		else
+			return i / 2;
+
+		bin[i / 2] |= tmp << (4 * ((i + 1) % 2));
+	}
+
+	return i / 2;
+}
+
+static uint8_t ref_sum8(const uint8_t *buf, size_t size)
+{
+	uint8_t sum = 0;
+
+	for (size_t i = 0; i < size; i++)
+		sum += buf[i];
+
+	return sum;
+}
+
+static size_t ref_escape(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	uint8_t *p = dst;
+
+	for (size_t i = 0; i < size; i++) {
+		uint8_t c = src[i];
+		if (c == '#' || c == '$' || c == '}' || c == '*') {
+			*p++ = '}';
+			c ^= 0x20;
+		}
+		*p++ = c;
+	}
+
+	return p - dst;
+}
+
+static size_t ref_unescape(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	uint8_t *p = dst;
+
+	for (size_t i = 0; i < size; i++) {
+		if (src[i] == '}' && i + 1 < size)
+			*p++ = src[++i] ^ 0x20;
+		else
+			*p++ = src[i];
+	}
+
+	return p - dst;
+}
+
+struct packet_bench {
+	/* size of the binary payload */
+	size_t bytes;
+	uint8_t *bin;
+	/* the payload in hex */
+	char *hex;
+	/* the payload escaped for a binary packet */
+	uint8_t *esc;
+	size_t esc_len;
+	/* room for the output of all the workloads, 2 * bytes + 1 */
+	uint8_t *dst;
+};
+
+static void packet_hex_encode(void *data, bool ref)
+{
+	struct packet_bench *b = data;
+
+	if (ref)
+		ref_hexify((char *)b->dst, b->bin, b->bytes);
+	else
+		hexify((char *)b->dst, b->bin, b->bytes, 2 * b->bytes + 1);
+}
+
+static void packet_hex_decode(void *data, bool ref)
+{
+	struct packet_bench *b = data;
+
+	if (ref)
+		ref_unhexify(b->dst, b->hex, b->bytes);
+	else
+		unhexify(b->dst, b->hex, b->bytes);
+}
+
+static void packet_checksum(void *data, bool ref)
+{
+	struct packet_bench *b = data;
+
+	if (ref)
+		b->dst[0] = ref_sum8(b->bin, b->bytes);
+	else
+		b->dst[0] = buf_sum8(b->bin, b->bytes);
+}
+
+static void packet_binary_encode(void *data, bool ref)
+{
+	struct packet_bench *b = data;
+
+	if (ref)
+		ref_escape(b->dst, b->bin, b->bytes);
+	else
+		buf_escape(b->dst, b->bin, b->bytes);
+}
+
+static void packet_binary_decode(void *data, bool ref)
+{
+	struct packet_bench *b = data;
+	size_t consumed;
+
+	if (ref)
+		ref_unescape(b->dst, b->esc, b->esc_len);
+	else
+		buf_unescape(b->dst, b->esc, b->esc_len, &consumed);
+}
+
+static const struct benchmark_workload packet_workloads[] = {
+	{ "hex encode", packet_hex_encode },
+	{ "hex decode", packet_hex_decode },
+	{ "checksum", packet_checksum },
+	{ "binary encode", packet_binary_encode },
+	{ "binary decode", packet_binary_decode },
+};
+
+/*
+ * Byte-at-a-time GDB CRC32 and bit-at-a-time reflected CRC32, as they were
+ * before the slicing-by-8 rewrite. They are the reference both for the
+ * speed and for the result of "benchmark crc32".
+ */
+
+static uint32_t ref_crc32_be(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	static uint32_t crc32_table[256];
+	static bool first_init;
+
+	if (!first_init) {
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = i << 24;
+			for (unsigned int j = 0; j < 8; j++)
+				c = c & 0x80000000 ? (c << 1) ^ CRC32_POLY_BE : (c << 1);
+			crc32_table[i] = c;
+		}
+		first_init = true;
+	}
+
+	for (size_t i = 0; i < size; i++)
+		crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ buf[i]) & 255];
+
+	return crc;
+}
+
+static uint32_t ref_crc32_le(uint32_t crc, const uint8_t *buf, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		for (unsigned int j = 0; j < 8; j++) {
+			uint32_t d = ((buf[i] >> j) & 0x1) ? 0xffffffff : 0;
+			uint32_t c = (crc & 0x1) ? 0xffffffff : 0;
+			crc = (crc >> 1) ^ ((d ^ c) & CRC32_POLY_LE);
+		}
+	}
+
+	return crc;
+}
+
+struct crc_bench {
+	size_t bytes;
+	uint8_t *buf;
+	uint32_t result;
+};
+
+static void crc_gdb(void *data, bool ref)
+{
+	struct crc_bench *b = data;
+
+	if (ref)
+		b->result = ref_crc32_be(0xffffffff, b->buf, b->bytes);
+	else
+		b->result = crc32_be(CRC32_POLY_BE, 0xffffffff, b->buf, b->bytes);
+}
+
+static void crc_gdb_unaligned(void *data, bool ref)
+{
+	struct crc_bench *b = data;
+
+	if (ref)
+		b->result = ref_crc32_be(0xffffffff, b->buf + 1, b->bytes - 1);
+	else
+		b->result = crc32_be(CRC32_POLY_BE, 0xffffffff, b->buf + 1, b->bytes - 1);
+}
+
+static void crc_reflected(void *data, bool ref)
+{
+	struct crc_bench *b = data;
+
+	if (ref)
+		b->result = ref_crc32_le(0xffffffff, b->buf, b->bytes);
+	else
+		b->result = crc32_le(CRC32_POLY_LE, 0xffffffff, b->buf, b->bytes);
+}
+
+static const struct benchmark_workload crc_workloads[] = {
+	{ "gdb", crc_gdb },
+	{ "gdb unaligned", crc_gdb_unaligned },
+	{ "reflected", crc_reflected },
+};
+
+COMMAND_HANDLER(handle_benchmark_bitbuf)
+{
+	unsigned int bits = 1024 * 1024;
+	unsigned int iterations = 20;
+
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC > 0)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], bits);
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], iterations);
+
+	if (bits < 64 || !iterations) {
+		command_print(CMD, "at least 64 bits and one iteration are needed");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct bitbuf_bench b;
+	b.bits = bits;
+	b.bytes = DIV_ROUND_UP(bits, 8);
+	b.src = malloc(b.bytes);
+	b.cmp = malloc(b.bytes);
+	b.mask = malloc(b.bytes);
+	b.dst = malloc(b.bytes);
+	if (!b.src || !b.cmp || !b.mask || !b.dst) {
+		LOG_ERROR("Unable to allocate memory");
+		free(b.src);
+		free(b.cmp);
+		free(b.mask);
+		free(b.dst);
+		return ERROR_FAIL;
+	}
+
+	/* fixed pseudo-random content, for repeatable results */
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < b.bytes; i++) {
+		seed = seed * 1103515245 + 12345;
+		b.src[i] = seed >> 16;
+		b.mask[i] = seed >> 24;
+		b.cmp[i] = b.src[i] ^ ~b.mask[i];
+	}
+
+	struct benchmark bench = {
+		.workloads = bitbuf_workloads,
+		.num_workloads = ARRAY_SIZE(bitbuf_workloads),
+		.data = &b,
+		.result = b.dst,
+		.result_size = b.bytes,
+		.amount = bits / 1e6,
+		.unit = "Mb/s",
+	};
+	int retval = benchmark_workloads(CMD, &bench, iterations);
+
+	free(b.src);
+	free(b.cmp);
+	free(b.mask);
+	free(b.dst);
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_benchmark_gdbpacket)
+{
+	unsigned int bytes = 64 * 1024;
+	unsigned int iterations = 1000;
+
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC > 0)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], bytes);
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], iterations);
+
+	if (!bytes || bytes > 64 * 1024 * 1024 || !iterations) {
+		command_print(CMD, "1 byte to 64 MiB and at least one iteration are needed");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct packet_bench b;
+	size_t out_size = 2 * (size_t)bytes + 1;
+	b.bytes = bytes;
+	b.bin = malloc(bytes);
+	b.hex = malloc(out_size);
+	b.esc = malloc(out_size);
+	b.dst = malloc(out_size);
+	if (!b.bin || !b.hex || !b.esc || !b.dst) {
+		LOG_ERROR("Unable to allocate memory");
+		free(b.bin);
+		free(b.hex);
+		free(b.esc);
+		free(b.dst);
+		return ERROR_FAIL;
+	}
+
+	/* fixed pseudo-random content, for repeatable results */
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < b.bytes; i++) {
+		seed = seed * 1103515245 + 12345;
+		b.bin[i] = seed >> 16;
+	}
+	ref_hexify(b.hex, b.bin, b.bytes);
+	b.esc_len = ref_escape(b.esc, b.bin, b.bytes);
+
+	struct benchmark bench = {
+		.workloads = packet_workloads,
+		.num_workloads = ARRAY_SIZE(packet_workloads),
+		.data = &b,
+		.result = b.dst,
+		.result_size = out_size,
+		.amount = bytes / 1e9,
+		.unit = "GB/s",
+	};
+	int retval = benchmark_workloads(CMD, &bench, iterations);
+
+	free(b.bin);
+	free(b.hex);
+	free(b.esc);
+	free(b.dst);
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_benchmark_crc32)
+{
+	unsigned int bytes = 1024 * 1024;
+	unsigned int iterations = 20;
+
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (CMD_ARGC > 0)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], bytes);
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], iterations);
+
+	if (bytes < 2 || bytes > 64 * 1024 * 1024 || !iterations) {
+		command_print(CMD, "2 bytes to 64 MiB and at least one iteration are needed");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct crc_bench b;
+	b.bytes = bytes;
+	b.buf = malloc(bytes);
+	if (!b.buf) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	/* fixed pseudo-random content, for repeatable results */
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < b.bytes; i++) {
+		seed = seed * 1103515245 + 12345;
+		b.buf[i] = seed >> 16;
+	}
+
+	struct benchmark bench = {
+		.workloads = crc_workloads,
+		.num_workloads = ARRAY_SIZE(crc_workloads),
+		.data = &b,
+		.result = &b.result,
+		.result_size = sizeof(b.result),
+		.amount = bytes / 1e6,
+		.unit = "MB/s",
+	};
+	int retval = benchmark_workloads(CMD, &bench, iterations);
+
+	free(b.buf);
+
+	return retval;
+}
+
+static const struct command_registration benchmark_subcommand_handlers[] = {
+	{
+		.name = "bitbuf",
+		.handler = handle_benchmark_bitbuf,
+		.mode = COMMAND_ANY,
+		.help = "Compare the bit buffer copy, compare and shift kernels "
+			"with their bit-at-a-time reference implementation",
+		.usage = "[bits [iterations]]",
+	},
+	{
+		.name = "gdbpacket",
+		.handler = handle_benchmark_gdbpacket,
+		.mode = COMMAND_ANY,
+		.help = "Compare the hex conversion, checksum and escaping kernels "
+			"of the GDB packets with their byte-at-a-time reference implementation",
+		.usage = "[bytes [iterations]]",
+	},
+	{
+		.name = "crc32",
+		.handler = handle_benchmark_crc32,
+		.mode = COMMAND_ANY,
+		.help = "Compare the table driven CRC32 of image checksums and of the "
+			"reflected CRC32 with their reference implementation",
+		.usage = "[bytes [iterations]]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+static const struct command_registration benchmark_command_handlers[] = {
+	{
+		.name = "benchmark",
+		.mode = COMMAND_ANY,
+		.help = "Host side micro-benchmarks",
+		.usage = "",
+		.chain = benchmark_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int benchmark_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, NULL, benchmark_command_handlers);
+}
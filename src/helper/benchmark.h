@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_HELPER_BENCHMARK_H
+#define OPENOCD_HELPER_BENCHMARK_H
+
+#include <helper/command.h>
+
+int benchmark_register_commands(struct command_context *cmd_ctx);
+
+#endif /* OPENOCD_HELPER_BENCHMARK_H */
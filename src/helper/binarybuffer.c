@@ -16,6 +16,14 @@
 #include "log.h"
 #include "binarybuffer.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BUF_SIMD_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BUF_SIMD_NEON
+#endif
+
 static const unsigned char bit_reverse_table256[] = {
 	0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
 	0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
@@ -84,6 +92,116 @@ bool buf_cmp(const void *_buf1, const void *_buf2, unsigned size)
 	return buf_cmp_trailing(buf1[last], buf2[last], 0xff, trailing);
 }
 
+/*
+ * Word-at-a-time kernels
+ *
+ * The scans of long shift registers (e.g. SVF files, FPGA bitstreams or
+ * large MEM-AP buffers) go through the functions below, so they process
+ * the bulk of the buffers 16 bytes at a time with SSE2 or NEON, when the
+ * compiler targets them, and 8 bytes at a time otherwise. The few bits
+ * at both ends are handled one byte at a time.
+ */
+
+/* @returns true if ((a ^ b) & m) is not zero in any of the first n bytes */
+static bool buf_cmp_mask_bytes(const uint8_t *a, const uint8_t *b,
+	const uint8_t *m, size_t n)
+{
+	size_t i = 0;
+
+#if defined(BUF_SIMD_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i)),
+				_mm_loadu_si128((const __m128i *)(b + i)));
+		x = _mm_and_si128(x, _mm_loadu_si128((const __m128i *)(m + i)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, zero)) != 0xffff)
+			return true;
+	}
+#elif defined(BUF_SIMD_NEON)
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t x = vandq_u8(veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i)),
+				vld1q_u8(m + i));
+		uint64x2_t x64 = vreinterpretq_u64_u8(x);
+		if (vgetq_lane_u64(x64, 0) | vgetq_lane_u64(x64, 1))
+			return true;
+	}
+#endif
+
+	for (; i + 8 <= n; i += 8) {
+		if ((le_to_h_u64(a + i) ^ le_to_h_u64(b + i)) & le_to_h_u64(m + i))
+			return true;
+	}
+
+	for (; i < n; i++) {
+		if (buf_cmp_masked(a[i], b[i], m[i]))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Fill n bytes of dst with the bits of src starting at bit shift (1-7),
+ * i.e. dst[i] = (src[i] >> shift) | (src[i + 1] << (8 - shift)).
+ * The bytes src[0] to src[n] are read. The buffers can overlap as long
+ * as dst does not start after src, which is what buffer_shr() needs.
+ */
+static void buf_shift_bytes(uint8_t *dst, const uint8_t *src,
+	unsigned int shift, size_t n)
+{
+	size_t i = 0;
+
+#if defined(BUF_SIMD_SSE2)
+	const __m128i rcount = _mm_cvtsi32_si128(shift);
+	const __m128i lcount = _mm_cvtsi32_si128(8 - shift);
+	const __m128i rmask = _mm_set1_epi8((char)(0xff >> shift));
+	const __m128i lmask = _mm_set1_epi8((char)(0xff << (8 - shift)));
+	for (; i + 16 <= n; i += 16) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(src + i + 1));
+		lo = _mm_and_si128(_mm_srl_epi16(lo, rcount), rmask);
+		hi = _mm_and_si128(_mm_sll_epi16(hi, lcount), lmask);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(lo, hi));
+	}
+#elif defined(BUF_SIMD_NEON)
+	const int8x16_t rcount = vdupq_n_s8(-(int8_t)shift);
+	const int8x16_t lcount = vdupq_n_s8(8 - shift);
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t lo = vshlq_u8(vld1q_u8(src + i), rcount);
+		uint8x16_t hi = vshlq_u8(vld1q_u8(src + i + 1), lcount);
+		vst1q_u8(dst + i, vorrq_u8(lo, hi));
+	}
+#endif
+
+	for (; i + 8 <= n; i += 8) {
+		uint64_t w = le_to_h_u64(src + i) >> shift;
+		w |= (uint64_t)src[i + 8] << (64 - shift);
+		h_u64_to_le(dst + i, w);
+	}
+
+	for (; i < n; i++)
+		dst[i] = (src[i] >> shift) | (src[i + 1] << (8 - shift));
+}
+
+/* @returns num (1-8) bits of src, starting at bit first (0-7) */
+static uint8_t buf_get_bits8(const uint8_t *src, unsigned int first, unsigned int num)
+{
+	unsigned int value = src[0] >> first;
+
+	if (first + num > 8)
+		value |= src[1] << (8 - first);
+
+	return value & ((1 << num) - 1);
+}
+
+/* Replace num (1-8) bits of *dst, starting at bit first, with value */
+static void buf_put_bits8(uint8_t *dst, unsigned int first, unsigned int num, uint8_t value)
+{
+	uint8_t mask = ((1 << num) - 1) << first;
+
+	*dst = (*dst & ~mask) | ((value << first) & mask);
+}
+
 bool buf_cmp_mask(const void *_buf1, const void *_buf2,
 	const void *_mask, unsigned size)
 {
@@ -92,10 +210,8 @@ bool buf_cmp_mask(const void *_buf1, const void *_buf2,
 
 	const uint8_t *buf1 = _buf1, *buf2 = _buf2, *mask = _mask;
 	unsigned last = size / 8;
-	for (unsigned i = 0; i < last; i++) {
-		if (buf_cmp_masked(buf1[i], buf2[i], mask[i]))
-			return true;
-	}
+	if (buf_cmp_mask_bytes(buf1, buf2, mask, last))
+		return true;
 	unsigned trailing = size % 8;
 	if (!trailing)
 		return false;
@@ -123,42 +239,36 @@ void *buf_set_buf(const void *_src, unsigned src_start,
 {
 	const uint8_t *src = _src;
 	uint8_t *dst = _dst;
-	unsigned i, sb, db, sq, dq, lb, lq;
+	unsigned sq, dq, lb, lq;
 
-	sb = src_start / 8;
-	db = dst_start / 8;
+	src += src_start / 8;
+	dst += dst_start / 8;
 	sq = src_start % 8;
 	dq = dst_start % 8;
+
+	/* complete the first destination byte, if not on byte boundary */
+	if (dq && len) {
+		unsigned n = MIN(len, 8 - dq);
+		buf_put_bits8(dst, dq, n, buf_get_bits8(src, sq, n));
+		sq += n;
+		src += sq / 8;
+		sq %= 8;
+		dst++;
+		len -= n;
+	}
+
 	lb = len / 8;
 	lq = len % 8;
 
-	src += sb;
-	dst += db;
+	/* the destination is now on byte boundary, copy the whole bytes
+	 * straight when the source is too, else shift them in place */
+	if (sq == 0)
+		memcpy(dst, src, lb);
+	else if (lb)
+		buf_shift_bytes(dst, src, sq, lb);
 
-	/* check if both buffers are on byte boundary and
-	 * len is a multiple of 8bit so we can simple copy
-	 * the buffer */
-	if ((sq == 0) && (dq == 0) &&  (lq == 0)) {
-		for (i = 0; i < lb; i++)
-			*dst++ = *src++;
-		return _dst;
-	}
-
-	/* fallback to slow bit copy */
-	for (i = 0; i < len; i++) {
-		if (((*src >> (sq&7)) & 1) == 1)
-			*dst |= 1 << (dq&7);
-		else
-			*dst &= ~(1 << (dq&7));
-		if (sq++ == 7) {
-			sq = 0;
-			src++;
-		}
-		if (dq++ == 7) {
-			dq = 0;
-			dst++;
-		}
-	}
+	if (lq)
+		buf_put_bits8(dst + lb, 0, lq, buf_get_bits8(src + lb, sq, lq));
 
 	return _dst;
 }
@@ -301,9 +411,28 @@ void bit_copy_queue_init(struct bit_copy_queue *q)
 	INIT_LIST_HEAD(&q->list);
 }
 
+/* @returns true if bit offset b of buffer b_buf is bit offset a of buffer a_buf */
+static bool bit_copy_follows(const uint8_t *a_buf, unsigned int a,
+	const uint8_t *b_buf, unsigned int b)
+{
+	return a_buf + a / 8 == b_buf + b / 8 && a % 8 == b % 8;
+}
+
 int bit_copy_queued(struct bit_copy_queue *q, uint8_t *dst, unsigned dst_offset, const uint8_t *src,
 	unsigned src_offset, unsigned bit_count)
 {
+	/* extend the last copy when this one directly follows it, as the
+	 * drivers unpack the result of a long scan field by field */
+	if (!list_empty(&q->list)) {
+		struct bit_copy_queue_entry *last =
+			list_last_entry(&q->list, struct bit_copy_queue_entry, list);
+		if (bit_copy_follows(last->dst, last->dst_offset + last->bit_count, dst, dst_offset)
+				&& bit_copy_follows(last->src, last->src_offset + last->bit_count, src, src_offset)) {
+			last->bit_count += bit_count;
+			return ERROR_OK;
+		}
+	}
+
 	struct bit_copy_queue_entry *qe = malloc(sizeof(*qe));
 	if (!qe)
 		return ERROR_FAIL;
@@ -339,6 +468,136 @@ void bit_copy_discard(struct bit_copy_queue *q)
 	}
 }
 
+/*
+ * Kernels of the GDB remote protocol
+ *
+ * Memory reads and writes, flash downloads and register transfers all go
+ * through the hex conversions, the checksum and the escape scanning of the
+ * GDB packets below. Like the kernels above, they process 16 bytes at a
+ * time with SSE2 or NEON, when the compiler targets them, and fall back to
+ * one byte at a time otherwise.
+ */
+
+#if defined(BUF_SIMD_SSE2)
+/*
+ * Convert the 16 characters of c into their values (0-15).
+ * @returns false if one of the characters is not a hex digit
+ */
+static inline bool hex_decode_sse2(__m128i c, __m128i *value)
+{
+	__m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+			_mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+	if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff)
+		return false;
+
+	*value = _mm_add_epi8(_mm_and_si128(c, _mm_set1_epi8(0x0f)),
+			_mm_and_si128(alpha, _mm_set1_epi8(9)));
+	return true;
+}
+
+/* Convert the 16 nibbles (0-15) of n into hex digits */
+static inline __m128i hex_encode_sse2(__m128i n)
+{
+	__m128i alpha = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+
+	return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')),
+			_mm_and_si128(alpha, _mm_set1_epi8('a' - '0' - 10)));
+}
+#elif defined(BUF_SIMD_NEON)
+static inline bool hex_decode_neon(uint8x16_t c, uint8x16_t *value)
+{
+	uint8x16_t lower = vorrq_u8(c, vdupq_n_u8(0x20));
+	uint8x16_t digit = vcltq_u8(vsubq_u8(c, vdupq_n_u8('0')), vdupq_n_u8(10));
+	uint8x16_t alpha = vcltq_u8(vsubq_u8(lower, vdupq_n_u8('a')), vdupq_n_u8(6));
+	uint64x2_t valid = vreinterpretq_u64_u8(vorrq_u8(digit, alpha));
+
+	if ((vgetq_lane_u64(valid, 0) & vgetq_lane_u64(valid, 1)) != UINT64_MAX)
+		return false;
+
+	*value = vaddq_u8(vandq_u8(c, vdupq_n_u8(0x0f)),
+			vandq_u8(alpha, vdupq_n_u8(9)));
+	return true;
+}
+
+static inline uint8x16_t hex_encode_neon(uint8x16_t n)
+{
+	uint8x16_t alpha = vcgtq_u8(n, vdupq_n_u8(9));
+
+	return vaddq_u8(vaddq_u8(n, vdupq_n_u8('0')),
+			vandq_u8(alpha, vdupq_n_u8('a' - '0' - 10)));
+}
+#endif
+
+/*
+ * Convert the first 2 * n characters of hex into n bytes, stopping at the
+ * first block of 16 bytes that contains something else than hex digits.
+ * @returns the number of bytes converted, a multiple of 16
+ */
+static size_t unhexify_blocks(uint8_t *bin, const char *hex, size_t n)
+{
+	size_t i = 0;
+
+#if defined(BUF_SIMD_SSE2)
+	const __m128i low_byte = _mm_set1_epi16(0x00ff);
+	for (; i + 16 <= n; i += 16) {
+		__m128i v0, v1;
+		if (!hex_decode_sse2(_mm_loadu_si128((const __m128i *)(hex + 2 * i)), &v0) ||
+				!hex_decode_sse2(_mm_loadu_si128((const __m128i *)(hex + 2 * i + 16)), &v1))
+			break;
+		/* each 16 bits lane holds the high nibble, then the low nibble */
+		v0 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v0, low_byte), 4),
+				_mm_srli_epi16(v0, 8));
+		v1 = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v1, low_byte), 4),
+				_mm_srli_epi16(v1, 8));
+		_mm_storeu_si128((__m128i *)(bin + i), _mm_packus_epi16(v0, v1));
+	}
+#elif defined(BUF_SIMD_NEON)
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x2_t c = vld2q_u8((const uint8_t *)hex + 2 * i);
+		uint8x16_t hi, lo;
+		if (!hex_decode_neon(c.val[0], &hi) || !hex_decode_neon(c.val[1], &lo))
+			break;
+		vst1q_u8(bin + i, vorrq_u8(vshlq_n_u8(hi, 4), lo));
+	}
+#endif
+
+	return i;
+}
+
+/* Convert n bytes of bin into 2 * n hex digits, without null-terminator */
+static void hexify_bytes(char *hex, const uint8_t *bin, size_t n)
+{
+	size_t i = 0;
+
+#if defined(BUF_SIMD_SSE2)
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+	for (; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(bin + i));
+		__m128i hi = hex_encode_sse2(_mm_and_si128(_mm_srli_epi16(x, 4), nibble));
+		__m128i lo = hex_encode_sse2(_mm_and_si128(x, nibble));
+		_mm_storeu_si128((__m128i *)(hex + 2 * i), _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(hex + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+#elif defined(BUF_SIMD_NEON)
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t x = vld1q_u8(bin + i);
+		uint8x16x2_t digits;
+		digits.val[0] = hex_encode_neon(vshrq_n_u8(x, 4));
+		digits.val[1] = hex_encode_neon(vandq_u8(x, vdupq_n_u8(0x0f)));
+		vst2q_u8((uint8_t *)hex + 2 * i, digits);
+	}
+#endif
+
+	for (; i < n; i++) {
+		hex[2 * i] = hex_digits[bin[i] >> 4];
+		hex[2 * i + 1] = hex_digits[bin[i] & 0x0f];
+	}
+}
+
 /**
  * Convert a string of hexadecimal pairs into its binary
  * representation.
@@ -359,9 +618,12 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 	if (!bin || !hex)
 		return 0;
 
-	memset(bin, 0, count);
+	/* the blocks must not be read past the end of the string */
+	size_t done = unhexify_blocks(bin, hex, strnlen(hex, 2 * count) / 2);
 
-	for (i = 0; i < 2 * count; i++) {
+	memset(bin + done, 0, count - done);
+
+	for (i = 2 * done; i < 2 * count; i++) {
 		if (hex[i] >= 'a' && hex[i] <= 'f')
 			tmp = hex[i] - 'a' + 10;
 		else if (hex[i] >= 'A' && hex[i] <= 'F')
@@ -392,38 +654,203 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 {
 	size_t i;
-	uint8_t tmp;
 
 	if (!length)
 		return 0;
 
-	for (i = 0; i < length - 1 && i < 2 * count; i++) {
-		tmp = (bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f;
-		hex[i] = hex_digits[tmp];
-	}
+	size_t n = MIN(count, (length - 1) / 2);
+	hexify_bytes(hex, bin, n);
+	i = 2 * n;
+
+	/* no room left for a whole pair, only for the high nibble */
+	if (n < count && i < length - 1)
+		hex[i++] = hex_digits[bin[n] >> 4];
 
 	hex[i] = 0;
 
 	return i;
 }
 
+/**
+ * Compute the modulo 256 sum of the bytes of a buffer, i.e. the checksum
+ * of the GDB remote protocol.
+ *
+ * @param[in] _buf Buffer to sum.
+ * @param[in] size Number of bytes in @p _buf.
+ *
+ * @returns The sum of the bytes, modulo 256.
+ */
+uint8_t buf_sum8(const void *_buf, size_t size)
+{
+	const uint8_t *buf = _buf;
+	unsigned int sum = 0;
+	size_t i = 0;
+
+#if defined(BUF_SIMD_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	for (; i + 16 <= size; i += 16)
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(buf + i)), zero));
+	sum = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(BUF_SIMD_NEON)
+	/* the 16 bits lanes wrap, which is harmless modulo 256 */
+	uint16x8_t acc = vdupq_n_u16(0);
+	for (; i + 16 <= size; i += 16)
+		acc = vpadalq_u8(acc, vld1q_u8(buf + i));
+	uint64x2_t acc64 = vpaddlq_u32(vpaddlq_u16(acc));
+	sum = vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1);
+#endif
+
+	for (; i < size; i++)
+		sum += buf[i];
+
+	return sum & 0xff;
+}
+
+/**
+ * Find the first byte of a buffer that is one of a few characters, e.g.
+ * the characters that must be escaped in a binary GDB packet.
+ *
+ * @param[in] _buf Buffer to scan.
+ * @param[in] size Number of bytes in @p _buf.
+ * @param[in] chars String of 1 to 4 characters to look for.
+ *
+ * @returns The offset of the first byte found, or @p size if there is none.
+ */
+size_t buf_find_any(const void *_buf, size_t size, const char *chars)
+{
+	const uint8_t *buf = _buf;
+	size_t nchars = strlen(chars);
+	size_t i = 0;
+
+	assert(nchars >= 1 && nchars <= 4);
+
+#if defined(BUF_SIMD_SSE2)
+	/* look for the first character again when there are less than 4 */
+	const __m128i c0 = _mm_set1_epi8(chars[0]);
+	const __m128i c1 = _mm_set1_epi8(chars[nchars > 1 ? 1 : 0]);
+	const __m128i c2 = _mm_set1_epi8(chars[nchars > 2 ? 2 : 0]);
+	const __m128i c3 = _mm_set1_epi8(chars[nchars > 3 ? 3 : 0]);
+	for (; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(buf + i));
+		__m128i found01 = _mm_or_si128(_mm_cmpeq_epi8(x, c0), _mm_cmpeq_epi8(x, c1));
+		__m128i found23 = _mm_or_si128(_mm_cmpeq_epi8(x, c2), _mm_cmpeq_epi8(x, c3));
+		__m128i found = _mm_or_si128(found01, found23);
+		int mask = _mm_movemask_epi8(found);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#elif defined(BUF_SIMD_NEON)
+	const uint8x16_t c0 = vdupq_n_u8(chars[0]);
+	const uint8x16_t c1 = vdupq_n_u8(chars[nchars > 1 ? 1 : 0]);
+	const uint8x16_t c2 = vdupq_n_u8(chars[nchars > 2 ? 2 : 0]);
+	const uint8x16_t c3 = vdupq_n_u8(chars[nchars > 3 ? 3 : 0]);
+	for (; i + 16 <= size; i += 16) {
+		uint8x16_t x = vld1q_u8(buf + i);
+		uint8x16_t found = vorrq_u8(vorrq_u8(vceqq_u8(x, c0), vceqq_u8(x, c1)),
+				vorrq_u8(vceqq_u8(x, c2), vceqq_u8(x, c3)));
+		/* 4 bits per byte */
+		uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(found), 4);
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+		if (mask)
+			return i + __builtin_ctzll(mask) / 4;
+	}
+#endif
+
+	for (; i < size; i++) {
+		if (memchr(chars, buf[i], nchars))
+			return i;
+	}
+
+	return size;
+}
+
+/**
+ * Escape binary data for a GDB packet: '#', '$', '}' and '*' are sent as
+ * '}' followed by the byte xor 0x20.
+ *
+ * @param[out] dst Escaped data, room for 2 * @p size bytes is needed.
+ * @param[in] src Binary data.
+ * @param[in] size Number of bytes in @p src.
+ *
+ * @returns The number of bytes written to @p dst.
+ */
+size_t buf_escape(uint8_t *dst, const uint8_t *src, size_t size)
+{
+	uint8_t *p = dst;
+
+	for (size_t i = 0; i < size; i++) {
+		size_t plain = buf_find_any(src + i, size - i, "#$}*");
+		memcpy(p, src + i, plain);
+		p += plain;
+		i += plain;
+		if (i == size)
+			break;
+		*p++ = '}';
+		*p++ = src[i] ^ 0x20;
+	}
+
+	return p - dst;
+}
+
+/**
+ * Unescape the binary data of a GDB packet, up to the '#' that ends the
+ * packet. A '}' in the last byte of @p src is left for the caller, as the
+ * byte it escapes is still to come.
+ *
+ * @param[out] dst Binary data, room for @p size bytes is needed.
+ * @param[in] src Escaped data.
+ * @param[in] size Number of bytes in @p src.
+ * @param[out] consumed Number of bytes of @p src unescaped, up to the '#'
+ * or the '}' that stopped it if any.
+ *
+ * @returns The number of bytes written to @p dst.
+ */
+size_t buf_unescape(uint8_t *dst, const uint8_t *src, size_t size, size_t *consumed)
+{
+	uint8_t *p = dst;
+	size_t i = 0;
+
+	while (i < size) {
+		size_t plain = buf_find_any(src + i, size - i, "#}");
+		memcpy(p, src + i, plain);
+		p += plain;
+		i += plain;
+		if (i == size || src[i] == '#' || i + 1 == size)
+			break;
+		*p++ = src[i + 1] ^ 0x20;
+		i += 2;
+	}
+
+	*consumed = i;
+	return p - dst;
+}
+
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count)
 {
-	unsigned i;
 	unsigned char *buf = _buf;
 	unsigned bytes_to_remove;
 	unsigned shift;
 
+	if (!buf_len)
+		return;
+
 	bytes_to_remove = count / 8;
 	shift = count - (bytes_to_remove * 8);
 
-	for (i = 0; i < (buf_len - 1); i++)
-		buf[i] = (buf[i] >> shift) | ((buf[i+1] << (8 - shift)) & 0xff);
-
-	buf[(buf_len - 1)] = buf[(buf_len - 1)] >> shift;
+	if (bytes_to_remove >= buf_len) {
+		memset(buf, 0, buf_len);
+		return;
+	}
 
-	if (bytes_to_remove) {
-		memmove(buf, &buf[bytes_to_remove], buf_len - bytes_to_remove);
-		memset(&buf[buf_len - bytes_to_remove], 0, bytes_to_remove);
+	/* shift the bits and remove the whole bytes in a single pass */
+	unsigned kept = buf_len - bytes_to_remove;
+	if (shift) {
+		buf_shift_bytes(buf, &buf[bytes_to_remove], shift, kept - 1);
+		buf[kept - 1] = buf[buf_len - 1] >> shift;
+	} else {
+		memmove(buf, &buf[bytes_to_remove], kept);
 	}
+
+	memset(&buf[kept], 0, bytes_to_remove);
 }
@@ -228,6 +228,10 @@ void bit_copy_discard(struct bit_copy_queue *q);
  * used in ti-icdi driver and gdb server */
 size_t unhexify(uint8_t *bin, const char *hex, size_t count);
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t out_maxlen);
+uint8_t buf_sum8(const void *buf, size_t size);
+size_t buf_find_any(const void *buf, size_t size, const char *chars);
+size_t buf_escape(uint8_t *dst, const uint8_t *src, size_t size);
+size_t buf_unescape(uint8_t *dst, const uint8_t *src, size_t size, size_t *consumed);
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count);
 
 #endif /* OPENOCD_HELPER_BINARYBUFFER_H */
@@ -13,6 +13,7 @@
 #endif
 
 #include "crc32.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -30,21 +31,121 @@ static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 	return crc;
 }
 
+static uint32_t crc_be_step(uint32_t poly, uint32_t crc, uint8_t data_in)
+{
+	crc ^= (uint32_t)data_in << 24;
+	for (unsigned int i = 0; i < 8; i++)
+		crc = (crc & 0x80000000) ? (crc << 1) ^ poly : crc << 1;
+
+	return crc;
+}
+
+/*
+ * Slicing-by-8 tables of CRC32_POLY_LE and CRC32_POLY_BE: table[0] is the
+ * usual byte-at-a-time table, table[k] advances a byte by k more zero bytes,
+ * so that eight bytes are folded into the CRC with eight independent lookups.
+ */
+static uint32_t crc32_le_table[8][256];
+static uint32_t crc32_be_table[8][256];
+
+static void crc32_le_init_table(void)
+{
+	static bool initialized;
+
+	if (initialized)
+		return;
+
+	for (unsigned int i = 0; i < 256; i++)
+		crc32_le_table[0][i] = crc_le_step(CRC32_POLY_LE, i, 0, 8);
+	for (unsigned int k = 1; k < 8; k++)
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = crc32_le_table[k - 1][i];
+			crc32_le_table[k][i] = (c >> 8) ^ crc32_le_table[0][c & 0xff];
+		}
+
+	initialized = true;
+}
+
+static void crc32_be_init_table(void)
+{
+	static bool initialized;
+
+	if (initialized)
+		return;
+
+	for (unsigned int i = 0; i < 256; i++)
+		crc32_be_table[0][i] = crc_be_step(CRC32_POLY_BE, 0, i);
+	for (unsigned int k = 1; k < 8; k++)
+		for (unsigned int i = 0; i < 256; i++) {
+			uint32_t c = crc32_be_table[k - 1][i];
+			crc32_be_table[k][i] = (c << 8) ^ crc32_be_table[0][c >> 24];
+		}
+
+	initialized = true;
+}
+
+static uint32_t crc32_le_sliced(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	const uint32_t (*t)[256] = crc32_le_table;
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		uint32_t lo = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24);
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+			^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+			^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+
+	while (data_len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+
+	return crc;
+}
+
+static uint32_t crc32_be_sliced(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	const uint32_t (*t)[256] = crc32_be_table;
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		uint32_t hi = crc ^ ((uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3]);
+		crc = t[7][hi >> 24] ^ t[6][(hi >> 16) & 0xff]
+			^ t[5][(hi >> 8) & 0xff] ^ t[4][hi & 0xff]
+			^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+
+	while (data_len--)
+		crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+
+	return crc;
+}
+
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 		size_t data_len)
 {
-	if (((uintptr_t)_data & 0x3) || (data_len & 0x3)) {
-		/* data is unaligned, processing data one byte at a time */
-		const uint8_t *data = _data;
-		for (size_t i = 0; i < data_len; i++)
-			seed = crc_le_step(poly, seed, data[i], 8);
-	} else {
-		/* data is aligned, processing 32 bit at a time */
-		data_len >>= 2;
-		const uint32_t *data = _data;
-		for (size_t i = 0; i < data_len; i++)
-			seed = crc_le_step(poly, seed, data[i], 32);
+	const uint8_t *data = _data;
+
+	if (poly == CRC32_POLY_LE) {
+		crc32_le_init_table();
+		return crc32_le_sliced(seed, data, data_len);
 	}
 
+	for (size_t i = 0; i < data_len; i++)
+		seed = crc_le_step(poly, seed, data[i], 8);
+
+	return seed;
+}
+
+uint32_t crc32_be(uint32_t poly, uint32_t seed, const void *_data,
+		size_t data_len)
+{
+	const uint8_t *data = _data;
+
+	if (poly == CRC32_POLY_BE) {
+		crc32_be_init_table();
+		return crc32_be_sliced(seed, data, data_len);
+	}
+
+	for (size_t i = 0; i < data_len; i++)
+		seed = crc_be_step(poly, seed, data[i]);
+
 	return seed;
 }
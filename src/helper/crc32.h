@@ -20,6 +20,12 @@
  */
 #define CRC32_POLY_LE	0xedb88320
 
+/**
+ * CRC32 polynomial of the non-reflected CRC32 used by GDB, e.g. for the
+ * qCRC packet
+ */
+#define CRC32_POLY_BE	0x04c11db7
+
 /**
  * Calculate the CRC32 value of the given data
  * @param	poly		The polynomial of the CRC
@@ -30,8 +36,26 @@
  * @note	This function can be used to incrementally compute the CRC one
  *			chunk of data at a time by using the CRC32 of the previous chunk
  *			as @p seed for the next chunk.
+ * @note	The bits of each byte are processed least significant first.
+ *			@ref CRC32_POLY_LE is table driven, other polynomials are
+ *			computed a bit at a time.
  */
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *data,
 		size_t data_len);
 
+/**
+ * Calculate the non-reflected CRC32 value of the given data, processing the
+ * bits of each byte most significant first
+ * @param	poly		The polynomial of the CRC
+ * @param	seed		The seed to use (mostly `0xffffffff`)
+ * @param	data		The data to calculate the CRC32 of
+ * @param	data_len	The length of the data in @p data in bytes
+ * @return	The CRC value of the first @p data_len bytes at @p data
+ * @note	Like crc32_le(), this can be computed incrementally.
+ *			@ref CRC32_POLY_BE is table driven, other polynomials are
+ *			computed a bit at a time.
+ */
+uint32_t crc32_be(uint32_t poly, uint32_t seed, const void *data,
+		size_t data_len);
+
 #endif /* OPENOCD_HELPER_CRC32_H */
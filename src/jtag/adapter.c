@@ -16,6 +16,7 @@
 #include "minidriver.h"
 #include "interface.h"
 #include "interfaces.h"
+#include "commands.h"
 #include <transport/transport.h>
 
 /**
@@ -194,6 +195,8 @@ int adapter_quit(void)
 	free(adapter_config.serial);
 	free(adapter_config.usb_location);
 
+	jtag_command_queue_free();
+
 	struct jtag_tap *t = jtag_all_taps();
 	while (t) {
 		struct jtag_tap *n = t->next_tap;
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * JTAG workloads of the "benchmark" commands. Run with the dummy adapter
+ * or with a loopback remote_bitbang server, they measure the host side
+ * overhead of the JTAG queue, from the jtag_add_*() calls to the driver.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "jtag.h"
+#include "benchmark.h"
+#include <helper/log.h>
+#include <helper/time_support.h>
+
+/* Number of IR/DR/runtest triplets queued between two flushes */
+#define BENCHMARK_SCAN_BATCH 64
+
+void benchmark_run_start(struct benchmark_run *run)
+{
+	run->start_stats = *transport_get_stats();
+	run->start_cpu = clock();
+	run->start_us = timeval_us();
+}
+
+void benchmark_run_report(struct command_invocation *cmd,
+	const struct benchmark_run *run, const char *name, uint64_t commands)
+{
+	int64_t elapsed_us = timeval_us() - run->start_us;
+	clock_t cpu = clock() - run->start_cpu;
+	const struct transport_stats *stats = transport_get_stats();
+
+	uint64_t flushes = stats->flushes - run->start_stats.flushes;
+	uint64_t scans = stats->scans - run->start_stats.scans;
+	uint64_t bits = stats->bits - run->start_stats.bits;
+
+	if (elapsed_us <= 0)
+		elapsed_us = 1;
+	double seconds = elapsed_us / 1e6;
+	double cpu_ns = (double)cpu * 1e9 / CLOCKS_PER_SEC;
+
+	command_print(cmd, "%s: %" PRIu64 " commands in %.3f s, %.0f commands/s, "
+			"%.0f scans/s, %.3f Mbit/s, %.0f ns CPU/command, %" PRIu64 " flushes",
+			name, commands, seconds, commands / seconds,
+			scans / seconds, bits / seconds / 1e6,
+			commands ? cpu_ns / commands : 0, flushes);
+}
+
+/*
+ * IR/DR ping-pong: an IR scan selecting BYPASS, a 32 bit DR scan with
+ * capture and a few idle clocks, as most target drivers do to access
+ * a debug register.
+ */
+COMMAND_HANDLER(handle_benchmark_scan)
+{
+	unsigned int pairs = 10000;
+
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct jtag_tap *tap = jtag_tap_by_string(CMD_ARGV[0]);
+	if (!tap) {
+		command_print(CMD, "Tap '%s' could not be found", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (!tap->enabled) {
+		command_print(CMD, "Tap '%s' is disabled", CMD_ARGV[0]);
+		return ERROR_FAIL;
+	}
+
+	if (CMD_ARGC == 2)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], pairs);
+
+	uint8_t *ir_out = malloc(DIV_ROUND_UP(tap->ir_length, 8));
+	uint8_t *dr_in = malloc(BENCHMARK_SCAN_BATCH * 4);
+	if (!ir_out || !dr_in) {
+		LOG_ERROR("Unable to allocate memory");
+		free(ir_out);
+		free(dr_in);
+		return ERROR_FAIL;
+	}
+
+	buf_set_ones(ir_out, tap->ir_length);
+	struct scan_field ir_field = {
+		.num_bits = tap->ir_length,
+		.out_value = ir_out,
+	};
+
+	uint8_t dr_out[4];
+	buf_set_u32(dr_out, 0, 32, 0x5a5aa5a5);
+
+	int retval = ERROR_OK;
+	struct benchmark_run run;
+	benchmark_run_start(&run);
+
+	for (unsigned int i = 0; i < pairs; i++) {
+		struct scan_field dr_field = {
+			.num_bits = 32,
+			.out_value = dr_out,
+			.in_value = dr_in + (i % BENCHMARK_SCAN_BATCH) * 4,
+		};
+
+		jtag_add_ir_scan(tap, &ir_field, TAP_IDLE);
+		jtag_add_dr_scan(tap, 1, &dr_field, TAP_IDLE);
+		jtag_add_runtest(8, TAP_IDLE);
+
+		if ((i + 1) % BENCHMARK_SCAN_BATCH == 0 || i + 1 == pairs) {
+			retval = jtag_execute_queue();
+			if (retval != ERROR_OK)
+				break;
+		}
+	}
+
+	if (retval == ERROR_OK)
+		benchmark_run_report(CMD, &run, "pingpong", 3 * (uint64_t)pairs);
+	else
+		command_print(CMD, "pingpong: JTAG queue failed");
+
+	free(ir_out);
+	free(dr_in);
+
+	return retval;
+}
+
+/* Replay of a SVF file, timed together with the parsing of the file */
+COMMAND_HANDLER(handle_benchmark_svf)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct benchmark_run run;
+	benchmark_run_start(&run);
+
+	int retval = command_run_linef(CMD_CTX, "svf -quiet {%s}", CMD_ARGV[0]);
+	if (retval != ERROR_OK) {
+		command_print(CMD, "svf: replay of '%s' failed", CMD_ARGV[0]);
+		return retval;
+	}
+
+	/* SVF only queues scans and idle clocks, count the scans */
+	benchmark_run_report(CMD, &run, "svf",
+			transport_get_stats()->scans - run.start_stats.scans);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration jtag_benchmark_subcommand_handlers[] = {
+	{
+		.name = "scan",
+		.handler = handle_benchmark_scan,
+		.mode = COMMAND_EXEC,
+		.help = "Queue IR/DR scan pairs and idle clocks to a TAP, "
+			"flushing the queue every " stringify(BENCHMARK_SCAN_BATCH) " pairs",
+		.usage = "tap_name [pairs]",
+	},
+	{
+		.name = "svf",
+		.handler = handle_benchmark_svf,
+		.mode = COMMAND_EXEC,
+		.help = "Replay a SVF file",
+		.usage = "filename",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int jtag_benchmark_register_commands(struct command_context *cmd_ctx)
+{
+	return register_commands(cmd_ctx, "benchmark", jtag_benchmark_subcommand_handlers);
+}
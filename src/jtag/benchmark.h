@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_JTAG_BENCHMARK_H
+#define OPENOCD_JTAG_BENCHMARK_H
+
+#include <time.h>
+#include <helper/command.h>
+#include <transport/transport.h>
+
+/**
+ * Measurement of a benchmark workload: the wall-clock and CPU time, and
+ * the transport traffic counters, at the start of the workload.
+ */
+struct benchmark_run {
+	int64_t start_us;
+	clock_t start_cpu;
+	struct transport_stats start_stats;
+};
+
+/** Start the measurement of a workload. */
+void benchmark_run_start(struct benchmark_run *run);
+
+/**
+ * Print on one line the rates of a workload since benchmark_run_start():
+ * queued commands, scans and bits per second, and host CPU time per
+ * queued command.
+ * @param cmd The command invocation to print to.
+ * @param run The measurement started by benchmark_run_start().
+ * @param name The name of the workload.
+ * @param commands The number of commands queued by the workload.
+ */
+void benchmark_run_report(struct command_invocation *cmd,
+		const struct benchmark_run *run, const char *name, uint64_t commands);
+
+#endif /* OPENOCD_JTAG_BENCHMARK_H */
@@ -26,12 +26,21 @@
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
+	size_t size;
 	size_t used;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
+
+/*
+ * The pages are not released after each jtag_execute_queue(), they are
+ * rewound and reused by the next queue. Once the queue has reached its
+ * high-water mark no further allocation is done on the hot path.
+ */
 static struct cmd_queue_page *cmd_queue_pages;
-static struct cmd_queue_page *cmd_queue_pages_tail;
+static struct cmd_queue_page *cmd_queue_page_current;
+
+static struct cmd_queue_stats cmd_queue_stats;
 
 static struct jtag_command *jtag_command_queue;
 static struct jtag_command **next_command_pointer = &jtag_command_queue;
@@ -66,7 +75,8 @@ void jtag_queue_command(struct jtag_command *cmd)
 void *cmd_queue_alloc(size_t size)
 {
 	struct cmd_queue_page **p_page = &cmd_queue_pages;
-	int offset;
+	struct cmd_queue_page *page;
+	size_t offset;
 	uint8_t *t;
 
 	/*
@@ -101,29 +111,59 @@ void *cmd_queue_alloc(size_t size)
 	size = (size + ALIGN_SIZE - 1) & (~(ALIGN_SIZE - 1));
 	/* Done... */
 
-	if (*p_page) {
-		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE < (*p_page)->used + size)
-			p_page = &((*p_page)->next);
+	if (cmd_queue_page_current) {
+		page = cmd_queue_page_current;
+		if (page->size < page->used + size)
+			p_page = &page->next;
+		else
+			p_page = NULL;
 	}
 
-	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
-		(*p_page)->used = 0;
+	/*
+	 * Reuse the next page, left over from a previous queue. Only when
+	 * there is none, or it is too small for an oversized request, a new
+	 * page is inserted in the list.
+	 */
+	if (p_page && (!*p_page || (*p_page)->size < size)) {
 		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
 					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
-		(*p_page)->next = NULL;
-		cmd_queue_pages_tail = *p_page;
+		page = malloc(sizeof(struct cmd_queue_page));
+		page->address = malloc(alloc_size);
+		page->size = alloc_size;
+		page->used = 0;
+		page->next = *p_page;
+		*p_page = page;
+
+		cmd_queue_stats.pages++;
+		cmd_queue_stats.page_allocs++;
+		cmd_queue_stats.reserved += alloc_size;
 	}
 
-	offset = (*p_page)->used;
-	(*p_page)->used += size;
+	if (p_page)
+		cmd_queue_page_current = *p_page;
+
+	page = cmd_queue_page_current;
+	offset = page->used;
+	page->used += size;
+
+	cmd_queue_stats.used += size;
+	if (cmd_queue_stats.used > cmd_queue_stats.high_water)
+		cmd_queue_stats.high_water = cmd_queue_stats.used;
 
-	t = (*p_page)->address;
+	t = page->address;
 	return t + offset;
 }
 
+/* Rewind all the pages, keeping them allocated for the next queue */
+static void cmd_queue_rewind(void)
+{
+	for (struct cmd_queue_page *page = cmd_queue_pages; page; page = page->next)
+		page->used = 0;
+
+	cmd_queue_page_current = NULL;
+	cmd_queue_stats.used = 0;
+}
+
 static void cmd_queue_free(void)
 {
 	struct cmd_queue_page *page = cmd_queue_pages;
@@ -136,22 +176,49 @@ static void cmd_queue_free(void)
 	}
 
 	cmd_queue_pages = NULL;
-	cmd_queue_pages_tail = NULL;
+	cmd_queue_page_current = NULL;
+	cmd_queue_stats.pages = 0;
+	cmd_queue_stats.reserved = 0;
+	cmd_queue_stats.used = 0;
+}
+
+void cmd_queue_get_stats(struct cmd_queue_stats *stats)
+{
+	*stats = cmd_queue_stats;
+}
+
+void cmd_queue_reset_stats(void)
+{
+	cmd_queue_stats.high_water = cmd_queue_stats.used;
+	cmd_queue_stats.page_allocs = 0;
 }
 
 void jtag_command_queue_reset(void)
 {
-	cmd_queue_free();
+	cmd_queue_rewind();
 
 	jtag_command_queue = NULL;
 	next_command_pointer = &jtag_command_queue;
 }
 
+void jtag_command_queue_free(void)
+{
+	jtag_command_queue_reset();
+	cmd_queue_free();
+}
+
 struct jtag_command *jtag_command_queue_get(void)
 {
 	return jtag_command_queue;
 }
 
+struct jtag_command *jtag_command_queue_last(void)
+{
+	if (next_command_pointer == &jtag_command_queue)
+		return NULL;
+	return container_of(next_command_pointer, struct jtag_command, next);
+}
+
 /**
  * Copy a struct scan_field for insertion into the queue.
  *
@@ -248,7 +315,7 @@ int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 		if (cmd->fields[i].in_value) {
 			int num_bits = cmd->fields[i].num_bits;
 			uint8_t *captured = buf_set_buf(buffer, bit_count,
-					malloc(DIV_ROUND_UP(num_bits, 8)), 0, num_bits);
+					cmd_queue_alloc(DIV_ROUND_UP(num_bits, 8)), 0, num_bits);
 
 			if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
 				char *char_buf = buf_to_hex_str(captured,
@@ -263,8 +330,6 @@ int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 
 			if (cmd->fields[i].in_value)
 				buf_cpy(captured, cmd->fields[i].in_value, num_bits);
-
-			free(captured);
 		}
 		bit_count += cmd->fields[i].num_bits;
 	}
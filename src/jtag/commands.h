@@ -149,11 +149,32 @@ struct jtag_command {
 	struct jtag_command *next;
 };
 
+/**
+ * Usage of the memory backing the JTAG command queue.
+ */
+struct cmd_queue_stats {
+	/** number of pages kept allocated */
+	unsigned int pages;
+	/** total size of the pages kept allocated */
+	size_t reserved;
+	/** bytes used by the current queue */
+	size_t used;
+	/** maximum of bytes used by a single queue */
+	size_t high_water;
+	/** number of pages allocated since the last statistics reset */
+	unsigned int page_allocs;
+};
+
 void *cmd_queue_alloc(size_t size);
+void cmd_queue_get_stats(struct cmd_queue_stats *stats);
+void cmd_queue_reset_stats(void);
 
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
+void jtag_command_queue_free(void);
 struct jtag_command *jtag_command_queue_get(void);
+/** @returns The last command of the queue, or NULL if the queue is empty. */
+struct jtag_command *jtag_command_queue_last(void);
 
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src);
 enum scan_type jtag_scan_type(const struct scan_command *cmd);
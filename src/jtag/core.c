@@ -25,6 +25,7 @@
 #include "interface.h"
 #include <transport/transport.h>
 #include <helper/jep106.h>
+#include <helper/time_support.h>
 #include "helper/system.h"
 
 #ifdef HAVE_STRINGS_H
@@ -90,6 +91,19 @@ tap_state_t cmd_queue_cur_state = TAP_RESET;
 static bool jtag_verify_capture_ir = true;
 static int jtag_verify = 1;
 
+/*
+ * IR scan elision. While jtag_ir_known is set, the cur_instr and bypass
+ * fields of every enabled TAP hold the IR the chain will have once the
+ * queue is executed, so an IR scan shifting the same values can be
+ * skipped. jtag_ir_last_scan is the last command of the queue if it is
+ * an IR scan without captured data, which a following IR scan can
+ * replace since it overwrites the IR of every TAP.
+ */
+static bool jtag_elide_ir;
+static bool jtag_ir_known;
+static struct jtag_command *jtag_ir_last_scan;
+static struct jtag_ir_elision_stats jtag_ir_stats;
+
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
  *deasserted (in ms) */
 static int adapter_nsrst_delay;	/* default to no nSRST delay */
@@ -327,6 +341,9 @@ int jtag_call_event_callbacks(enum jtag_event event)
 
 	LOG_DEBUG("jtag event: %s", jtag_event_strings[event]);
 
+	/* TAP reset, or the TAPs of the chain change */
+	jtag_ir_known = false;
+
 	while (callback) {
 		struct jtag_event_callback *next;
 
@@ -353,13 +370,76 @@ static void jtag_prelude(tap_state_t state)
 	cmd_queue_cur_state = state;
 }
 
-void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field *in_fields,
-	tap_state_t state)
+static unsigned int jtag_ir_chain_length(void)
+{
+	unsigned int bits = 0;
+
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap))
+		bits += tap->ir_length;
+
+	return bits;
+}
+
+/**
+ * Skip an IR scan which would not change the IR of any TAP, or merge it
+ * into the IR scan queued just before it.
+ * @param merge false if the scan must not be merged, e.g. because its
+ * Capture-IR value is verified.
+ * @returns true if the scan has been taken care of.
+ */
+static bool jtag_elide_ir_scan(struct jtag_tap *active, const struct scan_field *in_fields,
+	tap_state_t state, bool merge)
 {
+	if (!jtag_elide_ir)
+		return false;
+
+	/* the scan must not leave the TAPs in a shift state, where the IR
+	 * scan would add bits to the next one */
+	bool same_state = state == cmd_queue_cur_state &&
+		state != TAP_IRSHIFT && state != TAP_DRSHIFT;
+
+	if (jtag_ir_known && same_state && !in_fields->in_value && !active->bypass &&
+			!buf_cmp(active->cur_instr, in_fields->out_value, active->ir_length)) {
+		jtag_ir_stats.elided++;
+		jtag_ir_stats.elided_bits += jtag_ir_chain_length();
+		return true;
+	}
+
+	/* the previous scan must not have been left in a shift state either,
+	 * where the new scan would not start with its own Capture-IR */
+	if (merge && jtag_ir_last_scan && jtag_ir_last_scan == jtag_command_queue_last() &&
+			cmd_queue_cur_state != TAP_IRSHIFT && cmd_queue_cur_state != TAP_DRSHIFT) {
+		jtag_prelude(state);
+		jtag_set_error(interface_jtag_replace_ir_scan(jtag_ir_last_scan, active, in_fields, state));
+		if (in_fields->in_value)
+			jtag_ir_last_scan = NULL;
+		jtag_ir_stats.merged++;
+		jtag_ir_stats.elided_bits += jtag_ir_chain_length();
+		return true;
+	}
+
+	return false;
+}
+
+static void jtag_add_ir_scan_elide(struct jtag_tap *active, const struct scan_field *in_fields,
+	tap_state_t state, bool merge)
+{
+	if (jtag_elide_ir_scan(active, in_fields, state, merge))
+		return;
+
 	jtag_prelude(state);
 
 	int retval = interface_jtag_add_ir_scan(active, in_fields, state);
 	jtag_set_error(retval);
+
+	jtag_ir_known = true;
+	jtag_ir_last_scan = (merge && !in_fields->in_value) ? jtag_command_queue_last() : NULL;
+}
+
+void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field *in_fields,
+	tap_state_t state)
+{
+	jtag_add_ir_scan_elide(active, in_fields, state, true);
 }
 
 static void jtag_add_ir_scan_noverify_callback(struct jtag_tap *active,
@@ -367,7 +447,8 @@ static void jtag_add_ir_scan_noverify_callback(struct jtag_tap *active,
 	const struct scan_field *in_fields,
 	tap_state_t state)
 {
-	jtag_add_ir_scan_noverify(active, in_fields, state);
+	/* a verified scan is neither merged, nor replaced by the next one */
+	jtag_add_ir_scan_elide(active, in_fields, state, false);
 }
 
 /* If fields->in_value is filled out, then the captured IR value will be checked */
@@ -375,7 +456,13 @@ void jtag_add_ir_scan(struct jtag_tap *active, struct scan_field *in_fields, tap
 {
 	assert(state != TAP_RESET);
 
-	if (jtag_verify && jtag_verify_capture_ir) {
+	bool verify = jtag_verify && jtag_verify_capture_ir;
+
+	/* nothing would be captured, nor verified, for a skipped scan */
+	if (!in_fields->in_value && jtag_elide_ir_scan(active, in_fields, state, !verify))
+		return;
+
+	if (verify) {
 		/* 8 x 32 bit id's is enough for all invocations */
 
 		/* if we are to run a verification of the ir scan, we need to get the input back.
@@ -397,6 +484,9 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 
 	jtag_prelude(state);
 
+	/* the IR shifted in the TAPs is not known */
+	jtag_ir_known = false;
+
 	int retval = interface_jtag_add_plain_ir_scan(
 			num_bits, out_bits, in_bits, state);
 	jtag_set_error(retval);
@@ -509,6 +599,9 @@ int jtag_add_tms_seq(unsigned nbits, const uint8_t *seq, enum tap_state state)
 	jtag_checks();
 	cmd_queue_cur_state = state;
 
+	/* Update-IR may be crossed, loading the IR with the Capture-IR value */
+	jtag_ir_known = false;
+
 	retval = interface_add_tms_seq(nbits, seq, state);
 	jtag_set_error(retval);
 	return retval;
@@ -540,6 +633,10 @@ void jtag_add_pathmove(int num_states, const tap_state_t *path)
 			return;
 		}
 		cur_state = path[i];
+
+		/* Update-IR would load the IR with the Capture-IR value */
+		if (cur_state == TAP_IRCAPTURE)
+			jtag_ir_known = false;
 	}
 
 	jtag_checks();
@@ -952,7 +1049,26 @@ int default_interface_jtag_execute_queue(void)
 	}
 
 	struct jtag_command *cmd = jtag_command_queue_get();
+
+	for (struct jtag_command *c = cmd; c; c = c->next) {
+		switch (c->type) {
+		case JTAG_SCAN:
+			transport_stats_scan(jtag_scan_size(c->cmd.scan));
+			break;
+		case JTAG_RUNTEST:
+			transport_stats_idle_clocks(c->cmd.runtest->num_cycles);
+			break;
+		case JTAG_STABLECLOCKS:
+			transport_stats_idle_clocks(c->cmd.stableclocks->num_cycles);
+			break;
+		default:
+			break;
+		}
+	}
+
+	int64_t start = timeval_us();
 	int result = adapter_driver->jtag_ops->execute_queue(cmd);
+	transport_stats_flush(timeval_us() - start);
 
 	while (debug_level >= LOG_LVL_DEBUG_IO && cmd) {
 		switch (cmd->type) {
@@ -1018,7 +1134,14 @@ int default_interface_jtag_execute_queue(void)
 void jtag_execute_queue_noclear(void)
 {
 	jtag_flush_queue_count++;
-	jtag_set_error(interface_jtag_execute_queue());
+
+	/* the commands of the queue are released */
+	jtag_ir_last_scan = NULL;
+
+	int retval = interface_jtag_execute_queue();
+	if (retval != ERROR_OK)
+		jtag_ir_known = false;
+	jtag_set_error(retval);
 
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
@@ -1707,6 +1830,28 @@ bool jtag_will_verify_capture_ir(void)
 	return jtag_verify_capture_ir;
 }
 
+void jtag_set_elide_ir(bool enable)
+{
+	jtag_elide_ir = enable;
+	jtag_ir_known = false;
+	jtag_ir_last_scan = NULL;
+}
+
+bool jtag_will_elide_ir(void)
+{
+	return jtag_elide_ir;
+}
+
+void jtag_get_ir_elision_stats(struct jtag_ir_elision_stats *stats)
+{
+	*stats = jtag_ir_stats;
+}
+
+void jtag_reset_ir_elision_stats(void)
+{
+	memset(&jtag_ir_stats, 0, sizeof(jtag_ir_stats));
+}
+
 int jtag_power_dropout(int *dropout)
 {
 	if (!is_adapter_initialized()) {
@@ -1794,6 +1939,11 @@ static int jtag_select(struct command_context *ctx)
 
 	retval = jtag_register_commands(ctx);
 
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = jtag_benchmark_register_commands(ctx);
+
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -21,6 +21,7 @@
 #include <jtag/commands.h>
 
 #include <helper/time_support.h>
+#include <transport/transport.h>
 
 /* Timeout for retrying on SWD WAIT in msec */
 #define SWD_WAIT_TIMEOUT 500
@@ -72,6 +73,15 @@ static int bitbang_state_move(int skip)
 	uint8_t tms_scan = tap_get_tms_path(tap_get_state(), tap_get_end_state());
 	int tms_count = tap_get_tms_path_len(tap_get_state(), tap_get_end_state());
 
+	if (bitbang_interface->vector) {
+		tms_scan >>= skip;
+		if (tms_count > skip &&
+				bitbang_interface->vector(tms_count - skip, &tms_scan, NULL, NULL) != ERROR_OK)
+			return ERROR_FAIL;
+		tap_set_state(tap_get_end_state());
+		return ERROR_OK;
+	}
+
 	for (i = skip; i < tms_count; i++) {
 		tms = (tms_scan >> i) & 1;
 		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
@@ -97,6 +107,9 @@ static int bitbang_execute_tms(struct jtag_command *cmd)
 
 	LOG_DEBUG_IO("TMS: %d bits", num_bits);
 
+	if (bitbang_interface->vector)
+		return bitbang_interface->vector(num_bits, bits, NULL, NULL);
+
 	int tms = 0;
 	for (unsigned i = 0; i < num_bits; i++) {
 		tms = ((bits[i/8] >> (i % 8)) & 1);
@@ -161,14 +174,20 @@ static int bitbang_runtest(int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++) {
-		if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
+	if (bitbang_interface->vector) {
+		if (num_cycles > 0 &&
+				bitbang_interface->vector(num_cycles, NULL, NULL, NULL) != ERROR_OK)
 			return ERROR_FAIL;
-		if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
+	} else {
+		for (i = 0; i < num_cycles; i++) {
+			if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
+				return ERROR_FAIL;
+			if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
+				return ERROR_FAIL;
+		}
+		if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK)
 			return ERROR_FAIL;
 	}
-	if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK)
-		return ERROR_FAIL;
 
 	/* finish in end_state */
 	bitbang_end_state(saved_end_state);
@@ -184,6 +203,9 @@ static int bitbang_stableclocks(int num_cycles)
 	int tms = (tap_get_state() == TAP_RESET ? 1 : 0);
 	int i;
 
+	if (bitbang_interface->vector && !tms)
+		return bitbang_interface->vector(num_cycles, NULL, NULL, NULL);
+
 	/* send num_cycles clocks onto the cable */
 	for (i = 0; i < num_cycles; i++) {
 		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
@@ -195,6 +217,31 @@ static int bitbang_stableclocks(int num_cycles)
 	return ERROR_OK;
 }
 
+/*
+ * Shift a scan with a single vector, leaving the shift state on the last bit.
+ * The TDO values are only valid after the next flush.
+ */
+static int bitbang_scan_vector(enum scan_type type, uint8_t *buffer, unsigned int scan_size)
+{
+	uint8_t *tms = calloc(DIV_ROUND_UP(scan_size, 8), 1);
+	if (!tms) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+	buf_set_u32(tms, scan_size - 1, 1, 1);
+
+	int retval = bitbang_interface->vector(scan_size, tms,
+			type != SCAN_IN ? buffer : NULL,
+			type != SCAN_OUT ? buffer : NULL);
+	free(tms);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (tap_get_state() != tap_get_end_state())
+		return bitbang_state_move(1);
+	return ERROR_OK;
+}
+
 static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		unsigned scan_size)
 {
@@ -214,6 +261,9 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		bitbang_end_state(saved_end_state);
 	}
 
+	if (bitbang_interface->vector)
+		return bitbang_scan_vector(type, buffer, scan_size);
+
 	size_t buffered = 0;
 	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
 		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
@@ -293,7 +343,58 @@ static void bitbang_sleep(unsigned int microseconds)
 	}
 }
 
-int bitbang_execute_queue(struct jtag_command *cmd_queue)
+/* Scans shifted with bitbang_interface->vector(), waiting for their TDO values */
+struct bitbang_pending_scan {
+	struct scan_command *command;
+	uint8_t *buffer;
+};
+
+static struct bitbang_pending_scan *pending_scans;
+static unsigned int pending_scans_count;
+static unsigned int pending_scans_size;
+
+static int bitbang_add_pending_scan(struct scan_command *command, uint8_t *buffer)
+{
+	if (pending_scans_count == pending_scans_size) {
+		unsigned int size = pending_scans_size ? 2 * pending_scans_size : 64;
+		struct bitbang_pending_scan *p = realloc(pending_scans, size * sizeof(*p));
+		if (!p) {
+			LOG_ERROR("Unable to allocate memory");
+			return ERROR_FAIL;
+		}
+		pending_scans = p;
+		pending_scans_size = size;
+	}
+
+	pending_scans[pending_scans_count].command = command;
+	pending_scans[pending_scans_count].buffer = buffer;
+	pending_scans_count++;
+	return ERROR_OK;
+}
+
+/* Flush the vectors and copy the TDO values of the pending scans */
+static int bitbang_complete_pending_scans(int retval)
+{
+	if (!pending_scans_count)
+		return retval;
+
+	if (retval == ERROR_OK || retval == ERROR_JTAG_QUEUE_FAILED) {
+		if (bitbang_interface->flush() != ERROR_OK)
+			retval = ERROR_FAIL;
+	}
+
+	for (unsigned int i = 0; i < pending_scans_count; i++) {
+		if ((retval == ERROR_OK || retval == ERROR_JTAG_QUEUE_FAILED) &&
+				jtag_read_buffer(pending_scans[i].buffer, pending_scans[i].command) != ERROR_OK)
+			retval = ERROR_JTAG_QUEUE_FAILED;
+		free(pending_scans[i].buffer);
+	}
+	pending_scans_count = 0;
+
+	return retval;
+}
+
+static int bitbang_execute_commands(struct jtag_command *cmd_queue)
 {
 	struct jtag_command *cmd = cmd_queue;	/* currently processed command */
 	int scan_size;
@@ -358,8 +459,18 @@ int bitbang_execute_queue(struct jtag_command *cmd_queue)
 					tap_state_name(cmd->cmd.scan->end_state));
 				type = jtag_scan_type(cmd->cmd.scan);
 				if (bitbang_scan(cmd->cmd.scan->ir_scan, type, buffer,
-							scan_size) != ERROR_OK)
+							scan_size) != ERROR_OK) {
+					free(buffer);
 					return ERROR_FAIL;
+				}
+				/* vectors are completed at the end of the queue */
+				if (bitbang_interface->vector && type != SCAN_OUT) {
+					if (bitbang_add_pending_scan(cmd->cmd.scan, buffer) != ERROR_OK) {
+						free(buffer);
+						return ERROR_FAIL;
+					}
+					break;
+				}
 				if (jtag_read_buffer(buffer, cmd->cmd.scan) != ERROR_OK)
 					retval = ERROR_JTAG_QUEUE_FAILED;
 				free(buffer);
@@ -387,6 +498,13 @@ int bitbang_execute_queue(struct jtag_command *cmd_queue)
 	return retval;
 }
 
+int bitbang_execute_queue(struct jtag_command *cmd_queue)
+{
+	int retval = bitbang_execute_commands(cmd_queue);
+
+	return bitbang_complete_pending_scans(retval);
+}
+
 static int queued_retval;
 
 static int bitbang_swd_init(void)
@@ -402,21 +520,29 @@ static void bitbang_swd_exchange(bool rnw, uint8_t buf[], unsigned int offset, u
 		bitbang_interface->blink(1);
 	}
 
-	for (unsigned int i = offset; i < bit_cnt + offset; i++) {
-		int bytec = i/8;
-		int bcval = 1 << (i % 8);
-		int swdio = !rnw && (buf[bytec] & bcval);
-
-		bitbang_interface->swd_write(0, swdio);
+	if (bitbang_interface->swd_vector) {
+		/* the values read are needed right away, to check the ACK */
+		uint8_t *in = rnw ? buf : NULL;
+		if (bitbang_interface->swd_vector(bit_cnt, rnw ? NULL : buf, in, offset) != ERROR_OK ||
+				(in && bitbang_interface->flush() != ERROR_OK))
+			queued_retval = ERROR_FAIL;
+	} else {
+		for (unsigned int i = offset; i < bit_cnt + offset; i++) {
+			int bytec = i/8;
+			int bcval = 1 << (i % 8);
+			int swdio = !rnw && (buf[bytec] & bcval);
+
+			bitbang_interface->swd_write(0, swdio);
+
+			if (rnw && buf) {
+				if (bitbang_interface->swdio_read())
+					buf[bytec] |= bcval;
+				else
+					buf[bytec] &= ~bcval;
+			}
 
-		if (rnw && buf) {
-			if (bitbang_interface->swdio_read())
-				buf[bytec] |= bcval;
-			else
-				buf[bytec] &= ~bcval;
+			bitbang_interface->swd_write(1, swdio);
 		}
-
-		bitbang_interface->swd_write(1, swdio);
 	}
 
 	if (bitbang_interface->blink) {
@@ -503,6 +629,7 @@ static void bitbang_swd_read_reg(uint8_t cmd, uint32_t *value, uint32_t ap_delay
 			data);
 
 		if (ack == SWD_ACK_WAIT && timeval_ms() <= timeout) {
+			transport_stats_retry();
 			swd_clear_sticky_errors();
 			if (retry > 20)
 				alive_sleep(1);
@@ -581,6 +708,7 @@ static void bitbang_swd_write_reg(uint8_t cmd, uint32_t value, uint32_t ap_delay
 			buf_get_u32(trn_ack_data_parity_trn, 1 + 3 + 1, 32));
 
 		if (check_ack && ack == SWD_ACK_WAIT && timeval_ms() <= timeout) {
+			transport_stats_retry();
 			swd_clear_sticky_errors();
 			if (retry > 20)
 				alive_sleep(1);
@@ -608,6 +736,9 @@ static int bitbang_swd_run_queue(void)
 	 * ensure that data is clocked through the AP. */
 	bitbang_swd_exchange(true, NULL, 0, 8);
 
+	if (bitbang_interface->flush && bitbang_interface->flush() != ERROR_OK)
+		queued_retval = ERROR_FAIL;
+
 	int retval = queued_retval;
 	queued_retval = ERROR_OK;
 	LOG_DEBUG_IO("SWD queue return value: %02x", retval);
@@ -61,6 +61,31 @@ struct bitbang_interface {
 
 	/** Force a flush. */
 	int (*flush)(void);
+
+	/**
+	 * Clock a whole JTAG vector (optional). For each bit, TMS and TDI are
+	 * set with TCK low, TDO is sampled and TCK is raised; TCK is low again
+	 * at the end of the vector.
+	 * @param bits The number of TCK cycles.
+	 * @param tms The TMS values, or NULL to keep TMS low.
+	 * @param tdi The TDI values, or NULL to keep TDI low.
+	 * @param tdo Where to store the TDO values, or NULL. It may be the same
+	 * buffer as @a tdi, and it is filled no later than the next call to
+	 * flush().
+	 */
+	int (*vector)(unsigned int bits, const uint8_t *tms, const uint8_t *tdi, uint8_t *tdo);
+
+	/**
+	 * Clock a whole SWD vector (optional), in the direction set by
+	 * swdio_drive(). For each bit, SWDIO is set with SWCLK low, sampled and
+	 * SWCLK is raised.
+	 * @param bits The number of SWCLK cycles.
+	 * @param out The SWDIO values, or NULL to keep SWDIO low.
+	 * @param in Where to store the SWDIO values, or NULL. The buffer is
+	 * filled no later than the next call to flush().
+	 * @param offset The offset in bits of the first value in @a out and @a in.
+	 */
+	int (*swd_vector)(unsigned int bits, const uint8_t *out, uint8_t *in, unsigned int offset);
 };
 
 extern const struct swd_driver bitbang_swd;
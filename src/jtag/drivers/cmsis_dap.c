@@ -34,6 +34,7 @@
 #include <jtag/interface.h>
 #include <jtag/commands.h>
 #include <jtag/tcl.h>
+#include <helper/time_support.h>
 #include <target/cortex_m.h>
 
 #include "cmsis_dap.h"
@@ -165,6 +166,14 @@ static bool swd_mode;
  * Prevent using it until we have at least r/w operations. */
 #define CMD_DAP_TFER_BLOCK_MIN_OPS 4
 
+/* Moving the end of a DAP_Transfer to a DAP_TransferBlock of its own adds
+ * 5 bytes of command header, 4 of response header and possibly the
+ * DAP_ExecuteCommands headers. It pays off with 8 r/w operations. */
+#define CMD_DAP_BUNDLE_BLOCK_MIN_OPS 8
+
+/* CMSIS-DAP Atomic Commands */
+#define CMD_DAP_EXECUTE_COMMANDS  0x7F
+
 /* DAP Status Code */
 #define DAP_OK                    0
 #define DAP_ERROR                 0xFF
@@ -250,6 +259,11 @@ static uint8_t queued_seq_buf[1024]; /* TODO: make dynamic / move into cmsis obj
 
 static int queued_retval;
 
+/* bundle the DAP commands of a packet with DAP_ExecuteCommands, if supported */
+static bool cmsis_dap_bundle = true;
+/* maximal number of pending requests, 0 to tune it at runtime */
+static unsigned int cmsis_dap_pipeline_depth;
+
 static uint8_t output_pins = SWJ_PIN_SRST | SWJ_PIN_TRST;
 
 static struct cmsis_dap *cmsis_dap_handle;
@@ -308,6 +322,8 @@ static void cmsis_dap_close(struct cmsis_dap *dap)
 	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++) {
 		free(dap->pending_fifo[i].transfers);
 		dap->pending_fifo[i].transfers = NULL;
+		free(dap->pending_fifo[i].segments);
+		dap->pending_fifo[i].segments = NULL;
 	}
 
 	free(cmsis_dap_handle);
@@ -560,9 +576,12 @@ static int cmsis_dap_cmd_dap_delay(uint16_t delay_us)
 }
 #endif
 
-static int cmsis_dap_metacmd_targetsel(uint32_t instance_id)
+/* Size of the DAP_SWD_Sequence command and response writing TARGETSEL */
+#define TARGETSEL_SEQ_CMD_SIZE    11
+#define TARGETSEL_SEQ_RESP_SIZE   3
+
+static unsigned int cmsis_dap_targetsel_sequence(uint8_t *command, uint32_t instance_id)
 {
-	uint8_t *command = cmsis_dap_handle->command;
 	const uint32_t SEQ_RD = 0x80, SEQ_WR = 0x00;
 
 	/* SWD multi-drop requires a transfer ala CMD_DAP_TFER,
@@ -574,7 +593,7 @@ static int cmsis_dap_metacmd_targetsel(uint32_t instance_id)
 
 	LOG_DEBUG_IO("DP write reg TARGETSEL %" PRIx32, instance_id);
 
-	size_t idx = 0;
+	unsigned int idx = 0;
 	command[idx++] = CMD_DAP_SWD_SEQUENCE;
 	command[idx++] = 3;	/* sequence count */
 
@@ -591,7 +610,15 @@ static int cmsis_dap_metacmd_targetsel(uint32_t instance_id)
 	idx += 4;
 	command[idx++] = parity_u32(instance_id);
 
-	int retval = cmsis_dap_xfer(cmsis_dap_handle, idx);
+	assert(idx == TARGETSEL_SEQ_CMD_SIZE);
+	return idx;
+}
+
+static int cmsis_dap_metacmd_targetsel(uint32_t instance_id)
+{
+	unsigned int len = cmsis_dap_targetsel_sequence(cmsis_dap_handle->command, instance_id);
+
+	int retval = cmsis_dap_xfer(cmsis_dap_handle, len);
 	if (retval != ERROR_OK || cmsis_dap_handle->response[1] != DAP_OK) {
 		LOG_ERROR("CMSIS-DAP command SWD_Sequence failed.");
 		return ERROR_JTAG_DEVICE_ERROR;
@@ -761,8 +788,10 @@ static int cmsis_dap_cmd_dap_swo_data(
 
 static void cmsis_dap_swd_discard_all_pending(struct cmsis_dap *dap)
 {
-	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++)
+	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++) {
 		dap->pending_fifo[i].transfer_count = 0;
+		dap->pending_fifo[i].segment_count = 0;
+	}
 
 	dap->pending_fifo_put_idx = 0;
 	dap->pending_fifo_get_idx = 0;
@@ -776,49 +805,83 @@ static void cmsis_dap_swd_cancel_transfers(struct cmsis_dap *dap)
 	cmsis_dap_swd_discard_all_pending(dap);
 }
 
-static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
+/* Number of requests which may be pending until the first response arrives */
+static unsigned int cmsis_dap_swd_pending_depth(struct cmsis_dap *dap)
 {
-	uint8_t *command = dap->command;
-	struct pending_request_block *block = &dap->pending_fifo[dap->pending_fifo_put_idx];
+	return dap->quirk_mode ? 1 : dap->pending_depth;
+}
 
-	assert(dap->write_count + dap->read_count == block->transfer_count);
+/* Exponential moving average over 8 samples of a latency */
+static unsigned int cmsis_dap_average_us(unsigned int average_us, int64_t sample_us)
+{
+	sample_us = MAX(MIN(sample_us, 1000000), 1);
+	if (!average_us)
+		return sample_us;
+	return (7 * (uint64_t)average_us + sample_us) / 8;
+}
 
-	/* Reset packet size check counters for the next packet */
-	dap->write_count = 0;
-	dap->read_count = 0;
+/* Measure the round trip of a request sent to an idle adapter, or the time
+ * the adapter needed for a request it received before completing the
+ * previous one */
+static void cmsis_dap_swd_measure_latency(struct cmsis_dap *dap,
+		const struct pending_request_block *block)
+{
+	int64_t now = timeval_us();
 
-	LOG_DEBUG_IO("Executing %d queued transactions from FIFO index %u%s",
-				 block->transfer_count, dap->pending_fifo_put_idx,
-				 cmsis_dap_handle->swd_cmds_differ ? "" : ", same swd ops");
+	if (block->sent_idle)
+		dap->rtt_us = cmsis_dap_average_us(dap->rtt_us, now - block->sent_us);
+	else if (block->sent_us <= dap->last_response_us)
+		dap->service_us = cmsis_dap_average_us(dap->service_us, now - dap->last_response_us);
 
-	if (queued_retval != ERROR_OK) {
-		LOG_DEBUG("Skipping due to previous errors: %d", queued_retval);
-		goto skip;
-	}
+	dap->last_response_us = now;
+}
 
-	if (block->transfer_count == 0) {
-		LOG_ERROR("internal: write an empty queue?!");
-		goto skip;
-	}
+/* Enough requests must be pending to keep the adapter busy during the
+ * round trip of a response: as many as the adapter completes meanwhile,
+ * and one more being sent. Fewer pending requests are executed in vain
+ * after a failed transfer. */
+static void cmsis_dap_swd_update_pending_depth(struct cmsis_dap *dap)
+{
+	unsigned int depth = dap->packet_count;
+
+	if (cmsis_dap_pipeline_depth)
+		depth = MIN(depth, cmsis_dap_pipeline_depth);
+	else if (dap->rtt_us && dap->service_us)
+		depth = MIN(depth, DIV_ROUND_UP(dap->rtt_us, dap->service_us) + 1);
 
-	bool block_cmd = !cmsis_dap_handle->swd_cmds_differ
-					 && block->transfer_count >= CMD_DAP_TFER_BLOCK_MIN_OPS;
-	block->command = block_cmd ? CMD_DAP_TFER_BLOCK : CMD_DAP_TFER;
+	if (depth != dap->pending_depth)
+		LOG_DEBUG_IO("CMSIS-DAP: %u pending requests, round trip %u us, %u us per request",
+				depth, dap->rtt_us, dap->service_us);
 
-	command[0] = block->command;
+	dap->pending_depth = depth;
+}
+
+/* Fill the DAP command of a segment of a request, returns its size */
+static unsigned int cmsis_dap_swd_write_segment(uint8_t *command,
+		const struct pending_request_block *block,
+		const struct pending_request_segment *segment)
+{
+	const struct pending_transfer_result *transfers = &block->transfers[segment->first];
+
+	if (segment->command == CMD_DAP_SWD_SEQUENCE)
+		return cmsis_dap_targetsel_sequence(command, transfers[0].data);
+
+	bool block_cmd = segment->command == CMD_DAP_TFER_BLOCK;
+
+	command[0] = segment->command;
 	command[1] = 0x00;	/* DAP Index */
 
 	unsigned int idx;
 	if (block_cmd) {
-		h_u16_to_le(&command[2], block->transfer_count);
+		h_u16_to_le(&command[2], segment->count);
 		idx = 4;	/* The first transfer will store the common DAP register */
 	} else {
-		command[2] = block->transfer_count;
+		command[2] = segment->count;
 		idx = 3;
 	}
 
-	for (unsigned int i = 0; i < block->transfer_count; i++) {
-		struct pending_transfer_result *transfer = &(block->transfers[i]);
+	for (unsigned int i = 0; i < segment->count; i++) {
+		const struct pending_transfer_result *transfer = &transfers[i];
 		uint8_t cmd = transfer->cmd;
 		uint32_t data = transfer->data;
 
@@ -855,6 +918,62 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 		}
 	}
 
+	return idx;
+}
+
+static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
+{
+	uint8_t *command = dap->command;
+	struct pending_request_block *block = &dap->pending_fifo[dap->pending_fifo_put_idx];
+
+	assert(dap->write_count + dap->read_count == block->transfer_count);
+
+	/* Reset packet size check counters for the next packet */
+	dap->write_count = 0;
+	dap->read_count = 0;
+	dap->bundle_cmd_size = 0;
+	dap->bundle_resp_size = 0;
+	dap->bundle_run_len = 0;
+
+	if (queued_retval != ERROR_OK) {
+		LOG_DEBUG("Skipping due to previous errors: %d", queued_retval);
+		goto skip;
+	}
+
+	if (block->transfer_count == 0) {
+		LOG_ERROR("internal: write an empty queue?!");
+		goto skip;
+	}
+
+	if (!dap->bundle) {
+		/* A single DAP_Transfer or DAP_TransferBlock */
+		bool block_cmd = !dap->swd_cmds_differ
+						 && block->transfer_count >= CMD_DAP_TFER_BLOCK_MIN_OPS;
+		block->segments[0].command = block_cmd ? CMD_DAP_TFER_BLOCK : CMD_DAP_TFER;
+		block->segments[0].first = 0;
+		block->segments[0].count = block->transfer_count;
+		block->segment_count = 1;
+	}
+
+	LOG_DEBUG_IO("Executing %d queued transactions from FIFO index %u in %u DAP commands%s",
+				 block->transfer_count, dap->pending_fifo_put_idx, block->segment_count,
+				 dap->bundle || dap->swd_cmds_differ ? "" : ", same swd ops");
+
+	unsigned int idx = 0;
+	if (block->segment_count > 1) {
+		block->command = CMD_DAP_EXECUTE_COMMANDS;
+		command[idx++] = CMD_DAP_EXECUTE_COMMANDS;
+		command[idx++] = block->segment_count;
+	} else {
+		block->command = block->segments[0].command;
+	}
+
+	for (unsigned int i = 0; i < block->segment_count; i++)
+		idx += cmsis_dap_swd_write_segment(&command[idx], block, &block->segments[i]);
+
+	block->sent_idle = dap->pending_fifo_block_count == 0;
+	block->sent_us = timeval_us();
+
 	int retval = dap->backend->write(dap, idx, LIBUSB_TIMEOUT_MS);
 	if (retval < 0) {
 		queued_retval = retval;
@@ -871,6 +990,7 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 
 skip:
 	block->transfer_count = 0;
+	block->segment_count = 0;
 }
 
 static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, enum cmsis_dap_blocking blocking)
@@ -917,6 +1037,8 @@ static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, enum cmsis_dap_blo
 		goto skip;
 	}
 
+	cmsis_dap_swd_measure_latency(dap, block);
+
 	uint8_t *resp = dap->response;
 	if (resp[0] != block->command) {
 		LOG_ERROR("CMSIS-DAP command mismatch. Expected 0x%x received 0x%" PRIx8,
@@ -926,70 +1048,117 @@ static void cmsis_dap_swd_read_process(struct cmsis_dap *dap, enum cmsis_dap_blo
 		return;
 	}
 
-	unsigned int transfer_count;
-	unsigned int idx;
-	if (block->command == CMD_DAP_TFER_BLOCK) {
-		transfer_count = le_to_h_u16(&resp[1]);
-		idx = 3;
-	} else {
-		transfer_count = resp[1];
+	unsigned int idx = 0;
+	if (block->command == CMD_DAP_EXECUTE_COMMANDS) {
+		if (resp[1] != block->segment_count) {
+			LOG_ERROR("CMSIS-DAP command count mismatch: expected %u, got %" PRIu8,
+				block->segment_count, resp[1]);
+			cmsis_dap_swd_cancel_transfers(dap);
+			queued_retval = ERROR_FAIL;
+			return;
+		}
 		idx = 2;
 	}
-	if (resp[idx] & 0x08) {
-		LOG_DEBUG("CMSIS-DAP Protocol Error @ %d (wrong parity)", transfer_count);
-		queued_retval = ERROR_FAIL;
-		goto skip;
-	}
-	uint8_t ack = resp[idx++] & 0x07;
-	if (ack != SWD_ACK_OK) {
-		LOG_DEBUG("SWD ack not OK @ %d %s", transfer_count,
-			  ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK");
-		queued_retval = swd_ack_to_error_code(ack);
-		/* TODO: use results of transfers completed before the error occurred? */
-		goto skip;
-	}
 
-	if (block->transfer_count != transfer_count) {
-		LOG_ERROR("CMSIS-DAP transfer count mismatch: expected %d, got %d",
-			  block->transfer_count, transfer_count);
-		cmsis_dap_swd_cancel_transfers(dap);
-		queued_retval = ERROR_FAIL;
-		return;
-	}
+	for (unsigned int s = 0; s < block->segment_count; s++) {
+		const struct pending_request_segment *segment = &block->segments[s];
 
-	LOG_DEBUG_IO("Received results of %d queued transactions FIFO index %u, %s mode",
-				 transfer_count, dap->pending_fifo_get_idx,
-				 blocking ? "blocking" : "nonblocking");
+		if (resp[idx] != segment->command) {
+			LOG_ERROR("CMSIS-DAP command mismatch. Expected 0x%x received 0x%" PRIx8,
+				segment->command, resp[idx]);
+			cmsis_dap_swd_cancel_transfers(dap);
+			queued_retval = ERROR_FAIL;
+			return;
+		}
 
-	for (unsigned int i = 0; i < transfer_count; i++) {
-		struct pending_transfer_result *transfer = &(block->transfers[i]);
-		if (transfer->cmd & SWD_CMD_RNW) {
-			static uint32_t last_read;
-			uint32_t data = le_to_h_u32(&resp[idx]);
-			uint32_t tmp = data;
-			idx += 4;
+		if (segment->command == CMD_DAP_SWD_SEQUENCE) {
+			if (resp[idx + 1] != DAP_OK) {
+				LOG_DEBUG("CMSIS-DAP SWD_Sequence failed");
+				queued_retval = ERROR_FAIL;
+				goto skip;
+			}
+			idx += TARGETSEL_SEQ_RESP_SIZE;
+			continue;
+		}
 
-			LOG_DEBUG_IO("Read result: %" PRIx32, data);
+		unsigned int transfer_count;
+		if (segment->command == CMD_DAP_TFER_BLOCK) {
+			transfer_count = le_to_h_u16(&resp[idx + 1]);
+			idx += 3;
+		} else {
+			transfer_count = resp[idx + 1];
+			idx += 2;
+		}
+		if (resp[idx] & 0x08) {
+			LOG_DEBUG("CMSIS-DAP Protocol Error @ %d (wrong parity)", transfer_count);
+			queued_retval = ERROR_FAIL;
+			goto skip;
+		}
+		uint8_t ack = resp[idx++] & 0x07;
+		if (ack != SWD_ACK_OK) {
+			LOG_DEBUG("SWD ack not OK @ %d %s", transfer_count,
+				  ack == SWD_ACK_WAIT ? "WAIT" : ack == SWD_ACK_FAULT ? "FAULT" : "JUNK");
+			queued_retval = swd_ack_to_error_code(ack);
+			/* TODO: use results of transfers completed before the error occurred? */
+			goto skip;
+		}
 
-			/* Imitate posted AP reads */
-			if ((transfer->cmd & SWD_CMD_APNDP) ||
-			    ((transfer->cmd & SWD_CMD_A32) >> 1 == DP_RDBUFF)) {
-				tmp = last_read;
-				last_read = data;
-			}
+		if (segment->count != transfer_count) {
+			LOG_ERROR("CMSIS-DAP transfer count mismatch: expected %d, got %d",
+				  segment->count, transfer_count);
+			cmsis_dap_swd_cancel_transfers(dap);
+			queued_retval = ERROR_FAIL;
+			return;
+		}
+
+		for (unsigned int i = 0; i < transfer_count; i++) {
+			struct pending_transfer_result *transfer = &block->transfers[segment->first + i];
+			if (transfer->cmd & SWD_CMD_RNW) {
+				static uint32_t last_read;
+				uint32_t data = le_to_h_u32(&resp[idx]);
+				uint32_t tmp = data;
+				idx += 4;
+
+				LOG_DEBUG_IO("Read result: %" PRIx32, data);
+
+				/* Imitate posted AP reads */
+				if ((transfer->cmd & SWD_CMD_APNDP) ||
+				    ((transfer->cmd & SWD_CMD_A32) >> 1 == DP_RDBUFF)) {
+					tmp = last_read;
+					last_read = data;
+				}
 
-			if (transfer->buffer)
-				*(uint32_t *)(transfer->buffer) = tmp;
+				if (transfer->buffer)
+					*(uint32_t *)(transfer->buffer) = tmp;
+			}
 		}
 	}
 
+	LOG_DEBUG_IO("Received results of %d queued transactions FIFO index %u, %s mode",
+				 block->transfer_count, dap->pending_fifo_get_idx,
+				 blocking ? "blocking" : "nonblocking");
+
 skip:
 	block->transfer_count = 0;
+	block->segment_count = 0;
 	if (!dap->quirk_mode && dap->packet_count > 1)
 		dap->pending_fifo_get_idx = (dap->pending_fifo_get_idx + 1) % dap->packet_count;
 	dap->pending_fifo_block_count--;
 }
 
+/* Send the request being queued, then wait for the oldest response if
+ * the pipeline is full */
+static void cmsis_dap_swd_send_queued(struct cmsis_dap *dap)
+{
+	if (dap->pending_fifo_block_count)
+		cmsis_dap_swd_read_process(dap, CMSIS_DAP_NON_BLOCKING);
+
+	cmsis_dap_swd_write_from_queue(dap);
+
+	if (dap->pending_fifo_block_count >= cmsis_dap_swd_pending_depth(dap))
+		cmsis_dap_swd_read_process(dap, CMSIS_DAP_BLOCKING);
+}
+
 static int cmsis_dap_swd_run_queue(void)
 {
 	if (cmsis_dap_handle->write_count + cmsis_dap_handle->read_count) {
@@ -1005,6 +1174,8 @@ static int cmsis_dap_swd_run_queue(void)
 	cmsis_dap_handle->pending_fifo_put_idx = 0;
 	cmsis_dap_handle->pending_fifo_get_idx = 0;
 
+	cmsis_dap_swd_update_pending_depth(cmsis_dap_handle);
+
 	int retval = queued_retval;
 	queued_retval = ERROR_OK;
 
@@ -1039,8 +1210,145 @@ static unsigned int cmsis_dap_tfer_resp_size(unsigned int write_count,
 	return size;
 }
 
+/* Does a request bundling segment_count DAP commands fit into one packet? */
+static bool cmsis_dap_bundle_fits(unsigned int segment_count,
+							unsigned int cmd_size, unsigned int resp_size)
+{
+	if (segment_count > 1) {
+		cmd_size += 2;					/* DAP_ExecuteCommands header */
+		resp_size += 2;
+	}
+	return segment_count <= 255
+		&& cmd_size <= tfer_max_command_size
+		&& resp_size <= tfer_max_response_size;
+}
+
+/* Turn the trailing transfers of the last DAP_Transfer of a bundled
+ * request into a DAP_TransferBlock when they use the same register, and
+ * if it makes the command smaller */
+static void cmsis_dap_swd_bundle_pack(struct cmsis_dap *dap, struct pending_request_block *block)
+{
+	struct pending_request_segment *segment = &block->segments[block->segment_count - 1];
+	unsigned int run_len = dap->bundle_run_len;
+
+	if (segment->count == run_len) {
+		/* 2 more bytes of header, but no DAP register per transfer */
+		if (run_len < CMD_DAP_TFER_BLOCK_MIN_OPS
+				|| !cmsis_dap_bundle_fits(block->segment_count,
+						dap->bundle_cmd_size - (run_len - 2), dap->bundle_resp_size + 1))
+			return;
+
+		segment->command = CMD_DAP_TFER_BLOCK;
+		dap->bundle_cmd_size -= run_len - 2;
+		dap->bundle_resp_size += 1;
+	} else {
+		if (run_len < CMD_DAP_BUNDLE_BLOCK_MIN_OPS
+				|| !cmsis_dap_bundle_fits(block->segment_count + 1,
+						dap->bundle_cmd_size - (run_len - 5), dap->bundle_resp_size + 4))
+			return;
+
+		segment->count -= run_len;
+		struct pending_request_segment *next = &block->segments[block->segment_count++];
+		next->command = CMD_DAP_TFER_BLOCK;
+		next->first = segment->first + segment->count;
+		next->count = run_len;
+		dap->bundle_cmd_size -= run_len - 5;
+		dap->bundle_resp_size += 4;
+	}
+
+	dap->bundle_run_len = 0;
+}
+
+/* Queue a transfer to a request bundling DAP commands with
+ * DAP_ExecuteCommands: consecutive transfers are grouped in DAP_Transfer
+ * or DAP_TransferBlock commands, and a TARGETSEL write is a DAP_SWD_Sequence,
+ * so that it needs no round trip of its own */
+static void cmsis_dap_swd_bundle_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
+{
+	struct cmsis_dap *dap = cmsis_dap_handle;
+	struct pending_request_block *block = &dap->pending_fifo[dap->pending_fifo_put_idx];
+	struct pending_request_segment *segment = NULL;
+	bool targetsel = swd_cmd(false, false, DP_TARGETSEL) == cmd;
+	bool rnw = cmd & SWD_CMD_RNW;
+	unsigned int cmd_size, resp_size;
+
+	if (queued_retval != ERROR_OK)
+		return;
+
+	if (block->segment_count)
+		segment = &block->segments[block->segment_count - 1];
+
+	/* Can the transfer extend the last DAP command? */
+	bool extend = false;
+	if (segment && !targetsel) {
+		if (segment->command == CMD_DAP_TFER)
+			extend = segment->count < 255;
+		else if (segment->command == CMD_DAP_TFER_BLOCK)
+			extend = segment->count < 65535
+				&& block->transfers[segment->first].cmd == cmd;
+	}
+
+	if (targetsel) {
+		cmd_size = TARGETSEL_SEQ_CMD_SIZE;
+		resp_size = TARGETSEL_SEQ_RESP_SIZE;
+	} else {
+		cmd_size = rnw ? 0 : 4;			/* data */
+		resp_size = rnw ? 4 : 0;
+		if (!extend || segment->command == CMD_DAP_TFER)
+			cmd_size += 1;				/* DAP register */
+		if (!extend) {
+			cmd_size += 3;				/* DAP_Transfer header */
+			resp_size += 3;
+		}
+	}
+
+	if (block->transfer_count == pending_queue_len
+			|| !cmsis_dap_bundle_fits(block->segment_count + (extend ? 0 : 1),
+					dap->bundle_cmd_size + cmd_size, dap->bundle_resp_size + resp_size)) {
+		/* Not enough room in the packet, the transfer starts a new one */
+		cmsis_dap_swd_send_queued(dap);
+		cmsis_dap_swd_bundle_queue_cmd(cmd, dst, data);
+		return;
+	}
+
+	struct pending_transfer_result *transfer = &block->transfers[block->transfer_count];
+	transfer->data = data;
+	transfer->cmd = cmd;
+	transfer->buffer = rnw ? dst : NULL;
+
+	if (extend) {
+		segment->count++;
+	} else {
+		segment = &block->segments[block->segment_count++];
+		segment->command = targetsel ? CMD_DAP_SWD_SEQUENCE : CMD_DAP_TFER;
+		segment->first = block->transfer_count;
+		segment->count = 1;
+	}
+
+	if (extend && block->transfers[block->transfer_count - 1].cmd == cmd)
+		dap->bundle_run_len++;
+	else
+		dap->bundle_run_len = 1;
+
+	dap->bundle_cmd_size += cmd_size;
+	dap->bundle_resp_size += resp_size;
+	if (rnw)
+		dap->read_count++;
+	else
+		dap->write_count++;
+	block->transfer_count++;
+
+	if (segment->command == CMD_DAP_TFER)
+		cmsis_dap_swd_bundle_pack(dap, block);
+}
+
 static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 {
+	if (cmsis_dap_handle->bundle) {
+		cmsis_dap_swd_bundle_queue_cmd(cmd, dst, data);
+		return;
+	}
+
 	/* TARGETSEL register write cannot be queued */
 	if (swd_cmd(false, false, DP_TARGETSEL) == cmd) {
 		queued_retval = cmsis_dap_swd_run_queue();
@@ -1075,15 +1383,8 @@ static void cmsis_dap_swd_queue_cmd(uint8_t cmd, uint32_t *dst, uint32_t data)
 	if (cmd_size > tfer_max_command_size
 			|| resp_size > tfer_max_response_size
 			|| write_count + read_count > max_transfer_count) {
-		if (cmsis_dap_handle->pending_fifo_block_count)
-			cmsis_dap_swd_read_process(cmsis_dap_handle, CMSIS_DAP_NON_BLOCKING);
-
 		/* Not enough room in the queue. Run the queue. */
-		cmsis_dap_swd_write_from_queue(cmsis_dap_handle);
-
-		unsigned int packet_count = cmsis_dap_handle->quirk_mode ? 1 : cmsis_dap_handle->packet_count;
-		if (cmsis_dap_handle->pending_fifo_block_count >= packet_count)
-			cmsis_dap_swd_read_process(cmsis_dap_handle, CMSIS_DAP_BLOCKING);
+		cmsis_dap_swd_send_queued(cmsis_dap_handle);
 	}
 
 	assert(cmsis_dap_handle->pending_fifo[cmsis_dap_handle->pending_fifo_put_idx].transfer_count < pending_queue_len);
@@ -1397,12 +1698,23 @@ static int cmsis_dap_init(void)
 	for (unsigned int i = 0; i < cmsis_dap_handle->packet_count; i++) {
 		cmsis_dap_handle->pending_fifo[i].transfers = malloc(pending_queue_len
 									 * sizeof(struct pending_transfer_result));
-		if (!cmsis_dap_handle->pending_fifo[i].transfers) {
+		cmsis_dap_handle->pending_fifo[i].segments = malloc(pending_queue_len
+									 * sizeof(struct pending_request_segment));
+		if (!cmsis_dap_handle->pending_fifo[i].transfers
+				|| !cmsis_dap_handle->pending_fifo[i].segments) {
 			LOG_ERROR("Unable to allocate memory for CMSIS-DAP queue");
 			retval = ERROR_FAIL;
 			goto init_err;
 		}
 	}
+	cmsis_dap_handle->pending_depth = cmsis_dap_handle->packet_count;
+	cmsis_dap_swd_update_pending_depth(cmsis_dap_handle);
+
+	/* DAP_ExecuteCommands lets several DAP commands share a packet */
+	cmsis_dap_handle->bundle = cmsis_dap_bundle
+		&& (cmsis_dap_handle->caps & INFO_CAPS_ATOMIC_CMDS);
+	if (cmsis_dap_handle->bundle)
+		LOG_DEBUG("CMSIS-DAP: bundling DAP commands with DAP_ExecuteCommands");
 
 	/* Intentionally not checked for error, just logs an info message
 	 * not vital for further debugging */
@@ -1456,6 +1768,8 @@ init_err:
 static int cmsis_dap_swd_init(void)
 {
 	swd_mode = true;
+	/* the adapter resends after a WAIT by itself, see cmsis_dap_init() */
+	transport_stats_retries_unsupported();
 	return ERROR_OK;
 }
 
@@ -2236,6 +2550,53 @@ COMMAND_HANDLER(cmsis_dap_handle_quirk_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(cmsis_dap_handle_bundle_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], cmsis_dap_bundle);
+
+	command_print(CMD, "CMSIS-DAP command bundling %s",
+				  cmsis_dap_bundle ? "enabled" : "disabled");
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(cmsis_dap_handle_pipeline_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "auto") == 0) {
+			cmsis_dap_pipeline_depth = 0;
+		} else {
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], cmsis_dap_pipeline_depth);
+			if (!cmsis_dap_pipeline_depth)
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	if (!cmsis_dap_handle) {
+		if (cmsis_dap_pipeline_depth)
+			command_print(CMD, "CMSIS-DAP pipeline depth %u", cmsis_dap_pipeline_depth);
+		else
+			command_print(CMD, "CMSIS-DAP pipeline depth auto");
+		return ERROR_OK;
+	}
+
+	cmsis_dap_swd_update_pending_depth(cmsis_dap_handle);
+	command_print(CMD, "CMSIS-DAP pipeline depth %u of %u (%s), "
+				  "round trip %u us, %u us per request%s",
+				  cmsis_dap_swd_pending_depth(cmsis_dap_handle),
+				  cmsis_dap_handle->packet_count,
+				  cmsis_dap_pipeline_depth ? "fixed" : "auto",
+				  cmsis_dap_handle->rtt_us, cmsis_dap_handle->service_us,
+				  cmsis_dap_handle->bundle ? ", commands bundled" : "");
+	return ERROR_OK;
+}
+
 static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 	{
 		.name = "info",
@@ -2272,6 +2633,21 @@ static const struct command_registration cmsis_dap_subcommand_handlers[] = {
 		.help = "allow expensive workarounds of known adapter quirks.",
 		.usage = "[enable | disable]",
 	},
+	{
+		.name = "bundle",
+		.handler = &cmsis_dap_handle_bundle_command,
+		.mode = COMMAND_CONFIG,
+		.help = "bundle DAP commands with DAP_ExecuteCommands, if supported.",
+		.usage = "[enable | disable]",
+	},
+	{
+		.name = "pipeline",
+		.handler = &cmsis_dap_handle_pipeline_command,
+		.mode = COMMAND_ANY,
+		.help = "set the maximal number of pending requests, "
+			"or tune it from the measured latencies.",
+		.usage = "['auto' | depth]",
+	},
 #if BUILD_CMSIS_DAP_USB
 	{
 		.name = "usb",
@@ -3,6 +3,7 @@
 #ifndef OPENOCD_JTAG_DRIVERS_CMSIS_DAP_H
 #define OPENOCD_JTAG_DRIVERS_CMSIS_DAP_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 struct cmsis_dap_backend;
@@ -16,12 +17,26 @@ struct pending_transfer_result {
 
 /* Up to MIN(packet_count, MAX_PENDING_REQUESTS) requests may be issued
  * until the first response arrives */
-#define MAX_PENDING_REQUESTS 4
+#define MAX_PENDING_REQUESTS 16
+
+/* One DAP command of a request: a DAP_Transfer, a DAP_TransferBlock or
+ * a DAP_SWD_Sequence, executing the transfers [first, first + count) */
+struct pending_request_segment {
+	uint8_t command;
+	unsigned int first;
+	unsigned int count;
+};
 
 struct pending_request_block {
 	struct pending_transfer_result *transfers;
 	unsigned int transfer_count;
+	/* More than one segment are bundled by DAP_ExecuteCommands */
+	struct pending_request_segment *segments;
+	unsigned int segment_count;
 	uint8_t command;
+	/* Time the request was sent and whether no other one was pending */
+	int64_t sent_us;
+	bool sent_idle;
 };
 
 struct cmsis_dap {
@@ -45,12 +60,29 @@ struct cmsis_dap {
 	uint8_t common_swd_cmd;
 	bool swd_cmds_differ;
 
+	/* With DAP_ExecuteCommands, a packet bundles several DAP commands and
+	 * the sizes of the command and of the response are tracked while
+	 * queuing, along with the number of trailing transfers of the last
+	 * DAP_Transfer using the same DP/AP register */
+	bool bundle;
+	unsigned int bundle_cmd_size;
+	unsigned int bundle_resp_size;
+	unsigned int bundle_run_len;
+
 	/* Pending requests are organized as a FIFO - circular buffer */
 	struct pending_request_block pending_fifo[MAX_PENDING_REQUESTS];
 	unsigned int packet_count;
 	unsigned int pending_fifo_put_idx, pending_fifo_get_idx;
 	unsigned int pending_fifo_block_count;
 
+	/* Requests issued until the first response arrives, tuned from the
+	 * smoothed round trip of a request sent to an idle adapter and from
+	 * the interval between the responses of back-to-back requests */
+	unsigned int pending_depth;
+	unsigned int rtt_us;
+	unsigned int service_us;
+	int64_t last_response_us;
+
 	uint16_t caps;
 	bool quirk_mode;	/* enable expensive workarounds */
 
@@ -44,30 +44,13 @@ static void jtag_callback_queue_reset(void)
 	jtag_callback_queue_tail = NULL;
 }
 
-/**
- * see jtag_add_ir_scan()
- *
- */
-int interface_jtag_add_ir_scan(struct jtag_tap *active,
+/* Fill the fields of an IR scan: @a active gets @a in_fields, other TAPs BYPASS */
+static void jtag_fill_ir_scan(struct scan_command *scan, struct jtag_tap *active,
 		const struct scan_field *in_fields, tap_state_t state)
 {
-	size_t num_taps = jtag_tap_count_enabled();
-
-	struct jtag_command *cmd = cmd_queue_alloc(sizeof(struct jtag_command));
-	struct scan_command *scan = cmd_queue_alloc(sizeof(struct scan_command));
-	struct scan_field *out_fields = cmd_queue_alloc(num_taps  * sizeof(struct scan_field));
-
-	jtag_queue_command(cmd);
-
-	cmd->type = JTAG_SCAN;
-	cmd->cmd.scan = scan;
-
-	scan->ir_scan = true;
-	scan->num_fields = num_taps;	/* one field per device */
-	scan->fields = out_fields;
 	scan->end_state = state;
 
-	struct scan_field *field = out_fields;	/* keep track where we insert data */
+	struct scan_field *field = scan->fields;	/* keep track where we insert data */
 
 	/* loop over all enabled TAPs */
 
@@ -101,7 +84,47 @@ int interface_jtag_add_ir_scan(struct jtag_tap *active,
 		field++;
 	}
 	/* paranoia: jtag_tap_count_enabled() and jtag_tap_next_enabled() not in sync */
-	assert(field == out_fields + num_taps);
+	assert(field == scan->fields + scan->num_fields);
+}
+
+/**
+ * see jtag_add_ir_scan()
+ *
+ */
+int interface_jtag_add_ir_scan(struct jtag_tap *active,
+		const struct scan_field *in_fields, tap_state_t state)
+{
+	size_t num_taps = jtag_tap_count_enabled();
+
+	struct jtag_command *cmd = cmd_queue_alloc(sizeof(struct jtag_command));
+	struct scan_command *scan = cmd_queue_alloc(sizeof(struct scan_command));
+	struct scan_field *out_fields = cmd_queue_alloc(num_taps  * sizeof(struct scan_field));
+
+	jtag_queue_command(cmd);
+
+	cmd->type = JTAG_SCAN;
+	cmd->cmd.scan = scan;
+
+	scan->ir_scan = true;
+	scan->num_fields = num_taps;	/* one field per device */
+	scan->fields = out_fields;
+
+	jtag_fill_ir_scan(scan, active, in_fields, state);
+
+	return ERROR_OK;
+}
+
+/**
+ * Replace the values shifted by an IR scan still in the queue, as if it
+ * had been queued by interface_jtag_add_ir_scan() with these arguments.
+ */
+int interface_jtag_replace_ir_scan(struct jtag_command *cmd, struct jtag_tap *active,
+		const struct scan_field *in_fields, tap_state_t state)
+{
+	assert(cmd->type == JTAG_SCAN && cmd->cmd.scan->ir_scan);
+	assert(cmd->cmd.scan->num_fields == (int)jtag_tap_count_enabled());
+
+	jtag_fill_ir_scan(cmd->cmd.scan, active, in_fields, state);
 
 	return ERROR_OK;
 }
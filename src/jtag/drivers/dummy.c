@@ -22,6 +22,14 @@ static int clock_count;		/* count clocks in any stable state, only stable states
 
 static uint32_t dummy_data;
 
+/* values loaded on Capture-DR, see "dummy dr_capture" */
+static bool dummy_dr_capture_enabled;
+static uint32_t dummy_dr_capture;
+static uint32_t dummy_idcode = 0x00000001;
+
+/* IR has been shifted since the TAP was reset, i.e. IDCODE is no longer selected */
+static bool dummy_ir_scanned;
+
 static bb_value_t dummy_read(void)
 {
 	int data = 1 & dummy_data;
@@ -49,6 +57,12 @@ static int dummy_write(int tck, int tms, int tdi)
 				if (dummy_state == TAP_DRCAPTURE)
 					dummy_data = 0x01255043;
 #endif
+				if (dummy_state == TAP_RESET)
+					dummy_ir_scanned = false;
+				else if (dummy_state == TAP_IRSHIFT)
+					dummy_ir_scanned = true;
+				else if (dummy_state == TAP_DRCAPTURE && dummy_dr_capture_enabled)
+					dummy_data = dummy_ir_scanned ? dummy_dr_capture : dummy_idcode;
 			} else {
 				/* this is a stable state clock edge, no change of state here,
 				 * simply increment clock_count for subsequent logging
@@ -65,8 +79,10 @@ static int dummy_reset(int trst, int srst)
 {
 	dummy_clock = 0;
 
-	if (trst || (srst && (jtag_get_reset_config() & RESET_SRST_PULLS_TRST)))
+	if (trst || (srst && (jtag_get_reset_config() & RESET_SRST_PULLS_TRST))) {
 		dummy_state = TAP_RESET;
+		dummy_ir_scanned = false;
+	}
 
 	LOG_DEBUG("reset to: %s", tap_state_name(dummy_state));
 	return ERROR_OK;
@@ -119,12 +135,48 @@ static int dummy_quit(void)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(dummy_handle_dr_capture_command)
+{
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "off")) {
+		dummy_dr_capture_enabled = false;
+	} else if (CMD_ARGC > 0) {
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], dummy_dr_capture);
+		if (CMD_ARGC == 2)
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], dummy_idcode);
+		dummy_dr_capture_enabled = true;
+	}
+
+	if (dummy_dr_capture_enabled)
+		command_print(CMD, "0x%08" PRIx32 " 0x%08" PRIx32, dummy_dr_capture, dummy_idcode);
+	else
+		command_print(CMD, "off");
+
+	return ERROR_OK;
+}
+
+static const struct command_registration dummy_subcommand_handlers[] = {
+	{
+		.name = "dr_capture",
+		.handler = dummy_handle_dr_capture_command,
+		.mode = COMMAND_ANY,
+		.help = "set the values captured by the data registers on Capture-DR",
+		.usage = "[(value [idcode])|'off']",
+	},
+	{
+		.chain = hello_command_handlers,
+	},
+	COMMAND_REGISTRATION_DONE,
+};
+
 static const struct command_registration dummy_command_handlers[] = {
 	{
 		.name = "dummy",
 		.mode = COMMAND_ANY,
 		.help = "dummy interface driver commands",
-		.chain = hello_command_handlers,
+		.chain = dummy_subcommand_handlers,
 		.usage = "",
 	},
 	COMMAND_REGISTRATION_DONE,
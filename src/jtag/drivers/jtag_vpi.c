@@ -38,6 +38,9 @@
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
 
+/* Commands sent at once, and replies waited for at once, when pipelining */
+#define PIPELINE_DEPTH		32
+
 /* jtag_vpi server port and address to connect to */
 static int server_port = DEFAULT_SERVER_PORT;
 static char *server_address;
@@ -45,6 +48,9 @@ static char *server_address;
 /* Send CMD_STOP_SIMU to server when OpenOCD exits? */
 static bool stop_sim_on_exit;
 
+/* Send the commands of a JTAG queue without waiting for each reply? */
+static bool pipeline;
+
 static int sockfd;
 static struct sockaddr_in serv_addr;
 
@@ -66,6 +72,30 @@ struct vpi_cmd {
 	};
 };
 
+/* Commands not sent yet, when pipelining */
+static struct vpi_cmd send_queue[PIPELINE_DEPTH];
+static unsigned int send_queue_count;
+
+/* Where to copy the TDO data of the scan commands waiting for their reply */
+struct vpi_pending_xfer {
+	uint8_t *bits;
+	int nb_bytes;
+	int nb_bits;
+};
+
+static struct vpi_pending_xfer pending_xfers[PIPELINE_DEPTH];
+static unsigned int pending_xfers_count;
+
+/* Scans waiting for the end of the queue to be checked and freed */
+struct vpi_pending_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+};
+
+static struct vpi_pending_scan *pending_scans;
+static unsigned int pending_scans_count;
+static unsigned int pending_scans_size;
+
 static char *jtag_vpi_cmd_to_str(int cmd_num)
 {
 	switch (cmd_num) {
@@ -84,10 +114,11 @@ static char *jtag_vpi_cmd_to_str(int cmd_num)
 	}
 }
 
+static int jtag_vpi_write(const void *buf, size_t size);
+static int jtag_vpi_flush(void);
+
 static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
 {
-	int retval;
-
 	/* Optional low-level JTAG debug */
 	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
 		if (vpi->nb_bits > 0) {
@@ -125,8 +156,24 @@ static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
 	h_u32_to_le(vpi->length_buf, vpi->length);
 	h_u32_to_le(vpi->nb_bits_buf, vpi->nb_bits);
 
+	if (pipeline) {
+		/* sent with the next commands by jtag_vpi_flush() */
+		send_queue[send_queue_count++] = *vpi;
+		if (send_queue_count == PIPELINE_DEPTH)
+			return jtag_vpi_flush();
+		return ERROR_OK;
+	}
+
+	return jtag_vpi_write(vpi, sizeof(struct vpi_cmd));
+}
+
+static int jtag_vpi_write(const void *buf, size_t size)
+{
+	const char *data = buf;
+	int retval;
+
 retry_write:
-	retval = write_socket(sockfd, vpi, sizeof(struct vpi_cmd));
+	retval = write_socket(sockfd, data, size);
 
 	if (retval < 0) {
 		/* Account for the case when socket write is interrupted. */
@@ -144,12 +191,17 @@ retry_write:
 		/* TODO: Clean way how adapter drivers can report fatal errors
 		   to upper layers of OpenOCD and let it perform an orderly shutdown? */
 		exit(-1);
-	} else if (retval < (int)sizeof(struct vpi_cmd)) {
+	} else if (retval == 0) {
 		/* This means we could not send all data, which is most likely fatal
 		   for the jtag_vpi connection (the underlying TCP connection likely not
 		   usable anymore) */
 		LOG_ERROR("jtag_vpi: Could not send all data through jtag_vpi connection.");
 		exit(-1);
+	} else if ((size_t)retval < size) {
+		/* A large write may be split, send the rest */
+		data += retval;
+		size -= retval;
+		goto retry_write;
 	}
 
 	/* Otherwise the packet has been sent successfully. */
@@ -195,6 +247,51 @@ static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
 	return ERROR_OK;
 }
 
+/* Send the queued commands at once */
+static int jtag_vpi_flush(void)
+{
+	if (!send_queue_count)
+		return ERROR_OK;
+
+	int retval = jtag_vpi_write(send_queue, send_queue_count * sizeof(struct vpi_cmd));
+	send_queue_count = 0;
+	return retval;
+}
+
+static void jtag_vpi_log_buffer_in(const struct vpi_cmd *vpi, int nb_bits)
+{
+	/* Optional low-level JTAG debug */
+	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
+		char *char_buf = buf_to_hex_str(vpi->buffer_in,
+				(nb_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : nb_bits);
+		LOG_DEBUG_IO("recvd JTAG VPI data: nb_bits=%d, buf_in=0x%s%s",
+			nb_bits, char_buf, (nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
+		free(char_buf);
+	}
+}
+
+/* Send the queued commands and receive the replies of all the scans sent */
+static int jtag_vpi_complete(void)
+{
+	struct vpi_cmd vpi;
+
+	int retval = jtag_vpi_flush();
+
+	for (unsigned int i = 0; retval == ERROR_OK && i < pending_xfers_count; i++) {
+		retval = jtag_vpi_receive_cmd(&vpi);
+		if (retval != ERROR_OK)
+			break;
+
+		jtag_vpi_log_buffer_in(&vpi, pending_xfers[i].nb_bits);
+		if (pending_xfers[i].bits)
+			memcpy(pending_xfers[i].bits, vpi.buffer_in, pending_xfers[i].nb_bytes);
+	}
+	/* on error, the replies not received yet are dropped */
+	pending_xfers_count = 0;
+
+	return retval;
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @param trst 1 if TRST is to be asserted
@@ -207,7 +304,11 @@ static int jtag_vpi_reset(int trst, int srst)
 
 	vpi.cmd = CMD_RESET;
 	vpi.length = 0;
-	return jtag_vpi_send_cmd(&vpi);
+	int retval = jtag_vpi_send_cmd(&vpi);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return jtag_vpi_flush();
 }
 
 /**
@@ -310,18 +411,22 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
 	if (retval != ERROR_OK)
 		return retval;
 
+	if (pipeline) {
+		/* the reply is received by jtag_vpi_complete() */
+		struct vpi_pending_xfer *xfer = &pending_xfers[pending_xfers_count++];
+		xfer->bits = bits;
+		xfer->nb_bytes = nb_bytes;
+		xfer->nb_bits = nb_bits;
+		if (pending_xfers_count == PIPELINE_DEPTH)
+			return jtag_vpi_complete();
+		return ERROR_OK;
+	}
+
 	retval = jtag_vpi_receive_cmd(&vpi);
 	if (retval != ERROR_OK)
 		return retval;
 
-	/* Optional low-level JTAG debug */
-	if (LOG_LEVEL_IS(LOG_LVL_DEBUG_IO)) {
-		char *char_buf = buf_to_hex_str(vpi.buffer_in,
-				(nb_bits > DEBUG_JTAG_IOZ) ? DEBUG_JTAG_IOZ : nb_bits);
-		LOG_DEBUG_IO("recvd JTAG VPI data: nb_bits=%d, buf_in=0x%s%s",
-			nb_bits, char_buf, (nb_bits > DEBUG_JTAG_IOZ) ? "(...)" : "");
-		free(char_buf);
-	}
+	jtag_vpi_log_buffer_in(&vpi, nb_bits);
 
 	if (bits)
 		memcpy(bits, vpi.buffer_in, nb_bytes);
@@ -374,6 +479,46 @@ static int jtag_vpi_clock_tms(int tms)
 	return jtag_vpi_tms_seq(tms ? &tms_1 : &tms_0, 1);
 }
 
+static int jtag_vpi_add_pending_scan(struct scan_command *cmd, uint8_t *buf)
+{
+	if (pending_scans_count == pending_scans_size) {
+		unsigned int size = pending_scans_size ? 2 * pending_scans_size : 64;
+		struct vpi_pending_scan *p = realloc(pending_scans, size * sizeof(*p));
+		if (!p) {
+			LOG_ERROR("jtag_vpi: unable to allocate memory");
+			return ERROR_FAIL;
+		}
+		pending_scans = p;
+		pending_scans_size = size;
+	}
+
+	pending_scans[pending_scans_count].cmd = cmd;
+	pending_scans[pending_scans_count].buf = buf;
+	pending_scans_count++;
+	return ERROR_OK;
+}
+
+/*
+ * Receive the TDO data of the pending scans, then check and free them.
+ * The pending transfers point into the scan buffers, so they are
+ * completed even when the queue failed.
+ */
+static int jtag_vpi_complete_scans(int retval)
+{
+	int complete_retval = jtag_vpi_complete();
+	if (retval == ERROR_OK)
+		retval = complete_retval;
+
+	for (unsigned int i = 0; i < pending_scans_count; i++) {
+		if (retval == ERROR_OK)
+			retval = jtag_read_buffer(pending_scans[i].buf, pending_scans[i].cmd);
+		free(pending_scans[i].buf);
+	}
+	pending_scans_count = 0;
+
+	return retval;
+}
+
 /**
  * jtag_vpi_scan - launches a DR-scan or IR-scan
  * @param cmd the command to launch
@@ -390,6 +535,15 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 
 	scan_bits = jtag_build_buffer(cmd, &buf);
 
+	if (pipeline) {
+		/* checked at the end of the queue, once the TDO data is received */
+		retval = jtag_vpi_add_pending_scan(cmd, buf);
+		if (retval != ERROR_OK) {
+			free(buf);
+			return retval;
+		}
+	}
+
 	if (cmd->ir_scan) {
 		retval = jtag_vpi_state_move(TAP_IRSHIFT);
 		if (retval != ERROR_OK)
@@ -425,11 +579,13 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			tap_set_state(TAP_DRPAUSE);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
+	if (!pipeline) {
+		retval = jtag_read_buffer(buf, cmd);
+		if (retval != ERROR_OK)
+			return retval;
 
-	free(buf);
+		free(buf);
+	}
 
 	if (cmd->end_state != TAP_DRSHIFT) {
 		retval = jtag_vpi_state_move(cmd->end_state);
@@ -508,6 +664,7 @@ static int jtag_vpi_execute_queue(struct jtag_command *cmd_queue)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
+			retval = jtag_vpi_complete();
 			jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
@@ -521,7 +678,7 @@ static int jtag_vpi_execute_queue(struct jtag_command *cmd_queue)
 		}
 	}
 
-	return retval;
+	return jtag_vpi_complete_scans(retval);
 }
 
 static int jtag_vpi_init(void)
@@ -574,7 +731,11 @@ static int jtag_vpi_stop_simulation(void)
 	cmd.length = 0;
 	cmd.nb_bits = 0;
 	cmd.cmd = CMD_STOP_SIMU;
-	return jtag_vpi_send_cmd(&cmd);
+	int retval = jtag_vpi_send_cmd(&cmd);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return jtag_vpi_flush();
 }
 
 static int jtag_vpi_quit(void)
@@ -624,6 +785,18 @@ COMMAND_HANDLER(jtag_vpi_stop_sim_on_exit_handler)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_pipeline_handler)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_ON_OFF(CMD_ARGV[0], pipeline);
+
+	command_print(CMD, "jtag_vpi pipeline is %s", pipeline ? "on" : "off");
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 	{
 		.name = "set_port",
@@ -647,6 +820,15 @@ static const struct command_registration jtag_vpi_subcommand_handlers[] = {
 			"before OpenOCD exits (default: off)",
 		.usage = "<on|off>",
 	},
+	{
+		.name = "pipeline",
+		.handler = &jtag_vpi_pipeline_handler,
+		.mode = COMMAND_ANY,
+		.help = "Send all the commands of a JTAG queue before receiving "
+			"the TDO data, for servers which process the commands in "
+			"order (default: off)",
+		.usage = "[<on|off>]",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
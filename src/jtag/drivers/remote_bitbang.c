@@ -18,20 +18,49 @@
 #endif
 #include "helper/system.h"
 #include "helper/replacements.h"
+#include "helper/binarybuffer.h"
+#include "helper/bits.h"
+#include "helper/time_support.h"
 #include <jtag/interface.h>
 #include "bitbang.h"
 
 /* arbitrary limit on host name length: */
 #define REMOTE_BITBANG_HOST_MAX 255
 
+/* Vector extension of the protocol, see doc/manual/jtag/drivers/remote_bitbang.txt */
+#define REMOTE_BITBANG_VECTOR_VERSION	'1'
+#define REMOTE_BITBANG_VECTOR_TIMEOUT	1000	/* ms to wait for the server reply */
+#define REMOTE_BITBANG_VECTOR_MAX_BITS	4096	/* per message */
+#define REMOTE_BITBANG_VECTOR_HEADER	4
+
+#define REMOTE_BITBANG_VECTOR_OUT1		BIT(0)	/* TMS values follow */
+#define REMOTE_BITBANG_VECTOR_OUT2		BIT(1)	/* TDI or SWDIO values follow */
+#define REMOTE_BITBANG_VECTOR_CAPTURE	BIT(2)	/* reply with the TDO or SWDIO values */
+
+/* Vectors waiting for their reply */
+#define REMOTE_BITBANG_PENDING_MAX		64
+/* Replies in flight, small enough to fit in the socket buffers */
+#define REMOTE_BITBANG_PENDING_MAX_BYTES	16384
+
 static char *remote_bitbang_host;
 static char *remote_bitbang_port;
 
 static int remote_bitbang_fd;
-static uint8_t remote_bitbang_send_buf[512];
+static uint8_t remote_bitbang_send_buf[2048];
 static unsigned int remote_bitbang_send_buf_used;
 
 static bool use_remote_sleep;
+static bool use_vectors;
+
+struct remote_bitbang_pending {
+	uint8_t *buf;
+	unsigned int offset;
+	unsigned int bits;
+};
+
+static struct remote_bitbang_pending remote_bitbang_pending[REMOTE_BITBANG_PENDING_MAX];
+static unsigned int remote_bitbang_pending_count;
+static unsigned int remote_bitbang_pending_bytes;
 
 /* Circular buffer. When start == end, the buffer is empty. */
 static char remote_bitbang_recv_buf[256];
@@ -73,6 +102,18 @@ static int remote_bitbang_flush(void)
 	while (offset < remote_bitbang_send_buf_used) {
 		ssize_t written = write_socket(remote_bitbang_fd, remote_bitbang_send_buf + offset,
 									   remote_bitbang_send_buf_used - offset);
+#ifdef _WIN32
+		if (written < 0 && WSAGetLastError() == WSAEWOULDBLOCK) {
+#else
+		if (written < 0 && errno == EAGAIN) {
+#endif
+			/* the socket is non-blocking, wait for the server to catch up */
+			fd_set wfds;
+			FD_ZERO(&wfds);
+			FD_SET(remote_bitbang_fd, &wfds);
+			socket_select(remote_bitbang_fd + 1, NULL, &wfds, NULL, NULL);
+			continue;
+		}
 		if (written < 0) {
 			log_socket_error("remote_bitbang_putc");
 			remote_bitbang_send_buf_used = 0;
@@ -152,6 +193,120 @@ static int remote_bitbang_queue(int c, flush_bool_t flush)
 	return ERROR_OK;
 }
 
+/* Read @a size bytes of replies, blocking until they are all received */
+static int remote_bitbang_read_bytes(uint8_t *buf, unsigned int size)
+{
+	while (size) {
+		if (remote_bitbang_recv_buf_empty()) {
+			if (remote_bitbang_fill_buf(BLOCK) != ERROR_OK)
+				return ERROR_FAIL;
+			continue;
+		}
+
+		unsigned int end = remote_bitbang_recv_buf_end;
+		if (end < remote_bitbang_recv_buf_start)
+			end = sizeof(remote_bitbang_recv_buf);
+		unsigned int count = MIN(size, end - remote_bitbang_recv_buf_start);
+
+		memcpy(buf, remote_bitbang_recv_buf + remote_bitbang_recv_buf_start, count);
+		remote_bitbang_recv_buf_start =
+			(remote_bitbang_recv_buf_start + count) % sizeof(remote_bitbang_recv_buf);
+		buf += count;
+		size -= count;
+	}
+
+	return ERROR_OK;
+}
+
+/* Send the queued requests and wait for the replies of all the vectors */
+static int remote_bitbang_complete(void)
+{
+	static uint8_t reply[REMOTE_BITBANG_VECTOR_MAX_BITS / 8];
+	int retval = remote_bitbang_flush();
+
+	for (unsigned int i = 0; i < remote_bitbang_pending_count; i++) {
+		struct remote_bitbang_pending *p = &remote_bitbang_pending[i];
+
+		if (retval == ERROR_OK)
+			retval = remote_bitbang_read_bytes(reply, DIV_ROUND_UP(p->bits, 8));
+		if (retval == ERROR_OK)
+			buf_set_buf(reply, 0, p->buf, p->offset, p->bits);
+	}
+	remote_bitbang_pending_count = 0;
+	remote_bitbang_pending_bytes = 0;
+
+	return retval;
+}
+
+/*
+ * Queue a vector message, split in messages of at most
+ * REMOTE_BITBANG_VECTOR_MAX_BITS bits. @a out1 and @a out2 hold TMS and TDI,
+ * or NULL and SWDIO, starting at bit @a offset; the reply is stored in @a in
+ * from the same bit.
+ */
+static int remote_bitbang_queue_vector(char c, unsigned int bits, const uint8_t *out1,
+		const uint8_t *out2, uint8_t *in, unsigned int offset)
+{
+	while (bits) {
+		unsigned int n = MIN(bits, REMOTE_BITBANG_VECTOR_MAX_BITS);
+		unsigned int bytes = DIV_ROUND_UP(n, 8);
+		unsigned int size = REMOTE_BITBANG_VECTOR_HEADER +
+			(out1 ? bytes : 0) + (out2 ? bytes : 0);
+
+		if (in && (remote_bitbang_pending_count == REMOTE_BITBANG_PENDING_MAX ||
+				remote_bitbang_pending_bytes + bytes > REMOTE_BITBANG_PENDING_MAX_BYTES)) {
+			if (remote_bitbang_complete() != ERROR_OK)
+				return ERROR_FAIL;
+		}
+		if (remote_bitbang_send_buf_used + size > sizeof(remote_bitbang_send_buf)) {
+			if (remote_bitbang_flush() != ERROR_OK)
+				return ERROR_FAIL;
+		}
+
+		uint8_t *msg = remote_bitbang_send_buf + remote_bitbang_send_buf_used;
+		memset(msg, 0, size);
+		msg[0] = c;
+		h_u16_to_le(msg + 1, n);
+		msg[3] = (out1 ? REMOTE_BITBANG_VECTOR_OUT1 : 0) |
+			(out2 ? REMOTE_BITBANG_VECTOR_OUT2 : 0) |
+			(in ? REMOTE_BITBANG_VECTOR_CAPTURE : 0);
+		msg += REMOTE_BITBANG_VECTOR_HEADER;
+		if (out1) {
+			buf_set_buf(out1, offset, msg, 0, n);
+			msg += bytes;
+		}
+		if (out2)
+			buf_set_buf(out2, offset, msg, 0, n);
+		remote_bitbang_send_buf_used += size;
+
+		if (in) {
+			struct remote_bitbang_pending *p =
+				&remote_bitbang_pending[remote_bitbang_pending_count++];
+			p->buf = in;
+			p->offset = offset;
+			p->bits = n;
+			remote_bitbang_pending_bytes += bytes;
+		}
+
+		bits -= n;
+		offset += n;
+	}
+
+	return ERROR_OK;
+}
+
+static int remote_bitbang_vector(unsigned int bits, const uint8_t *tms,
+		const uint8_t *tdi, uint8_t *tdo)
+{
+	return remote_bitbang_queue_vector('J', bits, tms, tdi, tdo, 0);
+}
+
+static int remote_bitbang_swd_vector(unsigned int bits, const uint8_t *out,
+		uint8_t *in, unsigned int offset)
+{
+	return remote_bitbang_queue_vector('W', bits, NULL, out, in, offset);
+}
+
 static int remote_bitbang_quit(void)
 {
 	if (remote_bitbang_queue('Q', FLUSH_SEND_BUF) == ERROR_FAIL)
@@ -193,6 +348,10 @@ static int remote_bitbang_sample(void)
 
 static bb_value_t remote_bitbang_read_sample(void)
 {
+	/* the replies of the vectors come first */
+	if (remote_bitbang_pending_count && remote_bitbang_complete() != ERROR_OK)
+		return BB_ERROR;
+
 	if (remote_bitbang_recv_buf_empty()) {
 		if (remote_bitbang_fill_buf(BLOCK) != ERROR_OK)
 			return BB_ERROR;
@@ -253,12 +412,16 @@ static int remote_bitbang_blink(int on)
 static void remote_bitbang_swdio_drive(bool is_output)
 {
 	char c = is_output ? 'O' : 'o';
-	if (remote_bitbang_queue(c, FLUSH_SEND_BUF) == ERROR_FAIL)
+	/* with vectors, the direction is sent along with the next vector */
+	if (remote_bitbang_queue(c, use_vectors ? NO_FLUSH : FLUSH_SEND_BUF) == ERROR_FAIL)
 		LOG_ERROR("Error setting direction for swdio");
 }
 
 static int remote_bitbang_swdio_read(void)
 {
+	if (remote_bitbang_pending_count && remote_bitbang_complete() != ERROR_OK)
+		return BB_ERROR;
+
 	if (remote_bitbang_queue('c', FLUSH_SEND_BUF) != ERROR_FAIL)
 		return remote_bitbang_read_sample();
 	else
@@ -281,7 +444,7 @@ static struct bitbang_interface remote_bitbang_bitbang = {
 	.swd_write = &remote_bitbang_swd_write,
 	.blink = &remote_bitbang_blink,
 	.sleep = &remote_bitbang_sleep,
-	.flush = &remote_bitbang_flush,
+	.flush = &remote_bitbang_complete,
 };
 
 static int remote_bitbang_init_tcp(void)
@@ -361,6 +524,54 @@ static int remote_bitbang_init_unix(void)
 	return fd;
 }
 
+/*
+ * Ask the server for the vector extension: a server implementing it replies
+ * 'V' and the version of the extension, others ignore the request.
+ */
+static bool remote_bitbang_negotiate_vectors(void)
+{
+	uint8_t reply[2];
+	unsigned int received = 0;
+	int64_t timeout = timeval_ms() + REMOTE_BITBANG_VECTOR_TIMEOUT;
+
+	if (remote_bitbang_queue('V', FLUSH_SEND_BUF) != ERROR_OK)
+		return false;
+
+	while (received < sizeof(reply)) {
+		if (remote_bitbang_fill_buf(NO_BLOCK) != ERROR_OK)
+			return false;
+
+		while (received < sizeof(reply) && !remote_bitbang_recv_buf_empty()) {
+			reply[received++] = remote_bitbang_recv_buf[remote_bitbang_recv_buf_start];
+			remote_bitbang_recv_buf_start =
+				(remote_bitbang_recv_buf_start + 1) % sizeof(remote_bitbang_recv_buf);
+		}
+		if (received == sizeof(reply))
+			break;
+
+		int64_t remaining = timeout - timeval_ms();
+		if (remaining <= 0)
+			break;
+
+		fd_set rfds;
+		FD_ZERO(&rfds);
+		FD_SET(remote_bitbang_fd, &rfds);
+		struct timeval tv = {
+			.tv_sec = remaining / 1000,
+			.tv_usec = (remaining % 1000) * 1000,
+		};
+		socket_select(remote_bitbang_fd + 1, &rfds, NULL, NULL, &tv);
+	}
+
+	if (received < sizeof(reply) || reply[0] != 'V' || reply[1] < REMOTE_BITBANG_VECTOR_VERSION) {
+		if (received)
+			LOG_WARNING("remote_bitbang: invalid reply to the vector request");
+		return false;
+	}
+
+	return true;
+}
+
 static int remote_bitbang_init(void)
 {
 	bitbang_interface = &remote_bitbang_bitbang;
@@ -379,6 +590,16 @@ static int remote_bitbang_init(void)
 
 	socket_nonblock(remote_bitbang_fd);
 
+	remote_bitbang_pending_count = 0;
+	remote_bitbang_pending_bytes = 0;
+	if (use_vectors && !remote_bitbang_negotiate_vectors()) {
+		LOG_INFO("remote_bitbang: vectors not supported by the server, "
+			"falling back to the character protocol");
+		use_vectors = false;
+	}
+	remote_bitbang_bitbang.vector = use_vectors ? &remote_bitbang_vector : NULL;
+	remote_bitbang_bitbang.swd_vector = use_vectors ? &remote_bitbang_swd_vector : NULL;
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -417,6 +638,16 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_use_remote_sleep_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_vectors_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], use_vectors);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration remote_bitbang_subcommand_handlers[] = {
 	{
 		.name = "port",
@@ -442,6 +673,14 @@ static const struct command_registration remote_bitbang_subcommand_handlers[] =
 			"instruction stream for the remote host.",
 		.usage = "(on|off)",
 	},
+	{
+		.name = "vectors",
+		.handler = remote_bitbang_handle_remote_bitbang_vectors_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Send whole JTAG scans and SWD transfers in binary messages, "
+			"if the remote host supports them.",
+		.usage = "(on|off)",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
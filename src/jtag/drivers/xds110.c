@@ -14,6 +14,7 @@
 #include <jtag/interface.h>
 #include <jtag/commands.h>
 #include <jtag/tcl.h>
+#include <helper/time_support.h>
 #include <libusb.h>
 
 /* XDS110 stand-alone probe voltage supply limits */
@@ -53,6 +54,12 @@
 #endif
 #define MAX_RESULT_QUEUE (MAX_DATA_BLOCK / 4)
 
+/*
+ * Number of request blocks that may be in flight to the XDS110 at once
+ * when the USB pipeline is enabled
+ */
+#define XDS110_PIPELINE_DEPTH 2
+
 /***************************************************************************
  *   XDS110 Firmware API Definitions                                       *
  ***************************************************************************/
@@ -222,6 +229,30 @@ struct scan_result {
 	uint32_t num_bits;
 };
 
+/* Block of OCD scan or DAP requests sent with asynchronous USB transfers */
+struct xds110_pipeline_block {
+	struct libusb_transfer *write_transfer;
+	struct libusb_transfer *read_transfer;
+	unsigned char write_packet[3 + USB_PAYLOAD_SIZE];
+	unsigned char read_buffer[MAX_PACKET];
+	unsigned char read_payload[USB_PAYLOAD_SIZE];
+	/* Response payload size from the header, and bytes received so far */
+	uint32_t read_size;
+	uint32_t read_count;
+	/* Expected response payload size */
+	uint32_t in_length;
+	/* Results of the block, copied from the transaction queue */
+	uint8_t command;
+	uint32_t *dap_results[MAX_RESULT_QUEUE];
+	struct scan_result scan_results[MAX_RESULT_QUEUE];
+	uint32_t result_count;
+	/* Status flags */
+	bool write_done;
+	bool read_submitted;
+	bool read_done;
+	bool failed;
+};
+
 struct xds110_info {
 	/* USB connection handles and data buffers */
 	struct libusb_context *ctx;
@@ -261,6 +292,13 @@ struct xds110_info {
 	uint32_t txn_request_size;
 	uint32_t txn_result_size;
 	uint32_t txn_result_count;
+	/* Asynchronous USB pipeline */
+	bool use_pipeline;
+	bool pipeline_error;
+	bool pipeline_cancel;
+	struct xds110_pipeline_block pipeline[XDS110_PIPELINE_DEPTH];
+	uint32_t pipeline_head;
+	uint32_t pipeline_count;
 };
 
 static struct xds110_info xds110 = {
@@ -283,7 +321,12 @@ static struct xds110_info xds110 = {
 	.hardware = 0,
 	.txn_request_size = 0,
 	.txn_result_size = 0,
-	.txn_result_count = 0
+	.txn_result_count = 0,
+	.use_pipeline = false,
+	.pipeline_error = false,
+	.pipeline_cancel = false,
+	.pipeline_head = 0,
+	.pipeline_count = 0
 };
 
 static inline void xds110_set_u32(uint8_t *buffer, uint32_t value)
@@ -461,6 +504,13 @@ static bool usb_connect(void)
 
 static void usb_disconnect(void)
 {
+	for (unsigned int i = 0; i < XDS110_PIPELINE_DEPTH; i++) {
+		libusb_free_transfer(xds110.pipeline[i].write_transfer);
+		libusb_free_transfer(xds110.pipeline[i].read_transfer);
+		xds110.pipeline[i].write_transfer = NULL;
+		xds110.pipeline[i].read_transfer = NULL;
+	}
+
 	if (xds110.dev) {
 		/* Release the debug and data interface on the XDS110 */
 		(void)libusb_release_interface(xds110.dev, xds110.interface);
@@ -503,13 +553,13 @@ static bool usb_write(unsigned char *buffer, int size, int *written)
 		return false;
 
 	result = libusb_bulk_transfer(xds110.dev, xds110.endpoint_out, buffer,
-				size, &bytes_written, 0);
+				size, &bytes_written, DEFAULT_TIMEOUT);
 
 	while (result == LIBUSB_ERROR_PIPE && retries < 3) {
 		/* Try clearing the pipe stall and retry transfer */
 		libusb_clear_halt(xds110.dev, xds110.endpoint_out);
 		result = libusb_bulk_transfer(xds110.dev, xds110.endpoint_out, buffer,
-					size, &bytes_written, 0);
+					size, &bytes_written, DEFAULT_TIMEOUT);
 		retries++;
 	}
 
@@ -620,6 +670,364 @@ static bool usb_send_command(uint16_t size)
 	return usb_write(xds110.write_packet, (int)size, NULL);
 }
 
+/***************************************************************************
+ *   usb pipeline routines                                                 *
+ *                                                                         *
+ *   The following functions send blocks of OCD scan or DAP requests with  *
+ *   asynchronous libusb transfers, so the next block can be built and     *
+ *   queued while the XDS110 is still processing the previous one. The     *
+ *   responses come back in order; only the oldest block waiting for its   *
+ *   response has a read transfer submitted at any time.                   *
+ ***************************************************************************/
+
+static void xds110_copy_scan_results(uint8_t *data_in,
+	struct scan_result *results, uint32_t count)
+{
+	uint32_t bits = 0; /* Bit offset into current scan result */
+
+	for (uint32_t result = 0; result < count; result++) {
+		if (results[result].first) {
+			data_in += DIV_ROUND_UP(bits, 8);
+			bits = 0;
+		}
+		if (results[result].buffer)
+			bit_copy(results[result].buffer, 0, data_in, bits,
+				results[result].num_bits);
+		bits += results[result].num_bits;
+	}
+}
+
+static void xds110_copy_dap_results(uint8_t *data_in, uint32_t **results,
+	uint32_t count)
+{
+	for (uint32_t result = 0; result < count; result++)
+		if (results[result])
+			*results[result] = xds110_get_u32(&data_in[result * 4]);
+}
+
+static inline bool xds110_use_pipeline(void)
+{
+	return xds110.use_pipeline && xds110.firmware >= OCD_FIRMWARE_VERSION;
+}
+
+static void usb_pipeline_start_read(void);
+
+static void LIBUSB_CALL usb_pipeline_write_callback(
+	struct libusb_transfer *transfer)
+{
+	struct xds110_pipeline_block *block = transfer->user_data;
+
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED ||
+		transfer->actual_length != transfer->length) {
+		block->failed = true;
+		/* The XDS110 won't respond to a command it did not receive */
+		if (!block->read_submitted)
+			block->read_done = true;
+	}
+	block->write_done = true;
+
+	usb_pipeline_start_read();
+}
+
+static void LIBUSB_CALL usb_pipeline_read_callback(
+	struct libusb_transfer *transfer)
+{
+	struct xds110_pipeline_block *block = transfer->user_data;
+	unsigned char *buffer = transfer->buffer;
+	uint32_t bytes_read = transfer->actual_length;
+	uint16_t size;
+
+	/* A cancelled pipeline must not resubmit the transfer */
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED ||
+		xds110.pipeline_cancel) {
+		block->failed = true;
+		block->read_done = true;
+		usb_pipeline_start_read();
+		return;
+	}
+
+	if (block->read_size == 0) {
+		/* Same validation of the response packet as usb_get_response() */
+		if (bytes_read >= 7 && '*' == buffer[0]) {
+			size = xds110_get_u16(&buffer[1]);
+			if (USB_PAYLOAD_SIZE >= size && 4 <= size &&
+				(bytes_read - 3) <= size) {
+				block->read_size = size;
+				block->read_count = bytes_read - 3;
+				memcpy(block->read_payload, &buffer[3], block->read_count);
+			}
+		}
+		/*
+		 * On an invalid packet, retry till we time out or a valid
+		 * response packet is received
+		 */
+	} else if ((block->read_count + bytes_read) > block->read_size) {
+		/* Read too much data, not a valid packet, abort */
+		block->failed = true;
+		block->read_done = true;
+		usb_pipeline_start_read();
+		return;
+	} else {
+		memcpy(&block->read_payload[block->read_count], buffer, bytes_read);
+		block->read_count += bytes_read;
+	}
+
+	if (block->read_size == 0 || block->read_count < block->read_size) {
+		/* Once the response has started, the rest should arrive shortly */
+		if (block->read_size != 0)
+			transfer->timeout = 500; /* ms */
+		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS) {
+			block->failed = true;
+			block->read_done = true;
+			usb_pipeline_start_read();
+		}
+		return;
+	}
+
+	block->read_done = true;
+	usb_pipeline_start_read();
+}
+
+/* Submit the read transfer of the oldest block still waiting for a response */
+static void usb_pipeline_start_read(void)
+{
+	struct xds110_pipeline_block *block = NULL;
+
+	if (xds110.pipeline_cancel)
+		return;
+
+	for (uint32_t i = 0; i < xds110.pipeline_count; i++) {
+		block = &xds110.pipeline[(xds110.pipeline_head + i) %
+			XDS110_PIPELINE_DEPTH];
+		if (!block->read_done)
+			break;
+		block = NULL;
+	}
+
+	if (!block || block->read_submitted)
+		return;
+
+	block->read_size = 0;
+	block->read_count = 0;
+
+	libusb_fill_bulk_transfer(block->read_transfer, xds110.dev,
+		xds110.endpoint_in, block->read_buffer, sizeof(block->read_buffer),
+		usb_pipeline_read_callback, block, DEFAULT_TIMEOUT);
+
+	if (libusb_submit_transfer(block->read_transfer) != LIBUSB_SUCCESS) {
+		block->failed = true;
+		block->read_done = true;
+		/* Skip to the next block, it would get this block's response */
+		usb_pipeline_start_read();
+		return;
+	}
+
+	block->read_submitted = true;
+}
+
+static void usb_pipeline_handle_events(void)
+{
+	struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+	int result = libusb_handle_events_timeout_completed(xds110.ctx, &tv, NULL);
+
+	if (result != LIBUSB_SUCCESS && result != LIBUSB_ERROR_INTERRUPTED)
+		LOG_DEBUG("XDS110: libusb event handling failed (%d)", result);
+}
+
+/*
+ * Cancel the transfers of every block in flight and wait for them to
+ * complete. The blocks are marked failed, so retiring them fails the
+ * queue. Once a block is lost, a later block would get the wrong
+ * response, so none of them is kept.
+ */
+static void usb_pipeline_cancel(void)
+{
+	struct xds110_pipeline_block *block;
+	bool done;
+
+	/* Keep the callbacks from submitting new reads */
+	xds110.pipeline_cancel = true;
+
+	for (uint32_t i = 0; i < xds110.pipeline_count; i++) {
+		block = &xds110.pipeline[(xds110.pipeline_head + i) %
+			XDS110_PIPELINE_DEPTH];
+		block->failed = true;
+		if (!block->write_done)
+			libusb_cancel_transfer(block->write_transfer);
+		if (!block->read_submitted)
+			block->read_done = true;
+		else if (!block->read_done)
+			libusb_cancel_transfer(block->read_transfer);
+	}
+
+	/* libusb calls back every cancelled transfer */
+	do {
+		done = true;
+		for (uint32_t i = 0; i < xds110.pipeline_count; i++) {
+			block = &xds110.pipeline[(xds110.pipeline_head + i) %
+				XDS110_PIPELINE_DEPTH];
+			if (!block->write_done || !block->read_done)
+				done = false;
+		}
+		if (!done)
+			usb_pipeline_handle_events();
+	} while (!done);
+
+	xds110.pipeline_cancel = false;
+}
+
+/* Wait for the oldest block in flight and pass its results back */
+static bool usb_pipeline_retire(void)
+{
+	struct xds110_pipeline_block *block =
+		&xds110.pipeline[xds110.pipeline_head];
+	uint8_t *result_pntr = &block->read_payload[XDS_IN_LEN + 0];
+	/* Long enough for both the write and the read transfer to time out */
+	int64_t then = timeval_ms() + 2 * DEFAULT_TIMEOUT;
+	bool success;
+	int error;
+
+	while (!block->write_done || !block->read_done) {
+		if (block->failed)
+			break;
+		if (timeval_ms() > then) {
+			LOG_ERROR("XDS110: timeout waiting for %s response",
+				xds_api_comamnd_name(block->command));
+			break;
+		}
+		usb_pipeline_handle_events();
+	}
+
+	/* Don't wait for the rest of a failed or stalled block */
+	if (block->failed || !block->write_done || !block->read_done)
+		usb_pipeline_cancel();
+
+	success = !block->failed;
+
+	if (success && block->read_count != block->in_length) {
+		/* Unexpected amount of data returned */
+		success = false;
+		LOG_DEBUG("XDS110: %s return %" PRIu32 " bytes, expected %" PRIu32,
+			xds_api_comamnd_name(block->command), block->read_count,
+			block->in_length);
+	}
+
+	if (success) {
+		/* Extract error code from return packet */
+		error = (int)xds110_get_u32(&block->read_payload[0]);
+		if (error != SC_ERR_NONE) {
+			success = false;
+			LOG_DEBUG("XDS110: %s returned error %d",
+				xds_api_comamnd_name(block->command), error);
+		}
+	}
+
+	if (success) {
+		if (block->command == OCD_SCAN_REQUEST)
+			xds110_copy_scan_results(result_pntr, block->scan_results,
+				block->result_count);
+		else
+			xds110_copy_dap_results(result_pntr, block->dap_results,
+				block->result_count);
+	} else {
+		xds110.pipeline_error = true;
+	}
+
+	xds110.pipeline_head = (xds110.pipeline_head + 1) % XDS110_PIPELINE_DEPTH;
+	xds110.pipeline_count--;
+
+	return success;
+}
+
+/*
+ * Wait for every block in flight. Returns false if any block submitted
+ * since the previous call failed.
+ */
+static bool usb_pipeline_drain(void)
+{
+	bool success;
+
+	while (xds110.pipeline_count > 0)
+		(void)usb_pipeline_retire();
+
+	success = !xds110.pipeline_error;
+	xds110.pipeline_error = false;
+
+	return success;
+}
+
+/*
+ * Send the transaction queue as an OCD_SCAN_REQUEST or OCD_DAP_REQUEST
+ * block without waiting for the response. The results are passed back
+ * to the callers' buffers when the block is retired. On success the
+ * transaction queue is emptied, ready for the next block.
+ */
+static bool usb_pipeline_submit(uint8_t command)
+{
+	struct xds110_pipeline_block *block;
+	uint32_t size;
+
+	if (!xds110.dev)
+		return false;
+
+	/* Wait for a free block */
+	if (xds110.pipeline_count == XDS110_PIPELINE_DEPTH)
+		(void)usb_pipeline_retire();
+
+	block = &xds110.pipeline[(xds110.pipeline_head + xds110.pipeline_count) %
+		XDS110_PIPELINE_DEPTH];
+
+	if (!block->write_transfer)
+		block->write_transfer = libusb_alloc_transfer(0);
+	if (!block->read_transfer)
+		block->read_transfer = libusb_alloc_transfer(0);
+	if (!block->write_transfer || !block->read_transfer)
+		return false;
+
+	/* Terminate request queue */
+	xds110.txn_requests[xds110.txn_request_size] = 0;
+	size = XDS_OUT_LEN + xds110.txn_request_size + 1;
+
+	/* Build the packet: start character, payload size and payload */
+	block->write_packet[0] = '*';
+	xds110_set_u16(&block->write_packet[1], size);
+	block->write_packet[3] = command;
+	memcpy(&block->write_packet[3 + XDS_OUT_LEN], xds110.txn_requests,
+		xds110.txn_request_size + 1);
+
+	block->command = command;
+	block->in_length = XDS_IN_LEN + xds110.txn_result_size;
+	block->result_count = xds110.txn_result_count;
+	if (command == OCD_SCAN_REQUEST)
+		memcpy(block->scan_results, xds110.txn_scan_results,
+			xds110.txn_result_count * sizeof(struct scan_result));
+	else
+		memcpy(block->dap_results, xds110.txn_dap_results,
+			xds110.txn_result_count * sizeof(uint32_t *));
+
+	block->write_done = false;
+	block->read_submitted = false;
+	block->read_done = false;
+	block->failed = false;
+
+	libusb_fill_bulk_transfer(block->write_transfer, xds110.dev,
+		xds110.endpoint_out, block->write_packet, size + 3,
+		usb_pipeline_write_callback, block, DEFAULT_TIMEOUT);
+
+	if (libusb_submit_transfer(block->write_transfer) != LIBUSB_SUCCESS)
+		return false;
+
+	xds110.pipeline_count++;
+
+	usb_pipeline_start_read();
+
+	xds110.txn_request_size = 0;
+	xds110.txn_result_size = 0;
+	xds110.txn_result_count = 0;
+
+	return true;
+}
+
 /***************************************************************************
  *   XDS110 firmware API routines                                          *
  *                                                                         *
@@ -638,6 +1046,10 @@ static bool xds_execute(uint32_t out_length, uint32_t in_length,
 	if (!xds110.dev)
 		return false;
 
+	/* Let any pipelined block complete before a synchronous command */
+	while (xds110.pipeline_count > 0)
+		(void)usb_pipeline_retire();
+
 	while (!done && attempts > 0) {
 		attempts--;
 
@@ -1133,6 +1545,8 @@ static bool xds_set_property(uint32_t id, uint32_t mode)
 static int xds110_swd_init(void)
 {
 	xds110.is_swd_mode = true;
+	/* the firmware resends after a WAIT by itself */
+	transport_stats_retries_unsupported();
 	return ERROR_OK;
 }
 
@@ -1316,8 +1730,11 @@ static int xds110_swd_run_queue(void)
 	uint32_t value;
 	bool success = true;
 
-	if (xds110.txn_request_size == 0)
-		return ERROR_OK;
+	if (xds110.txn_request_size == 0 ||
+		(xds110_use_pipeline() && usb_pipeline_submit(OCD_DAP_REQUEST))) {
+		/* Wait for the blocks already sent to the XDS110 */
+		return usb_pipeline_drain() ? ERROR_OK : ERROR_FAIL;
+	}
 
 	/* Terminate request queue */
 	xds110.txn_requests[xds110.txn_request_size++] = 0;
@@ -1359,9 +1776,20 @@ static int xds110_swd_run_queue(void)
 	xds110.txn_result_size = 0;
 	xds110.txn_result_count = 0;
 
+	/* Catch the failure of any block pipelined before this one */
+	if (!usb_pipeline_drain())
+		success = false;
+
 	return (success) ? ERROR_OK : ERROR_FAIL;
 }
 
+static void xds110_swd_flush_queue(void)
+{
+	/* When pipelined, send the full queue without waiting for it */
+	if (!xds110_use_pipeline() || !usb_pipeline_submit(OCD_DAP_REQUEST))
+		xds110_swd_run_queue();
+}
+
 static void xds110_swd_queue_cmd(uint8_t cmd, uint32_t *value)
 {
 	/* Check if this is a read or write request */
@@ -1375,7 +1803,7 @@ static void xds110_swd_queue_cmd(uint8_t cmd, uint32_t *value)
 	/* Check if new request would be too large to fit */
 	if (((xds110.txn_request_size + request_size + 1) > MAX_DATA_BLOCK) ||
 		((xds110.txn_result_count + 1) > MAX_RESULT_QUEUE))
-		xds110_swd_run_queue();
+		xds110_swd_flush_queue();
 
 	/* Set the START bit in cmd to ensure cmd is not zero */
 	/* (a value of zero is used to terminate the buffer) */
@@ -1578,11 +2006,14 @@ static void xds110_flush(void)
 	uint32_t result;
 	uint8_t *data_out;
 	uint8_t data_in[MAX_DATA_BLOCK];
-	uint8_t *data_pntr;
 
 	if (xds110.txn_request_size == 0)
 		return;
 
+	/* When pipelined, results are passed back as the block completes */
+	if (xds110_use_pipeline() && usb_pipeline_submit(OCD_SCAN_REQUEST))
+		return;
+
 	/* Terminate request queue */
 	xds110.txn_requests[xds110.txn_request_size++] = 0;
 
@@ -1638,21 +2069,8 @@ static void xds110_flush(void)
 	}
 
 	/* Transfer results into caller's buffers from data_in buffer */
-	bits = 0; /* Bit offset into current scan result */
-	data_pntr = data_in;
-	for (result = 0; result < xds110.txn_result_count; result++) {
-		if (xds110.txn_scan_results[result].first) {
-			if (bits != 0) {
-				bytes = DIV_ROUND_UP(bits, 8);
-				data_pntr += bytes;
-			}
-			bits = 0;
-		}
-		if (xds110.txn_scan_results[result].buffer)
-			bit_copy(xds110.txn_scan_results[result].buffer, 0, data_pntr,
-				bits, xds110.txn_scan_results[result].num_bits);
-		bits += xds110.txn_scan_results[result].num_bits;
-	}
+	xds110_copy_scan_results(data_in, xds110.txn_scan_results,
+		xds110.txn_result_count);
 
 	xds110.txn_request_size = 0;
 	xds110.txn_result_size = 0;
@@ -1859,6 +2277,8 @@ static void xds110_execute_command(struct jtag_command *cmd)
 	switch (cmd->type) {
 		case JTAG_SLEEP:
 			xds110_flush();
+			while (xds110.pipeline_count > 0)
+				(void)usb_pipeline_retire();
 			xds110_execute_sleep(cmd);
 			break;
 		case JTAG_TLR_RESET:
@@ -1897,7 +2317,7 @@ static int xds110_execute_queue(struct jtag_command *cmd_queue)
 
 	xds110_flush();
 
-	return ERROR_OK;
+	return usb_pipeline_drain() ? ERROR_OK : ERROR_FAIL;
 }
 
 static int xds110_speed(int speed)
@@ -2069,6 +2489,25 @@ COMMAND_HANDLER(xds110_handle_supply_voltage_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(xds110_handle_pipeline_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		if (!enable)
+			(void)usb_pipeline_drain();
+		xds110.use_pipeline = enable;
+	}
+
+	command_print(CMD, "XDS110: USB pipeline %s",
+		xds110.use_pipeline ? "enabled" : "disabled");
+
+	return ERROR_OK;
+}
+
 static const struct command_registration xds110_subcommand_handlers[] = {
 	{
 		.name = "info",
@@ -2084,6 +2523,14 @@ static const struct command_registration xds110_subcommand_handlers[] = {
 		.help = "set the XDS110 probe supply voltage",
 		.usage = "voltage_in_millivolts",
 	},
+	{
+		.name = "pipeline",
+		.handler = &xds110_handle_pipeline_command,
+		.mode = COMMAND_ANY,
+		.help = "send request blocks to the XDS110 without waiting for "
+			"the previous response",
+		.usage = "['enable'|'disable']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -256,6 +256,26 @@ void jtag_set_verify_capture_ir(bool enable);
 /** @returns True if IR scan verification will be performed. */
 bool jtag_will_verify_capture_ir(void);
 
+/** Counters of the IR scans skipped by the IR scan elision. */
+struct jtag_ir_elision_stats {
+	/** IR scans skipped as the IR of every TAP already had the value */
+	uint64_t elided;
+	/** IR scans merged into the IR scan queued just before them */
+	uint64_t merged;
+	/** IR bits not shifted, for the whole chain */
+	uint64_t elided_bits;
+};
+
+/**
+ * Enable or disable the elision of IR scans which would not change the
+ * IR of any TAP, or which follow another IR scan in the queue.
+ */
+void jtag_set_elide_ir(bool enable);
+/** @returns True if IR scans may be elided. */
+bool jtag_will_elide_ir(void);
+void jtag_get_ir_elision_stats(struct jtag_ir_elision_stats *stats);
+void jtag_reset_ir_elision_stats(void);
+
 /** Set ms to sleep after jtag_execute_queue() flushes queue. Debug purposes. */
 void jtag_set_flush_queue_sleep(int ms);
 
@@ -268,6 +288,7 @@ int jtag_init(struct command_context *cmd_ctx);
 /** reset, then initialize JTAG chain */
 int jtag_init_reset(struct command_context *cmd_ctx);
 int jtag_register_commands(struct command_context *cmd_ctx);
+int jtag_benchmark_register_commands(struct command_context *cmd_ctx);
 int jtag_init_inner(struct command_context *cmd_ctx);
 
 /**
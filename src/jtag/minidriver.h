@@ -39,6 +39,11 @@
 int interface_jtag_add_ir_scan(struct jtag_tap *active,
 		const struct scan_field *fields,
 		tap_state_t endstate);
+struct jtag_command;
+
+int interface_jtag_replace_ir_scan(struct jtag_command *cmd,
+		struct jtag_tap *active, const struct scan_field *fields,
+		tap_state_t endstate);
 int interface_jtag_add_plain_ir_scan(
 		int num_bits, const uint8_t *out_bits, uint8_t *in_bits,
 		tap_state_t endstate);
@@ -215,6 +215,35 @@ COMMAND_HANDLER(handle_jtag_flush_count)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_jtag_queue_stats)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "reset") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		cmd_queue_reset_stats();
+		jtag_reset_ir_elision_stats();
+		return ERROR_OK;
+	}
+
+	struct cmd_queue_stats stats;
+	cmd_queue_get_stats(&stats);
+
+	command_print(CMD, "pages:       %u (%zu bytes)", stats.pages, stats.reserved);
+	command_print(CMD, "high-water:  %zu bytes", stats.high_water);
+	command_print(CMD, "page allocs: %u", stats.page_allocs);
+
+	struct jtag_ir_elision_stats ir_stats;
+	jtag_get_ir_elision_stats(&ir_stats);
+
+	command_print(CMD, "IR elided:   %" PRIu64 " scans, %" PRIu64 " merged (%" PRIu64 " bits)",
+		ir_stats.elided, ir_stats.merged, ir_stats.elided_bits);
+
+	return ERROR_OK;
+}
+
 /* REVISIT Just what about these should "move" ... ?
  * These registrations, into the main JTAG table?
  *
@@ -763,6 +792,14 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 			"TAP event.",
 		.usage = "tap_name '-event' event_name",
 	},
+	{
+		.name = "queue_stats",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_stats,
+		.help = "Display memory usage of the JTAG command queue, "
+			"or reset the high-water mark and page allocation count.",
+		.usage = "['reset']",
+	},
 	{
 		.name = "names",
 		.mode = COMMAND_ANY,
@@ -1012,6 +1049,23 @@ COMMAND_HANDLER(handle_verify_ircapture_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_elide_irscan_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_set_elide_ir(enable);
+	}
+
+	const char *status = jtag_will_elide_ir() ? "enabled" : "disabled";
+	command_print(CMD, "IR scan elision is %s", status);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_verify_jtag_command)
 {
 	if (CMD_ARGC > 1)
@@ -1164,6 +1218,14 @@ static const struct command_registration jtag_command_handlers[] = {
 			"verify values captured during Capture-IR.",
 		.usage = "['enable'|'disable']",
 	},
+	{
+		.name = "elide_irscan",
+		.handler = handle_elide_irscan_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or assign flag controlling whether to "
+			"skip IR scans which do not change the IR of any TAP.",
+		.usage = "['enable'|'disable']",
+	},
 	{
 		.name = "verify_jtag",
 		.handler = handle_verify_jtag_command,
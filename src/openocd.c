@@ -20,6 +20,7 @@
 #include <jtag/jtag.h>
 #include <transport/transport.h>
 #include <helper/util.h>
+#include <helper/benchmark.h>
 #include <helper/configuration.h>
 #include <flash/nor/core.h>
 #include <flash/nand/core.h>
@@ -246,6 +247,7 @@ static struct command_context *setup_command_handler(Jim_Interp *interp)
 		&server_register_commands,
 		&gdb_register_commands,
 		&log_register_commands,
+		&benchmark_register_commands,
 		&rtt_server_register_commands,
 		&transport_register_commands,
 		&adapter_register_commands,
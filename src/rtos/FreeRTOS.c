@@ -75,6 +75,7 @@ static const struct freertos_params freertos_params_list[] = {
 
 static bool freertos_detect_rtos(struct target *target);
 static int freertos_create(struct target *target);
+static int freertos_clean(struct target *target);
 static int freertos_update_threads(struct rtos *rtos);
 static int freertos_get_thread_reg_list(struct rtos *rtos, int64_t thread_id,
 		struct rtos_reg **reg_list, int *num_regs);
@@ -88,6 +89,7 @@ const struct rtos_type freertos_rtos = {
 	.update_threads = freertos_update_threads,
 	.get_thread_reg_list = freertos_get_thread_reg_list,
 	.get_symbol_list_to_lookup = freertos_get_symbol_list_to_lookup,
+	.clean = freertos_clean,
 };
 
 enum freertos_symbol_values {
@@ -103,6 +105,7 @@ enum freertos_symbol_values {
 	FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS = 9,
 	FREERTOS_VAL_UX_TOP_USED_PRIORITY = 10,
 	FREERTOS_VAL_X_SCHEDULER_RUNNING = 11,
+	FREERTOS_VAL_UX_TASK_NUMBER = 12,
 };
 
 struct symbols {
@@ -123,6 +126,7 @@ static const struct symbols freertos_symbol_list[] = {
 	{ "uxCurrentNumberOfTasks", false },
 	{ "uxTopUsedPriority", true }, /* Unavailable since v7.5.3 */
 	{ "xSchedulerRunning", false },
+	{ "uxTaskNumber", true }, /* Incremented at each task creation */
 	{ NULL, false }
 };
 
@@ -131,16 +135,53 @@ static const struct symbols freertos_symbol_list[] = {
 /* may be problems reading if sizes are not 32 bit long integers. */
 /* test mallocs for failure */
 
+#define FREERTOS_THREAD_NAME_STR_SIZE (200)
+
+struct freertos_private {
+	const struct freertos_params *params;
+	/* uxTaskNumber and uxCurrentNumberOfTasks when the thread list was
+	 * last walked, valid only if threads_known */
+	bool threads_known;
+	uint32_t task_number;
+	uint32_t thread_list_size;
+};
+
+/* Progress of the walk of one FreeRTOS task list */
+struct freertos_list_walk {
+	uint8_t header[2][4];	/* uxNumberOfItems, pxIndex->pxNext */
+	uint8_t item[2][4];	/* pvOwner, pxNext of the current item */
+	uint32_t list_thread_count;
+	uint32_t prev_list_elem_ptr;
+	uint32_t list_elem_ptr;
+	uint32_t *thread_ids;
+	unsigned int found;
+};
+
+static bool freertos_list_walk_active(const struct freertos_list_walk *walk)
+{
+	return walk->list_thread_count > 0 && walk->list_elem_ptr != 0 &&
+		walk->list_elem_ptr != walk->prev_list_elem_ptr;
+}
+
 static int freertos_update_threads(struct rtos *rtos)
 {
 	int retval;
 	unsigned int tasks_found = 0;
+	struct freertos_private *freertos;
 	const struct freertos_params *param;
+	struct thread_detail *old_details = NULL;
+	int old_count = 0;
+	symbol_address_t *list_of_lists = NULL;
+	struct freertos_list_walk *walks = NULL;
+	unsigned int num_walks = 0;
+	struct target_memory_sg *sg = NULL;
+	uint8_t *names = NULL;
 
 	if (!rtos->rtos_specific_params)
 		return -1;
 
-	param = (const struct freertos_params *) rtos->rtos_specific_params;
+	freertos = rtos->rtos_specific_params;
+	param = freertos->params;
 
 	if (!rtos->symbols) {
 		LOG_ERROR("No symbols for FreeRTOS");
@@ -152,49 +193,92 @@ static int freertos_update_threads(struct rtos *rtos)
 		return -2;
 	}
 
-	uint32_t thread_list_size = 0;
-	retval = target_read_u32(rtos->target,
-			rtos->symbols[FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS].address,
-			&thread_list_size);
-	LOG_DEBUG("FreeRTOS: Read uxCurrentNumberOfTasks at 0x%" PRIx64 ", value %" PRIu32,
-										rtos->symbols[FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS].address,
-										thread_list_size);
-
+	/* Read the kernel state in one batch */
+	static const enum freertos_symbol_values kernel_symbols[] = {
+		FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS,
+		FREERTOS_VAL_PX_CURRENT_TCB,
+		FREERTOS_VAL_X_SCHEDULER_RUNNING,
+		FREERTOS_VAL_UX_TOP_USED_PRIORITY,
+		FREERTOS_VAL_UX_TASK_NUMBER,
+	};
+	uint8_t kernel_state[ARRAY_SIZE(kernel_symbols)][4] = { 0 };
+	struct target_memory_sg kernel_sg[ARRAY_SIZE(kernel_symbols)];
+	unsigned int kernel_sg_count = 0;
+	for (unsigned int i = 0; i < ARRAY_SIZE(kernel_symbols); i++) {
+		symbol_address_t address = rtos->symbols[kernel_symbols[i]].address;
+
+		/* skip the optional symbols not found */
+		if (address)
+			kernel_sg[kernel_sg_count++] = (struct target_memory_sg){ address, 4, kernel_state[i] };
+	}
+	retval = target_read_memory_sg(rtos->target, kernel_sg, kernel_sg_count);
 	if (retval != ERROR_OK) {
 		LOG_ERROR("Could not read FreeRTOS thread count from target");
 		return retval;
 	}
 
-	/* wipe out previous thread details if any */
-	rtos_free_threadlist(rtos);
+	uint32_t thread_list_size = target_buffer_get_u32(rtos->target, kernel_state[0]);
+	LOG_DEBUG("FreeRTOS: Read uxCurrentNumberOfTasks at 0x%" PRIx64 ", value %" PRIu32,
+										rtos->symbols[FREERTOS_VAL_UX_CURRENT_NUMBER_OF_TASKS].address,
+										thread_list_size);
 
-	/* read the current thread */
-	uint32_t pointer_casts_are_bad;
-	retval = target_read_u32(rtos->target,
-			rtos->symbols[FREERTOS_VAL_PX_CURRENT_TCB].address,
-			&pointer_casts_are_bad);
-	if (retval != ERROR_OK) {
-		LOG_ERROR("Error reading current thread in FreeRTOS thread list");
-		return retval;
-	}
-	rtos->current_thread = pointer_casts_are_bad;
-	LOG_DEBUG("FreeRTOS: Read pxCurrentTCB at 0x%" PRIx64 ", value 0x%" PRIx64,
+	uint32_t current_thread = target_buffer_get_u32(rtos->target, kernel_state[1]);
+	LOG_DEBUG("FreeRTOS: Read pxCurrentTCB at 0x%" PRIx64 ", value 0x%" PRIx32,
 										rtos->symbols[FREERTOS_VAL_PX_CURRENT_TCB].address,
-										rtos->current_thread);
+										current_thread);
 
-	/* read scheduler running */
-	uint32_t scheduler_running;
-	retval = target_read_u32(rtos->target,
-			rtos->symbols[FREERTOS_VAL_X_SCHEDULER_RUNNING].address,
-			&scheduler_running);
-	if (retval != ERROR_OK) {
-		LOG_ERROR("Error reading FreeRTOS scheduler state");
-		return retval;
-	}
+	uint32_t scheduler_running = target_buffer_get_u32(rtos->target, kernel_state[2]);
 	LOG_DEBUG("FreeRTOS: Read xSchedulerRunning at 0x%" PRIx64 ", value 0x%" PRIx32,
 										rtos->symbols[FREERTOS_VAL_X_SCHEDULER_RUNNING].address,
 										scheduler_running);
 
+	bool have_task_number = rtos->symbols[FREERTOS_VAL_UX_TASK_NUMBER].address != 0;
+	uint32_t task_number = target_buffer_get_u32(rtos->target, kernel_state[4]);
+	if (have_task_number)
+		LOG_DEBUG("FreeRTOS: Read uxTaskNumber at 0x%" PRIx64 ", value %" PRIu32,
+										rtos->symbols[FREERTOS_VAL_UX_TASK_NUMBER].address,
+										task_number);
+
+	/* A task creation increments uxTaskNumber, a deletion decrements
+	 * uxCurrentNumberOfTasks: if neither changed, the threads are the
+	 * same and only the running one may have changed */
+	bool same_tasks = freertos->threads_known && have_task_number &&
+		task_number == freertos->task_number;
+	if (same_tasks && thread_list_size == freertos->thread_list_size &&
+			current_thread != 0 && scheduler_running == 1) {
+		LOG_DEBUG("FreeRTOS: No task created or deleted, keeping the thread list");
+		rtos->current_thread = current_thread;
+		for (int i = 0; i < rtos->thread_count; i++) {
+			struct thread_detail *detail = &rtos->thread_details[i];
+
+			free(detail->extra_info_str);
+			if (detail->threadid == rtos->current_thread)
+				detail->extra_info_str = strdup("State: Running");
+			else
+				detail->extra_info_str = NULL;
+		}
+		return ERROR_OK;
+	}
+
+	/* The TCB of a thread of the previous list still belongs to the same
+	 * task, unless the task was deleted and its TCB reused by a new one:
+	 * not possible without creation, nor without deletion, when all the
+	 * new tasks are counted in both. */
+	if (freertos->threads_known && have_task_number &&
+			(same_tasks || task_number - freertos->task_number ==
+				thread_list_size - freertos->thread_list_size)) {
+		old_details = rtos->thread_details;
+		old_count = rtos->thread_count;
+		rtos->thread_details = NULL;
+		rtos->thread_count = 0;
+	}
+	freertos->threads_known = false;
+
+	/* wipe out previous thread details if any */
+	rtos_free_threadlist(rtos);
+
+	rtos->current_thread = current_thread;
+
 	if ((thread_list_size  == 0) || (rtos->current_thread == 0) || (scheduler_running != 1)) {
 		/* Either : No RTOS threads - there is always at least the current execution though */
 		/* OR     : No current thread - all threads suspended - show the current execution
@@ -206,7 +290,8 @@ static int freertos_update_threads(struct rtos *rtos)
 				sizeof(struct thread_detail) * thread_list_size);
 		if (!rtos->thread_details) {
 			LOG_ERROR("Error allocating memory for %d threads", thread_list_size);
-			return ERROR_FAIL;
+			retval = ERROR_FAIL;
+			goto done;
 		}
 		rtos->current_thread = 1;
 		rtos->thread_details->threadid = rtos->current_thread;
@@ -217,7 +302,7 @@ static int freertos_update_threads(struct rtos *rtos)
 
 		if (thread_list_size == 1) {
 			rtos->thread_count = 1;
-			return ERROR_OK;
+			goto done;
 		}
 	} else {
 		/* create space for new thread details */
@@ -225,28 +310,26 @@ static int freertos_update_threads(struct rtos *rtos)
 				sizeof(struct thread_detail) * thread_list_size);
 		if (!rtos->thread_details) {
 			LOG_ERROR("Error allocating memory for %d threads", thread_list_size);
-			return ERROR_FAIL;
+			retval = ERROR_FAIL;
+			goto done;
 		}
 	}
 
 	/* Find out how many lists are needed to be read from pxReadyTasksLists, */
 	if (rtos->symbols[FREERTOS_VAL_UX_TOP_USED_PRIORITY].address == 0) {
 		LOG_ERROR("FreeRTOS: uxTopUsedPriority is not defined, consult the OpenOCD manual for a work-around");
-		return ERROR_FAIL;
+		retval = ERROR_FAIL;
+		goto done;
 	}
-	uint32_t top_used_priority = 0;
-	retval = target_read_u32(rtos->target,
-			rtos->symbols[FREERTOS_VAL_UX_TOP_USED_PRIORITY].address,
-			&top_used_priority);
-	if (retval != ERROR_OK)
-		return retval;
+	uint32_t top_used_priority = target_buffer_get_u32(rtos->target, kernel_state[3]);
 	LOG_DEBUG("FreeRTOS: Read uxTopUsedPriority at 0x%" PRIx64 ", value %" PRIu32,
 										rtos->symbols[FREERTOS_VAL_UX_TOP_USED_PRIORITY].address,
 										top_used_priority);
 	if (top_used_priority > FREERTOS_MAX_PRIORITIES) {
 		LOG_ERROR("FreeRTOS top used priority is unreasonably big, not proceeding: %" PRIu32,
 			top_used_priority);
-		return ERROR_FAIL;
+		retval = ERROR_FAIL;
+		goto done;
 	}
 
 	/* uxTopUsedPriority was defined as configMAX_PRIORITIES - 1
@@ -256,12 +339,15 @@ static int freertos_update_threads(struct rtos *rtos)
 	 * Here we restore the original configMAX_PRIORITIES value */
 	unsigned int config_max_priorities = top_used_priority + 1;
 
-	symbol_address_t *list_of_lists =
-		malloc(sizeof(symbol_address_t) * (config_max_priorities + 5));
-	if (!list_of_lists) {
+	list_of_lists = malloc(sizeof(symbol_address_t) * (config_max_priorities + 5));
+	walks = calloc(config_max_priorities + 5, sizeof(*walks));
+	sg = calloc(2 * (config_max_priorities + 5), sizeof(*sg));
+	if (!list_of_lists || !walks || !sg) {
 		LOG_ERROR("Error allocating memory for %u priorities", config_max_priorities);
-		return ERROR_FAIL;
+		retval = ERROR_FAIL;
+		goto done;
 	}
+	num_walks = config_max_priorities + 5;
 
 	unsigned int num_lists;
 	for (num_lists = 0; num_lists < config_max_priorities; num_lists++)
@@ -274,116 +360,181 @@ static int freertos_update_threads(struct rtos *rtos)
 	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_SUSPENDED_TASK_LIST].address;
 	list_of_lists[num_lists++] = rtos->symbols[FREERTOS_VAL_X_TASKS_WAITING_TERMINATION].address;
 
+	/* Read the number of threads and the location of the first item of
+	 * all the lists in one batch */
+	unsigned int sg_count = 0;
 	for (unsigned int i = 0; i < num_lists; i++) {
 		if (list_of_lists[i] == 0)
 			continue;
+		sg[sg_count++] = (struct target_memory_sg){ list_of_lists[i], 4, walks[i].header[0] };
+		sg[sg_count++] = (struct target_memory_sg){ list_of_lists[i] + param->list_next_offset,
+			4, walks[i].header[1] };
+	}
+	retval = target_read_memory_sg(rtos->target, sg, sg_count);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading number of threads in FreeRTOS thread list");
+		goto done;
+	}
 
-		/* Read the number of threads in this list */
-		uint32_t list_thread_count = 0;
-		retval = target_read_u32(rtos->target,
-				list_of_lists[i],
-				&list_thread_count);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading number of threads in FreeRTOS thread list");
-			free(list_of_lists);
-			return retval;
-		}
-		LOG_DEBUG("FreeRTOS: Read thread count for list %u at 0x%" PRIx64 ", value %" PRIu32,
-										i, list_of_lists[i], list_thread_count);
+	for (unsigned int i = 0; i < num_lists; i++) {
+		struct freertos_list_walk *walk = &walks[i];
 
-		if (list_thread_count == 0)
+		if (list_of_lists[i] == 0)
 			continue;
 
-		/* Read the location of first list item */
-		uint32_t prev_list_elem_ptr = -1;
-		uint32_t list_elem_ptr = 0;
-		retval = target_read_u32(rtos->target,
-				list_of_lists[i] + param->list_next_offset,
-				&list_elem_ptr);
+		walk->list_thread_count = target_buffer_get_u32(rtos->target, walk->header[0]);
+		LOG_DEBUG("FreeRTOS: Read thread count for list %u at 0x%" PRIx64 ", value %" PRIu32,
+										i, list_of_lists[i], walk->list_thread_count);
+		if (walk->list_thread_count == 0)
+			continue;
+
+		walk->prev_list_elem_ptr = -1;
+		walk->list_elem_ptr = target_buffer_get_u32(rtos->target, walk->header[1]);
+		LOG_DEBUG("FreeRTOS: Read first item for list %u at 0x%" PRIx64 ", value 0x%" PRIx32,
+										i, list_of_lists[i] + param->list_next_offset, walk->list_elem_ptr);
+
+		/* no list can hold more threads than there are */
+		walk->list_thread_count = MIN(walk->list_thread_count, thread_list_size - tasks_found);
+		walk->thread_ids = malloc(sizeof(uint32_t) * walk->list_thread_count);
+		if (!walk->thread_ids) {
+			LOG_ERROR("Error allocating memory for %" PRIu32 " threads", walk->list_thread_count);
+			retval = ERROR_FAIL;
+			goto done;
+		}
+	}
+
+	/* Walk all the lists side by side, reading the thread structure location
+	 * and the next item location of one item of each list per batch */
+	while (true) {
+		sg_count = 0;
+		for (unsigned int i = 0; i < num_lists; i++) {
+			struct freertos_list_walk *walk = &walks[i];
+
+			if (!freertos_list_walk_active(walk))
+				continue;
+			sg[sg_count++] = (struct target_memory_sg){
+				walk->list_elem_ptr + param->list_elem_content_offset, 4, walk->item[0] };
+			sg[sg_count++] = (struct target_memory_sg){
+				walk->list_elem_ptr + param->list_elem_next_offset, 4, walk->item[1] };
+		}
+		if (sg_count == 0)
+			break;
+
+		retval = target_read_memory_sg(rtos->target, sg, sg_count);
 		if (retval != ERROR_OK) {
-			LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-			free(list_of_lists);
-			return retval;
+			LOG_ERROR("Error reading thread list items in FreeRTOS thread list");
+			goto done;
 		}
-		LOG_DEBUG("FreeRTOS: Read first item for list %u at 0x%" PRIx64 ", value 0x%" PRIx32,
-										i, list_of_lists[i] + param->list_next_offset, list_elem_ptr);
-
-		while ((list_thread_count > 0) && (list_elem_ptr != 0) &&
-				(list_elem_ptr != prev_list_elem_ptr) &&
-				(tasks_found < thread_list_size)) {
-			/* Get the location of the thread structure. */
-			retval = target_read_u32(rtos->target,
-					list_elem_ptr + param->list_elem_content_offset,
-					&pointer_casts_are_bad);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading thread list item object in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			rtos->thread_details[tasks_found].threadid = pointer_casts_are_bad;
-			LOG_DEBUG("FreeRTOS: Read Thread ID at 0x%" PRIx32 ", value 0x%" PRIx64,
-										list_elem_ptr + param->list_elem_content_offset,
-										rtos->thread_details[tasks_found].threadid);
 
-			/* get thread name */
+		for (unsigned int i = 0; i < num_lists; i++) {
+			struct freertos_list_walk *walk = &walks[i];
 
-			#define FREERTOS_THREAD_NAME_STR_SIZE (200)
-			char tmp_str[FREERTOS_THREAD_NAME_STR_SIZE];
+			if (!freertos_list_walk_active(walk))
+				continue;
 
-			/* Read the thread name */
-			retval = target_read_buffer(rtos->target,
-					rtos->thread_details[tasks_found].threadid + param->thread_name_offset,
-					FREERTOS_THREAD_NAME_STR_SIZE,
-					(uint8_t *)&tmp_str);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading first thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
+			uint32_t thread_id = target_buffer_get_u32(rtos->target, walk->item[0]);
+			walk->thread_ids[walk->found++] = thread_id;
+			LOG_DEBUG("FreeRTOS: Read Thread ID at 0x%" PRIx32 ", value 0x%" PRIx32,
+										walk->list_elem_ptr + param->list_elem_content_offset,
+										thread_id);
+
+			walk->list_thread_count--;
+			walk->prev_list_elem_ptr = walk->list_elem_ptr;
+			walk->list_elem_ptr = target_buffer_get_u32(rtos->target, walk->item[1]);
+			LOG_DEBUG("FreeRTOS: Read next thread location at 0x%" PRIx32 ", value 0x%" PRIx32,
+										walk->prev_list_elem_ptr + param->list_elem_next_offset,
+										walk->list_elem_ptr);
+		}
+	}
+
+	/* Threads are listed in the order of the lists, up to the thread count */
+	unsigned int first_task = tasks_found;
+	for (unsigned int i = 0; i < num_lists; i++) {
+		for (unsigned int j = 0; j < walks[i].found && tasks_found < thread_list_size; j++) {
+			struct thread_detail *detail = &rtos->thread_details[tasks_found++];
+
+			detail->threadid = walks[i].thread_ids[j];
+			detail->thread_name_str = NULL;
+			for (int k = 0; k < old_count; k++) {
+				if (old_details[k].threadid == detail->threadid) {
+					detail->thread_name_str = old_details[k].thread_name_str;
+					old_details[k].thread_name_str = NULL;
+					break;
+				}
 			}
-			tmp_str[FREERTOS_THREAD_NAME_STR_SIZE-1] = '\x00';
+		}
+	}
+
+	/* Read the names of all the new threads in one batch */
+	names = malloc((tasks_found - first_task) * FREERTOS_THREAD_NAME_STR_SIZE);
+	free(sg);
+	sg = malloc((tasks_found - first_task) * sizeof(*sg));
+	if (tasks_found > first_task && (!names || !sg)) {
+		LOG_ERROR("Error allocating memory for %u thread names", tasks_found - first_task);
+		for (unsigned int i = first_task; i < tasks_found; i++)
+			free(rtos->thread_details[i].thread_name_str);
+		retval = ERROR_FAIL;
+		goto done;
+	}
+	unsigned int sg_names = 0;
+	for (unsigned int i = first_task; i < tasks_found; i++) {
+		if (rtos->thread_details[i].thread_name_str)
+			continue;
+		sg[sg_names++] = (struct target_memory_sg){
+			rtos->thread_details[i].threadid + param->thread_name_offset,
+			FREERTOS_THREAD_NAME_STR_SIZE,
+			names + (i - first_task) * FREERTOS_THREAD_NAME_STR_SIZE };
+	}
+	LOG_DEBUG("FreeRTOS: Reading the names of %u threads out of %u", sg_names, tasks_found - first_task);
+	retval = target_read_memory_sg(rtos->target, sg, sg_names);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error reading thread names in FreeRTOS thread list");
+		for (unsigned int i = first_task; i < tasks_found; i++)
+			free(rtos->thread_details[i].thread_name_str);
+		goto done;
+	}
+
+	for (unsigned int i = first_task; i < tasks_found; i++) {
+		if (!rtos->thread_details[i].thread_name_str) {
+			char *tmp_str = (char *)names + (i - first_task) * FREERTOS_THREAD_NAME_STR_SIZE;
+
+			tmp_str[FREERTOS_THREAD_NAME_STR_SIZE - 1] = '\x00';
 			LOG_DEBUG("FreeRTOS: Read Thread Name at 0x%" PRIx64 ", value '%s'",
-										rtos->thread_details[tasks_found].threadid + param->thread_name_offset,
+										rtos->thread_details[i].threadid + param->thread_name_offset,
 										tmp_str);
 
 			if (tmp_str[0] == '\x00')
 				strcpy(tmp_str, "No Name");
 
-			rtos->thread_details[tasks_found].thread_name_str =
-				malloc(strlen(tmp_str)+1);
-			strcpy(rtos->thread_details[tasks_found].thread_name_str, tmp_str);
-			rtos->thread_details[tasks_found].exists = true;
-
-			if (rtos->thread_details[tasks_found].threadid == rtos->current_thread) {
-				char running_str[] = "State: Running";
-				rtos->thread_details[tasks_found].extra_info_str = malloc(
-						sizeof(running_str));
-				strcpy(rtos->thread_details[tasks_found].extra_info_str,
-					running_str);
-			} else
-				rtos->thread_details[tasks_found].extra_info_str = NULL;
-
-			tasks_found++;
-			list_thread_count--;
-			rtos->thread_count = tasks_found;
-
-			prev_list_elem_ptr = list_elem_ptr;
-			list_elem_ptr = 0;
-			retval = target_read_u32(rtos->target,
-					prev_list_elem_ptr + param->list_elem_next_offset,
-					&list_elem_ptr);
-			if (retval != ERROR_OK) {
-				LOG_ERROR("Error reading next thread item location in FreeRTOS thread list");
-				free(list_of_lists);
-				return retval;
-			}
-			LOG_DEBUG("FreeRTOS: Read next thread location at 0x%" PRIx32 ", value 0x%" PRIx32,
-										prev_list_elem_ptr + param->list_elem_next_offset,
-										list_elem_ptr);
+			rtos->thread_details[i].thread_name_str = strdup(tmp_str);
 		}
+		rtos->thread_details[i].exists = true;
+
+		if (rtos->thread_details[i].threadid == rtos->current_thread)
+			rtos->thread_details[i].extra_info_str = strdup("State: Running");
+		else
+			rtos->thread_details[i].extra_info_str = NULL;
+
+		rtos->thread_count = i + 1;
 	}
 
+	freertos->threads_known = true;
+	freertos->task_number = task_number;
+	freertos->thread_list_size = thread_list_size;
+
+done:
+	for (unsigned int i = 0; i < num_walks; i++)
+		free(walks[i].thread_ids);
+	for (int i = 0; i < old_count; i++) {
+		free(old_details[i].thread_name_str);
+		free(old_details[i].extra_info_str);
+	}
+	free(old_details);
+	free(walks);
+	free(names);
+	free(sg);
 	free(list_of_lists);
-	return 0;
+	return retval;
 }
 
 static int freertos_get_thread_reg_list(struct rtos *rtos, int64_t thread_id,
@@ -402,7 +553,7 @@ static int freertos_get_thread_reg_list(struct rtos *rtos, int64_t thread_id,
 	if (!rtos->rtos_specific_params)
 		return -1;
 
-	param = (const struct freertos_params *) rtos->rtos_specific_params;
+	param = ((struct freertos_private *)rtos->rtos_specific_params)->params;
 
 	/* Read the stack pointer */
 	uint32_t pointer_casts_are_bad;
@@ -530,11 +681,40 @@ static bool freertos_detect_rtos(struct target *target)
 	return false;
 }
 
+/* Forget the threads: the next update reads all of them again */
+static int freertos_clean(struct target *target)
+{
+	struct freertos_private *freertos = target->rtos->rtos_specific_params;
+
+	if (freertos)
+		freertos->threads_known = false;
+
+	return ERROR_OK;
+}
+
+static int freertos_reset_handler(struct target *target, enum target_reset_mode reset_mode, void *priv)
+{
+	/* the firmware may have changed, with the same task counters */
+	if (target->rtos && target->rtos->type == &freertos_rtos)
+		freertos_clean(target);
+
+	return ERROR_OK;
+}
+
 static int freertos_create(struct target *target)
 {
 	for (unsigned int i = 0; i < ARRAY_SIZE(freertos_params_list); i++)
 		if (strcmp(freertos_params_list[i].target_name, target->type->name) == 0) {
-			target->rtos->rtos_specific_params = (void *)&freertos_params_list[i];
+			struct freertos_private *freertos = calloc(1, sizeof(*freertos));
+			if (!freertos) {
+				LOG_ERROR("Out of memory");
+				return -1;
+			}
+			freertos->params = &freertos_params_list[i];
+			target->rtos->rtos_specific_params = freertos;
+
+			target_register_reset_callback(freertos_reset_handler, NULL);
+
 			return 0;
 		}
 
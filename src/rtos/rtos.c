@@ -224,7 +224,20 @@ int rtos_qsymbol(struct connection *connection, char const *packet, int packet_s
 		goto done;
 
 	/* Decode any symbol name in the packet*/
-	size_t len = unhexify((uint8_t *)cur_sym, strchr(packet + 8, ':') + 1, strlen(strchr(packet + 8, ':') + 1));
+	const char *hex_sym = packet_size > 8 ? strchr(packet + 8, ':') : NULL;
+	if (!hex_sym) {
+		LOG_WARNING("RTOS: malformed qSymbol packet");
+		goto done;
+	}
+	hex_sym++;
+
+	/* packets can be larger than the buffer, see gdb_packet_size */
+	size_t hex_len = strlen(hex_sym);
+	if (hex_len / 2 > sizeof(cur_sym) - 1) {
+		LOG_WARNING("RTOS: symbol name in qSymbol packet is too long");
+		goto done;
+	}
+	size_t len = unhexify((uint8_t *)cur_sym, hex_sym, hex_len / 2);
 	cur_sym[len] = 0;
 
 	const char no_suffix[] = "";
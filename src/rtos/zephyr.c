@@ -508,55 +508,37 @@ static int zephyr_fetch_thread(const struct rtos *rtos,
 				struct zephyr_thread *thread, uint32_t ptr)
 {
 	const struct zephyr_params *param = rtos->rtos_specific_params;
+	uint8_t entry[4], next_ptr[4], stack_pointer[4], prio;
 	int retval;
 
 	thread->ptr = ptr;
+	thread->name[0] = '\0';
 
-	retval = target_read_u32(rtos->target, ptr + param->offsets[OFFSET_T_ENTRY],
-				 &thread->entry);
-	if (retval != ERROR_OK)
-		return retval;
-
-	retval = target_read_u32(rtos->target,
-				 ptr + param->offsets[OFFSET_T_NEXT_THREAD],
-				 &thread->next_ptr);
-	if (retval != ERROR_OK)
-		return retval;
-
-	retval = target_read_u32(rtos->target,
-				 ptr + param->offsets[OFFSET_T_STACK_POINTER],
-				 &thread->stack_pointer);
-	if (retval != ERROR_OK)
-		return retval;
-
-	retval = target_read_u8(rtos->target, ptr + param->offsets[OFFSET_T_STATE],
-				&thread->state);
-	if (retval != ERROR_OK)
-		return retval;
-
-	retval = target_read_u8(rtos->target,
-				ptr + param->offsets[OFFSET_T_USER_OPTIONS],
-				&thread->user_options);
+	/* Read the whole thread structure in one batch */
+	struct target_memory_sg sg[] = {
+		{ ptr + param->offsets[OFFSET_T_ENTRY], 4, entry },
+		{ ptr + param->offsets[OFFSET_T_NEXT_THREAD], 4, next_ptr },
+		{ ptr + param->offsets[OFFSET_T_STACK_POINTER], 4, stack_pointer },
+		{ ptr + param->offsets[OFFSET_T_STATE], 1, &thread->state },
+		{ ptr + param->offsets[OFFSET_T_USER_OPTIONS], 1, &thread->user_options },
+		{ ptr + param->offsets[OFFSET_T_PRIO], 1, &prio },
+		{ ptr + param->offsets[OFFSET_T_NAME], sizeof(thread->name) - 1,
+			(uint8_t *)thread->name },
+	};
+	unsigned int count = ARRAY_SIZE(sg);
+
+	if (param->offsets[OFFSET_T_NAME] == UNIMPLEMENTED)
+		count--;
+
+	retval = target_read_memory_sg(rtos->target, sg, count);
 	if (retval != ERROR_OK)
 		return retval;
 
-	uint8_t prio;
-	retval = target_read_u8(rtos->target,
-				ptr + param->offsets[OFFSET_T_PRIO], &prio);
-	if (retval != ERROR_OK)
-		return retval;
+	thread->entry = target_buffer_get_u32(rtos->target, entry);
+	thread->next_ptr = target_buffer_get_u32(rtos->target, next_ptr);
+	thread->stack_pointer = target_buffer_get_u32(rtos->target, stack_pointer);
 	thread->prio = prio;
-
-	thread->name[0] = '\0';
-	if (param->offsets[OFFSET_T_NAME] != UNIMPLEMENTED) {
-		retval = target_read_buffer(rtos->target,
-					ptr + param->offsets[OFFSET_T_NAME],
-					sizeof(thread->name) - 1, (uint8_t *)thread->name);
-		if (retval != ERROR_OK)
-			return retval;
-
-		thread->name[sizeof(thread->name) - 1] = '\0';
-	}
+	thread->name[sizeof(thread->name) - 1] = '\0';
 
 	LOG_DEBUG("Fetched thread%" PRIx32 ": {entry@0x%" PRIx32
 		", state=%" PRIu8 ", useropts=%" PRIu8 ", prio=%" PRId8 "}",
@@ -708,20 +690,21 @@ static int zephyr_update_threads(struct rtos *rtos)
 		}
 	}
 	/* We can fetch the whole array for version 0, as they're supposed
-	 * to grow only */
-	uint32_t address;
-	address  = rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_OFFSETS].address;
-	for (size_t i = 0; i < OFFSET_MAX; i++, address += param->size_width) {
-		if (i >= param->num_offsets) {
+	 * to grow only. The size of size_t was checked above. */
+	uint8_t offsets[OFFSET_MAX * 4];
+	uint32_t num_offsets = MIN(param->num_offsets, OFFSET_MAX);
+	retval = target_read_buffer(rtos->target,
+			rtos->symbols[ZEPHYR_VAL__KERNEL_OPENOCD_OFFSETS].address,
+			num_offsets * param->size_width, offsets);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Could not fetch offsets from Zephyr");
+		return ERROR_FAIL;
+	}
+	for (size_t i = 0; i < OFFSET_MAX; i++) {
+		if (i < num_offsets)
+			param->offsets[i] = target_buffer_get_u32(rtos->target, offsets + 4 * i);
+		else
 			param->offsets[i] = UNIMPLEMENTED;
-			continue;
-		}
-
-		retval = target_read_u32(rtos->target, address, &param->offsets[i]);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Could not fetch offsets from Zephyr");
-			return ERROR_FAIL;
-		}
 	}
 
 	LOG_DEBUG("Zephyr OpenOCD support version %" PRId32,
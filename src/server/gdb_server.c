@@ -59,19 +59,60 @@ enum gdb_output_flag {
 	GDB_OUTPUT_ALL,
 };
 
-struct target_desc_format {
-	char *tdesc;
-	uint32_t tdesc_length;
+/* a target description, generated once and shared by the connections to
+ * the target, until the layout of its registers changes */
+struct gdb_tdesc {
+	/* the target described, or the first target of its SMP group */
+	struct target *target;
+	/* register_cache_layout() of the targets described */
+	uint32_t layout;
+	/* held by gdb_tdescs and by the connections sending it */
+	unsigned int refcount;
+	/* whether GDB gets it, see gdb_target_description_supported() */
+	int supported;
+	char *xml;
+	uint32_t length;
+	struct gdb_tdesc *next;
+};
+
+/* a core of the target, i.e. a thread of GDB in non-stop mode */
+struct gdb_nonstop_thread {
+	struct target *target;
+	/* 0 if the target has no threads */
+	int64_t threadid;
+	/* resumed by GDB, which waits for the stop of the thread */
+	bool running;
+	/* halted on request of GDB (vCont;t), reported with signal 0 */
+	bool stop_requested;
+	/* stop not acknowledged by GDB yet, reported in order of stop_seq */
+	bool stop_pending;
+	uint64_t stop_seq;
+};
+
+/* flash sectors programmed while streaming vFlashWrite packets */
+struct gdb_vflash_range {
+	target_addr_t address;
+	uint32_t size;
+	/* CRC32 of the data, checked at vFlashDone */
+	uint32_t checksum;
 };
 
 /* private connection data for GDB */
 struct gdb_connection {
-	char buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for null-termination */
+	char *buffer; /* gdb_packet_size + 1, extra byte for null-termination */
 	char *buf_p;
 	int buf_cnt;
 	bool ctrl_c;
 	enum target_state frontend_state;
 	struct image *vflash_image;
+	/* set once the complete flash sectors received with vFlashWrite are
+	 * programmed while GDB sends the next ones, see gdb_flash_stream */
+	bool vflash_streaming;
+	/* error when programming streamed sectors, reported to GDB by the next
+	 * vFlashWrite or vFlashDone packet */
+	int vflash_error;
+	struct gdb_vflash_range *vflash_ranges;
+	unsigned int vflash_num_ranges;
 	bool closed;
 	/* set to prevent re-entrance from log messages during gdb_get_packet()
 	 * and gdb_put_packet(). */
@@ -93,14 +134,23 @@ struct gdb_connection {
 	bool attached;
 	/* set when extended protocol is used */
 	bool extended_protocol;
-	/* temporarily used for target description support */
-	struct target_desc_format target_desc;
+	/* the target description being sent */
+	struct gdb_tdesc *tdesc;
 	/* temporarily used for thread list support */
 	char *thread_list;
 	/* flag to mask the output from gdb_log_callback() */
 	enum gdb_output_flag output_flag;
 	/* Unique index for this GDB connection. */
 	unsigned int unique_index;
+	/* set by QNonStop:1, the threads then run and stop independently
+	 * and their stops are reported with %Stop notifications */
+	bool non_stop;
+	struct gdb_nonstop_thread *threads;
+	unsigned int thread_count;
+	/* thread whose stop was sent last to GDB, acknowledged by the next
+	 * vStopped; NULL once vStopped got OK, i.e. no more stop to report */
+	struct gdb_nonstop_thread *stop_sent;
+	uint64_t stop_seq;
 };
 
 #if 0
@@ -131,6 +181,16 @@ static int gdb_actual_connections;
 static int gdb_use_memory_map = 1;
 /* enabled by default*/
 static int gdb_flash_program = 1;
+/* PacketSize advertised to GDB, also the size of the input buffers */
+static unsigned int gdb_packet_size = GDB_BUFFER_SIZE;
+/* shared by all the connections, allocated with the first one */
+static char *gdb_packet_buffer;
+/* if set, complete flash sectors are programmed during the vFlashWrite
+ * sequence instead of at vFlashDone. Disabled by default. */
+static int gdb_flash_stream;
+/* least amount of complete sectors to stream, so that the flash algorithm
+ * isn't started for each sector */
+#define GDB_VFLASH_STREAM_MIN_SIZE	(4 * 1024)
 
 /* if set, data aborts cause an error to be reported in memory read packets
  * see the code in gdb_read_memory_packet() for further explanations.
@@ -146,6 +206,18 @@ static int gdb_report_register_access_error;
 /* enabled by default */
 static int gdb_use_target_description = 1;
 
+/* the target descriptions generated so far, one per target or SMP group */
+static struct gdb_tdesc *gdb_tdescs;
+
+static void gdb_tdesc_put(struct gdb_tdesc *tdesc)
+{
+	if (!tdesc || --tdesc->refcount)
+		return;
+
+	free(tdesc->xml);
+	free(tdesc);
+}
+
 /* current processing free-run type, used by file-I/O */
 static char gdb_running_type;
 
@@ -222,14 +294,14 @@ static int gdb_get_char_inner(struct connection *connection, int *next_char)
 #endif
 	for (;; ) {
 		if (connection->service->type != CONNECTION_TCP)
-			gdb_con->buf_cnt = read(connection->fd, gdb_con->buffer, GDB_BUFFER_SIZE);
+			gdb_con->buf_cnt = read(connection->fd, gdb_con->buffer, gdb_packet_size);
 		else {
 			retval = check_pending(connection, 1, NULL);
 			if (retval != ERROR_OK)
 				return retval;
 			gdb_con->buf_cnt = read_socket(connection->fd,
 					gdb_con->buffer,
-					GDB_BUFFER_SIZE);
+					gdb_packet_size);
 		}
 
 		if (gdb_con->buf_cnt > 0)
@@ -404,14 +476,12 @@ static void gdb_log_outgoing_packet(struct connection *connection, char *packet_
 static int gdb_put_packet_inner(struct connection *connection,
 		char *buffer, int len)
 {
-	int i;
 	unsigned char my_checksum = 0;
 	int reply;
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
 
-	for (i = 0; i < len; i++)
-		my_checksum += buffer[i];
+	my_checksum = buf_sum8(buffer, len);
 
 #ifdef _DEBUG_GDB_IO_
 	/*
@@ -563,33 +633,20 @@ static inline int fetch_packet(struct connection *connection,
 			 * aliasing, so we help it by showing that these values do not
 			 * change inside the loop
 			 */
-			int i;
-			char *buf = buf_p;
+			const char *buf = buf_p;
 			int run = buf_cnt - 2;
-			i = 0;
 			int done = 0;
-			while (i < run) {
-				character = *buf++;
-				i++;
-				if (character == '#') {
-					/* Danger! character can be '#' when esc is
-					 * used so we need an explicit boolean for done here. */
-					done = 1;
-					break;
-				}
 
-				if (character == '}') {
-					/* data transmitted in binary mode (X packet)
-					 * uses 0x7d as escape character */
-					my_checksum += character & 0xff;
-					character = *buf++;
-					i++;
-					my_checksum += character & 0xff;
-					buffer[count++] = (character ^ 0x20) & 0xff;
-				} else {
-					my_checksum += character & 0xff;
-					buffer[count++] = character & 0xff;
-				}
+			/* copy the characters up to the next '#' at once; data transmitted
+			 * in binary mode (X packet) uses 0x7d as escape character */
+			size_t i;
+			count += buf_unescape((uint8_t *)buffer + count, (const uint8_t *)buf, run, &i);
+			my_checksum += buf_sum8(buf, i);
+			if (i < (size_t)run && buf[i] == '#') {
+				/* Danger! character can be '#' when esc is
+				 * used so we need an explicit boolean for done here. */
+				done = 1;
+				i++;
 			}
 			buf_p += i;
 			buf_cnt -= i;
@@ -769,6 +826,34 @@ static int gdb_output(struct command_context *context, const char *line)
 	return ERROR_OK;
 }
 
+/* Describe in @a stop_reason the watchpoint hit by @a target, if any */
+static void gdb_watch_stop_reason(struct target *target, char *stop_reason, size_t size)
+{
+	enum watchpoint_rw hit_wp_type;
+	target_addr_t hit_wp_address;
+
+	stop_reason[0] = '\0';
+	if (target->debug_reason != DBG_REASON_WATCHPOINT)
+		return;
+
+	if (watchpoint_hit(target, &hit_wp_type, &hit_wp_address) != ERROR_OK)
+		return;
+
+	switch (hit_wp_type) {
+		case WPT_WRITE:
+			snprintf(stop_reason, size, "watch:%08" TARGET_PRIxADDR ";", hit_wp_address);
+			break;
+		case WPT_READ:
+			snprintf(stop_reason, size, "rwatch:%08" TARGET_PRIxADDR ";", hit_wp_address);
+			break;
+		case WPT_ACCESS:
+			snprintf(stop_reason, size, "awatch:%08" TARGET_PRIxADDR ";", hit_wp_address);
+			break;
+		default:
+			break;
+	}
+}
+
 static void gdb_signal_reply(struct target *target, struct connection *connection)
 {
 	struct gdb_connection *gdb_connection = connection->priv;
@@ -797,31 +882,7 @@ static void gdb_signal_reply(struct target *target, struct connection *connectio
 		} else
 			signal_var = gdb_last_signal(ct);
 
-		stop_reason[0] = '\0';
-		if (ct->debug_reason == DBG_REASON_WATCHPOINT) {
-			enum watchpoint_rw hit_wp_type;
-			target_addr_t hit_wp_address;
-
-			if (watchpoint_hit(ct, &hit_wp_type, &hit_wp_address) == ERROR_OK) {
-
-				switch (hit_wp_type) {
-					case WPT_WRITE:
-						snprintf(stop_reason, sizeof(stop_reason),
-								"watch:%08" TARGET_PRIxADDR ";", hit_wp_address);
-						break;
-					case WPT_READ:
-						snprintf(stop_reason, sizeof(stop_reason),
-								"rwatch:%08" TARGET_PRIxADDR ";", hit_wp_address);
-						break;
-					case WPT_ACCESS:
-						snprintf(stop_reason, sizeof(stop_reason),
-								"awatch:%08" TARGET_PRIxADDR ";", hit_wp_address);
-						break;
-					default:
-						break;
-				}
-			}
-		}
+		gdb_watch_stop_reason(ct, stop_reason, sizeof(stop_reason));
 
 		current_thread[0] = '\0';
 		if (target->rtos)
@@ -951,11 +1012,344 @@ static void gdb_frontend_halted(struct target *target, struct connection *connec
 	}
 }
 
+/*
+ * Non-stop mode
+ *
+ * With QNonStop:1 each core of the target is a thread of GDB that runs and
+ * stops independently: vCont applies to the threads it names, and replies
+ * OK at once. The stops are queued and reported with a %Stop notification,
+ * GDB then fetches the next ones with vStopped until it gets OK. The
+ * threads are the cores of the SMP group, with the hwthread RTOS, or the
+ * target itself when it has no RTOS.
+ */
+
+static struct gdb_nonstop_thread *gdb_nonstop_find(struct gdb_connection *gdb_con,
+		struct target *target)
+{
+	for (unsigned int i = 0; i < gdb_con->thread_count; i++) {
+		if (gdb_con->threads[i].target == target)
+			return &gdb_con->threads[i];
+	}
+
+	return NULL;
+}
+
+/* @returns the thread whose stop is the oldest not acknowledged by GDB */
+static struct gdb_nonstop_thread *gdb_nonstop_next_stop(struct gdb_connection *gdb_con)
+{
+	struct gdb_nonstop_thread *next = NULL;
+
+	for (unsigned int i = 0; i < gdb_con->thread_count; i++) {
+		struct gdb_nonstop_thread *thread = &gdb_con->threads[i];
+		if (thread->stop_pending && (!next || thread->stop_seq < next->stop_seq))
+			next = thread;
+	}
+
+	return next;
+}
+
+static int gdb_nonstop_stop_reply(struct gdb_nonstop_thread *thread, char *reply, size_t size)
+{
+	struct target *target = thread->target;
+	char stop_reason[32];
+	char current_thread[25];
+
+	if (target->debug_reason == DBG_REASON_EXIT)
+		return snprintf(reply, size, "W00");
+
+	gdb_watch_stop_reason(target, stop_reason, sizeof(stop_reason));
+
+	current_thread[0] = '\0';
+	if (thread->threadid)
+		snprintf(current_thread, sizeof(current_thread), "thread:%" PRIx64 ";",
+				thread->threadid);
+
+	return snprintf(reply, size, "T%2.2x%s%s",
+			thread->stop_requested ? 0 : gdb_last_signal(target),
+			stop_reason, current_thread);
+}
+
+/* Send the oldest stop not reported yet, unless GDB is still fetching them */
+static void gdb_nonstop_notify(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct gdb_nonstop_thread *next;
+	char notif[96];
+
+	if (gdb_con->stop_sent)
+		return;
+
+	next = gdb_nonstop_next_stop(gdb_con);
+	if (!next)
+		return;
+
+	/* notifications are not acknowledged, only framed with '%' */
+	int len = sprintf(notif, "%%Stop:");
+	len += gdb_nonstop_stop_reply(next, notif + len, sizeof(notif) - len - 3);
+	len += sprintf(notif + len, "#%2.2x", buf_sum8(notif + 1, len - 1));
+
+	LOG_TARGET_DEBUG(next->target, "{%d} sending notification: %s",
+			gdb_con->unique_index, notif);
+
+	gdb_write(connection, notif, len);
+	gdb_con->stop_sent = next;
+}
+
+static void gdb_nonstop_stopped(struct connection *connection,
+		struct gdb_nonstop_thread *thread)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
+	thread->running = false;
+	thread->stop_pending = true;
+	thread->stop_seq = ++gdb_con->stop_seq;
+
+	gdb_nonstop_notify(connection);
+}
+
+/* vStopped: acknowledge the last stop sent, reply with the next one */
+static void gdb_nonstop_vstopped(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	char reply[64];
+
+	if (gdb_con->stop_sent) {
+		gdb_con->stop_sent->stop_pending = false;
+		gdb_con->stop_sent->stop_requested = false;
+	}
+
+	gdb_con->stop_sent = gdb_nonstop_next_stop(gdb_con);
+	if (!gdb_con->stop_sent) {
+		gdb_put_packet(connection, "OK", 2);
+		return;
+	}
+
+	int len = gdb_nonstop_stop_reply(gdb_con->stop_sent, reply, sizeof(reply));
+	gdb_put_packet(connection, reply, len);
+}
+
+/* '?': report all the stopped threads, one now and the others with vStopped */
+static void gdb_nonstop_status(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
+	for (unsigned int i = 0; i < gdb_con->thread_count; i++) {
+		struct gdb_nonstop_thread *thread = &gdb_con->threads[i];
+		thread->stop_pending = !thread->running &&
+			thread->target->state == TARGET_HALTED;
+		thread->stop_seq = ++gdb_con->stop_seq;
+	}
+
+	gdb_con->stop_sent = NULL;
+	gdb_nonstop_vstopped(connection);
+}
+
+static void gdb_nonstop_apply(struct connection *connection,
+		struct gdb_nonstop_thread *thread, char action)
+{
+	struct target *target = thread->target;
+	int retval;
+
+	if (action == 't') {
+		if (!thread->running || target->state != TARGET_RUNNING)
+			return;
+		thread->stop_requested = true;
+		retval = target_halt(target);
+		if (retval == ERROR_OK)
+			retval = target_poll(target);
+		if (retval != ERROR_OK)
+			LOG_TARGET_ERROR(target, "failed to halt the thread requested by GDB");
+		return;
+	}
+
+	if (thread->running || target->state != TARGET_HALTED)
+		return;
+
+	/* a stop not acknowledged yet is obsolete once the thread runs */
+	thread->running = true;
+	thread->stop_pending = false;
+	thread->stop_requested = false;
+	target_call_event_callbacks(target, TARGET_EVENT_GDB_START);
+
+	if (action == 'c' || action == 'C') {
+		LOG_TARGET_DEBUG(target, "continue thread %" PRIx64, thread->threadid);
+		retval = target_resume(target, 1, 0, 0, 0);
+	} else {
+		LOG_TARGET_DEBUG(target, "single-step thread %" PRIx64, thread->threadid);
+		retval = target_step(target, 1, 0, 0);
+		if (retval == ERROR_OK && thread->running)
+			retval = target_poll(target);
+	}
+
+	if (retval != ERROR_OK)
+		LOG_TARGET_ERROR(target, "failed to resume the thread requested by GDB");
+
+	/* report the stop if the target did not, e.g. after a step or an error,
+	 * GDB would wait for it forever */
+	if (thread->running && target->state != TARGET_RUNNING)
+		gdb_nonstop_stopped(connection, thread);
+}
+
+/*
+ * vCont in non-stop mode: each thread gets the first action naming it, or
+ * the first action without thread-id; the threads without action are left
+ * as they are.
+ */
+static bool gdb_nonstop_vcont(struct connection *connection, const char *packet)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	char actions[gdb_con->thread_count];
+	const char *parse;
+
+	for (unsigned int i = 0; i < gdb_con->thread_count; i++)
+		actions[i] = 0;
+
+	for (parse = packet; parse[0] == ';'; ) {
+		char action = parse[1];
+		char *end;
+		int64_t threadid = -1;
+
+		if (!action || !strchr("cCsSt", action))
+			return false;
+		parse += 2;
+
+		/* the signal of C and S is not delivered, like with c and s */
+		if (action == 'C' || action == 'S') {
+			strtoul(parse, &end, 16);
+			parse = end;
+		}
+
+		if (parse[0] == ':') {
+			threadid = strtoll(parse + 1, &end, 16);
+			if (end == parse + 1)
+				return false;
+			parse = end;
+		}
+
+		for (unsigned int i = 0; i < gdb_con->thread_count; i++) {
+			if (actions[i])
+				continue;
+			if (threadid == -1 || threadid == 0 || !gdb_con->threads[i].threadid ||
+					threadid == gdb_con->threads[i].threadid)
+				actions[i] = action;
+		}
+	}
+
+	if (parse[0] != '\0')
+		return false;
+
+	/* reply at once, the stops are notified */
+	gdb_put_packet(connection, "OK", 2);
+
+	for (unsigned int i = 0; i < gdb_con->thread_count; i++) {
+		if (actions[i])
+			gdb_nonstop_apply(connection, &gdb_con->threads[i], actions[i]);
+	}
+
+	return true;
+}
+
+static void gdb_nonstop_disable(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct gdb_service *gdb_service = connection->service->priv;
+
+	free(gdb_con->threads);
+	gdb_con->threads = NULL;
+	gdb_con->thread_count = 0;
+	gdb_con->stop_sent = NULL;
+	gdb_con->non_stop = false;
+	gdb_service->non_stop = false;
+}
+
+/* QNonStop:1, one thread per core: hwthread RTOS or target without RTOS */
+static int gdb_nonstop_enable(struct connection *connection)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct gdb_service *gdb_service = connection->service->priv;
+	struct target *target = get_target_from_connection(connection);
+	struct rtos *rtos = target->rtos;
+	unsigned int count = 1;
+
+	gdb_nonstop_disable(connection);
+
+	if (rtos) {
+		rtos_update_threads(target);
+		if (rtos->thread_count > 0)
+			count = rtos->thread_count;
+		else
+			rtos = NULL;
+	}
+
+	struct gdb_nonstop_thread *threads = calloc(count, sizeof(*threads));
+	if (!threads) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	for (unsigned int i = 0; i < count; i++) {
+		struct target *ct = target;
+
+		if (rtos) {
+			threads[i].threadid = rtos->thread_details[i].threadid;
+			rtos->gdb_target_for_threadid(connection, threads[i].threadid, &ct);
+			for (unsigned int j = 0; j < i; j++) {
+				if (threads[j].target == ct) {
+					LOG_ERROR("GDB non-stop mode needs one thread per core, "
+							"e.g. with the hwthread RTOS");
+					free(threads);
+					return ERROR_FAIL;
+				}
+			}
+		}
+
+		threads[i].target = ct;
+		threads[i].running = ct->state != TARGET_HALTED;
+	}
+
+	gdb_con->threads = threads;
+	gdb_con->thread_count = count;
+	gdb_con->non_stop = true;
+	/* let the cores of an SMP group halt and resume independently */
+	gdb_service->non_stop = true;
+
+	return ERROR_OK;
+}
+
+static void gdb_nonstop_event(struct connection *connection, struct target *target,
+		enum target_event event)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+	struct gdb_nonstop_thread *thread = gdb_nonstop_find(gdb_con, target);
+
+	if (!thread)
+		return;
+
+	switch (event) {
+		case TARGET_EVENT_GDB_HALT:
+			/* only the threads GDB waits for, not e.g. halted by monitor commands */
+			if (thread->running && target->state == TARGET_HALTED)
+				gdb_nonstop_stopped(connection, thread);
+			break;
+		case TARGET_EVENT_HALTED:
+			target_call_event_callbacks(target, TARGET_EVENT_GDB_END);
+			break;
+		default:
+			break;
+	}
+}
+
 static int gdb_target_callback_event_handler(struct target *target,
 		enum target_event event, void *priv)
 {
 	struct connection *connection = priv;
 	struct gdb_service *gdb_service = connection->service->priv;
+	struct gdb_connection *gdb_connection = connection->priv;
+
+	if (gdb_connection->non_stop) {
+		gdb_nonstop_event(connection, target, event);
+		return ERROR_OK;
+	}
 
 	if (gdb_service->target != target)
 		return ERROR_OK;
@@ -982,16 +1376,31 @@ static int gdb_new_connection(struct connection *connection)
 	int initial_ack;
 	static unsigned int next_unique_id = 1;
 
+	if (!gdb_packet_buffer)
+		gdb_packet_buffer = malloc(gdb_packet_size + 1);
+	char *buffer = malloc(gdb_packet_size + 1);
+	if (!gdb_connection || !gdb_packet_buffer || !buffer) {
+		LOG_ERROR("Unable to allocate memory");
+		free(gdb_connection);
+		free(buffer);
+		return ERROR_FAIL;
+	}
+
 	target = get_target_from_connection(connection);
 	connection->priv = gdb_connection;
 	connection->cmd_ctx->current_target = target;
 
 	/* initialize gdb connection information */
+	gdb_connection->buffer = buffer;
 	gdb_connection->buf_p = gdb_connection->buffer;
 	gdb_connection->buf_cnt = 0;
 	gdb_connection->ctrl_c = false;
 	gdb_connection->frontend_state = TARGET_HALTED;
 	gdb_connection->vflash_image = NULL;
+	gdb_connection->vflash_streaming = false;
+	gdb_connection->vflash_error = ERROR_OK;
+	gdb_connection->vflash_ranges = NULL;
+	gdb_connection->vflash_num_ranges = 0;
 	gdb_connection->closed = false;
 	gdb_connection->busy = false;
 	gdb_connection->noack_mode = 0;
@@ -999,11 +1408,15 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->mem_write_error = false;
 	gdb_connection->attached = true;
 	gdb_connection->extended_protocol = false;
-	gdb_connection->target_desc.tdesc = NULL;
-	gdb_connection->target_desc.tdesc_length = 0;
+	gdb_connection->tdesc = NULL;
 	gdb_connection->thread_list = NULL;
 	gdb_connection->output_flag = GDB_OUTPUT_NO;
 	gdb_connection->unique_index = next_unique_id++;
+	gdb_connection->non_stop = false;
+	gdb_connection->threads = NULL;
+	gdb_connection->thread_count = 0;
+	gdb_connection->stop_sent = NULL;
+	gdb_connection->stop_seq = 0;
 
 	/* output goes through gdb connection */
 	command_set_output_handler(connection->cmd_ctx, gdb_output, connection);
@@ -1089,6 +1502,20 @@ static int gdb_new_connection(struct connection *connection)
 	return ERROR_OK;
 }
 
+static void gdb_vflash_release(struct gdb_connection *gdb_connection)
+{
+	if (gdb_connection->vflash_image) {
+		image_close(gdb_connection->vflash_image);
+		free(gdb_connection->vflash_image);
+		gdb_connection->vflash_image = NULL;
+	}
+	free(gdb_connection->vflash_ranges);
+	gdb_connection->vflash_ranges = NULL;
+	gdb_connection->vflash_num_ranges = 0;
+	gdb_connection->vflash_streaming = false;
+	gdb_connection->vflash_error = ERROR_OK;
+}
+
 static int gdb_connection_closed(struct connection *connection)
 {
 	struct target *target;
@@ -1109,15 +1536,19 @@ static int gdb_connection_closed(struct connection *connection)
 		gdb_actual_connections);
 
 	/* see if an image built with vFlash commands is left */
-	if (gdb_connection->vflash_image) {
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
-	}
+	if (gdb_connection->vflash_streaming)
+		target_call_event_callbacks(target, TARGET_EVENT_GDB_FLASH_WRITE_END);
+	gdb_vflash_release(gdb_connection);
+
+	gdb_tdesc_put(gdb_connection->tdesc);
+
+	/* the cores of an SMP group halt and resume together again */
+	gdb_nonstop_disable(connection);
 
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, target);
 
+	free(gdb_connection->buffer);
 	free(connection->priv);
 	connection->priv = NULL;
 
@@ -1255,6 +1686,11 @@ static int gdb_get_registers_packet(struct connection *connection,
 	if ((target->rtos) && (rtos_get_gdb_reg_list(connection) == ERROR_OK))
 		return ERROR_OK;
 
+	/* best effort, what is left invalid is read one register at a time */
+	if (target->state == TARGET_HALTED &&
+			target_fetch_registers(target, REG_CLASS_GENERAL) != ERROR_OK)
+		LOG_DEBUG("batched register read failed");
+
 	retval = target_get_gdb_reg_list(target, &reg_list, &reg_list_size,
 			REG_CLASS_GENERAL);
 	if (retval != ERROR_OK)
@@ -1490,6 +1926,17 @@ static int gdb_error(struct connection *connection, int retval)
 	return ERROR_OK;
 }
 
+/*
+ * Binary reply of the 'x' packet: 'b' followed by the data, in which '#',
+ * '$', '}' and '*' are escaped as '}' followed by the byte xor 0x20.
+ * The reply buffer must hold 2 * len + 1 characters.
+ */
+static size_t gdb_binary_reply(char *reply, const uint8_t *data, size_t len)
+{
+	reply[0] = 'b';
+	return 1 + buf_escape((uint8_t *)reply + 1, data, len);
+}
+
 static int gdb_read_memory_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -1499,10 +1946,13 @@ static int gdb_read_memory_packet(struct connection *connection,
 	uint32_t len = 0;
 
 	uint8_t *buffer;
-	char *hex_buffer;
+	char *reply;
 
 	int retval = ERROR_OK;
 
+	/* 'm' is replied in hex, 'x' in binary */
+	bool binary = packet[0] == 'x';
+
 	/* skip command character */
 	packet++;
 
@@ -1516,6 +1966,11 @@ static int gdb_read_memory_packet(struct connection *connection,
 	len = strtoul(separator + 1, NULL, 16);
 
 	if (!len) {
+		/* an empty binary read is valid, e.g. to probe for the packet */
+		if (binary) {
+			gdb_put_packet(connection, "b", 1);
+			return ERROR_OK;
+		}
 		LOG_WARNING("invalid read memory packet received (len == 0)");
 		gdb_put_packet(connection, "", 0);
 		return ERROR_OK;
@@ -1550,13 +2005,17 @@ static int gdb_read_memory_packet(struct connection *connection,
 	}
 
 	if (retval == ERROR_OK) {
-		hex_buffer = malloc(len * 2 + 1);
+		reply = malloc(len * 2 + 1);
 
-		size_t pkt_len = hexify(hex_buffer, buffer, len, len * 2 + 1);
+		size_t pkt_len;
+		if (binary)
+			pkt_len = gdb_binary_reply(reply, buffer, len);
+		else
+			pkt_len = hexify(reply, buffer, len, len * 2 + 1);
 
-		gdb_put_packet(connection, hex_buffer, pkt_len);
+		gdb_put_packet(connection, reply, pkt_len);
 
-		free(hex_buffer);
+		free(reply);
 	} else
 		retval = gdb_error(connection, retval);
 
@@ -2545,60 +3004,6 @@ error:
 	return retval;
 }
 
-static int gdb_get_target_description_chunk(struct target *target, struct target_desc_format *target_desc,
-		char **chunk, int32_t offset, uint32_t length)
-{
-	if (!target_desc) {
-		LOG_ERROR("Unable to Generate Target Description");
-		return ERROR_FAIL;
-	}
-
-	char *tdesc = target_desc->tdesc;
-	uint32_t tdesc_length = target_desc->tdesc_length;
-
-	if (!tdesc) {
-		int retval = gdb_generate_target_description(target, &tdesc);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("Unable to Generate Target Description");
-			return ERROR_FAIL;
-		}
-
-		tdesc_length = strlen(tdesc);
-	}
-
-	char transfer_type;
-
-	if (length < (tdesc_length - offset))
-		transfer_type = 'm';
-	else
-		transfer_type = 'l';
-
-	*chunk = malloc(length + 2);
-	if (!*chunk) {
-		LOG_ERROR("Unable to allocate memory");
-		return ERROR_FAIL;
-	}
-
-	(*chunk)[0] = transfer_type;
-	if (transfer_type == 'm') {
-		strncpy((*chunk) + 1, tdesc + offset, length);
-		(*chunk)[1 + length] = '\0';
-	} else {
-		strncpy((*chunk) + 1, tdesc + offset, tdesc_length - offset);
-		(*chunk)[1 + (tdesc_length - offset)] = '\0';
-
-		/* After gdb-server sends out last chunk, invalidate tdesc. */
-		free(tdesc);
-		tdesc = NULL;
-		tdesc_length = 0;
-	}
-
-	target_desc->tdesc = tdesc;
-	target_desc->tdesc_length = tdesc_length;
-
-	return ERROR_OK;
-}
-
 static int gdb_target_description_supported(struct target *target, int *supported)
 {
 	int retval = ERROR_OK;
@@ -2644,6 +3049,149 @@ error:
 	return retval;
 }
 
+/* Returns the register layout of the target, or of its SMP group, and the
+ * target that identifies its description. The registers and architecture
+ * given to GDB are part of the layout, they depend on the core state.
+ */
+static uint32_t gdb_target_layout(struct target *target, struct target **key)
+{
+	uint32_t layout = 0;
+
+	if (!target->smp) {
+		*key = target;
+		layout = register_cache_layout(target->reg_cache, 0);
+	} else {
+		struct target_list *head;
+		*key = NULL;
+		foreach_smp_target(head, target->smp_targets) {
+			if (!*key)
+				*key = head->target;
+			if (!target_was_examined(head->target))
+				continue;
+			layout = register_cache_layout(head->target->reg_cache, layout);
+		}
+	}
+
+	struct reg **reg_list;
+	int reg_list_size;
+	if (target_get_gdb_reg_list(target, &reg_list, &reg_list_size,
+			REG_CLASS_ALL) == ERROR_OK) {
+		layout = register_list_layout(target_get_gdb_arch(target), reg_list,
+				reg_list_size, layout);
+		free(reg_list);
+	} else {
+		/* not cached, gdb_generate_target_description() reports the error */
+		layout = 0;
+	}
+
+	return layout;
+}
+
+/* Returns the target description, generated again only if the layout of
+ * the registers changed since the last time. Release with gdb_tdesc_put().
+ */
+static struct gdb_tdesc *gdb_tdesc_get(struct target *target)
+{
+	struct target *key;
+	uint32_t layout = gdb_target_layout(target, &key);
+
+	struct gdb_tdesc **tdesc_p = &gdb_tdescs;
+	while (*tdesc_p && (*tdesc_p)->target != key)
+		tdesc_p = &(*tdesc_p)->next;
+
+	struct gdb_tdesc *tdesc = *tdesc_p;
+	if (tdesc && tdesc->layout == layout) {
+		tdesc->refcount++;
+		return tdesc;
+	}
+
+	/* the description of the old layout lives on until sent */
+	if (tdesc) {
+		*tdesc_p = tdesc->next;
+		gdb_tdesc_put(tdesc);
+	}
+
+	char *xml = NULL;
+	int supported;
+	int retval = gdb_generate_target_description(target, &xml);
+	if (retval == ERROR_OK)
+		retval = gdb_target_description_supported(target, &supported);
+	if (retval != ERROR_OK) {
+		free(xml);
+		return NULL;
+	}
+
+	tdesc = malloc(sizeof(*tdesc));
+	if (!tdesc) {
+		LOG_ERROR("Unable to allocate memory");
+		free(xml);
+		return NULL;
+	}
+
+	LOG_TARGET_DEBUG(target, "generated the target description, layout 0x%08" PRIx32, layout);
+	tdesc->target = key;
+	tdesc->layout = layout;
+	tdesc->refcount = 2;
+	tdesc->supported = supported;
+	tdesc->xml = xml;
+	tdesc->length = strlen(xml);
+	tdesc->next = gdb_tdescs;
+	gdb_tdescs = tdesc;
+
+	return tdesc;
+}
+
+static int gdb_get_target_description_chunk(struct target *target, struct gdb_tdesc **tdesc_p,
+		char **chunk, int32_t offset, uint32_t length)
+{
+	/* the description may be sent again with another layout */
+	if (offset == 0 && *tdesc_p) {
+		gdb_tdesc_put(*tdesc_p);
+		*tdesc_p = NULL;
+	}
+
+	if (!*tdesc_p) {
+		*tdesc_p = gdb_tdesc_get(target);
+		if (!*tdesc_p) {
+			LOG_ERROR("Unable to Generate Target Description");
+			return ERROR_FAIL;
+		}
+	}
+
+	struct gdb_tdesc *tdesc = *tdesc_p;
+	if (offset < 0 || (uint32_t)offset > tdesc->length) {
+		LOG_ERROR("Target description offset %" PRId32 " out of range", offset);
+		return ERROR_FAIL;
+	}
+
+	char transfer_type;
+
+	if (length < (tdesc->length - offset)) {
+		transfer_type = 'm';
+	} else {
+		transfer_type = 'l';
+		length = tdesc->length - offset;
+	}
+
+	*chunk = malloc(length + 2);
+	if (!*chunk) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	(*chunk)[0] = transfer_type;
+	memcpy((*chunk) + 1, tdesc->xml + offset, length);
+	(*chunk)[1 + length] = '\0';
+
+	/* After gdb-server sends out last chunk, release tdesc. */
+	if (transfer_type == 'l') {
+		gdb_tdesc_put(tdesc);
+		*tdesc_p = NULL;
+	}
+
+	return ERROR_OK;
+}
+
 static int gdb_generate_thread_list(struct target *target, char **thread_list_out)
 {
 	struct rtos *rtos = target->rtos;
@@ -2869,8 +3417,19 @@ static int gdb_query_packet(struct connection *connection,
 		int size = 0;
 		int gdb_target_desc_supported = 0;
 
-		/* we need to test that the target supports target descriptions */
-		retval = gdb_target_description_supported(target, &gdb_target_desc_supported);
+		/* we need to test that the target supports target descriptions,
+		 * generating the description now saves it for qXfer:features:read */
+		if (gdb_use_target_description) {
+			struct gdb_tdesc *tdesc = gdb_tdesc_get(target);
+			if (tdesc) {
+				gdb_target_desc_supported = tdesc->supported;
+				gdb_tdesc_put(tdesc);
+			} else {
+				retval = ERROR_FAIL;
+			}
+		} else {
+			retval = gdb_target_description_supported(target, &gdb_target_desc_supported);
+		}
 		if (retval != ERROR_OK) {
 			LOG_INFO("Failed detecting Target Description Support, disabling");
 			gdb_target_desc_supported = 0;
@@ -2887,8 +3446,8 @@ static int gdb_query_packet(struct connection *connection,
 			&buffer,
 			&pos,
 			&size,
-			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+",
-			GDB_BUFFER_SIZE,
+			"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;qXfer:threads:read+;QStartNoAckMode+;vContSupported+;binary-upload+;QNonStop+",
+			gdb_packet_size,
 			((gdb_use_memory_map == 1) && (flash_get_bank_count() > 0)) ? '+' : '-',
 			(gdb_target_desc_supported == 1) ? '+' : '-');
 
@@ -2924,7 +3483,7 @@ static int gdb_query_packet(struct connection *connection,
 		 * there are *more* chunks to transfer. 'l' for it is the *last*
 		 * chunk of target description.
 		 */
-		retval = gdb_get_target_description_chunk(target, &gdb_connection->target_desc,
+		retval = gdb_get_target_description_chunk(target, &gdb_connection->tdesc,
 				&xml, offset, length);
 		if (retval != ERROR_OK) {
 			gdb_error(connection, retval);
@@ -2970,6 +3529,17 @@ static int gdb_query_packet(struct connection *connection,
 		gdb_connection->noack_mode = 1;
 		gdb_put_packet(connection, "OK", 2);
 		return ERROR_OK;
+	} else if (strncmp(packet, "QNonStop:", 9) == 0) {
+		if (packet[9] == '1') {
+			if (gdb_nonstop_enable(connection) != ERROR_OK) {
+				gdb_send_error(connection, EFAULT);
+				return ERROR_OK;
+			}
+		} else {
+			gdb_nonstop_disable(connection);
+		}
+		gdb_put_packet(connection, "OK", 2);
+		return ERROR_OK;
 	} else if (target->type->gdb_query_custom) {
 		char *buffer = NULL;
 		int ret = target->type->gdb_query_custom(target, packet, &buffer);
@@ -2993,12 +3563,15 @@ static bool gdb_handle_vcont_packet(struct connection *connection, const char *p
 	if (parse[0] == '?') {
 		if (target->type->step) {
 			/* gdb doesn't accept c without C and s without S */
-			gdb_put_packet(connection, "vCont;c;C;s;S", 13);
+			gdb_put_packet(connection, "vCont;c;C;s;S;t", 15);
 			return true;
 		}
 		return false;
 	}
 
+	if (gdb_connection->non_stop)
+		return gdb_nonstop_vcont(connection, parse);
+
 	if (parse[0] == ';') {
 		++parse;
 	}
@@ -3247,6 +3820,184 @@ static bool gdb_handle_vrun_packet(struct connection *connection, const char *pa
 	return true;
 }
 
+static void gdb_vflash_send_error(struct connection *connection, int result)
+{
+	if (result == ERROR_FLASH_DST_OUT_OF_BANK)
+		gdb_put_packet(connection, "E.memtype", 9);
+	else
+		gdb_send_error(connection, EIO);
+}
+
+/* Remember the CRC32 of streamed sectors, to verify them at vFlashDone */
+static int gdb_vflash_add_range(struct gdb_connection *gdb_connection,
+		target_addr_t address, uint32_t size, const uint8_t *data)
+{
+	struct gdb_vflash_range *ranges = realloc(gdb_connection->vflash_ranges,
+			(gdb_connection->vflash_num_ranges + 1) * sizeof(*ranges));
+	if (!ranges) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+	gdb_connection->vflash_ranges = ranges;
+
+	struct gdb_vflash_range *range = &ranges[gdb_connection->vflash_num_ranges];
+	range->address = address;
+	range->size = size;
+	int retval = image_calculate_checksum(data, size, &range->checksum);
+	if (retval != ERROR_OK)
+		return retval;
+
+	gdb_connection->vflash_num_ranges++;
+	return ERROR_OK;
+}
+
+/*
+ * Verify the sectors programmed while streaming, as verify_image does: the
+ * data is gone from the image by vFlashDone, so GDB is the only one left
+ * able to check them otherwise. Targets without a checksum algorithm have
+ * the data read back.
+ */
+static int gdb_vflash_read_checksum(struct target *target,
+		const struct gdb_vflash_range *range, uint32_t *checksum)
+{
+	uint8_t *data = malloc(range->size);
+	if (!data) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	int retval = target_read_buffer(target, range->address, range->size, data);
+	if (retval == ERROR_OK)
+		retval = image_calculate_checksum(data, range->size, checksum);
+	free(data);
+	return retval;
+}
+
+static int gdb_vflash_verify_ranges(struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+
+	for (unsigned int i = 0; i < gdb_connection->vflash_num_ranges; i++) {
+		const struct gdb_vflash_range *range = &gdb_connection->vflash_ranges[i];
+		uint32_t checksum;
+		int retval;
+
+		if (target->type->checksum_memory) {
+			retval = target_checksum_memory(target, range->address, range->size, &checksum);
+			/* like verify_image, don't trust a mismatch of the on-target checksum */
+			if (retval == ERROR_OK && checksum != range->checksum) {
+				LOG_DEBUG("checksum mismatch at " TARGET_ADDR_FMT ", reading it back",
+						range->address);
+				retval = gdb_vflash_read_checksum(target, range, &checksum);
+			}
+		} else {
+			retval = gdb_vflash_read_checksum(target, range, &checksum);
+		}
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (checksum != range->checksum) {
+			LOG_ERROR("verification of the flash streamed from GDB failed at "
+					TARGET_ADDR_FMT ", %" PRIu32 " bytes", range->address, range->size);
+			return ERROR_FLASH_OPERATION_FAILED;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/*
+ * Program the complete flash sectors at the end of the image built with
+ * vFlashWrite packets, as the next packets can't modify them any more,
+ * and drop them from the image. The partial sectors are left to vFlashDone.
+ */
+static int gdb_vflash_stream(struct connection *connection)
+{
+	struct gdb_connection *gdb_connection = connection->priv;
+	struct target *target = get_target_from_connection(connection);
+	struct image *image = gdb_connection->vflash_image;
+
+	while (image->num_sections) {
+		struct imagesection *section = &image->sections[image->num_sections - 1];
+		target_addr_t base = section->base_address;
+		target_addr_t end = base + section->size;
+
+		/* let vFlashDone report data out of the flash banks */
+		struct flash_bank *bank;
+		int retval = get_flash_bank_by_addr(target, base, false, &bank);
+		if (retval != ERROR_OK || !bank)
+			return retval;
+
+		/* complete sectors from first to last, excluded */
+		target_addr_t first = 0, last = 0;
+		for (unsigned int i = 0; i < bank->num_sectors; i++) {
+			target_addr_t start = bank->base + bank->sectors[i].offset;
+			target_addr_t stop = start + bank->sectors[i].size;
+
+			if (start < base)
+				continue;
+			if (stop > end)
+				break;
+			if (first == last)
+				first = start;
+			last = stop;
+		}
+
+		if (last - first < GDB_VFLASH_STREAM_MIN_SIZE)
+			return ERROR_OK;
+
+		struct image chunk;
+		retval = image_open(&chunk, "", "build");
+		if (retval != ERROR_OK)
+			return retval;
+
+		uint8_t *data = section->private;
+		retval = image_add_section(&chunk, first, last - first, section->flags,
+				data + (first - base));
+		if (retval == ERROR_OK) {
+			if (!gdb_connection->vflash_streaming) {
+				gdb_connection->vflash_streaming = true;
+				target_call_event_callbacks(target,
+						TARGET_EVENT_GDB_FLASH_WRITE_START);
+			}
+
+			uint32_t written;
+			retval = flash_write(target, &chunk, &written, false);
+			if (retval == ERROR_OK) {
+				LOG_DEBUG("wrote %" PRIu32 " bytes from vFlash stream to flash", written);
+				retval = gdb_vflash_add_range(gdb_connection, first, last - first,
+						data + (first - base));
+			}
+		}
+		image_close(&chunk);
+		if (retval != ERROR_OK)
+			return retval;
+
+		/* keep the partial sectors around the programmed ones */
+		uint32_t head = first - base;
+		uint32_t tail = end - last;
+		if (head) {
+			section->size = head;
+			if (tail) {
+				retval = image_add_section(image, last, tail, section->flags,
+						data + (last - base));
+				if (retval != ERROR_OK)
+					return retval;
+			}
+		} else if (tail) {
+			memmove(data, data + (last - base), tail);
+			section->base_address = last;
+			section->size = tail;
+		} else {
+			free(data);
+			image->num_sections--;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int gdb_v_packet(struct connection *connection,
 		char const *packet, int packet_size)
 {
@@ -3268,6 +4019,11 @@ static int gdb_v_packet(struct connection *connection,
 		return ERROR_OK;
 	}
 
+	if (strncmp(packet, "vStopped", 8) == 0 && gdb_connection->non_stop) {
+		gdb_nonstop_vstopped(connection);
+		return ERROR_OK;
+	}
+
 	if (strncmp(packet, "vRun", 4) == 0) {
 		bool handled;
 
@@ -3359,6 +4115,17 @@ static int gdb_v_packet(struct connection *connection,
 		}
 		length = packet_size - (parse - packet);
 
+		/* the programming of the previous packets failed, possibly
+		 * before any of them got to the flash */
+		if (gdb_connection->vflash_error != ERROR_OK) {
+			gdb_vflash_send_error(connection, gdb_connection->vflash_error);
+			if (gdb_connection->vflash_streaming)
+				target_call_event_callbacks(target,
+					TARGET_EVENT_GDB_FLASH_WRITE_END);
+			gdb_vflash_release(gdb_connection);
+			return ERROR_OK;
+		}
+
 		/* create a new image if there isn't already one */
 		if (!gdb_connection->vflash_image) {
 			gdb_connection->vflash_image = malloc(sizeof(struct image));
@@ -3371,8 +4138,13 @@ static int gdb_v_packet(struct connection *connection,
 		if (retval != ERROR_OK)
 			return retval;
 
+		/* By replying the packet *before* programming the flash, GDB sends
+		 * the next packet while we program the sectors it completed. */
 		gdb_put_packet(connection, "OK", 2);
 
+		if (gdb_flash_stream)
+			gdb_connection->vflash_error = gdb_vflash_stream(connection);
+
 		return ERROR_OK;
 	}
 
@@ -3386,27 +4158,30 @@ static int gdb_v_packet(struct connection *connection,
 			return ERROR_OK;
 		}
 
-		/* process the flashing buffer. No need to erase as GDB
-		 * always issues a vFlashErase first. */
-		target_call_event_callbacks(target,
-				TARGET_EVENT_GDB_FLASH_WRITE_START);
-		result = flash_write(target, gdb_connection->vflash_image,
-			&written, false);
+		/* process the flashing buffer, what is left of it if the complete
+		 * sectors have been streamed. No need to erase as GDB always issues
+		 * a vFlashErase first. */
+		result = gdb_connection->vflash_error;
+		if (!gdb_connection->vflash_streaming)
+			target_call_event_callbacks(target,
+					TARGET_EVENT_GDB_FLASH_WRITE_START);
+		if (result == ERROR_OK && gdb_connection->vflash_image->num_sections) {
+			result = flash_write(target, gdb_connection->vflash_image,
+				&written, false);
+			if (result == ERROR_OK)
+				LOG_DEBUG("wrote %" PRIu32 " bytes from vFlash image to flash", written);
+		}
+		/* the streamed sectors are gone from the image, check them on target */
+		if (result == ERROR_OK)
+			result = gdb_vflash_verify_ranges(connection);
 		target_call_event_callbacks(target,
 			TARGET_EVENT_GDB_FLASH_WRITE_END);
-		if (result != ERROR_OK) {
-			if (result == ERROR_FLASH_DST_OUT_OF_BANK)
-				gdb_put_packet(connection, "E.memtype", 9);
-			else
-				gdb_send_error(connection, EIO);
-		} else {
-			LOG_DEBUG("wrote %u bytes from vFlash image to flash", (unsigned)written);
+		if (result != ERROR_OK)
+			gdb_vflash_send_error(connection, result);
+		else
 			gdb_put_packet(connection, "OK", 2);
-		}
 
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
+		gdb_vflash_release(gdb_connection);
 
 		return ERROR_OK;
 	}
@@ -3501,9 +4276,6 @@ static void gdb_sig_halted(struct connection *connection)
 
 static int gdb_input_inner(struct connection *connection)
 {
-	/* Do not allocate this on the stack */
-	static char gdb_packet_buffer[GDB_BUFFER_SIZE + 1]; /* Extra byte for null-termination */
-
 	struct target *target;
 	char const *packet = gdb_packet_buffer;
 	int packet_size;
@@ -3525,7 +4297,7 @@ static int gdb_input_inner(struct connection *connection)
 	 * drain the rest of the buffer.
 	 */
 	do {
-		packet_size = GDB_BUFFER_SIZE;
+		packet_size = gdb_packet_size;
 		retval = gdb_get_packet(connection, gdb_packet_buffer, &packet_size);
 		if (retval != ERROR_OK)
 			return retval;
@@ -3565,6 +4337,7 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_set_register_packet(connection, packet, packet_size);
 					break;
 				case 'm':
+				case 'x':
 					gdb_con->output_flag = GDB_OUTPUT_NOTIF;
 					retval = gdb_read_memory_packet(connection, packet, packet_size);
 					gdb_con->output_flag = GDB_OUTPUT_NO;
@@ -3579,7 +4352,10 @@ static int gdb_input_inner(struct connection *connection)
 					retval = gdb_breakpoint_watchpoint_packet(connection, packet, packet_size);
 					break;
 				case '?':
-					gdb_last_signal_packet(connection, packet, packet_size);
+					if (gdb_con->non_stop)
+						gdb_nonstop_status(connection);
+					else
+						gdb_last_signal_packet(connection, packet, packet_size);
 					/* '?' is sent after the eventual '!' */
 					if (!warn_use_ext && !gdb_con->extended_protocol) {
 						warn_use_ext = true;
@@ -3724,7 +4500,13 @@ static int gdb_input_inner(struct connection *connection)
 				return retval;
 		}
 
-		if (gdb_con->ctrl_c) {
+		if (gdb_con->ctrl_c && gdb_con->non_stop) {
+			/* GDB stops the threads with vCont;t in non-stop mode,
+			 * handle an interrupt as a stop of all of them */
+			for (unsigned int i = 0; i < gdb_con->thread_count; i++)
+				gdb_nonstop_apply(connection, &gdb_con->threads[i], 't');
+			gdb_con->ctrl_c = false;
+		} else if (gdb_con->ctrl_c) {
 			/* target->state in RESET is introduced to handle the case when CPU undergoes a reset while the
 			 * device goes through standby procedure.Probably better(or may be required) to have a conditional
 			 * warning, but that could be annoying for the user
@@ -3842,6 +4624,7 @@ static int gdb_target_start(struct target *target, const char *port)
 	gdb_service->target = target;
 	gdb_service->core[0] = -1;
 	gdb_service->core[1] = -1;
+	gdb_service->non_stop = false;
 	target->gdb_service = gdb_service;
 
 	ret = add_service(&gdb_service_driver, port, target->gdb_max_connections, gdb_service);
@@ -3974,6 +4757,37 @@ COMMAND_HANDLER(handle_gdb_flash_program_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_gdb_packet_size_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 0) {
+		command_print(CMD, "%u", gdb_packet_size);
+		return ERROR_OK;
+	}
+
+	unsigned int size;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], size);
+	if (size < GDB_BUFFER_SIZE || size > GDB_MAX_PACKET_SIZE) {
+		command_print(CMD, "packet size must be between %d and %d bytes",
+				GDB_BUFFER_SIZE, GDB_MAX_PACKET_SIZE);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	gdb_packet_size = size;
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_gdb_flash_stream_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ENABLE(CMD_ARGV[0], gdb_flash_stream);
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_gdb_report_data_abort_command)
 {
 	if (CMD_ARGC != 1)
@@ -4027,18 +4841,15 @@ COMMAND_HANDLER(handle_gdb_target_description_command)
 
 COMMAND_HANDLER(handle_gdb_save_tdesc_command)
 {
-	char *tdesc;
-	uint32_t tdesc_length;
 	struct target *target = get_current_target(CMD_CTX);
 
-	int retval = gdb_generate_target_description(target, &tdesc);
-	if (retval != ERROR_OK) {
+	struct gdb_tdesc *tdesc = gdb_tdesc_get(target);
+	if (!tdesc) {
 		LOG_ERROR("Unable to Generate Target Description");
 		return ERROR_FAIL;
 	}
 
-	tdesc_length = strlen(tdesc);
-
+	int retval;
 	struct fileio *fileio;
 	size_t size_written;
 
@@ -4055,7 +4866,7 @@ COMMAND_HANDLER(handle_gdb_save_tdesc_command)
 		goto out;
 	}
 
-	retval = fileio_write(fileio, tdesc_length, tdesc, &size_written);
+	retval = fileio_write(fileio, tdesc->length, tdesc->xml, &size_written);
 
 	fileio_close(fileio);
 
@@ -4064,7 +4875,7 @@ COMMAND_HANDLER(handle_gdb_save_tdesc_command)
 
 out:
 	free(tdesc_filename);
-	free(tdesc);
+	gdb_tdesc_put(tdesc);
 
 	return retval;
 }
@@ -4106,6 +4917,21 @@ static const struct command_registration gdb_command_handlers[] = {
 		.help = "enable or disable flash program",
 		.usage = "('enable'|'disable')"
 	},
+	{
+		.name = "gdb_packet_size",
+		.handler = handle_gdb_packet_size_command,
+		.mode = COMMAND_CONFIG,
+		.help = "set the maximum size of the packets exchanged with GDB",
+		.usage = "[size]"
+	},
+	{
+		.name = "gdb_flash_stream",
+		.handler = handle_gdb_flash_stream_command,
+		.mode = COMMAND_CONFIG,
+		.help = "enable or disable the programming of the flash sectors "
+			"while GDB is still sending the image",
+		.usage = "('enable'|'disable')"
+	},
 	{
 		.name = "gdb_report_data_abort",
 		.handler = handle_gdb_report_data_abort_command,
@@ -4156,6 +4982,14 @@ void gdb_service_free(void)
 {
 	free(gdb_port);
 	free(gdb_port_next);
+	free(gdb_packet_buffer);
+	gdb_packet_buffer = NULL;
+
+	while (gdb_tdescs) {
+		struct gdb_tdesc *tdesc = gdb_tdescs;
+		gdb_tdescs = tdesc->next;
+		gdb_tdesc_put(tdesc);
+	}
 }
 
 int gdb_get_actual_connections(void)
@@ -23,6 +23,7 @@ struct reg;
 #include <server/server.h>
 
 #define GDB_BUFFER_SIZE 16384
+#define GDB_MAX_PACKET_SIZE (1024 * 1024)
 
 int gdb_target_add_all(struct target *target);
 int gdb_register_commands(struct command_context *command_context);
@@ -20,6 +20,7 @@
 #include <target/target.h>
 #include <target/target_request.h>
 #include <target/openrisc/jsp_server.h>
+#include <transport/transport.h>
 #include "openocd.h"
 #include "tcl_server.h"
 #include "telnet_server.h"
@@ -35,8 +36,35 @@
 #include <netinet/tcp.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 static struct service *services;
 
+/* bumped whenever a service or a connection comes or goes */
+static unsigned int server_generation;
+
+#ifdef HAVE_SYS_EPOLL_H
+/*
+ * On Linux the listening sockets and the connections are watched with epoll.
+ * The epoll set is only rebuilt when services or connections change, while
+ * select() needs an fd_set rebuilt on every iteration of the server loop.
+ * Should epoll fail, e.g. on a stdin redirected from a file, the server loop
+ * falls back to select() for good.
+ */
+struct server_watch {
+	struct service *service;
+	struct connection *connection;	/* NULL for a listening fd */
+};
+
+static int server_epoll_fd = -1;
+static bool server_epoll_failed;
+static unsigned int server_epoll_generation;
+static struct server_watch *server_watches;
+static unsigned int server_watch_alloc;
+#endif
+
 enum shutdown_reason {
 	CONTINUE_MAIN_LOOP,			/* stay in main event loop */
 	SHUTDOWN_REQUESTED,			/* set by shutdown command; exit the event loop and quit the debugger */
@@ -146,6 +174,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	for (p = &service->connections; *p; p = &(*p)->next)
 		;
 	*p = c;
+	server_generation++;
 
 	if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 		service->max_connections--;
@@ -174,6 +203,7 @@ static int remove_connection(struct service *service, struct connection *connect
 			/* delete connection */
 			*p = c->next;
 			free(c);
+			server_generation++;
 
 			if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 				service->max_connections++;
@@ -333,6 +363,7 @@ int add_service(const struct service_driver *driver, const char *port,
 	for (p = &services; *p; p = &(*p)->next)
 		;
 	*p = c;
+	server_generation++;
 
 	return ERROR_OK;
 }
@@ -373,6 +404,7 @@ int remove_service(const char *name, const char *port)
 
 			free(tmp->priv);
 			free_service(tmp);
+			server_generation++;
 
 			return ERROR_OK;
 		}
@@ -407,6 +439,16 @@ static int remove_services(void)
 	}
 
 	services = NULL;
+	server_generation++;
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (server_epoll_fd != -1)
+		close(server_epoll_fd);
+	server_epoll_fd = -1;
+	free(server_watches);
+	server_watches = NULL;
+	server_watch_alloc = 0;
+#endif
 
 	return ERROR_OK;
 }
@@ -419,6 +461,110 @@ void server_keep_clients_alive(void)
 				s->keep_client_alive(c);
 }
 
+/* handle a new connection on a listener */
+static void server_accept(struct service *service, struct command_context *cmd_ctx)
+{
+	if (service->max_connections != 0) {
+		add_connection(service, cmd_ctx);
+		return;
+	}
+
+	if (service->type == CONNECTION_TCP) {
+		struct sockaddr_in sin;
+		socklen_t address_size = sizeof(sin);
+		int tmp_fd;
+		tmp_fd = accept(service->fd,
+				(struct sockaddr *)&service->sin,
+				&address_size);
+		close_socket(tmp_fd);
+	}
+	LOG_INFO("rejected '%s' connection, no more connections allowed",
+		service->name);
+}
+
+/* handle activity on a connection, dropping it on error */
+static int server_input(struct service *service, struct connection *c)
+{
+	int retval = service->input(c);
+	if (retval == ERROR_OK)
+		return ERROR_OK;
+
+	if (service->type == CONNECTION_PIPE ||
+			service->type == CONNECTION_STDINOUT) {
+		/* if connection uses a pipe then
+		 * shutdown openocd on error */
+		shutdown_openocd = SHUTDOWN_REQUESTED;
+	}
+	remove_connection(service, c);
+	LOG_INFO("dropped '%s' connection", service->name);
+	return retval;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/* (re)build the epoll set if services or connections changed */
+static int server_epoll_sync(void)
+{
+	unsigned int count = 0;
+
+	if (server_epoll_fd != -1 && server_epoll_generation == server_generation)
+		return ERROR_OK;
+
+	if (server_epoll_fd != -1)
+		close(server_epoll_fd);
+
+	server_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (server_epoll_fd == -1)
+		goto fail;
+
+	for (struct service *s = services; s; s = s->next) {
+		count++;
+		for (struct connection *c = s->connections; c; c = c->next)
+			count++;
+	}
+
+	if (count > server_watch_alloc) {
+		struct server_watch *watches = realloc(server_watches,
+				count * sizeof(*watches));
+		if (!watches)
+			goto fail;
+		server_watches = watches;
+		server_watch_alloc = count;
+	}
+
+	count = 0;
+	for (struct service *s = services; s; s = s->next) {
+		struct epoll_event ev = { .events = EPOLLIN };
+
+		if (s->fd != -1) {
+			server_watches[count] = (struct server_watch){ s, NULL };
+			ev.data.u32 = count++;
+			if (epoll_ctl(server_epoll_fd, EPOLL_CTL_ADD, s->fd, &ev) == -1)
+				goto fail;
+		}
+
+		for (struct connection *c = s->connections; c; c = c->next) {
+			if (c->fd < 0)
+				continue;
+			server_watches[count] = (struct server_watch){ s, c };
+			ev.data.u32 = count++;
+			if (epoll_ctl(server_epoll_fd, EPOLL_CTL_ADD, c->fd, &ev) == -1)
+				goto fail;
+		}
+	}
+
+	server_epoll_generation = server_generation;
+	return ERROR_OK;
+
+fail:
+	LOG_DEBUG("epoll failed: %s, using select()", strerror(errno));
+	if (server_epoll_fd != -1)
+		close(server_epoll_fd);
+	server_epoll_fd = -1;
+	server_epoll_failed = true;
+	return ERROR_FAIL;
+}
+#endif
+
 int server_loop(struct command_context *command_context)
 {
 	struct service *service;
@@ -429,6 +575,12 @@ int server_loop(struct command_context *command_context)
 	fd_set read_fds;
 	int fd_max;
 
+#ifdef HAVE_SYS_EPOLL_H
+	/* used in epoll_wait() */
+	struct epoll_event events[16];
+#endif
+	bool use_epoll = false;
+
 	/* used in accept() */
 	int retval;
 
@@ -440,46 +592,58 @@ int server_loop(struct command_context *command_context)
 #endif
 
 	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
-		/* monitor sockets for activity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
+		int timeout_ms = 0;
 
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next) {
-			if (service->fd != -1) {
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
+		if (!poll_ok) {
+			/* Timeout when a target timer expires or every polling_period */
+			timeout_ms = next_event - timeval_ms();
+			if (timeout_ms < 0)
+				timeout_ms = 0;
+			else if (timeout_ms > polling_period)
+				timeout_ms = polling_period;
+		}
 
-				if (service->fd > fd_max)
-					fd_max = service->fd;
-			}
+#ifdef HAVE_SYS_EPOLL_H
+		use_epoll = !server_epoll_failed && server_epoll_sync() == ERROR_OK;
+#endif
 
-			if (service->connections) {
-				struct connection *c;
+		unsigned int generation = server_generation;
+
+		if (use_epoll) {
+#ifdef HAVE_SYS_EPOLL_H
+			/* Only while we're sleeping we'll let others run */
+			retval = epoll_wait(server_epoll_fd, events, ARRAY_SIZE(events), timeout_ms);
+#endif
+		} else {
+			/* monitor sockets for activity */
+			fd_max = 0;
+			FD_ZERO(&read_fds);
+
+			/* add service and connection fds to read_fds */
+			for (service = services; service; service = service->next) {
+				if (service->fd != -1) {
+					/* listen for new connections */
+					FD_SET(service->fd, &read_fds);
+
+					if (service->fd > fd_max)
+						fd_max = service->fd;
+				}
 
-				for (c = service->connections; c; c = c->next) {
-					/* check for activity on the connection */
-					FD_SET(c->fd, &read_fds);
-					if (c->fd > fd_max)
-						fd_max = c->fd;
+				if (service->connections) {
+					struct connection *c;
+
+					for (c = service->connections; c; c = c->next) {
+						/* check for activity on the connection */
+						FD_SET(c->fd, &read_fds);
+						if (c->fd > fd_max)
+							fd_max = c->fd;
+					}
 				}
 			}
-		}
 
-		struct timeval tv;
-		tv.tv_sec = 0;
-		if (poll_ok) {
-			/* we're just polling this iteration, this is faster on embedded
-			 * hosts */
-			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
-		} else {
-			/* Timeout socket_select() when a target timer expires or every polling_period */
-			int timeout_ms = next_event - timeval_ms();
-			if (timeout_ms < 0)
-				timeout_ms = 0;
-			else if (timeout_ms > polling_period)
-				timeout_ms = polling_period;
+			struct timeval tv;
+			tv.tv_sec = 0;
+			/* when just polling, this is faster on embedded hosts */
 			tv.tv_usec = timeout_ms * 1000;
 			/* Only while we're sleeping we'll let others run */
 			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
@@ -510,7 +674,7 @@ int server_loop(struct command_context *command_context)
 		if (retval == 0) {
 			/* Execute callbacks of expired timers when
 			 * - there was nothing to do if poll_ok was true
-			 * - socket_select() timed out if poll_ok was false, now one or more
+			 * - we timed out if poll_ok was false, now one or more
 			 *   timers expired or the polling period elapsed
 			 */
 			target_call_timer_callbacks();
@@ -534,46 +698,51 @@ int server_loop(struct command_context *command_context)
 		 */
 		poll_ok = poll_ok || target_got_message();
 
+#ifdef HAVE_SYS_EPOLL_H
+		/* Dispatch the events; once a service or a connection went away,
+		 * the remaining ones may be stale, epoll reports them again. */
+		for (int i = 0; use_epoll && i < retval; i++) {
+			if (generation != server_generation)
+				break;
+
+			struct server_watch *w = &server_watches[events[i].data.u32];
+			if (w->connection)
+				server_input(w->service, w->connection);
+			else
+				server_accept(w->service, command_context);
+		}
+#endif
+
 		for (service = services; service; service = service->next) {
-			/* handle new connections on listeners */
-			if ((service->fd != -1)
-				&& (FD_ISSET(service->fd, &read_fds))) {
-				if (service->max_connections != 0)
-					add_connection(service, command_context);
-				else {
-					if (service->type == CONNECTION_TCP) {
-						struct sockaddr_in sin;
-						socklen_t address_size = sizeof(sin);
-						int tmp_fd;
-						tmp_fd = accept(service->fd,
-								(struct sockaddr *)&service->sin,
-								&address_size);
-						close_socket(tmp_fd);
-					}
-					LOG_INFO(
-						"rejected '%s' connection, no more connections allowed",
-						service->name);
+			if (use_epoll) {
+				/* only the input buffered by the services is left */
+				struct connection *c = service->connections;
+
+				while (c && generation == server_generation) {
+					struct connection *next = c->next;
+
+					if (c->input_pending)
+						server_input(service, c);
+					c = next;
 				}
+				if (generation != server_generation)
+					break;
+				continue;
 			}
 
+			/* handle new connections on listeners */
+			if ((service->fd != -1)
+				&& (FD_ISSET(service->fd, &read_fds)))
+				server_accept(service, command_context);
+
 			/* handle activity on connections */
 			if (service->connections) {
 				struct connection *c;
 
 				for (c = service->connections; c; ) {
 					if ((c->fd >= 0 && FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
-						retval = service->input(c);
-						if (retval != ERROR_OK) {
-							struct connection *next = c->next;
-							if (service->type == CONNECTION_PIPE ||
-									service->type == CONNECTION_STDINOUT) {
-								/* if connection uses a pipe then
-								 * shutdown openocd on error */
-								shutdown_openocd = SHUTDOWN_REQUESTED;
-							}
-							remove_connection(service, c);
-							LOG_INFO("dropped '%s' connection",
-								service->name);
+						struct connection *next = c->next;
+						if (server_input(service, c) != ERROR_OK) {
 							c = next;
 							continue;
 						}
@@ -695,9 +864,36 @@ int server_init(struct command_context *cmd_ctx)
 	return ERROR_OK;
 }
 
+/* Periodic dump of the transport traffic counters, see "transport stats_dump" */
+static FILE *transport_stats_dump_file;
+
+static int transport_stats_dump_callback(void *priv)
+{
+	if (!transport_stats_dump_file)
+		return ERROR_OK;
+
+	char buf[TRANSPORT_STATS_JSON_SIZE];
+	transport_stats_json(buf, timeval_ms());
+	fprintf(transport_stats_dump_file, "%s\n", buf);
+	fflush(transport_stats_dump_file);
+
+	return ERROR_OK;
+}
+
+static void transport_stats_dump_stop(void)
+{
+	if (!transport_stats_dump_file)
+		return;
+
+	target_unregister_timer_callback(transport_stats_dump_callback, NULL);
+	fclose(transport_stats_dump_file);
+	transport_stats_dump_file = NULL;
+}
+
 int server_quit(void)
 {
 	remove_services();
+	transport_stats_dump_stop();
 	target_quit();
 
 #ifdef _WIN32
@@ -801,6 +997,57 @@ COMMAND_HANDLER(handle_bindto_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_transport_stats_dump_command)
+{
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "off")) {
+		transport_stats_dump_stop();
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	unsigned int period_ms;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[1], period_ms);
+	if (!period_ms) {
+		command_print(CMD, "period must be greater than 0");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	transport_stats_dump_stop();
+
+	transport_stats_dump_file = fopen(CMD_ARGV[0], "a");
+	if (!transport_stats_dump_file) {
+		command_print(CMD, "cannot open file '%s'", CMD_ARGV[0]);
+		return ERROR_FAIL;
+	}
+
+	int retval = target_register_timer_callback(transport_stats_dump_callback,
+			period_ms, TARGET_TIMER_TYPE_PERIODIC, NULL);
+	if (retval != ERROR_OK) {
+		fclose(transport_stats_dump_file);
+		transport_stats_dump_file = NULL;
+	}
+
+	return retval;
+}
+
+/*
+ * The transport layer only keeps the counters, the timer driving their
+ * periodic dump belongs to the server
+ */
+static const struct command_registration transport_stats_dump_command_handlers[] = {
+	{
+		.name = "stats_dump",
+		.handler = &handle_transport_stats_dump_command,
+		.mode = COMMAND_ANY,
+		.usage = "(filename period_ms)|'off'",
+		.help = "Periodically append the transport traffic counters, "
+			"as one JSON object per line, to a file",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration server_command_handlers[] = {
 	{
 		.name = "shutdown",
@@ -841,6 +1088,10 @@ int server_register_commands(struct command_context *cmd_ctx)
 	if (retval != ERROR_OK)
 		return retval;
 
+	retval = transport_register_group_commands(cmd_ctx, transport_stats_dump_command_handlers);
+	if (retval != ERROR_OK)
+		return retval;
+
 	return register_commands(cmd_ctx, NULL, server_command_handlers);
 }
 
@@ -527,7 +527,8 @@ static int aarch64_poll(struct target *target)
 			if (retval != ERROR_OK)
 				return retval;
 
-			if (target->smp)
+			/* an algorithm only ran on this PE, leave the others alone */
+			if (target_smp_coupled(target) && prev_target_state != TARGET_DEBUG_RUNNING)
 				update_halt_gdb(target, debug_reason);
 
 			if (arm_semihosting(target, &retval) != 0)
@@ -546,7 +547,7 @@ static int aarch64_poll(struct target *target)
 				break;
 			}
 		}
-	} else
+	} else if (target->state != TARGET_DEBUG_RUNNING)
 		target->state = TARGET_RUNNING;
 
 	return retval;
@@ -557,7 +558,7 @@ static int aarch64_halt(struct target *target)
 	struct armv8_common *armv8 = target_to_armv8(target);
 	armv8->last_run_control_op = ARMV8_RUNCONTROL_HALT;
 
-	if (target->smp)
+	if (target_smp_coupled(target))
 		return aarch64_halt_smp(target, false);
 
 	return aarch64_halt_one(target, HALT_SYNC);
@@ -623,7 +624,7 @@ static int aarch64_restore_one(struct target *target, int current,
  *
  *
  */
-static int aarch64_prepare_restart_one(struct target *target)
+static int aarch64_prepare_restart_one(struct target *target, int debug_execution)
 {
 	struct armv8_common *armv8 = target_to_armv8(target);
 	int retval;
@@ -646,11 +647,17 @@ static int aarch64_prepare_restart_one(struct target *target)
 	retval = arm_cti_ack_events(armv8->cti, CTI_TRIG(HALT));
 	/*
 	 * open the CTI gate for channel 1 so that the restart events
-	 * get passed along to all PEs. Also close gate for channel 0
-	 * to isolate the PE from halt events.
+	 * get passed along to all PEs, unless the PEs of the SMP group
+	 * run independently (GDB non-stop mode) or an algorithm runs on
+	 * this PE alone. Also close gate for channel 0 to isolate the PE
+	 * from halt events.
 	 */
-	if (retval == ERROR_OK)
-		retval = arm_cti_ungate_channel(armv8->cti, 1);
+	if (retval == ERROR_OK) {
+		if ((target->smp && !target_smp_coupled(target)) || debug_execution)
+			retval = arm_cti_gate_channel(armv8->cti, 1);
+		else
+			retval = arm_cti_ungate_channel(armv8->cti, 1);
+	}
 	if (retval == ERROR_OK)
 		retval = arm_cti_gate_channel(armv8->cti, 0);
 
@@ -712,13 +719,14 @@ static int aarch64_do_restart_one(struct target *target, enum restart_mode mode)
 	return ERROR_OK;
 }
 
-static int aarch64_restart_one(struct target *target, enum restart_mode mode)
+static int aarch64_restart_one(struct target *target, enum restart_mode mode,
+	int debug_execution)
 {
 	int retval;
 
 	LOG_DEBUG("%s", target_name(target));
 
-	retval = aarch64_prepare_restart_one(target);
+	retval = aarch64_prepare_restart_one(target, debug_execution);
 	if (retval == ERROR_OK)
 		retval = aarch64_do_restart_one(target, mode);
 
@@ -749,7 +757,7 @@ static int aarch64_prep_restart_smp(struct target *target, int handle_breakpoint
 		/*  resume at current address, not in step mode */
 		retval = aarch64_restore_one(curr, 1, &address, handle_breakpoints, 0);
 		if (retval == ERROR_OK)
-			retval = aarch64_prepare_restart_one(curr);
+			retval = aarch64_prepare_restart_one(curr, 0);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("failed to restore target %s", target_name(curr));
 			break;
@@ -857,9 +865,11 @@ static int aarch64_resume(struct target *target, int current,
 	 * If this target is part of a SMP group, prepare the others
 	 * targets for resuming. This involves restoring the complete
 	 * target register context and setting up CTI gates to accept
-	 * resume events from the trigger matrix.
+	 * resume events from the trigger matrix. Algorithms only run
+	 * on the calling PE.
 	 */
-	if (target->smp) {
+	bool smp = target_smp_coupled(target) && !debug_execution;
+	if (smp) {
 		retval = aarch64_prep_restart_smp(target, handle_breakpoints, NULL);
 		if (retval != ERROR_OK)
 			return retval;
@@ -869,11 +879,11 @@ static int aarch64_resume(struct target *target, int current,
 	retval = aarch64_restore_one(target, current, &addr, handle_breakpoints,
 				 debug_execution);
 	if (retval == ERROR_OK)
-		retval = aarch64_restart_one(target, RESTART_SYNC);
+		retval = aarch64_restart_one(target, RESTART_SYNC, debug_execution);
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (target->smp) {
+	if (smp) {
 		int64_t then = timeval_ms();
 		for (;;) {
 			struct target *curr = target;
@@ -1013,6 +1023,14 @@ static int aarch64_debug_entry(struct target *target)
 	return retval;
 }
 
+static int aarch64_fetch_registers(struct target *target,
+	enum target_register_class reg_class)
+{
+	struct armv8_common *armv8 = target_to_armv8(target);
+
+	return armv8_dpm_fetch_registers(&armv8->dpm, reg_class == REG_CLASS_ALL);
+}
+
 static int aarch64_post_debug_entry(struct target *target)
 {
 	struct aarch64_common *aarch64 = target_to_aarch64(target);
@@ -1122,7 +1140,7 @@ static int aarch64_step(struct target *target, int current, target_addr_t addres
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (target->smp && (current == 1)) {
+	if (target_smp_coupled(target) && (current == 1)) {
 		/*
 		 * isolate current target so that it doesn't get resumed
 		 * together with the others
@@ -1141,7 +1159,7 @@ static int aarch64_step(struct target *target, int current, target_addr_t addres
 	/* all other targets running, restore and restart the current target */
 	retval = aarch64_restore_one(target, current, &address, 0, 0);
 	if (retval == ERROR_OK)
-		retval = aarch64_restart_one(target, RESTART_LAZY);
+		retval = aarch64_restart_one(target, RESTART_LAZY, 0);
 
 	if (retval != ERROR_OK)
 		return retval;
@@ -2597,7 +2615,7 @@ static int aarch64_examine_first(struct target *target)
 	int i;
 	int retval = ERROR_OK;
 	uint64_t debug, ttypr;
-	uint32_t cpuid;
+	uint32_t cpuid, eddevid;
 	uint32_t tmp0, tmp1, tmp2, tmp3;
 	debug = ttypr = cpuid = 0;
 
@@ -2670,6 +2688,12 @@ static int aarch64_examine_first(struct target *target)
 		LOG_DEBUG("Examine %s failed", "ID_AA64DFR0_EL1");
 		return retval;
 	}
+	retval = mem_ap_read_u32(armv8->debug_ap,
+			armv8->debug_base + CPUV8_DBG_EDDEVID, &eddevid);
+	if (retval != ERROR_OK) {
+		LOG_DEBUG("Examine %s failed", "EDDEVID");
+		return retval;
+	}
 
 	retval = dap_run(armv8->debug_ap->dap);
 	if (retval != ERROR_OK) {
@@ -2685,6 +2709,10 @@ static int aarch64_examine_first(struct target *target)
 	LOG_DEBUG("cpuid = 0x%08" PRIx32, cpuid);
 	LOG_DEBUG("ttypr = 0x%08" PRIx64, ttypr);
 	LOG_DEBUG("debug = 0x%08" PRIx64, debug);
+	LOG_DEBUG("eddevid = 0x%08" PRIx32, eddevid);
+
+	/* EDDEVID.PCSample, the samples have no offset */
+	aarch64->pcsr = (eddevid & 0xF) ? CPUV8_DBG_EDPCSR : 0;
 
 	if (!pc->cti) {
 		LOG_TARGET_ERROR(target, "CTI not specified");
@@ -2753,6 +2781,27 @@ static int aarch64_examine(struct target *target)
 	return retval;
 }
 
+static bool aarch64_get_pcsr(struct target *target, struct arm_dpm_pcsr *pcsr)
+{
+	struct aarch64_common *aarch64 = target_to_aarch64(target);
+	struct armv8_common *armv8 = &aarch64->armv8_common;
+
+	if (!aarch64->pcsr)
+		return false;
+
+	pcsr->ap = armv8->debug_ap;
+	pcsr->address = armv8->debug_base + aarch64->pcsr;
+	pcsr->offset = false;
+	return true;
+}
+
+static int aarch64_profiling(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+{
+	return arm_dpm_profiling(target, aarch64_get_pcsr, samples,
+			max_num_samples, num_samples, seconds);
+}
+
 /*
  *	Cortex-A8 target creation and initialization
  */
@@ -3224,6 +3273,7 @@ struct target_type aarch64_target = {
 	/* REVISIT allow exporting VFP3 registers ... */
 	.get_gdb_arch = armv8_get_gdb_arch,
 	.get_gdb_reg_list = armv8_get_gdb_reg_list,
+	.fetch_registers = aarch64_fetch_registers,
 
 	.read_memory = aarch64_read_memory,
 	.write_memory = aarch64_write_memory,
@@ -3236,6 +3286,12 @@ struct target_type aarch64_target = {
 	.remove_watchpoint = aarch64_remove_watchpoint,
 	.hit_watchpoint = aarch64_hit_watchpoint,
 
+	.run_algorithm = armv8_run_algorithm,
+	.checksum_memory = armv8_checksum_memory,
+	.blank_check_memory = armv8_blank_check_memory,
+
+	.profiling = aarch64_profiling,
+
 	.commands = aarch64_command_handlers,
 	.target_create = aarch64_target_create,
 	.target_jim_configure = aarch64_jim_configure,
@@ -3265,6 +3321,7 @@ struct target_type armv8r_target = {
 	/* REVISIT allow exporting VFP3 registers ... */
 	.get_gdb_arch = armv8_get_gdb_arch,
 	.get_gdb_reg_list = armv8_get_gdb_reg_list,
+	.fetch_registers = aarch64_fetch_registers,
 
 	.read_memory = aarch64_read_phys_memory,
 	.write_memory = aarch64_write_phys_memory,
@@ -3277,6 +3334,8 @@ struct target_type armv8r_target = {
 	.remove_watchpoint = aarch64_remove_watchpoint,
 	.hit_watchpoint = aarch64_hit_watchpoint,
 
+	.profiling = aarch64_profiling,
+
 	.commands = aarch64_command_handlers,
 	.target_create = armv8r_target_create,
 	.target_jim_configure = aarch64_jim_configure,
@@ -58,6 +58,9 @@ struct aarch64_common {
 	struct aarch64_brp *wp_list;
 
 	enum aarch64_isrmasking_mode isrmasking_mode;
+
+	/* PC sample register, offset from the debug base, or 0 */
+	uint32_t pcsr;
 };
 
 static inline struct aarch64_common *
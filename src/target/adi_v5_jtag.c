@@ -558,6 +558,7 @@ static int jtagdp_overrun_check(struct adiv5_dap *dap)
 	/* move all remaining transactions over to the replay list */
 	list_for_each_entry_safe_from(el, tmp, &dap->cmd_journal, lh) {
 		log_dap_cmd(dap, "REP", el);
+		transport_stats_retry();
 		list_move_tail(&el->lh, &replay_list);
 	}
 
@@ -615,6 +616,7 @@ static int jtagdp_overrun_check(struct adiv5_dap *dap)
 					break;
 				}
 				LOG_DEBUG("DAP transaction stalled during replay (WAIT) - resending");
+				transport_stats_retry();
 				/* clear the sticky overrun condition */
 				retval = adi_jtag_scan_inout_check_u32(dap, JTAG_DP_DPACC,
 						DP_CTRL_STAT, DPAP_WRITE,
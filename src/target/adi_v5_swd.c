@@ -85,7 +85,11 @@ static int swd_run_inner(struct adiv5_dap *dap)
 {
 	const struct swd_driver *swd = adiv5_dap_swd_driver(dap);
 
-	return swd->run();
+	int64_t start = timeval_us();
+	int retval = swd->run();
+	transport_stats_flush(timeval_us() - start);
+
+	return retval;
 }
 
 static inline int check_sync(struct adiv5_dap *dap)
@@ -588,25 +588,17 @@ static int mem_ap_write(struct adiv5_ap *ap, const uint8_t *buffer, uint32_t siz
 	return retval;
 }
 
-/**
- * Synchronous read of a block of memory, using a specific access size.
- *
- * @param ap The MEM-AP to access.
- * @param buffer The data buffer to receive the data. No particular alignment is assumed.
- * @param size Which access size to use, in bytes. 1, 2, or 4.
- *	If large data extension is available also accepts sizes 8, 16, 32.
- * @param count The number of reads to do (in size units, not bytes).
- * @param adr Address to be read; it must be readable by the currently selected MEM-AP.
- * @param addrinc Whether the target address should be increased after each read or not. This
- *  should normally be true, except when reading from e.g. a FIFO.
- * @return ERROR_OK on success, otherwise an error code.
- */
-static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint32_t count,
+/* Queue up the DRW reads of a mem_ap_read() into @a read_buf, which must hold
+ * @a count words of MAX(4, @a size) bytes. Each read will store the entire DRW
+ * word in the read buffer. How many useful bytes it contains, and their location
+ * in the word, depends on the type of transfer and alignment. */
+static int mem_ap_read_queue(struct adiv5_ap *ap, uint32_t *read_buf, uint32_t size, uint32_t count,
 		target_addr_t adr, bool addrinc)
 {
 	struct adiv5_dap *dap = ap->dap;
 	size_t nbytes = size * count;
 	target_addr_t address = adr;
+	uint32_t *read_ptr = read_buf;
 	int retval = ERROR_OK;
 
 	/* TI BE-32 Quirks mode:
@@ -624,21 +616,6 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 	if (ap->unaligned_access_bad && (adr % size != 0))
 		return ERROR_TARGET_UNALIGNED_ACCESS;
 
-	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
-	 * over-allocation if packed transfers are going to be used, but determining the real need at
-	 * this point would be messy. */
-	uint32_t *read_buf = calloc(count, MAX(sizeof(uint32_t), size));
-
-	/* Multiplication count * sizeof(uint32_t) may overflow, calloc() is safe */
-	uint32_t *read_ptr = read_buf;
-	if (!read_buf) {
-		LOG_ERROR("Failed to allocate read buffer");
-		return ERROR_FAIL;
-	}
-
-	/* Queue up all reads. Each read will store the entire DRW word in the read buffer. How many
-	 * useful bytes it contains, and their location in the word, depends on the type of transfer
-	 * and alignment. */
 	while (nbytes > 0) {
 		unsigned int this_size;
 		retval = mem_ap_setup_transfer_verify_size_packing_fallback(ap,
@@ -662,34 +639,17 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 		mem_ap_update_tar_cache(ap);
 	}
 
-	if (retval == ERROR_OK)
-		retval = dap_run(dap);
-
-	/* Restore state */
-	address = adr;
-	nbytes = size * count;
-	read_ptr = read_buf;
-
-	/* If something failed, read TAR to find out how much data was successfully read, so we can
-	 * at least give the caller what we have. */
-	if (retval == ERROR_TARGET_SIZE_NOT_SUPPORTED) {
-		nbytes = 0;
-	} else if (retval != ERROR_OK) {
-		target_addr_t tar;
-		if (mem_ap_read_tar(ap, &tar) == ERROR_OK) {
-			/* TAR is incremented after failed transfer on some devices (eg Cortex-M4) */
-			LOG_ERROR("Failed to read memory at " TARGET_ADDR_FMT, tar);
-			if (nbytes > tar - address)
-				nbytes = tar - address;
-		} else {
-			LOG_ERROR("Failed to read memory and, additionally, failed to find out where");
-			nbytes = 0;
-		}
-	}
+	return retval;
+}
 
-	target_addr_t ti_be_lane_xor = dap->ti_be_32_quirks ? 3 : 0;
+/* Replay the DRW words queued by mem_ap_read_queue() to populate the caller's
+ * buffer with the first @a nbytes read, from the correct word and byte lane */
+static void mem_ap_read_replay(struct adiv5_ap *ap, uint8_t *buffer, const uint32_t *read_buf,
+		uint32_t size, size_t nbytes, target_addr_t address, bool addrinc)
+{
+	const uint32_t *read_ptr = read_buf;
+	target_addr_t ti_be_lane_xor = ap->dap->ti_be_32_quirks ? 3 : 0;
 
-	/* Replay loop to populate caller's buffer from the correct word and byte lane */
 	while (nbytes > 0) {
 		/* Convert transfers longer than 32-bit on word-at-a-time basis */
 		unsigned int this_size = MIN(size, 4);
@@ -714,6 +674,66 @@ static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint
 		read_ptr++;
 		nbytes -= this_size;
 	}
+}
+
+/**
+ * Synchronous read of a block of memory, using a specific access size.
+ *
+ * @param ap The MEM-AP to access.
+ * @param buffer The data buffer to receive the data. No particular alignment is assumed.
+ * @param size Which access size to use, in bytes. 1, 2, or 4.
+ *	If large data extension is available also accepts sizes 8, 16, 32.
+ * @param count The number of reads to do (in size units, not bytes).
+ * @param adr Address to be read; it must be readable by the currently selected MEM-AP.
+ * @param addrinc Whether the target address should be increased after each read or not. This
+ *  should normally be true, except when reading from e.g. a FIFO.
+ * @return ERROR_OK on success, otherwise an error code.
+ */
+static int mem_ap_read(struct adiv5_ap *ap, uint8_t *buffer, uint32_t size, uint32_t count,
+		target_addr_t adr, bool addrinc)
+{
+	struct adiv5_dap *dap = ap->dap;
+	size_t nbytes = size * count;
+	int retval;
+
+	/* Allocate buffer to hold the sequence of DRW reads that will be made. This is a significant
+	 * over-allocation if packed transfers are going to be used, but determining the real need at
+	 * this point would be messy. */
+	uint32_t *read_buf = calloc(count, MAX(sizeof(uint32_t), size));
+
+	/* Multiplication count * sizeof(uint32_t) may overflow, calloc() is safe */
+	if (!read_buf) {
+		LOG_ERROR("Failed to allocate read buffer");
+		return ERROR_FAIL;
+	}
+
+	retval = mem_ap_read_queue(ap, read_buf, size, count, adr, addrinc);
+	if (retval == ERROR_TARGET_UNALIGNED_ACCESS) {
+		free(read_buf);
+		return retval;
+	}
+
+	if (retval == ERROR_OK)
+		retval = dap_run(dap);
+
+	/* If something failed, read TAR to find out how much data was successfully read, so we can
+	 * at least give the caller what we have. */
+	if (retval == ERROR_TARGET_SIZE_NOT_SUPPORTED) {
+		nbytes = 0;
+	} else if (retval != ERROR_OK) {
+		target_addr_t tar;
+		if (mem_ap_read_tar(ap, &tar) == ERROR_OK) {
+			/* TAR is incremented after failed transfer on some devices (eg Cortex-M4) */
+			LOG_ERROR("Failed to read memory at " TARGET_ADDR_FMT, tar);
+			if (nbytes > tar - adr)
+				nbytes = tar - adr;
+		} else {
+			LOG_ERROR("Failed to read memory and, additionally, failed to find out where");
+			nbytes = 0;
+		}
+	}
+
+	mem_ap_read_replay(ap, buffer, read_buf, size, nbytes, adr, addrinc);
 
 	free(read_buf);
 	return retval;
@@ -737,6 +757,62 @@ int mem_ap_read_buf_noincr(struct adiv5_ap *ap,
 	return mem_ap_read(ap, buffer, size, count, address, false);
 }
 
+/* Widest access size the address and the length of @a sg are aligned to */
+static unsigned int mem_ap_sg_access_size(const struct target_memory_sg *sg)
+{
+	if ((sg->address | sg->size) & 1)
+		return 1;
+	if ((sg->address | sg->size) & 2)
+		return 2;
+	return 4;
+}
+
+int mem_ap_read_buf_sg(struct adiv5_ap *ap,
+		const struct target_memory_sg *sg, unsigned int count)
+{
+	unsigned int words = 0;
+	int retval = ERROR_OK;
+
+	/* One DRW word per access at most */
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int size = mem_ap_sg_access_size(&sg[i]);
+		words += sg[i].size / size;
+	}
+
+	uint32_t *read_buf = calloc(words, sizeof(uint32_t));
+	if (!read_buf) {
+		LOG_ERROR("Failed to allocate read buffer");
+		return ERROR_FAIL;
+	}
+
+	uint32_t *read_ptr = read_buf;
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		unsigned int size = mem_ap_sg_access_size(&sg[i]);
+		retval = mem_ap_read_queue(ap, read_ptr, size, sg[i].size / size,
+				sg[i].address, true);
+		read_ptr += sg[i].size / size;
+	}
+
+	if (retval == ERROR_OK)
+		retval = dap_run(ap->dap);
+	if (retval != ERROR_OK) {
+		LOG_DEBUG("Failed to read %u memory blocks in one go", count);
+		free(read_buf);
+		return retval;
+	}
+
+	read_ptr = read_buf;
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int size = mem_ap_sg_access_size(&sg[i]);
+		mem_ap_read_replay(ap, sg[i].buffer, read_ptr, size, sg[i].size,
+				sg[i].address, true);
+		read_ptr += sg[i].size / size;
+	}
+
+	free(read_buf);
+	return ERROR_OK;
+}
+
 int mem_ap_write_buf_noincr(struct adiv5_ap *ap,
 		const uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address)
 {
@@ -23,6 +23,7 @@
 #include <helper/list.h>
 #include "arm_jtag.h"
 #include "helper/bits.h"
+#include <transport/transport.h>
 
 /* JEP106 ID for ARM */
 #define ARM_ID 0x23B
@@ -556,6 +557,7 @@ static inline int dap_queue_dp_read(struct adiv5_dap *dap,
 		unsigned reg, uint32_t *data)
 {
 	assert(dap->ops);
+	transport_stats_dap_transactions(1);
 	return dap->ops->queue_dp_read(dap, reg, data);
 }
 
@@ -574,6 +576,7 @@ static inline int dap_queue_dp_write(struct adiv5_dap *dap,
 		unsigned reg, uint32_t data)
 {
 	assert(dap->ops);
+	transport_stats_dap_transactions(1);
 	return dap->ops->queue_dp_write(dap, reg, data);
 }
 
@@ -595,6 +598,7 @@ static inline int dap_queue_ap_read(struct adiv5_ap *ap,
 		ap->refcount = 1;
 		LOG_ERROR("BUG: refcount AP#0x%" PRIx64 " used without get", ap->ap_num);
 	}
+	transport_stats_dap_transactions(1);
 	return ap->dap->ops->queue_ap_read(ap, reg, data);
 }
 
@@ -615,6 +619,7 @@ static inline int dap_queue_ap_write(struct adiv5_ap *ap,
 		ap->refcount = 1;
 		LOG_ERROR("BUG: refcount AP#0x%" PRIx64 " used without get", ap->ap_num);
 	}
+	transport_stats_dap_transactions(1);
 	return ap->dap->ops->queue_ap_write(ap, reg, data);
 }
 
@@ -724,6 +729,14 @@ int mem_ap_read_buf_noincr(struct adiv5_ap *ap,
 int mem_ap_write_buf_noincr(struct adiv5_ap *ap,
 		const uint8_t *buffer, uint32_t size, uint32_t count, target_addr_t address);
 
+struct target_memory_sg;
+
+/* Synchronous read of several blocks of memory, all queued before a single
+ * dap_run(). Each block is read with the widest access size its address and
+ * length are aligned to. Nothing is reliable in the buffers on error. */
+int mem_ap_read_buf_sg(struct adiv5_ap *ap,
+		const struct target_memory_sg *sg, unsigned int count);
+
 /* Initialisation of the debug system, power domains and registers */
 int dap_dp_init(struct adiv5_dap *dap);
 int dap_dp_init_or_reconnect(struct adiv5_dap *dap);
@@ -16,6 +16,7 @@
 #include "helper/list.h"
 #include "helper/command.h"
 #include "transport/transport.h"
+#include "jtag/benchmark.h"
 #include "jtag/interface.h"
 
 static LIST_HEAD(all_dap);
@@ -496,6 +497,88 @@ COMMAND_HANDLER(handle_dap_info_command)
 	return retval;
 }
 
+/* Size of the blocks written by "benchmark memap" */
+#define BENCHMARK_MEMAP_BLOCK 4096
+
+COMMAND_HANDLER(handle_benchmark_memap)
+{
+	uint32_t bytes = 1024 * 1024;
+	uint64_t apsel = 0;
+	target_addr_t address;
+
+	if (CMD_ARGC < 2 || CMD_ARGC > 4)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct arm_dap_object *obj;
+	struct adiv5_dap *dap = NULL;
+	list_for_each_entry(obj, &all_dap, lh) {
+		if (!strcmp(CMD_ARGV[0], obj->name)) {
+			dap = &obj->dap;
+			break;
+		}
+	}
+	if (!dap) {
+		command_print(CMD, "DAP '%s' could not be found", CMD_ARGV[0]);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (!dap->ops) {
+		command_print(CMD, "DAP '%s' is not initialized", CMD_ARGV[0]);
+		return ERROR_FAIL;
+	}
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], address);
+	if (CMD_ARGC > 2)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], bytes);
+	if (CMD_ARGC > 3) {
+		COMMAND_PARSE_NUMBER(u64, CMD_ARGV[3], apsel);
+		if (!is_ap_num_valid(dap, apsel))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	struct adiv5_ap *ap = dap_get_ap(dap, apsel);
+	if (!ap) {
+		command_print(CMD, "Cannot get AP");
+		return ERROR_FAIL;
+	}
+
+	int retval = ERROR_OK;
+	if (ap->cfg_reg == MEM_AP_REG_CFG_INVALID)
+		retval = mem_ap_init(ap);
+
+	uint8_t buffer[BENCHMARK_MEMAP_BLOCK];
+	for (unsigned int i = 0; i < sizeof(buffer); i++)
+		buffer[i] = i;
+
+	struct benchmark_run run;
+	benchmark_run_start(&run);
+
+	for (uint32_t offset = 0; offset < bytes && retval == ERROR_OK; offset += sizeof(buffer)) {
+		uint32_t n = MIN(bytes - offset, sizeof(buffer));
+		retval = mem_ap_write_buf(ap, buffer, 4, DIV_ROUND_UP(n, 4), address + offset);
+	}
+
+	if (retval == ERROR_OK)
+		benchmark_run_report(CMD, &run, "memap",
+				transport_get_stats()->dap_transactions - run.start_stats.dap_transactions);
+	else
+		command_print(CMD, "memap: MEM-AP write failed");
+
+	dap_put_ap(ap);
+
+	return retval;
+}
+
+static const struct command_registration dap_benchmark_subcommand_handlers[] = {
+	{
+		.name = "memap",
+		.handler = handle_benchmark_memap,
+		.mode = COMMAND_EXEC,
+		.help = "Write blocks of memory through a MEM-AP, 1 MiB by default",
+		.usage = "dap_name address [bytes [ap_num]]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
 static const struct command_registration dap_subcommand_handlers[] = {
 	{
 		.name = "create",
@@ -542,5 +625,9 @@ static const struct command_registration dap_commands[] = {
 
 int dap_register_commands(struct command_context *cmd_ctx)
 {
-	return register_commands(cmd_ctx, NULL, dap_commands);
+	int retval = register_commands(cmd_ctx, NULL, dap_commands);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return register_commands(cmd_ctx, "benchmark", dap_benchmark_subcommand_handlers);
 }
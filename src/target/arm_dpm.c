@@ -16,6 +16,9 @@
 #include "breakpoints.h"
 #include "target_type.h"
 #include "arm_opcodes.h"
+#include "arm_adi_v5.h"
+#include "smp.h"
+#include <helper/time_support.h>
 
 
 /**
@@ -205,6 +208,14 @@ static int dpm_read_reg_u64(struct arm_dpm *dpm, struct reg *r, unsigned regnum)
 	return retval;
 }
 
+static void dpm_set_reg_u32(struct reg *r, uint32_t value)
+{
+	buf_set_u32(r->value, 0, 32, value);
+	r->valid = true;
+	r->dirty = false;
+	LOG_DEBUG("READ: %s, %8.8" PRIx32, r->name, value);
+}
+
 /* just read the register -- rely on the core mode being right */
 int arm_dpm_read_reg(struct arm_dpm *dpm, struct reg *r, unsigned regnum)
 {
@@ -262,12 +273,8 @@ int arm_dpm_read_reg(struct arm_dpm *dpm, struct reg *r, unsigned regnum)
 			break;
 	}
 
-	if (retval == ERROR_OK) {
-		buf_set_u32(r->value, 0, 32, value);
-		r->valid = true;
-		r->dirty = false;
-		LOG_DEBUG("READ: %s, %8.8x", r->name, (unsigned) value);
-	}
+	if (retval == ERROR_OK)
+		dpm_set_reg_u32(r, value);
 
 	return retval;
 }
@@ -379,6 +386,8 @@ static int dpm_write_pc_core_state(struct arm_dpm *dpm, struct reg *r)
 int arm_dpm_read_current_registers(struct arm_dpm *dpm)
 {
 	struct arm *arm = dpm->arm;
+	uint32_t regs[15];
+	bool batched = false;
 	uint32_t cpsr;
 	int retval;
 	struct reg *r;
@@ -387,11 +396,25 @@ int arm_dpm_read_current_registers(struct arm_dpm *dpm)
 	if (retval != ERROR_OK)
 		return retval;
 
+	/* R0..R14 of the current mode in one go, if the core can queue them;
+	 * they are stored once CPSR tells which of the shadow registers they are
+	 */
+	if (dpm->instr_read_data_dcc_n) {
+		uint32_t opcodes[15];
+
+		for (unsigned int i = 0; i < 15; i++)
+			opcodes[i] = ARMV4_5_MCR(14, 0, i, 0, 5, 0);
+		batched = dpm->instr_read_data_dcc_n(dpm, opcodes, regs, 15) == ERROR_OK;
+	}
+
 	/* read R0 and R1 first (it's used for scratch), then CPSR */
 	for (unsigned i = 0; i < 2; i++) {
 		r = arm->core_cache->reg_list + i;
 		if (!r->valid) {
-			retval = arm_dpm_read_reg(dpm, r, i);
+			if (batched)
+				dpm_set_reg_u32(r, regs[i]);
+			else
+				retval = arm_dpm_read_reg(dpm, r, i);
 			if (retval != ERROR_OK)
 				goto fail;
 		}
@@ -411,6 +434,11 @@ int arm_dpm_read_current_registers(struct arm_dpm *dpm)
 		if (r->valid)
 			continue;
 
+		if (batched && i < 15) {
+			dpm_set_reg_u32(r, regs[i]);
+			continue;
+		}
+
 		retval = arm_dpm_read_reg(dpm, r, i);
 		if (retval != ERROR_OK)
 			goto fail;
@@ -1080,6 +1108,131 @@ void arm_dpm_report_dscr(struct arm_dpm *dpm, uint32_t dscr)
 	}
 }
 
+/* PC samples read in a row from one core, before moving to the next one */
+#define PCSR_BATCH_SIZE 1024
+
+static int arm_dpm_sample_pcsr(struct target *target, const struct arm_dpm_pcsr *pcsr,
+		unsigned int num_pcsr, uint32_t *samples, uint32_t max_num_samples,
+		uint32_t *num_samples, uint32_t seconds)
+{
+	struct timeval timeout, now;
+	uint32_t sample_count = 0;
+	uint32_t discarded = 0;
+	int retval = ERROR_OK;
+
+	gettimeofday(&timeout, NULL);
+	timeval_add_time(&timeout, seconds, 0);
+
+	LOG_TARGET_DEBUG(target, "Starting profiling. Sampling the PC of %u core(s) as fast as we can...",
+			num_pcsr);
+
+	/* Make sure the target is running */
+	target_poll(target);
+	if (target->state == TARGET_HALTED)
+		retval = target_resume(target, 1, 0, 0, 0);
+
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Error while resuming target");
+		return retval;
+	}
+
+	uint32_t batch_size = MAX(PCSR_BATCH_SIZE / num_pcsr, 1);
+
+	for (unsigned int core = 0; ; core = (core + 1) % num_pcsr) {
+		uint32_t read_count = MIN(max_num_samples - sample_count, batch_size);
+		uint32_t *batch = &samples[sample_count];
+
+		retval = mem_ap_read_buf_noincr(pcsr[core].ap, (uint8_t *)batch, 4,
+				read_count, pcsr[core].address);
+		if (retval != ERROR_OK) {
+			LOG_TARGET_ERROR(target, "Error while reading PCSR");
+			return retval;
+		}
+
+		for (uint32_t i = 0; i < read_count; i++) {
+			uint32_t pc = le_to_h_u32((uint8_t *)&batch[i]);
+
+			if (pc == 0xffffffff) {
+				discarded++;
+				continue;
+			}
+
+			/* ARMv7 debug: bit 0 set in Thumb state, bits [1:0] clear in ARM state */
+			if (pc & 1)
+				pc = (pc & ~1) - (pcsr[core].offset ? 4 : 0);
+			else if (!(pc & 2))
+				pc -= pcsr[core].offset ? 8 : 0;
+
+			samples[sample_count++] = pc;
+		}
+
+		gettimeofday(&now, NULL);
+		if (sample_count >= max_num_samples || timeval_compare(&now, &timeout) > 0) {
+			LOG_TARGET_DEBUG(target, "Profiling completed. %" PRIu32 " samples, %" PRIu32
+					" discarded as the core was halted or sampling was prohibited.",
+					sample_count, discarded);
+			break;
+		}
+	}
+
+	*num_samples = sample_count;
+	return ERROR_OK;
+}
+
+/**
+ * Samples the program counter of running cores without halting them, by
+ * reading their PC sample register (DBGPCSR, EDPCSRlo) in batches of
+ * non-incrementing MEM-AP reads. The cores of an SMP group are sampled in
+ * turn. Cores without such a register are halted at each sample instead,
+ * see target_profiling_default().
+ *
+ * Samples taken while a core is halted, or while sampling is prohibited,
+ * read as all ones and are discarded. Only the 32 lower bits of AArch64
+ * program counters are kept.
+ *
+ * @param get_pcsr Fills in the PC sample register of a core, returns false
+ *	if it has none.
+ */
+int arm_dpm_profiling(struct target *target,
+		bool (*get_pcsr)(struct target *target, struct arm_dpm_pcsr *pcsr),
+		uint32_t *samples, uint32_t max_num_samples, uint32_t *num_samples,
+		uint32_t seconds)
+{
+	struct target_list *head;
+	unsigned int num_pcsr = 0;
+
+	struct arm_dpm_pcsr *pcsr = calloc(target->smp ? list_count_nodes(target->smp_targets) : 1,
+			sizeof(*pcsr));
+	if (!pcsr) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	if (target->smp) {
+		foreach_smp_target(head, target->smp_targets) {
+			if (head->target->type == target->type &&
+					target_was_examined(head->target) &&
+					get_pcsr(head->target, &pcsr[num_pcsr]))
+				num_pcsr++;
+		}
+	} else if (get_pcsr(target, &pcsr[0])) {
+		num_pcsr++;
+	}
+
+	int retval;
+	if (num_pcsr) {
+		retval = arm_dpm_sample_pcsr(target, pcsr, num_pcsr, samples,
+				max_num_samples, num_samples, seconds);
+	} else {
+		LOG_TARGET_DEBUG(target, "PCSR sampling not supported on this processor.");
+		retval = target_profiling_default(target, samples, max_num_samples,
+				num_samples, seconds);
+	}
+
+	free(pcsr);
+	return retval;
+}
+
 /*----------------------------------------------------------------------*/
 
 /*
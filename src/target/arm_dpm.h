@@ -94,6 +94,14 @@ struct arm_dpm {
 	int (*instr_read_data_dcc_64)(struct arm_dpm *dpm,
 			uint32_t opcode, uint64_t *data);
 
+	/**
+	 * Optional. Runs @a count instructions, each writing one word to the
+	 * dcc, and reads these words into @a data, queueing the whole sequence
+	 * instead of waiting for the dcc after each instruction.
+	 */
+	int (*instr_read_data_dcc_n)(struct arm_dpm *dpm,
+			const uint32_t *opcodes, uint32_t *data, unsigned int count);
+
 	/** Runs one instruction, reading data from r0 after execution. */
 	int (*instr_read_data_r0)(struct arm_dpm *dpm,
 			uint32_t opcode, uint32_t *data);
@@ -166,6 +174,22 @@ int arm_dpm_write_dirty_registers(struct arm_dpm *dpm, bool bpwp);
 
 void arm_dpm_report_wfar(struct arm_dpm *dpm, uint32_t wfar);
 
+struct adiv5_ap;
+
+/* A core sampled by arm_dpm_profiling() */
+struct arm_dpm_pcsr {
+	struct adiv5_ap *ap;
+	/* address of DBGPCSR or EDPCSRlo */
+	target_addr_t address;
+	/* samples are the instruction address + 8 in ARM state, + 4 in Thumb state */
+	bool offset;
+};
+
+int arm_dpm_profiling(struct target *target,
+		bool (*get_pcsr)(struct target *target, struct arm_dpm_pcsr *pcsr),
+		uint32_t *samples, uint32_t max_num_samples, uint32_t *num_samples,
+		uint32_t seconds);
+
 /* DSCR bits; see ARMv7a arch spec section C10.3.1.
  * Not all v7 bits are valid in v6.
  */
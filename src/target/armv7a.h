@@ -132,10 +132,20 @@ static inline bool is_armv7a(struct armv7a_common *armv7a)
 
 /* See ARMv7a arch spec section C10.2 */
 #define CPUDBG_DIDR		0x000
+#define CPUDBG_DEVID1		0xFC4
+#define CPUDBG_DEVID		0xFC8
+
+/* DIDR bits */
+#define DIDR_VERSION(didr)	(((didr) >> 16) & 0xF)
+#define DIDR_VERSION_V7_1	5
+#define DIDR_DEVID_IMP		(1 << 15)
+#define DIDR_PCSR_IMP		(1 << 13)
 
 /* See ARMv7a arch spec section C10.3 */
 #define CPUDBG_WFAR		0x018
 /* PCSR at 0x084 -or- 0x0a0 -or- both ... based on flags in DIDR */
+#define CPUDBG_PCSR_LEGACY	0x084
+#define CPUDBG_PCSR		0x0A0
 #define CPUDBG_DSCR		0x088
 #define CPUDBG_DRCR		0x090
 #define CPUDBG_PRCR		0x310
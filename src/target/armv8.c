@@ -14,6 +14,7 @@
 #include <helper/replacements.h>
 
 #include "armv8.h"
+#include "armv8_cache.h"
 #include "arm_disassembler.h"
 
 #include "register.h"
@@ -28,6 +29,7 @@
 #include "armv8_opcodes.h"
 #include "target.h"
 #include "target_type.h"
+#include "algorithm.h"
 #include "semihosting_common.h"
 
 static const char * const armv8_state_strings[] = {
@@ -1953,3 +1955,388 @@ int armv8_set_dbgreg_bits(struct armv8_common *armv8, unsigned int reg, unsigned
 			armv8->debug_base + reg, tmp);
 	return retval;
 }
+
+/* wait for execution to complete and check exit point */
+static int armv8_run_algorithm_completion(struct target *target,
+	target_addr_t exit_point, unsigned int timeout_ms)
+{
+	struct arm *arm = target_to_arm(target);
+	int retval;
+
+	retval = target_wait_state(target, TARGET_HALTED, timeout_ms);
+	if (retval != ERROR_OK)
+		return retval;
+	if (target->state != TARGET_HALTED) {
+		retval = target_halt(target);
+		if (retval != ERROR_OK)
+			return retval;
+		retval = target_wait_state(target, TARGET_HALTED, 500);
+		if (retval != ERROR_OK)
+			return retval;
+		return ERROR_TARGET_TIMEOUT;
+	}
+
+	/* the algorithm terminates with a HLT, which leaves the PC on it */
+	if (exit_point && buf_get_u64(arm->pc->value, 0, 64) != exit_point) {
+		LOG_TARGET_WARNING(target,
+			"reentered debug state, but not at the desired exit point: 0x%" PRIx64,
+			buf_get_u64(arm->pc->value, 0, 64));
+		return ERROR_TARGET_TIMEOUT;
+	}
+
+	return ERROR_OK;
+}
+
+/**
+ * Runs AArch64 code on the target. The algorithm is entered in the current
+ * exception level and must terminate with a HLT instruction; a nonzero
+ * @a exit_point is the expected address of that instruction.
+ */
+int armv8_run_algorithm(struct target *target,
+	int num_mem_params, struct mem_param *mem_params,
+	int num_reg_params, struct reg_param *reg_params,
+	target_addr_t entry_point, target_addr_t exit_point,
+	unsigned int timeout_ms, void *arch_info)
+{
+	struct arm *arm = target_to_arm(target);
+	struct arm_algorithm *arm_algorithm_info = arch_info;
+	uint64_t context[ARMV8_XPSR + 1];
+	int i;
+	int retval;
+
+	LOG_DEBUG("Running algorithm");
+
+	if (arm_algorithm_info->common_magic != ARM_COMMON_MAGIC) {
+		LOG_ERROR("current target isn't an ARM target");
+		return ERROR_TARGET_INVALID;
+	}
+
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_ERROR(target, "not halted (run target algo)");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	if (arm_algorithm_info->core_state != ARM_STATE_AARCH64
+			|| arm->core_state != ARM_STATE_AARCH64) {
+		LOG_TARGET_ERROR(target, "can only run algorithms in AArch64 state");
+		return ERROR_TARGET_INVALID;
+	}
+
+	/* entering another exception level would need an exception return */
+	if (arm_algorithm_info->core_mode != ARM_MODE_ANY
+			&& arm_algorithm_info->core_mode != arm->core_mode) {
+		LOG_TARGET_ERROR(target, "can't run algorithm in %s mode",
+			armv8_mode_name(arm_algorithm_info->core_mode));
+		return ERROR_TARGET_INVALID;
+	}
+
+	/* save x0..x30, sp, pc and cpsr; they'll be restored later */
+	for (i = ARMV8_R0; i <= ARMV8_XPSR; i++) {
+		struct reg *r = armv8_reg_current(arm, i);
+
+		if (!r->valid) {
+			retval = r->type->get(r);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		context[i] = buf_get_u64(r->value, 0, r->size);
+	}
+
+	for (i = 0; i < num_mem_params; i++) {
+		if (mem_params[i].direction == PARAM_IN)
+			continue;
+		retval = target_write_buffer(target, mem_params[i].address, mem_params[i].size,
+				mem_params[i].value);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (i = 0; i < num_reg_params; i++) {
+		if (reg_params[i].direction == PARAM_IN)
+			continue;
+
+		struct reg *reg = register_get_by_name(arm->core_cache, reg_params[i].reg_name, false);
+		if (!reg) {
+			LOG_ERROR("BUG: register '%s' not found", reg_params[i].reg_name);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		if (reg->size != reg_params[i].size) {
+			LOG_ERROR("BUG: register '%s' size doesn't match reg_params[i].size",
+				reg_params[i].reg_name);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+
+		retval = reg->type->set(reg, reg_params[i].value);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	retval = target_resume(target, 0, entry_point, 1, 1);
+	if (retval != ERROR_OK)
+		return retval;
+	retval = armv8_run_algorithm_completion(target, exit_point, timeout_ms);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (i = 0; i < num_mem_params; i++) {
+		if (mem_params[i].direction != PARAM_OUT) {
+			int retvaltemp = target_read_buffer(target, mem_params[i].address,
+					mem_params[i].size,
+					mem_params[i].value);
+			if (retvaltemp != ERROR_OK)
+				retval = retvaltemp;
+		}
+	}
+
+	for (i = 0; i < num_reg_params; i++) {
+		if (reg_params[i].direction != PARAM_OUT) {
+			struct reg *reg = register_get_by_name(arm->core_cache,
+					reg_params[i].reg_name, false);
+			if (!reg) {
+				LOG_ERROR("BUG: register '%s' not found", reg_params[i].reg_name);
+				retval = ERROR_COMMAND_SYNTAX_ERROR;
+				continue;
+			}
+
+			if (reg->size != reg_params[i].size) {
+				LOG_ERROR("BUG: register '%s' size doesn't match reg_params[i].size",
+					reg_params[i].reg_name);
+				retval = ERROR_COMMAND_SYNTAX_ERROR;
+				continue;
+			}
+
+			buf_cpy(reg->value, reg_params[i].value, reg->size);
+		}
+	}
+
+	/* restore everything we saved before */
+	for (i = ARMV8_R0; i < ARMV8_XPSR; i++) {
+		struct reg *r = armv8_reg_current(arm, i);
+
+		if (buf_get_u64(r->value, 0, r->size) != context[i]) {
+			LOG_DEBUG("restoring register %s with value 0x%" PRIx64,
+				r->name, context[i]);
+			buf_set_u64(r->value, 0, r->size, context[i]);
+			r->valid = true;
+			r->dirty = true;
+		}
+	}
+
+	armv8_set_cpsr(arm, (uint32_t)context[ARMV8_XPSR]);
+	arm->cpsr->dirty = true;
+
+	return retval;
+}
+
+/* load AArch64 code into a working area, bypassing stale cache lines */
+static int armv8_load_algorithm(struct target *target,
+	struct working_area *area, const uint8_t *code, uint32_t size)
+{
+	struct armv8_common *armv8 = target_to_armv8(target);
+	int retval;
+
+	/* instructions are always little endian, whatever the data endianness */
+	retval = target_write_buffer(target, area->address, size, code);
+	if (retval != ERROR_OK)
+		return retval;
+
+	armv8_cache_d_inner_flush_virt(armv8, area->address, size);
+	armv8_cache_i_inner_inval_virt(armv8, area->address, size);
+
+	return ERROR_OK;
+}
+
+/** Generates a CRC32 checksum of a memory region. */
+int armv8_checksum_memory(struct target *target,
+	target_addr_t address, uint32_t count, uint32_t *checksum)
+{
+	struct working_area *crc_algorithm;
+	struct arm_algorithm arm_algo;
+	struct reg_param reg_params[3];
+	int retval;
+
+	static const uint8_t armv8_crc_code[] = {
+#include "../../contrib/loaders/checksum/armv8_crc.inc"
+	};
+
+	/* the algorithm builds its 1 KiB lookup table behind the code */
+	const uint32_t code_size = sizeof(armv8_crc_code);
+	const uint32_t table_size = 256 * sizeof(uint32_t);
+
+	retval = target_alloc_working_area(target, code_size + table_size, &crc_algorithm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = armv8_load_algorithm(target, crc_algorithm, armv8_crc_code, code_size);
+	if (retval != ERROR_OK)
+		goto cleanup;
+
+	arm_algo.common_magic = ARM_COMMON_MAGIC;
+	arm_algo.core_mode = ARM_MODE_ANY;
+	arm_algo.core_state = ARM_STATE_AARCH64;
+
+	init_reg_param(&reg_params[0], "x0", 64, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "x1", 64, PARAM_OUT);
+	init_reg_param(&reg_params[2], "x2", 64, PARAM_OUT);
+
+	buf_set_u64(reg_params[0].value, 0, 64, address);
+	buf_set_u64(reg_params[1].value, 0, 64, count);
+	buf_set_u64(reg_params[2].value, 0, 64, crc_algorithm->address + code_size);
+
+	/* 20 second timeout/megabyte */
+	unsigned int timeout = 20000 * (1 + (count / (1024 * 1024)));
+
+	retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
+			crc_algorithm->address,
+			crc_algorithm->address + code_size - 4,
+			timeout, &arm_algo);
+
+	if (retval == ERROR_OK)
+		*checksum = buf_get_u32(reg_params[0].value, 0, 32);
+	else
+		LOG_ERROR("error executing AArch64 crc algorithm");
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+
+cleanup:
+	target_free_working_area(target, crc_algorithm);
+
+	return retval;
+}
+
+/** Checks an array of memory regions whether they are erased. */
+int armv8_blank_check_memory(struct target *target,
+	struct target_memory_check_block *blocks, int num_blocks, uint8_t erased_value)
+{
+	struct working_area *erase_check_algorithm;
+	struct working_area *erase_check_params;
+	struct reg_param reg_params[2];
+	struct arm_algorithm arm_algo;
+	int retval;
+
+	static bool timed_out;
+
+	static const uint8_t erase_check_code[] = {
+#include "../../contrib/loaders/erase_check/armv8_erase_check.inc"
+	};
+
+	const uint32_t code_size = sizeof(erase_check_code);
+
+	/* make sure we have a working area */
+	if (target_alloc_working_area(target, code_size,
+		&erase_check_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	retval = armv8_load_algorithm(target, erase_check_algorithm,
+			erase_check_code, code_size);
+	if (retval != ERROR_OK)
+		goto cleanup1;
+
+	/* prepare blocks array for algo */
+	struct algo_block {
+		union {
+			uint64_t size;
+			uint64_t result;
+		};
+		uint64_t address;
+	};
+
+	uint32_t avail = target_get_working_area_avail(target);
+	int blocks_to_check = avail / sizeof(struct algo_block) - 1;
+	if (num_blocks < blocks_to_check)
+		blocks_to_check = num_blocks;
+
+	struct algo_block *params = malloc((blocks_to_check + 1) * sizeof(struct algo_block));
+	if (!params) {
+		retval = ERROR_FAIL;
+		goto cleanup1;
+	}
+
+	int i;
+	uint64_t total_size = 0;
+	for (i = 0; i < blocks_to_check; i++) {
+		total_size += blocks[i].size;
+		target_buffer_set_u64(target, (uint8_t *)&params[i].size,
+				blocks[i].size / sizeof(uint32_t));
+		target_buffer_set_u64(target, (uint8_t *)&params[i].address,
+				blocks[i].address);
+	}
+	target_buffer_set_u64(target, (uint8_t *)&params[blocks_to_check].size, 0);
+
+	uint32_t param_size = (blocks_to_check + 1) * sizeof(struct algo_block);
+	if (target_alloc_working_area(target, param_size,
+			&erase_check_params) != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup2;
+	}
+
+	retval = target_write_buffer(target, erase_check_params->address,
+			param_size, (uint8_t *)params);
+	if (retval != ERROR_OK)
+		goto cleanup3;
+
+	uint32_t erased_word = erased_value | (erased_value << 8)
+			| (erased_value << 16) | (erased_value << 24);
+
+	LOG_DEBUG("Starting erase check of %d blocks, parameters@"
+		TARGET_ADDR_FMT, blocks_to_check, erase_check_params->address);
+
+	arm_algo.common_magic = ARM_COMMON_MAGIC;
+	arm_algo.core_mode = ARM_MODE_ANY;
+	arm_algo.core_state = ARM_STATE_AARCH64;
+
+	init_reg_param(&reg_params[0], "x0", 64, PARAM_OUT);
+	buf_set_u64(reg_params[0].value, 0, 64, erase_check_params->address);
+
+	init_reg_param(&reg_params[1], "x1", 64, PARAM_OUT);
+	buf_set_u64(reg_params[1].value, 0, 64, erased_word);
+
+	/* assume CPU clk at least 1 MHz */
+	unsigned int timeout = (timed_out ? 30000 : 2000) + total_size * 3 / 1000;
+
+	retval = target_run_algorithm(target,
+			0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			erase_check_algorithm->address,
+			erase_check_algorithm->address + code_size - 4,
+			timeout,
+			&arm_algo);
+
+	timed_out = retval == ERROR_TARGET_TIMEOUT;
+	if (retval != ERROR_OK && !timed_out)
+		goto cleanup4;
+
+	retval = target_read_buffer(target, erase_check_params->address,
+			param_size, (uint8_t *)params);
+	if (retval != ERROR_OK)
+		goto cleanup4;
+
+	for (i = 0; i < blocks_to_check; i++) {
+		uint64_t result = target_buffer_get_u64(target,
+				(uint8_t *)&params[i].result);
+		if (result != 0 && result != 1)
+			break;
+
+		blocks[i].result = result;
+	}
+	if (i && timed_out)
+		LOG_INFO("Slow CPU clock: %d blocks checked, %d remain. Continuing...", i, num_blocks - i);
+
+	retval = i;		/* return number of blocks really checked */
+
+cleanup4:
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+
+cleanup3:
+	target_free_working_area(target, erase_check_params);
+cleanup2:
+	free(params);
+cleanup1:
+	target_free_working_area(target, erase_check_algorithm);
+
+	return retval;
+}
@@ -262,6 +262,9 @@ static inline bool is_armv8(struct armv8_common *armv8)
 #define CPUV8_DBG_PRCR		0x310
 #define CPUV8_DBG_PRSR		0x314
 
+#define CPUV8_DBG_EDPCSR	0x0A0
+#define CPUV8_DBG_EDDEVID	0xFC8
+
 #define CPUV8_DBG_DTRRX		0x080
 #define CPUV8_DBG_ITR		0x084
 #define CPUV8_DBG_SCR		0x088
@@ -331,6 +334,17 @@ const char *armv8_mode_name(unsigned psr_mode);
 void armv8_select_reg_access(struct armv8_common *armv8, bool is_aarch64);
 int armv8_set_dbgreg_bits(struct armv8_common *armv8, unsigned int reg, unsigned long mask, unsigned long value);
 
+int armv8_run_algorithm(struct target *target,
+		int num_mem_params, struct mem_param *mem_params,
+		int num_reg_params, struct reg_param *reg_params,
+		target_addr_t entry_point, target_addr_t exit_point,
+		unsigned int timeout_ms, void *arch_info);
+int armv8_checksum_memory(struct target *target,
+		target_addr_t address, uint32_t count, uint32_t *checksum);
+int armv8_blank_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks,
+		uint8_t erased_value);
+
 extern void armv8_free_reg_cache(struct target *target);
 
 extern const struct command_registration armv8_command_handlers[];
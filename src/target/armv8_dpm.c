@@ -724,6 +724,221 @@ static int dpmv8_write_reg(struct arm_dpm *dpm, struct reg *r, unsigned regnum)
 	return retval;
 }
 
+/*
+ * Batched register reads, AArch64 state only.
+ *
+ * Reading one register at a time polls DSCR before the ITR write and again
+ * before the DTR reads, several adapter round trips per register. Here the
+ * ITR writes and the DTR reads of a whole set of registers are queued and
+ * flushed at once: the core executes "MSR DBGDTR_EL0, Xn" well before the
+ * debugger gets to issue the next access. Should it not, the overrun (ITO)
+ * or underrun (TXU) is latched in DSCR, checked at the end of the batch,
+ * and the values are thrown away.
+ */
+struct dpmv8_batch {
+	struct arm_dpm *dpm;
+	int retval;
+	unsigned int count;
+	struct reg *regs[ARMV8_LAST_REG];
+	uint32_t data[ARMV8_LAST_REG][4];
+};
+
+/* Instruction moving register regnum to X0, 0 if it is not batched */
+static uint32_t dpmv8_batch_opcode(unsigned int regnum)
+{
+	switch (regnum) {
+	case ARMV8_SP:
+		return ARMV8_MOVFSP_64(0);
+	case ARMV8_PC:
+		return ARMV8_MRS_DLR(0);
+	case ARMV8_XPSR:
+		return ARMV8_MRS_DSPSR(0);
+	case ARMV8_FPSR:
+		return ARMV8_MRS_FPSR(0);
+	case ARMV8_FPCR:
+		return ARMV8_MRS_FPCR(0);
+	case ARMV8_ELR_EL1:
+		return ARMV8_MRS(SYSTEM_ELR_EL1, 0);
+	case ARMV8_ELR_EL2:
+		return ARMV8_MRS(SYSTEM_ELR_EL2, 0);
+	case ARMV8_ELR_EL3:
+		return ARMV8_MRS(SYSTEM_ELR_EL3, 0);
+	case ARMV8_ESR_EL1:
+		return ARMV8_MRS(SYSTEM_ESR_EL1, 0);
+	case ARMV8_ESR_EL2:
+		return ARMV8_MRS(SYSTEM_ESR_EL2, 0);
+	case ARMV8_ESR_EL3:
+		return ARMV8_MRS(SYSTEM_ESR_EL3, 0);
+	case ARMV8_SPSR_EL1:
+		return ARMV8_MRS(SYSTEM_SPSR_EL1, 0);
+	case ARMV8_SPSR_EL2:
+		return ARMV8_MRS(SYSTEM_SPSR_EL2, 0);
+	case ARMV8_SPSR_EL3:
+		return ARMV8_MRS(SYSTEM_SPSR_EL3, 0);
+	default:
+		return 0;
+	}
+}
+
+/* Queue the optional opcode, then the transfer of Xn through DBGDTR_EL0 */
+static void dpmv8_batch_queue_xn(struct dpmv8_batch *batch, uint32_t opcode,
+	unsigned int xn, uint32_t *data)
+{
+	struct armv8_common *armv8 = batch->dpm->arm->arch_info;
+	target_addr_t itr = armv8->debug_base + CPUV8_DBG_ITR;
+
+	if (batch->retval == ERROR_OK && opcode)
+		batch->retval = mem_ap_write_u32(armv8->debug_ap, itr, opcode);
+	if (batch->retval == ERROR_OK)
+		batch->retval = mem_ap_write_u32(armv8->debug_ap, itr,
+				ARMV8_MSR_GP(SYSTEM_DBG_DBGDTR_EL0, xn));
+	if (batch->retval == ERROR_OK)
+		batch->retval = mem_ap_read_u32(armv8->debug_ap,
+				armv8->debug_base + CPUV8_DBG_DTRTX, &data[0]);
+	if (batch->retval == ERROR_OK)
+		batch->retval = mem_ap_read_u32(armv8->debug_ap,
+				armv8->debug_base + CPUV8_DBG_DTRRX, &data[1]);
+}
+
+static void dpmv8_batch_queue_reg(struct dpmv8_batch *batch, struct reg *r,
+	unsigned int regnum)
+{
+	uint32_t *data = batch->data[batch->count];
+
+	if (regnum <= ARMV8_R30) {
+		dpmv8_batch_queue_xn(batch, 0, regnum, data);
+	} else if (regnum >= ARMV8_V0 && regnum <= ARMV8_V31) {
+		dpmv8_batch_queue_xn(batch,
+				ARMV8_MOV_GPR_VFP(0, (regnum - ARMV8_V0), 0), 0, &data[0]);
+		dpmv8_batch_queue_xn(batch,
+				ARMV8_MOV_GPR_VFP(0, (regnum - ARMV8_V0), 1), 0, &data[2]);
+	} else {
+		dpmv8_batch_queue_xn(batch, dpmv8_batch_opcode(regnum), 0, data);
+	}
+
+	batch->regs[batch->count++] = r;
+}
+
+/* Flush the batch, check DSCR and update the register cache */
+static int dpmv8_batch_run(struct dpmv8_batch *batch)
+{
+	struct arm_dpm *dpm = batch->dpm;
+	struct armv8_common *armv8 = dpm->arm->arch_info;
+	uint32_t dscr;
+	int retval = batch->retval;
+
+	if (retval == ERROR_OK)
+		retval = mem_ap_read_u32(armv8->debug_ap,
+				armv8->debug_base + CPUV8_DBG_DSCR, &dscr);
+	if (retval == ERROR_OK)
+		retval = dap_run(armv8->debug_ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	dpm->dscr = dscr;
+	dpm->last_el = (dscr >> 8) & 3;
+
+	if (dscr & (DSCR_ERR | DSCR_ITO | DSCR_TXU)) {
+		LOG_DEBUG("batched register read failed, DSCR 0x%08" PRIx32, dscr);
+		if (dscr & DSCR_ERR)
+			armv8_dpm_handle_exception(dpm, true);
+		else
+			mem_ap_write_atomic_u32(armv8->debug_ap,
+					armv8->debug_base + CPUV8_DBG_DRCR, DRCR_CSE);
+		return ERROR_FAIL;
+	}
+
+	for (unsigned int i = 0; i < batch->count; i++) {
+		struct reg *r = batch->regs[i];
+		uint32_t *data = batch->data[i];
+
+		buf_set_u64(r->value, 0, MIN(r->size, 64),
+				data[0] | (uint64_t)data[1] << 32);
+		if (r->size > 64)
+			buf_set_u64(r->value + 8, 0, r->size - 64,
+					data[2] | (uint64_t)data[3] << 32);
+		r->valid = true;
+		r->dirty = false;
+		LOG_DEBUG("READ: %s, %08" PRIx32 "%08" PRIx32, r->name, data[1], data[0]);
+	}
+
+	return ERROR_OK;
+}
+
+/*
+ * Read the registers of the current context that are not valid yet, FP/SIMD
+ * included if fpsimd is set, relies on dpm->prepare() having been called.
+ * X0..X30 go in a first batch; what has to go through X0 in a second one,
+ * so that a failure of the latter leaves the value of X0 in the cache.
+ * Whatever is left invalid is for the caller to read one at a time.
+ */
+static int dpmv8_read_registers_batched(struct arm_dpm *dpm, bool fpsimd)
+{
+	struct arm *arm = dpm->arm;
+	struct reg *r0 = arm->core_cache->reg_list + ARMV8_R0;
+	unsigned int el = (dpm->dscr >> 8) & 3;
+	struct dpmv8_batch batch;
+	int retval;
+
+	if (armv8_dpm_get_core_state(dpm) != ARM_STATE_AARCH64)
+		return ERROR_OK;
+
+	/* the batch relies on the DCC being empty and no instruction pending */
+	if ((dpm->dscr & (DSCR_ITE | DSCR_DTR_TX_FULL)) != DSCR_ITE)
+		return ERROR_OK;
+
+	batch.dpm = dpm;
+	batch.retval = ERROR_OK;
+	batch.count = 0;
+
+	for (unsigned int i = ARMV8_R0; i <= ARMV8_R30; i++) {
+		struct reg *r = armv8_reg_current(arm, i);
+
+		if (r->exist && !r->valid)
+			dpmv8_batch_queue_reg(&batch, r, i);
+	}
+
+	if (batch.count) {
+		retval = dpmv8_batch_run(&batch);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (!r0->valid)
+		return ERROR_OK;
+
+	batch.count = 0;
+
+	for (unsigned int i = ARMV8_SP; i < ARMV8_LAST_REG; i++) {
+		struct reg *r = armv8_reg_current(arm, i);
+		struct arm_reg *arm_reg = r->arch_info;
+
+		if (!r->exist || r->valid)
+			continue;
+
+		if (i >= ARMV8_V0 && i <= ARMV8_FPCR) {
+			if (!fpsimd)
+				continue;
+		} else if (!dpmv8_batch_opcode(i)) {
+			continue;
+		}
+
+		/* same as below, only what the current EL can access */
+		if (arm_reg->mode != ARM_MODE_ANY &&
+				el != armv8_curel_from_core_mode(arm_reg->mode))
+			continue;
+
+		dpmv8_batch_queue_reg(&batch, r, i);
+	}
+
+	if (!batch.count)
+		return ERROR_OK;
+
+	r0->dirty = true;
+
+	return dpmv8_batch_run(&batch);
+}
+
 /**
  * Read basic registers of the current context:  R0 to R15, and CPSR in AArch32
  * state or R0 to R31, PC and CPSR in AArch64 state;
@@ -747,6 +962,11 @@ int armv8_dpm_read_current_registers(struct arm_dpm *dpm)
 
 	cache = arm->core_cache;
 
+	/* queue what can be queued, the rest is read one at a time below */
+	retval = dpmv8_read_registers_batched(dpm, false);
+	if (retval != ERROR_OK)
+		LOG_DEBUG("reading the registers one at a time");
+
 	/* read R0 first (it's used for scratch), then CPSR */
 	r = cache->reg_list + ARMV8_R0;
 	if (!r->valid) {
@@ -764,11 +984,15 @@ int armv8_dpm_read_current_registers(struct arm_dpm *dpm)
 			goto fail;
 	}
 
-	/* read cpsr to r0 and get it back */
-	retval = dpm->instr_read_data_r0(dpm,
-			armv8_opcode(armv8, READ_REG_DSPSR), &cpsr);
-	if (retval != ERROR_OK)
-		goto fail;
+	/* read cpsr to r0 and get it back, unless the batch did */
+	if (arm->cpsr->valid) {
+		cpsr = buf_get_u32(arm->cpsr->value, 0, 32);
+	} else {
+		retval = dpm->instr_read_data_r0(dpm,
+				armv8_opcode(armv8, READ_REG_DSPSR), &cpsr);
+		if (retval != ERROR_OK)
+			goto fail;
+	}
 
 	/* update core mode and state */
 	armv8_set_cpsr(arm, cpsr);
@@ -814,6 +1038,26 @@ fail:
 	return retval;
 }
 
+/*
+ * Read the registers of the current context that are not valid yet, in as
+ * few adapter round trips as possible. Meant for filling the register cache
+ * before handing it to GDB: registers that cannot be batched are left to
+ * the register access methods.
+ */
+int armv8_dpm_fetch_registers(struct arm_dpm *dpm, bool fpsimd)
+{
+	int retval;
+
+	retval = dpm->prepare(dpm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = dpmv8_read_registers_batched(dpm, fpsimd);
+
+	/* (void) */ dpm->finish(dpm);
+	return retval;
+}
+
 /* Avoid needless I/O ... leave breakpoints and watchpoints alone
  * unless they're removed, or need updating because of single-stepping
  * or running debugger code.
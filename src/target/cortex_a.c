@@ -74,6 +74,8 @@ static int cortex_a_virt2phys(struct target *target,
 	target_addr_t virt, target_addr_t *phys);
 static int cortex_a_read_cpu_memory(struct target *target,
 	uint32_t address, uint32_t size, uint32_t count, uint8_t *buffer);
+static int cortex_a_set_dcc_mode(struct target *target, uint32_t mode,
+	uint32_t *dscr);
 
 static unsigned int ilog2(unsigned int x)
 {
@@ -571,6 +573,45 @@ static int cortex_a_instr_read_data_r0_r1(struct arm_dpm *dpm,
 	return retval;
 }
 
+static int cortex_a_instr_read_data_dcc_n(struct arm_dpm *dpm,
+	const uint32_t *opcodes, uint32_t *data, unsigned int count)
+{
+	struct cortex_a_common *a = dpm_to_a(dpm);
+	struct armv7a_common *armv7a = &a->armv7a_common;
+	struct target *target = armv7a->arm.target;
+	uint32_t dscr;
+	int retval, retval2;
+
+	retval = cortex_a_wait_instrcmpl(target, &dscr, true);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* In stall mode the write to ITR waits for the previous instruction
+	 * to complete and the read of DTRTX for the instruction to fill it,
+	 * so the whole sequence can be queued and flushed once.
+	 */
+	retval = cortex_a_set_dcc_mode(target, DSCR_EXT_DCC_STALL_MODE, &dscr);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (unsigned int i = 0; i < count && retval == ERROR_OK; i++) {
+		retval = mem_ap_write_u32(armv7a->debug_ap,
+				armv7a->debug_base + CPUDBG_ITR, opcodes[i]);
+		if (retval == ERROR_OK)
+			retval = mem_ap_read_u32(armv7a->debug_ap,
+					armv7a->debug_base + CPUDBG_DTRTX, &data[i]);
+	}
+	if (retval == ERROR_OK)
+		retval = dap_run(armv7a->debug_ap->dap);
+
+	/* back to non-blocking mode, whatever happened */
+	retval2 = cortex_a_set_dcc_mode(target, DSCR_EXT_DCC_NON_BLOCKING, &dscr);
+	if (retval == ERROR_OK)
+		retval = retval2;
+
+	return retval;
+}
+
 static int cortex_a_bpwp_enable(struct arm_dpm *dpm, unsigned index_t,
 	uint32_t addr, uint32_t control)
 {
@@ -650,6 +691,7 @@ static int cortex_a_dpm_setup(struct cortex_a_common *a, uint32_t didr)
 	dpm->instr_read_data_dcc = cortex_a_instr_read_data_dcc;
 	dpm->instr_read_data_r0 = cortex_a_instr_read_data_r0;
 	dpm->instr_read_data_r0_r1 = cortex_a_instr_read_data_r0_r1;
+	dpm->instr_read_data_dcc_n = cortex_a_instr_read_data_dcc_n;
 
 	dpm->bpwp_enable = cortex_a_bpwp_enable;
 	dpm->bpwp_disable = cortex_a_bpwp_disable;
@@ -768,7 +810,7 @@ static int cortex_a_poll(struct target *target)
 			if (retval != ERROR_OK)
 				return retval;
 
-			if (target->smp) {
+			if (target_smp_coupled(target)) {
 				retval = update_halt_gdb(target);
 				if (retval != ERROR_OK)
 					return retval;
@@ -990,7 +1032,7 @@ static int cortex_a_resume(struct target *target, int current,
 {
 	int retval = 0;
 	/* dummy resume for smp toggle in order to reduce gdb impact  */
-	if ((target->smp) && (target->gdb_service->core[1] != -1)) {
+	if (target_smp_coupled(target) && (target->gdb_service->core[1] != -1)) {
 		/*   simulate a start and halt of target */
 		target->gdb_service->target = NULL;
 		target->gdb_service->core[0] = target->gdb_service->core[1];
@@ -999,7 +1041,7 @@ static int cortex_a_resume(struct target *target, int current,
 		return 0;
 	}
 	cortex_a_internal_restore(target, current, &address, handle_breakpoints, debug_execution);
-	if (target->smp) {
+	if (target_smp_coupled(target)) {
 		target->gdb_service->core[0] = -1;
 		retval = cortex_a_restore_smp(target, handle_breakpoints);
 		if (retval != ERROR_OK)
@@ -1099,6 +1141,21 @@ static int cortex_a_debug_entry(struct target *target)
 	return retval;
 }
 
+static int cortex_a_fetch_registers(struct target *target,
+	enum target_register_class reg_class)
+{
+	struct armv7a_common *armv7a = target_to_armv7a(target);
+	struct arm *arm = &armv7a->arm;
+
+	/* only the core registers are batched, VFP ones are read on demand */
+	for (unsigned int i = 0; i < 16; i++) {
+		if (!arm_reg_current(arm, i)->valid)
+			return arm_dpm_read_current_registers(&armv7a->dpm);
+	}
+
+	return ERROR_OK;
+}
+
 static int cortex_a_post_debug_entry(struct target *target)
 {
 	struct cortex_a_common *cortex_a = target_to_cortex_a(target);
@@ -3027,6 +3084,36 @@ static int cortex_a_examine_first(struct target *target)
 		armv7a->arm.core_type = ARM_CORE_TYPE_VIRT_EXT;
 	}
 
+	/* See ARMv7a arch spec DDI 0406C C11.11.29 for where to sample the PC */
+	cortex_a->pcsr = 0;
+	cortex_a->pcsr_offset = true;
+	if (didr & DIDR_DEVID_IMP) {
+		uint32_t devid, devid1;
+
+		retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
+					armv7a->debug_base + CPUDBG_DEVID, &devid);
+		if (retval != ERROR_OK)
+			return retval;
+
+		/* DBGDEVID.PCsample */
+		if (devid & 0xF)
+			cortex_a->pcsr = CPUDBG_PCSR;
+
+		if ((devid & 0xF) && DIDR_VERSION(didr) >= DIDR_VERSION_V7_1) {
+			retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
+						armv7a->debug_base + CPUDBG_DEVID1, &devid1);
+			if (retval != ERROR_OK)
+				return retval;
+
+			/* DBGDEVID1.PCSROffset */
+			cortex_a->pcsr_offset = (devid1 & 0xF) == 0;
+		}
+	}
+	if (!cortex_a->pcsr && (didr & DIDR_PCSR_IMP))
+		cortex_a->pcsr = CPUDBG_PCSR_LEGACY;
+	LOG_TARGET_DEBUG(target, "PCSR at 0x%03" PRIx32 "%s", cortex_a->pcsr,
+			cortex_a->pcsr_offset ? ", with offset" : "");
+
 	/* Avoid recreating the registers cache */
 	if (!target_was_examined(target)) {
 		retval = cortex_a_dpm_setup(cortex_a, didr);
@@ -3101,6 +3188,27 @@ static int cortex_a_init_target(struct command_context *cmd_ctx,
 	return ERROR_OK;
 }
 
+static bool cortex_a_get_pcsr(struct target *target, struct arm_dpm_pcsr *pcsr)
+{
+	struct cortex_a_common *cortex_a = target_to_cortex_a(target);
+	struct armv7a_common *armv7a = &cortex_a->armv7a_common;
+
+	if (!cortex_a->pcsr)
+		return false;
+
+	pcsr->ap = armv7a->debug_ap;
+	pcsr->address = armv7a->debug_base + cortex_a->pcsr;
+	pcsr->offset = cortex_a->pcsr_offset;
+	return true;
+}
+
+static int cortex_a_profiling(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+{
+	return arm_dpm_profiling(target, cortex_a_get_pcsr, samples,
+			max_num_samples, num_samples, seconds);
+}
+
 static int cortex_a_init_arch_info(struct target *target,
 	struct cortex_a_common *cortex_a, struct adiv5_dap *dap)
 {
@@ -3392,6 +3500,7 @@ struct target_type cortexa_target = {
 	/* REVISIT allow exporting VFP3 registers ... */
 	.get_gdb_arch = arm_get_gdb_arch,
 	.get_gdb_reg_list = arm_get_gdb_reg_list,
+	.fetch_registers = cortex_a_fetch_registers,
 
 	.read_memory = cortex_a_read_memory,
 	.write_memory = cortex_a_write_memory,
@@ -3411,6 +3520,8 @@ struct target_type cortexa_target = {
 	.add_watchpoint = cortex_a_add_watchpoint,
 	.remove_watchpoint = cortex_a_remove_watchpoint,
 
+	.profiling = cortex_a_profiling,
+
 	.commands = cortex_a_command_handlers,
 	.target_create = cortex_a_target_create,
 	.target_jim_configure = adiv5_jim_configure,
@@ -3472,6 +3583,7 @@ struct target_type cortexr4_target = {
 	/* REVISIT allow exporting VFP3 registers ... */
 	.get_gdb_arch = arm_get_gdb_arch,
 	.get_gdb_reg_list = arm_get_gdb_reg_list,
+	.fetch_registers = cortex_a_fetch_registers,
 
 	.read_memory = cortex_a_read_phys_memory,
 	.write_memory = cortex_a_write_phys_memory,
@@ -3488,6 +3600,8 @@ struct target_type cortexr4_target = {
 	.add_watchpoint = cortex_a_add_watchpoint,
 	.remove_watchpoint = cortex_a_remove_watchpoint,
 
+	.profiling = cortex_a_profiling,
+
 	.commands = cortex_r4_command_handlers,
 	.target_create = cortex_r4_target_create,
 	.target_jim_configure = adiv5_jim_configure,
@@ -96,6 +96,11 @@ struct cortex_a_common {
 	uint32_t cpuid;
 	uint32_t didr;
 
+	/* PC sample register, offset from the debug base, or 0 */
+	uint32_t pcsr;
+	/* PC samples are offset by 8 in ARM state, by 4 in Thumb state */
+	bool pcsr_offset;
+
 	enum cortex_a_isrmasking_mode isrmasking_mode;
 	enum cortex_a_dacrfixup_mode dacrfixup_mode;
 };
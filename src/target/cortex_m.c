@@ -2162,6 +2162,15 @@ static int cortex_m_read_memory(struct target *target, target_addr_t address,
 	return mem_ap_read_buf(armv7m->debug_ap, buffer, size, count, address);
 }
 
+static int cortex_m_read_memory_sg(struct target *target,
+	const struct target_memory_sg *sg, unsigned int count)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+
+	/* the blocks are read with naturally aligned accesses, fine for armv6m */
+	return mem_ap_read_buf_sg(armv7m->debug_ap, sg, count);
+}
+
 static int cortex_m_write_memory(struct target *target, target_addr_t address,
 	uint32_t size, uint32_t count, const uint8_t *buffer)
 {
@@ -2215,14 +2224,14 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 		return retval;
 	}
 	if (reg_value == 0) {
-		LOG_TARGET_INFO(target, "PCSR sampling not supported on this processor.");
+		LOG_TARGET_DEBUG(target, "PCSR sampling not supported on this processor.");
 		return target_profiling_default(target, samples, max_num_samples, num_samples, seconds);
 	}
 
 	gettimeofday(&timeout, NULL);
 	timeval_add_time(&timeout, seconds, 0);
 
-	LOG_TARGET_INFO(target, "Starting Cortex-M profiling. Sampling DWT_PCSR as fast as we can...");
+	LOG_TARGET_DEBUG(target, "Starting Cortex-M profiling. Sampling DWT_PCSR as fast as we can...");
 
 	/* Make sure the target is running */
 	target_poll(target);
@@ -2258,7 +2267,7 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 
 		gettimeofday(&now, NULL);
 		if (sample_count >= max_num_samples || timeval_compare(&now, &timeout) > 0) {
-			LOG_TARGET_INFO(target, "Profiling completed. %" PRIu32 " samples.", sample_count);
+			LOG_TARGET_DEBUG(target, "Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
@@ -3098,6 +3107,7 @@ struct target_type cortexm_target = {
 	.get_gdb_reg_list = armv7m_get_gdb_reg_list,
 
 	.read_memory = cortex_m_read_memory,
+	.read_memory_sg = cortex_m_read_memory_sg,
 	.write_memory = cortex_m_write_memory,
 	.checksum_memory = armv7m_checksum_memory,
 	.blank_check_memory = armv7m_blank_check_memory,
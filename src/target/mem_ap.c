@@ -247,6 +247,14 @@ static int mem_ap_read_memory(struct target *target, target_addr_t address,
 	return mem_ap_read_buf(mem_ap->ap, buffer, size, count, address);
 }
 
+static int mem_ap_read_memory_sg(struct target *target,
+				 const struct target_memory_sg *sg, unsigned int count)
+{
+	struct mem_ap *mem_ap = target->arch_info;
+
+	return mem_ap_read_buf_sg(mem_ap->ap, sg, count);
+}
+
 static int mem_ap_write_memory(struct target *target, target_addr_t address,
 				uint32_t size, uint32_t count,
 				const uint8_t *buffer)
@@ -285,5 +293,6 @@ struct target_type mem_ap_target = {
 	.get_gdb_reg_list = mem_ap_get_gdb_reg_list,
 
 	.read_memory = mem_ap_read_memory,
+	.read_memory_sg = mem_ap_read_memory_sg,
 	.write_memory = mem_ap_write_memory,
 };
@@ -0,0 +1,494 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Host side cache of the target memory.
+ *
+ * While a target is halted its memory is not supposed to change, except
+ * through OpenOCD, and GDB reads the same locations many times per stop to
+ * unwind the stack or refresh its views. The cache keeps the lines read
+ * since the last halt, so that these reads don't go to the debug adapter.
+ *
+ * The cache is direct mapped and only covers the regions explicitly marked
+ * as cacheable, never MMIO. It is invalidated by every target event (halt,
+ * resume, step, reset...), by every write to the memory of any target and
+ * whenever the target is found not halted.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/align.h>
+#include <helper/log.h>
+#include <helper/replacements.h>
+
+#include "memcache.h"
+#include "target.h"
+#include "target_type.h"
+
+#define MEMCACHE_DEFAULT_LINE_SIZE	64
+#define MEMCACHE_DEFAULT_LINES		256
+#define MEMCACHE_MAX_LINE_SIZE		4096
+#define MEMCACHE_MAX_SIZE			(16 * 1024 * 1024)
+
+struct memcache_region {
+	target_addr_t address;
+	target_addr_t size;
+	bool cached;
+};
+
+struct memcache_line {
+	target_addr_t address;
+	/* the line is valid only if filled during the current generation */
+	uint64_t generation;
+};
+
+struct target_memcache {
+	bool enabled;
+	unsigned int line_size;
+	unsigned int num_lines;
+	struct memcache_line *lines;
+	uint8_t *data;
+	/* incremented to invalidate all the lines at once */
+	uint64_t generation;
+
+	/* the last region containing an address sets its policy */
+	struct memcache_region *regions;
+	unsigned int num_regions;
+
+	/* line accesses served by the cache and line fills */
+	uint64_t hits;
+	uint64_t misses;
+	/* reads left to the target */
+	uint64_t bypassed;
+};
+
+static struct target_memcache *memcache_get(struct target *target)
+{
+	if (!target->memcache) {
+		struct target_memcache *cache = calloc(1, sizeof(*cache));
+		if (!cache)
+			return NULL;
+		cache->line_size = MEMCACHE_DEFAULT_LINE_SIZE;
+		cache->num_lines = MEMCACHE_DEFAULT_LINES;
+		cache->generation = 1;
+		target->memcache = cache;
+	}
+
+	return target->memcache;
+}
+
+static void memcache_free_lines(struct target_memcache *cache)
+{
+	free(cache->lines);
+	free(cache->data);
+	cache->lines = NULL;
+	cache->data = NULL;
+}
+
+static int memcache_alloc_lines(struct target_memcache *cache)
+{
+	memcache_free_lines(cache);
+
+	cache->lines = calloc(cache->num_lines, sizeof(*cache->lines));
+	cache->data = malloc(cache->num_lines * cache->line_size);
+	if (!cache->lines || !cache->data) {
+		LOG_ERROR("Unable to allocate memory");
+		memcache_free_lines(cache);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+void target_memcache_free(struct target *target)
+{
+	struct target_memcache *cache = target->memcache;
+	if (!cache)
+		return;
+
+	memcache_free_lines(cache);
+	free(cache->regions);
+	free(cache);
+	target->memcache = NULL;
+}
+
+void target_memcache_invalidate(struct target *target)
+{
+	if (target->memcache)
+		target->memcache->generation++;
+}
+
+void target_memcache_invalidate_all(void)
+{
+	for (struct target *target = all_targets; target; target = target->next)
+		target_memcache_invalidate(target);
+}
+
+static bool memcache_line_cacheable(const struct target_memcache *cache, target_addr_t line)
+{
+	target_addr_t line_end = line + cache->line_size - 1;
+
+	for (unsigned int i = cache->num_regions; i > 0; i--) {
+		const struct memcache_region *region = &cache->regions[i - 1];
+		target_addr_t region_end = region->address + region->size - 1;
+
+		if (region->address > line_end || region_end < line)
+			continue;
+
+		/* a line partly outside of a cached region would read beyond it */
+		return region->cached && region->address <= line && region_end >= line_end;
+	}
+
+	return false;
+}
+
+bool target_memcache_read(struct target *target, target_addr_t address,
+		uint32_t len, uint8_t *buffer)
+{
+	struct target_memcache *cache = target->memcache;
+
+	if (!cache || !cache->enabled || !len)
+		return false;
+
+	if (target->state != TARGET_HALTED) {
+		/* the memory can change behind our back */
+		cache->generation++;
+		return false;
+	}
+
+	target_addr_t end = address + len - 1;
+	if (end < address)
+		return false;
+
+	target_addr_t mask = cache->line_size - 1;
+	target_addr_t first = address & ~mask;
+	target_addr_t last = end & ~mask;
+
+	for (target_addr_t line = first; ; line += cache->line_size) {
+		if (!memcache_line_cacheable(cache, line)) {
+			cache->bypassed++;
+			return false;
+		}
+		if (line == last)
+			break;
+	}
+
+	for (target_addr_t line = first; ; line += cache->line_size) {
+		unsigned int index = (line / cache->line_size) & (cache->num_lines - 1);
+		struct memcache_line *l = &cache->lines[index];
+		uint8_t *data = cache->data + (size_t)index * cache->line_size;
+
+		if (l->generation == cache->generation && l->address == line) {
+			cache->hits++;
+		} else {
+			int retval = target->type->read_memory(target, line, 4,
+					cache->line_size / 4, data);
+			if (retval != ERROR_OK) {
+				LOG_TARGET_DEBUG(target, "memory cache fill at " TARGET_ADDR_FMT " failed",
+						line);
+				l->generation = 0;
+				cache->bypassed++;
+				return false;
+			}
+			l->address = line;
+			l->generation = cache->generation;
+			cache->misses++;
+		}
+
+		target_addr_t from = MAX(line, address);
+		target_addr_t to = MIN(line + mask, end);
+		memcpy(buffer + (from - address), data + (from - line), to - from + 1);
+
+		if (line == last)
+			break;
+	}
+
+	return true;
+}
+
+static void memcache_print(struct command_invocation *cmd, const struct target_memcache *cache)
+{
+	command_print(cmd, "memory cache %s, %u lines of %u bytes",
+			cache->enabled ? "enabled" : "disabled",
+			cache->num_lines, cache->line_size);
+
+	if (!cache->num_regions)
+		command_print(cmd, "no region, nothing is cached");
+
+	for (unsigned int i = 0; i < cache->num_regions; i++) {
+		const struct memcache_region *region = &cache->regions[i];
+		command_print(cmd, "region " TARGET_ADDR_FMT " size " TARGET_ADDR_FMT " %s",
+				region->address, region->size,
+				region->cached ? "cached" : "uncached");
+	}
+
+	uint64_t accesses = cache->hits + cache->misses;
+	command_print(cmd, "%" PRIu64 " hits, %" PRIu64 " misses (hit rate %.1f%%), "
+			"%" PRIu64 " reads bypassed",
+			cache->hits, cache->misses,
+			accesses ? 100.0 * cache->hits / accesses : 0.0,
+			cache->bypassed);
+}
+
+COMMAND_HANDLER(handle_memcache_enable)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target_memcache *cache = memcache_get(target);
+	if (!cache) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	if (!cache->enabled) {
+		int retval = memcache_alloc_lines(cache);
+		if (retval != ERROR_OK)
+			return retval;
+		cache->hits = 0;
+		cache->misses = 0;
+		cache->bypassed = 0;
+		cache->enabled = true;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_disable)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target_memcache *cache = target->memcache;
+	if (cache) {
+		cache->enabled = false;
+		memcache_free_lines(cache);
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_flush)
+{
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_memcache_invalidate(get_current_target(CMD_CTX));
+
+	return ERROR_OK;
+}
+
+/* the geometry can change at any time, line size and count are powers of 2 */
+static int memcache_set_geometry(struct command_invocation *cmd,
+		struct target_memcache *cache, unsigned int line_size, unsigned int num_lines)
+{
+	if (!IS_PWR_OF_2(line_size) || line_size < 4 || line_size > MEMCACHE_MAX_LINE_SIZE) {
+		command_print(cmd, "line size must be a power of 2 between 4 and %d",
+				MEMCACHE_MAX_LINE_SIZE);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+	if (!IS_PWR_OF_2(num_lines) || (uint64_t)num_lines * line_size > MEMCACHE_MAX_SIZE) {
+		command_print(cmd, "number of lines must be a power of 2, for at most %d bytes",
+				MEMCACHE_MAX_SIZE);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	cache->line_size = line_size;
+	cache->num_lines = num_lines;
+	cache->generation++;
+
+	if (cache->enabled) {
+		int retval = memcache_alloc_lines(cache);
+		if (retval != ERROR_OK) {
+			cache->enabled = false;
+			return retval;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_line_size)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target_memcache *cache = memcache_get(target);
+	if (!cache) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	if (!CMD_ARGC) {
+		command_print(CMD, "%u", cache->line_size);
+		return ERROR_OK;
+	}
+
+	unsigned int line_size;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], line_size);
+
+	return memcache_set_geometry(CMD, cache, line_size, cache->num_lines);
+}
+
+COMMAND_HANDLER(handle_memcache_lines)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target_memcache *cache = memcache_get(target);
+	if (!cache) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	if (!CMD_ARGC) {
+		command_print(CMD, "%u", cache->num_lines);
+		return ERROR_OK;
+	}
+
+	unsigned int num_lines;
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], num_lines);
+
+	return memcache_set_geometry(CMD, cache, cache->line_size, num_lines);
+}
+
+COMMAND_HANDLER(handle_memcache_region)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	struct target_memcache *cache = memcache_get(target);
+	if (!cache) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	if (CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "clear")) {
+		free(cache->regions);
+		cache->regions = NULL;
+		cache->num_regions = 0;
+		cache->generation++;
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC < 2 || CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct memcache_region region = { .cached = true };
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], region.address);
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], region.size);
+	if (CMD_ARGC == 3) {
+		if (!strcmp(CMD_ARGV[2], "uncached"))
+			region.cached = false;
+		else if (strcmp(CMD_ARGV[2], "cached"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	if (!region.size || region.address + region.size - 1 < region.address) {
+		command_print(CMD, "invalid region size");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct memcache_region *regions = realloc(cache->regions,
+			(cache->num_regions + 1) * sizeof(*regions));
+	if (!regions) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+	regions[cache->num_regions++] = region;
+	cache->regions = regions;
+	cache->generation++;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_info)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target_memcache *cache = memcache_get(target);
+	if (!cache) {
+		LOG_ERROR("Unable to allocate memory");
+		return ERROR_FAIL;
+	}
+
+	memcache_print(CMD, cache);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration memcache_subcommand_handlers[] = {
+	{
+		.name = "enable",
+		.handler = handle_memcache_enable,
+		.mode = COMMAND_ANY,
+		.help = "Enable the memory cache",
+		.usage = "",
+	},
+	{
+		.name = "disable",
+		.handler = handle_memcache_disable,
+		.mode = COMMAND_ANY,
+		.help = "Disable the memory cache",
+		.usage = "",
+	},
+	{
+		.name = "flush",
+		.handler = handle_memcache_flush,
+		.mode = COMMAND_ANY,
+		.help = "Invalidate all the lines of the memory cache",
+		.usage = "",
+	},
+	{
+		.name = "line_size",
+		.handler = handle_memcache_line_size,
+		.mode = COMMAND_ANY,
+		.help = "Display or set the size in bytes of the cache lines",
+		.usage = "[bytes]",
+	},
+	{
+		.name = "lines",
+		.handler = handle_memcache_lines,
+		.mode = COMMAND_ANY,
+		.help = "Display or set the number of cache lines",
+		.usage = "[count]",
+	},
+	{
+		.name = "region",
+		.handler = handle_memcache_region,
+		.mode = COMMAND_ANY,
+		.help = "Set the cache policy of a memory region, "
+			"the last region containing an address wins",
+		.usage = "(address size ['cached'|'uncached'])|'clear'",
+	},
+	{
+		.name = "info",
+		.handler = handle_memcache_info,
+		.mode = COMMAND_ANY,
+		.help = "Display the configuration and the hit rate of the memory cache",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration target_memcache_command_handlers[] = {
+	{
+		.name = "memcache",
+		.mode = COMMAND_ANY,
+		.help = "Host side cache of the target memory",
+		.usage = "",
+		.chain = memcache_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_MEMCACHE_H
+#define OPENOCD_TARGET_MEMCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <helper/command.h>
+#include <helper/types.h>
+
+struct target;
+
+/**
+ * Read @a len bytes at @a address from the memory cache of @a target,
+ * filling the missing lines from the target.
+ *
+ * @returns true if the whole range was served, false if the caller has to
+ * read it from the target: cache disabled, target not halted, range not
+ * in a cached region or failure to fill a line.
+ */
+bool target_memcache_read(struct target *target, target_addr_t address,
+		uint32_t len, uint8_t *buffer);
+
+/** Invalidate all the lines of the memory cache of @a target */
+void target_memcache_invalidate(struct target *target);
+
+/**
+ * Invalidate the memory caches of all the targets, e.g. after a write:
+ * memory can be shared between targets, or mapped at several addresses.
+ */
+void target_memcache_invalidate_all(void);
+
+void target_memcache_free(struct target *target);
+
+extern const struct command_registration target_memcache_command_handlers[];
+
+#endif /* OPENOCD_TARGET_MEMCACHE_H */
@@ -102,6 +102,91 @@ void register_cache_invalidate(struct reg_cache *cache)
 	}
 }
 
+static uint32_t register_layout_mix(uint32_t layout, uint64_t value)
+{
+	/* FNV-1a, one 32 bit word at a time */
+	layout = (layout ^ (uint32_t)value) * 16777619;
+	return (layout ^ (uint32_t)(value >> 32)) * 16777619;
+}
+
+static uint32_t register_layout_mix_string(uint32_t layout, const char *str)
+{
+	/* the contents, an address may be reused by another string */
+	if (str)
+		for (; *str; str++)
+			layout = (layout ^ (uint8_t)*str) * 16777619;
+
+	return register_layout_mix(layout, str ? 1 : 0);
+}
+
+/**
+ * Returns a fingerprint of the shape of the register caches starting at
+ * @a first: the caches, their registers and how these are described to
+ * GDB, but not the register values. It changes when a cache is added or
+ * removed, or when a register is found to exist or not, or gets hidden.
+ *
+ * @param first The first cache of the list.
+ * @param layout The fingerprint of other caches to combine with, or 0.
+ */
+uint32_t register_cache_layout(const struct reg_cache *first, uint32_t layout)
+{
+	if (!layout)
+		layout = 2166136261;
+
+	for (const struct reg_cache *cache = first; cache; cache = cache->next) {
+		layout = register_layout_mix(layout, (uintptr_t)cache);
+		layout = register_layout_mix(layout, (uintptr_t)cache->reg_list);
+		layout = register_layout_mix(layout, cache->num_regs);
+
+		for (unsigned int i = 0; i < cache->num_regs; i++) {
+			const struct reg *reg = &cache->reg_list[i];
+
+			layout = register_layout_mix_string(layout, reg->name);
+			layout = register_layout_mix_string(layout,
+					reg->feature ? reg->feature->name : NULL);
+			if (reg->reg_data_type) {
+				layout = register_layout_mix_string(layout, reg->reg_data_type->id);
+				layout = register_layout_mix(layout, reg->reg_data_type->type);
+			}
+			layout = register_layout_mix_string(layout, reg->group);
+			layout = register_layout_mix(layout, (uint64_t)reg->number << 32 | reg->size);
+			layout = register_layout_mix(layout, reg->exist | reg->hidden << 1
+					| reg->caller_save << 2);
+		}
+	}
+
+	return layout;
+}
+
+/**
+ * Returns a fingerprint of the registers given to GDB, as returned by
+ * target_get_gdb_reg_list(), and of the architecture GDB is told about.
+ * Both change with the state of some cores, e.g. AArch64 or AArch32,
+ * while the register caches stay the same.
+ *
+ * @param arch The architecture, from target_get_gdb_arch(), or NULL.
+ * @param reg_list The registers, in the order given to GDB.
+ * @param reg_list_size The number of registers in @a reg_list.
+ * @param layout The fingerprint to combine with, or 0.
+ */
+uint32_t register_list_layout(const char *arch, struct reg **reg_list,
+		int reg_list_size, uint32_t layout)
+{
+	if (!layout)
+		layout = 2166136261;
+
+	layout = register_layout_mix_string(layout, arch);
+	layout = register_layout_mix(layout, reg_list_size);
+
+	for (int i = 0; i < reg_list_size; i++) {
+		layout = register_layout_mix(layout, (uintptr_t)reg_list[i]);
+		layout = register_layout_mix_string(layout,
+				reg_list[i] ? reg_list[i]->name : NULL);
+	}
+
+	return layout;
+}
+
 static int register_get_dummy_core_reg(struct reg *reg)
 {
 	return ERROR_OK;
@@ -160,6 +160,9 @@ struct reg *register_get_by_name(struct reg_cache *first,
 struct reg_cache **register_get_last_cache_p(struct reg_cache **first);
 void register_unlink_cache(struct reg_cache **cache_p, const struct reg_cache *cache);
 void register_cache_invalidate(struct reg_cache *cache);
+uint32_t register_cache_layout(const struct reg_cache *first, uint32_t layout);
+uint32_t register_list_layout(const char *arch, struct reg **reg_list,
+		int reg_list_size, uint32_t layout);
 
 void register_init_dummy(struct reg *reg);
 
@@ -94,6 +94,11 @@ int gdb_write_smp_packet(struct connection *connection,
 	return retval;
 }
 
+bool target_smp_coupled(struct target *target)
+{
+	return target->smp && !(target->gdb_service && target->gdb_service->non_stop);
+}
+
 COMMAND_HANDLER(default_handle_smp_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
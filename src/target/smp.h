@@ -20,6 +20,14 @@
 
 extern const struct command_registration smp_command_handlers[];
 
+struct target;
+
+/**
+ * @returns true if the cores of the SMP group of @a target halt and resume
+ * together, i.e. unless GDB debugs them in non-stop mode.
+ */
+bool target_smp_coupled(struct target *target);
+
 /* DEPRECATED */
 int gdb_read_smp_packet(struct connection *connection,
 		char const *packet, int packet_size);
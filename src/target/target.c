@@ -45,9 +45,11 @@
 #include "image.h"
 #include "rtos/rtos.h"
 #include "transport/transport.h"
+#include "arm.h"
 #include "arm_cti.h"
 #include "smp.h"
 #include "semihosting_common.h"
+#include "memcache.h"
 
 /* default halt wait timeout (ms) */
 #define DEFAULT_HALT_TIMEOUT 5000
@@ -106,7 +108,6 @@ static struct target_type *target_types[] = {
 
 struct target *all_targets;
 static struct target_event_callback *target_event_callbacks;
-static struct target_timer_callback *target_timer_callbacks;
 static int64_t target_timer_next_event_value;
 static LIST_HEAD(target_reset_callback_list);
 static LIST_HEAD(target_trace_callback_list);
@@ -794,6 +795,7 @@ int target_run_algorithm(struct target *target,
 			num_reg_params, reg_param,
 			entry_point, exit_point, timeout_ms, arch_info);
 	target->running_alg = false;
+	target_memcache_invalidate_all();
 
 done:
 	return retval;
@@ -877,6 +879,7 @@ int target_wait_algorithm(struct target *target,
 			num_mem_params, mem_params,
 			num_reg_params, reg_params,
 			exit_point, timeout_ms, arch_info);
+	target_memcache_invalidate_all();
 	if (retval != ERROR_TARGET_TIMEOUT)
 		target->running_alg = false;
 
@@ -1245,6 +1248,8 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	if (target_memcache_read(target, address, size * count, buffer))
+		return ERROR_OK;
 	return target->type->read_memory(target, address, size, count, buffer);
 }
 
@@ -1273,6 +1278,7 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_memcache_invalidate_all();
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1287,6 +1293,7 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_memcache_invalidate_all();
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1297,6 +1304,8 @@ int target_add_breakpoint(struct target *target,
 		LOG_TARGET_ERROR(target, "not halted (add breakpoint)");
 		return ERROR_TARGET_NOT_HALTED;
 	}
+	/* software breakpoints can be written without target_write_memory() */
+	target_memcache_invalidate_all();
 	return target->type->add_breakpoint(target, breakpoint);
 }
 
@@ -1323,6 +1332,7 @@ int target_add_hybrid_breakpoint(struct target *target,
 int target_remove_breakpoint(struct target *target,
 		struct breakpoint *breakpoint)
 {
+	target_memcache_invalidate_all();
 	return target->type->remove_breakpoint(target, breakpoint);
 }
 
@@ -1398,6 +1408,35 @@ int target_get_gdb_reg_list_noread(struct target *target,
 	return target_get_gdb_reg_list(target, reg_list, reg_list_size, reg_class);
 }
 
+int target_fetch_registers(struct target *target,
+		enum target_register_class reg_class)
+{
+	struct reg **reg_list;
+	int reg_list_size;
+	bool all_valid = true;
+
+	if (!target->type->fetch_registers)
+		return ERROR_OK;
+	if (target->state != TARGET_HALTED)
+		return ERROR_TARGET_NOT_HALTED;
+
+	/* Nothing to fetch, skip the debug state setup of the batch */
+	int retval = target_get_gdb_reg_list_noread(target, &reg_list,
+			&reg_list_size, reg_class);
+	if (retval != ERROR_OK)
+		return retval;
+	for (int i = 0; i < reg_list_size && all_valid; i++) {
+		if (!reg_list[i] || !reg_list[i]->exist || reg_list[i]->hidden)
+			continue;
+		all_valid = reg_list[i]->valid;
+	}
+	free(reg_list);
+	if (all_valid)
+		return ERROR_OK;
+
+	return target->type->fetch_registers(target, reg_class);
+}
+
 bool target_supports_gdb_connection(const struct target *target)
 {
 	/*
@@ -1655,31 +1694,125 @@ int target_register_trace_callback(int (*callback)(struct target *target,
 	return ERROR_OK;
 }
 
+/*
+ * The timer callbacks are kept in a binary min-heap, ordered by due time then
+ * by registration order: the next event is at the top, and registering or
+ * rescheduling a callback costs O(log n) instead of a walk of all of them.
+ * While they run, the due callbacks are out of the heap, in
+ * target_timer_running[], so that they can (un)register timers themselves.
+ * Unregistered callbacks are only flagged, and freed when they get out of
+ * the heap.
+ */
+static struct target_timer_callback **target_timer_heap;
+static unsigned int target_timer_heap_size;
+static unsigned int target_timer_heap_alloc;
+static struct target_timer_callback **target_timer_running;
+static unsigned int target_timer_running_count;
+static uint64_t target_timer_seq;
+
+static bool target_timer_before(const struct target_timer_callback *a,
+		const struct target_timer_callback *b)
+{
+	if (a->when != b->when)
+		return a->when < b->when;
+	return a->seq < b->seq;
+}
+
+static void target_timer_heap_sift_up(unsigned int i)
+{
+	struct target_timer_callback *cb = target_timer_heap[i];
+
+	while (i > 0) {
+		unsigned int parent = (i - 1) / 2;
+
+		if (!target_timer_before(cb, target_timer_heap[parent]))
+			break;
+		target_timer_heap[i] = target_timer_heap[parent];
+		i = parent;
+	}
+	target_timer_heap[i] = cb;
+}
+
+static void target_timer_heap_sift_down(unsigned int i)
+{
+	struct target_timer_callback *cb = target_timer_heap[i];
+
+	for (;;) {
+		unsigned int child = 2 * i + 1;
+
+		if (child >= target_timer_heap_size)
+			break;
+		if (child + 1 < target_timer_heap_size &&
+				target_timer_before(target_timer_heap[child + 1], target_timer_heap[child]))
+			child++;
+		if (!target_timer_before(target_timer_heap[child], cb))
+			break;
+		target_timer_heap[i] = target_timer_heap[child];
+		i = child;
+	}
+	target_timer_heap[i] = cb;
+}
+
+static int target_timer_heap_push(struct target_timer_callback *cb)
+{
+	if (target_timer_heap_size == target_timer_heap_alloc) {
+		unsigned int alloc = target_timer_heap_alloc ? 2 * target_timer_heap_alloc : 16;
+		struct target_timer_callback **heap;
+
+		heap = realloc(target_timer_heap, alloc * sizeof(*heap));
+		if (!heap) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+		target_timer_heap = heap;
+		target_timer_heap_alloc = alloc;
+	}
+
+	target_timer_heap[target_timer_heap_size++] = cb;
+	target_timer_heap_sift_up(target_timer_heap_size - 1);
+
+	return ERROR_OK;
+}
+
+static struct target_timer_callback *target_timer_heap_pop(void)
+{
+	struct target_timer_callback *cb = target_timer_heap[0];
+
+	target_timer_heap[0] = target_timer_heap[--target_timer_heap_size];
+	if (target_timer_heap_size)
+		target_timer_heap_sift_down(0);
+
+	return cb;
+}
+
 int target_register_timer_callback(int (*callback)(void *priv),
 		unsigned int time_ms, enum target_timer_type type, void *priv)
 {
-	struct target_timer_callback **callbacks_p = &target_timer_callbacks;
+	struct target_timer_callback *cb;
 
 	if (!callback)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	if (*callbacks_p) {
-		while ((*callbacks_p)->next)
-			callbacks_p = &((*callbacks_p)->next);
-		callbacks_p = &((*callbacks_p)->next);
+	cb = malloc(sizeof(struct target_timer_callback));
+	if (!cb) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
 	}
 
-	(*callbacks_p) = malloc(sizeof(struct target_timer_callback));
-	(*callbacks_p)->callback = callback;
-	(*callbacks_p)->type = type;
-	(*callbacks_p)->time_ms = time_ms;
-	(*callbacks_p)->removed = false;
+	cb->callback = callback;
+	cb->type = type;
+	cb->time_ms = time_ms;
+	cb->removed = false;
+	cb->when = timeval_ms() + time_ms;
+	cb->seq = target_timer_seq++;
+	cb->priv = priv;
 
-	(*callbacks_p)->when = timeval_ms() + time_ms;
-	target_timer_next_event_value = MIN(target_timer_next_event_value, (*callbacks_p)->when);
+	if (target_timer_heap_push(cb) != ERROR_OK) {
+		free(cb);
+		return ERROR_FAIL;
+	}
 
-	(*callbacks_p)->priv = priv;
-	(*callbacks_p)->next = NULL;
+	target_timer_next_event_value = MIN(target_timer_next_event_value, cb->when);
 
 	return ERROR_OK;
 }
@@ -1750,9 +1883,19 @@ int target_unregister_timer_callback(int (*callback)(void *priv), void *priv)
 	if (!callback)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	for (struct target_timer_callback *c = target_timer_callbacks;
-	     c; c = c->next) {
-		if ((c->callback == callback) && (c->priv == priv)) {
+	for (unsigned int i = 0; i < target_timer_running_count; i++) {
+		struct target_timer_callback *c = target_timer_running[i];
+
+		if (c && !c->removed && c->callback == callback && c->priv == priv) {
+			c->removed = true;
+			return ERROR_OK;
+		}
+	}
+
+	for (unsigned int i = 0; i < target_timer_heap_size; i++) {
+		struct target_timer_callback *c = target_timer_heap[i];
+
+		if (!c->removed && c->callback == callback && c->priv == priv) {
 			c->removed = true;
 			return ERROR_OK;
 		}
@@ -1775,6 +1918,9 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 			target_event_name(event),
 			target_name(target));
 
+	/* whatever happened to the target, its memory may have changed */
+	target_memcache_invalidate(target);
+
 	target_handle_event(target, event);
 
 	while (callback) {
@@ -1809,22 +1955,15 @@ int target_call_trace_callbacks(struct target *target, size_t len, uint8_t *data
 	return ERROR_OK;
 }
 
-static int target_timer_callback_periodic_restart(
-		struct target_timer_callback *cb, int64_t *now)
-{
-	cb->when = *now + cb->time_ms;
-	return ERROR_OK;
-}
-
-static int target_call_timer_callback(struct target_timer_callback *cb,
+static void target_call_timer_callback(struct target_timer_callback *cb,
 		int64_t *now)
 {
 	cb->callback(cb->priv);
 
 	if (cb->type == TARGET_TIMER_TYPE_PERIODIC)
-		return target_timer_callback_periodic_restart(cb, now);
-
-	return target_unregister_timer_callback(cb->callback, cb->priv);
+		cb->when = *now + cb->time_ms;
+	else
+		cb->removed = true;
 }
 
 static int target_call_timer_callbacks_check_time(int checktime)
@@ -1841,35 +1980,51 @@ static int target_call_timer_callbacks_check_time(int checktime)
 
 	int64_t now = timeval_ms();
 
-	/* Initialize to a default value that's a ways into the future.
-	 * The loop below will make it closer to now if there are
-	 * callbacks that want to be called sooner. */
-	target_timer_next_event_value = now + 1000;
+	/* Take the due callbacks out of the heap, all of them if the periodic
+	 * ones have to be called now anyway. */
+	if (target_timer_heap_size) {
+		struct target_timer_callback **running;
 
-	/* Store an address of the place containing a pointer to the
-	 * next item; initially, that's a standalone "root of the
-	 * list" variable. */
-	struct target_timer_callback **callback = &target_timer_callbacks;
-	while (callback && *callback) {
-		if ((*callback)->removed) {
-			struct target_timer_callback *p = *callback;
-			*callback = (*callback)->next;
-			free(p);
-			continue;
+		running = realloc(target_timer_running,
+				target_timer_heap_size * sizeof(*running));
+		if (!running) {
+			LOG_ERROR("Out of memory");
+			callback_processing = false;
+			return ERROR_FAIL;
 		}
+		target_timer_running = running;
+	}
 
-		bool call_it = (*callback)->callback &&
-			((!checktime && (*callback)->type == TARGET_TIMER_TYPE_PERIODIC) ||
-			 now >= (*callback)->when);
+	target_timer_running_count = 0;
+	while (target_timer_heap_size &&
+			(!checktime || target_timer_heap[0]->when <= now))
+		target_timer_running[target_timer_running_count++] = target_timer_heap_pop();
 
-		if (call_it)
-			target_call_timer_callback(*callback, &now);
+	for (unsigned int i = 0; i < target_timer_running_count; i++) {
+		struct target_timer_callback *cb = target_timer_running[i];
+
+		bool call_it = !cb->removed && cb->callback &&
+			((!checktime && cb->type == TARGET_TIMER_TYPE_PERIODIC) ||
+			 now >= cb->when);
 
-		if (!(*callback)->removed && (*callback)->when < target_timer_next_event_value)
-			target_timer_next_event_value = (*callback)->when;
+		if (call_it)
+			target_call_timer_callback(cb, &now);
 
-		callback = &(*callback)->next;
+		target_timer_running[i] = NULL;
+		if (cb->removed || target_timer_heap_push(cb) != ERROR_OK)
+			free(cb);
 	}
+	target_timer_running_count = 0;
+
+	/* Unregistered callbacks on top would only cause spurious wake-ups */
+	while (target_timer_heap_size && target_timer_heap[0]->removed)
+		free(target_timer_heap_pop());
+
+	/* Default to a value that's a ways into the future */
+	target_timer_next_event_value = now + 1000;
+	if (target_timer_heap_size)
+		target_timer_next_event_value = MIN(target_timer_next_event_value,
+				target_timer_heap[0]->when);
 
 	callback_processing = false;
 	return ERROR_OK;
@@ -2203,6 +2358,8 @@ static void target_destroy(struct target *target)
 
 	target_free_all_working_areas(target);
 
+	target_memcache_free(target);
+
 	/* release the targets SMP list */
 	if (target->smp) {
 		struct target_list *head, *tmp;
@@ -2237,13 +2394,14 @@ void target_quit(void)
 	}
 	target_event_callbacks = NULL;
 
-	struct target_timer_callback *pt = target_timer_callbacks;
-	while (pt) {
-		struct target_timer_callback *t = pt->next;
-		free(pt);
-		pt = t;
-	}
-	target_timer_callbacks = NULL;
+	for (unsigned int i = 0; i < target_timer_heap_size; i++)
+		free(target_timer_heap[i]);
+	free(target_timer_heap);
+	target_timer_heap = NULL;
+	target_timer_heap_size = 0;
+	target_timer_heap_alloc = 0;
+	free(target_timer_running);
+	target_timer_running = NULL;
 
 	for (struct target *target = all_targets; target;) {
 		struct target *tmp;
@@ -2295,7 +2453,7 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 	gettimeofday(&timeout, NULL);
 	timeval_add_time(&timeout, seconds, 0);
 
-	LOG_INFO("Starting profiling. Halting and resuming the"
+	LOG_DEBUG("Starting profiling. Halting and resuming the"
 			" target as often as we can...");
 
 	uint32_t sample_count = 0;
@@ -2326,7 +2484,7 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 
 		gettimeofday(&now, NULL);
 		if ((sample_count >= max_num_samples) || timeval_compare(&now, &timeout) >= 0) {
-			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+			LOG_DEBUG("Profiling completed. %" PRIu32 " samples.", sample_count);
 			break;
 		}
 	}
@@ -2360,6 +2518,9 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	/* also for the targets writing their buffers without target_write_memory() */
+	target_memcache_invalidate_all();
+
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2425,9 +2586,65 @@ int target_read_buffer(struct target *target, target_addr_t address, uint32_t si
 		return ERROR_FAIL;
 	}
 
+	/* the default implementation looks up the cache in target_read_memory() */
+	if (target->type->read_buffer != target_read_buffer_default
+			&& target_memcache_read(target, address, size, buffer))
+		return ERROR_OK;
+
 	return target->type->read_buffer(target, address, size, buffer);
 }
 
+int target_read_memory_sg(struct target *target,
+		const struct target_memory_sg *sg, unsigned int count)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (count == 0)
+		return ERROR_OK;
+
+	if (!target->type->read_memory_sg) {
+		for (unsigned int i = 0; i < count; i++) {
+			int retval = target_read_buffer(target, sg[i].address, sg[i].size, sg[i].buffer);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+		return ERROR_OK;
+	}
+
+	/* Serve what we can from the memory cache, batch the rest */
+	struct target_memory_sg *todo = malloc(count * sizeof(*todo));
+	if (!todo) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		if (sg[i].size == 0)
+			continue;
+		if (sg[i].address + sg[i].size - 1 < sg[i].address) {
+			LOG_ERROR("address + size wrapped (" TARGET_ADDR_FMT ", 0x%08" PRIx32 ")",
+					sg[i].address, sg[i].size);
+			free(todo);
+			return ERROR_FAIL;
+		}
+		if (!target_memcache_read(target, sg[i].address, sg[i].size, sg[i].buffer))
+			todo[n++] = sg[i];
+	}
+
+	int retval = ERROR_OK;
+	if (n > 0) {
+		LOG_DEBUG("reading %u blocks in one batch", n);
+		retval = target->type->read_memory_sg(target, todo, n);
+	}
+
+	free(todo);
+	return retval;
+}
+
 static int target_read_buffer_default(struct target *target, target_addr_t address, uint32_t count, uint8_t *buffer)
 {
 	uint32_t size;
@@ -3569,6 +3786,151 @@ COMMAND_HANDLER(handle_mw_command)
 	return target_fill_mem(target, address, fn, wordsize, value, count);
 }
 
+/*
+ * "load_image -delta" compares each section in blocks of at least
+ * LOAD_DELTA_MIN_BLOCK_SIZE bytes, and at most LOAD_DELTA_MAX_BLOCKS of
+ * them, which bounds the number of checksum runs of a rewritten section.
+ */
+#define LOAD_DELTA_MIN_BLOCK_SIZE	4096
+#define LOAD_DELTA_MAX_BLOCKS		256
+
+struct load_delta_section {
+	target_addr_t address;
+	uint32_t length;
+	const uint8_t *data;
+	/* copy of the image section owned by the caller, or NULL */
+	uint8_t *buffer;
+	uint32_t block_size;
+	/* blocks whose content differs from the target memory */
+	bool *changed;
+};
+
+/*
+ * Compare blocks [first, last) of a section with the target memory: when
+ * their checksums differ, compare both halves, down to single blocks.
+ * An unchanged section costs a single checksum run.
+ */
+static int load_delta_compare(struct target *target,
+	struct load_delta_section *section, unsigned int first, unsigned int last)
+{
+	uint32_t offset = first * section->block_size;
+	uint32_t size = MIN(last * section->block_size, section->length) - offset;
+	uint32_t image_crc, target_crc;
+	int retval;
+
+	retval = target->type->checksum_memory(target, section->address + offset,
+			size, &target_crc);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = image_calculate_checksum(section->data + offset, size, &image_crc);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (image_crc == target_crc)
+		return ERROR_OK;
+
+	if (last - first == 1) {
+		section->changed[first] = true;
+		return ERROR_OK;
+	}
+
+	unsigned int middle = first + (last - first) / 2;
+	retval = load_delta_compare(target, section, first, middle);
+	if (retval == ERROR_OK)
+		retval = load_delta_compare(target, section, middle, last);
+
+	return retval;
+}
+
+/*
+ * Write to the target only the blocks of the sections that differ from its
+ * memory. All the checksums are computed before the first write, because
+ * the checksum algorithm may use a working area inside the sections.
+ */
+static int load_delta_write_sections(struct command_invocation *cmd,
+	struct target *target, struct load_delta_section *sections,
+	unsigned int num_sections, uint32_t *written)
+{
+	bool compare = target->type->checksum_memory;
+	int retval = ERROR_OK;
+
+	if (!compare)
+		LOG_TARGET_WARNING(target, "can't checksum memory, writing all the sections");
+
+	*written = 0;
+
+	for (unsigned int i = 0; i < num_sections; i++) {
+		struct load_delta_section *section = &sections[i];
+		unsigned int num_blocks;
+
+		section->block_size = MAX(LOAD_DELTA_MIN_BLOCK_SIZE,
+				DIV_ROUND_UP(section->length, LOAD_DELTA_MAX_BLOCKS));
+		num_blocks = DIV_ROUND_UP(section->length, section->block_size);
+		if (!num_blocks)
+			continue;
+
+		section->changed = calloc(num_blocks, sizeof(bool));
+		if (!section->changed) {
+			LOG_ERROR("Unable to allocate memory");
+			return ERROR_FAIL;
+		}
+
+		if (compare && load_delta_compare(target, section, 0, num_blocks) != ERROR_OK) {
+			LOG_TARGET_WARNING(target, "can't checksum memory, writing all the sections");
+			compare = false;
+		}
+
+		if (!compare)
+			memset(section->changed, true, num_blocks * sizeof(bool));
+	}
+
+	for (unsigned int i = 0; i < num_sections && retval == ERROR_OK; i++) {
+		struct load_delta_section *section = &sections[i];
+		unsigned int num_blocks = DIV_ROUND_UP(section->length, section->block_size);
+		uint32_t section_written = 0;
+
+		for (unsigned int first = 0; first < num_blocks; first++) {
+			if (!section->changed[first])
+				continue;
+
+			/* merge the consecutive changed blocks into one write */
+			unsigned int last = first + 1;
+			while (last < num_blocks && section->changed[last])
+				last++;
+
+			uint32_t offset = first * section->block_size;
+			uint32_t size = MIN(last * section->block_size, section->length) - offset;
+			retval = target_write_buffer(target, section->address + offset,
+					size, section->data + offset);
+			if (retval != ERROR_OK)
+				break;
+			section_written += size;
+			first = last;
+		}
+
+		if (section->length)
+			command_print(cmd, "%" PRIu32 " of %" PRIu32 " bytes written at address "
+					TARGET_ADDR_FMT, section_written, section->length, section->address);
+		*written += section_written;
+	}
+
+	return retval;
+}
+
+static void load_delta_free_sections(struct load_delta_section *sections,
+	unsigned int num_sections)
+{
+	if (!sections)
+		return;
+
+	for (unsigned int i = 0; i < num_sections; i++) {
+		free(sections[i].buffer);
+		free(sections[i].changed);
+	}
+	free(sections);
+}
+
 static COMMAND_HELPER(parse_load_image_command, struct image *image,
 		target_addr_t *min_address, target_addr_t *max_address)
 {
@@ -3609,6 +3971,15 @@ COMMAND_HANDLER(handle_load_image_command)
 	target_addr_t min_address = 0;
 	target_addr_t max_address = -1;
 	struct image image;
+	struct load_delta_section *delta = NULL;
+	unsigned int delta_num = 0;
+
+	/* only write the blocks that differ from the target memory */
+	bool delta_mode = CMD_ARGC > 0 && !strcmp(CMD_ARGV[0], "-delta");
+	if (delta_mode) {
+		CMD_ARGC--;
+		CMD_ARGV++;
+	}
 
 	int retval = CALL_COMMAND_HANDLER(parse_load_image_command,
 			&image, &min_address, &max_address);
@@ -3623,6 +3994,15 @@ COMMAND_HANDLER(handle_load_image_command)
 	if (image_open(&image, CMD_ARGV[0], (CMD_ARGC >= 3) ? CMD_ARGV[2] : NULL) != ERROR_OK)
 		return ERROR_FAIL;
 
+	if (delta_mode) {
+		delta = calloc(image.num_sections, sizeof(*delta));
+		if (!delta) {
+			LOG_ERROR("Unable to allocate memory");
+			image_close(&image);
+			return ERROR_FAIL;
+		}
+	}
+
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (unsigned int i = 0; i < image.num_sections; i++) {
@@ -3658,6 +4038,17 @@ COMMAND_HANDLER(handle_load_image_command)
 			if (image.sections[i].base_address + buf_cnt > max_address)
 				length -= (image.sections[i].base_address + buf_cnt)-max_address;
 
+			if (delta_mode) {
+				/* written once all the sections are compared */
+				delta[delta_num].address = image.sections[i].base_address + offset;
+				delta[delta_num].length = length;
+				delta[delta_num].data = buffer + offset;
+				delta[delta_num].buffer = buffer;
+				delta_num++;
+				image_size += length;
+				continue;
+			}
+
 			retval = target_write_buffer(target,
 					image.sections[i].base_address + offset, length, buffer + offset);
 			if (retval != ERROR_OK) {
@@ -3673,10 +4064,21 @@ COMMAND_HANDLER(handle_load_image_command)
 		free(buffer);
 	}
 
+	uint32_t skipped = 0;
+	if (delta_mode && retval == ERROR_OK) {
+		uint32_t written;
+		retval = load_delta_write_sections(CMD, target, delta, delta_num, &written);
+		skipped = image_size - written;
+		image_size = written;
+	}
+	load_delta_free_sections(delta, delta_num);
+
 	if ((retval == ERROR_OK) && (duration_measure(&bench) == ERROR_OK)) {
 		command_print(CMD, "downloaded %" PRIu32 " bytes "
 				"in %fs (%0.3f KiB/s)", image_size,
 				duration_elapsed(&bench), duration_kbps(&bench, image_size));
+		if (delta_mode)
+			command_print(CMD, "skipped %" PRIu32 " unchanged bytes", skipped);
 	}
 
 	image_close(&image);
@@ -4197,8 +4599,41 @@ static void write_string(FILE *f, char *s)
 
 typedef unsigned char UNIT[2];  /* unit of profiling */
 
-/* Dump a gmon.out histogram file. */
-static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filename, bool with_range,
+/* PC samples buffered by the profile command before they are flushed */
+#define PROFILE_SAMPLES_BUFFER_SIZE	(64 * 1024)
+
+/* PC samples taken by the profile command. The buffer is flushed to a
+ * temporary file each time it fills up, so that long captures need no more
+ * memory, and write_gmon() reads them back from there. */
+struct profile_samples {
+	FILE *f;
+	uint64_t total;
+	uint32_t count;
+	uint32_t buffer[PROFILE_SAMPLES_BUFFER_SIZE];
+};
+
+static int profile_samples_flush(struct profile_samples *samples)
+{
+	if (fwrite(samples->buffer, sizeof(uint32_t), samples->count, samples->f) != samples->count) {
+		LOG_ERROR("failed to write the samples: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	samples->total += samples->count;
+	samples->count = 0;
+	return ERROR_OK;
+}
+
+/* Read the next flushed samples back into the buffer, returns 0 at the end */
+static uint32_t profile_samples_read(struct profile_samples *samples)
+{
+	samples->count = fread(samples->buffer, sizeof(uint32_t),
+			PROFILE_SAMPLES_BUFFER_SIZE, samples->f);
+	return samples->count;
+}
+
+/* Dump a gmon.out histogram file of the flushed samples. */
+static void write_gmon(struct profile_samples *samples, const char *filename, bool with_range,
 			uint32_t start_address, uint32_t end_address, struct target *target, uint32_t duration_ms)
 {
 	uint32_t i;
@@ -4221,13 +4656,16 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 		min = start_address;
 		max = end_address;
 	} else {
-		min = samples[0];
-		max = samples[0];
-		for (i = 0; i < sample_num; i++) {
-			if (min > samples[i])
-				min = samples[i];
-			if (max < samples[i])
-				max = samples[i];
+		min = samples->total ? UINT32_MAX : 0;
+		max = 0;
+		rewind(samples->f);
+		while (profile_samples_read(samples)) {
+			for (i = 0; i < samples->count; i++) {
+				if (min > samples->buffer[i])
+					min = samples->buffer[i];
+				if (max < samples->buffer[i])
+					max = samples->buffer[i];
+			}
 		}
 
 		/* max should be (largest sample + 1)
@@ -4258,24 +4696,27 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 		return;
 	}
 	memset(buckets, 0, sizeof(int) * num_buckets);
-	for (i = 0; i < sample_num; i++) {
-		uint32_t address = samples[i];
+	rewind(samples->f);
+	while (profile_samples_read(samples)) {
+		for (i = 0; i < samples->count; i++) {
+			uint32_t address = samples->buffer[i];
 
-		if ((address < min) || (max <= address))
-			continue;
+			if ((address < min) || (max <= address))
+				continue;
 
-		long long a = address - min;
-		long long b = num_buckets;
-		long long c = address_space;
-		int index_t = (a * b) / c; /* danger!!!! int32 overflows */
-		buckets[index_t]++;
+			long long a = address - min;
+			long long b = num_buckets;
+			long long c = address_space;
+			int index_t = (a * b) / c; /* danger!!!! int32 overflows */
+			buckets[index_t]++;
+		}
 	}
 
 	/* append binary memory gmon.out &profile_hist_hdr ((char*)&profile_hist_hdr + sizeof(struct gmon_hist_hdr)) */
 	write_long(f, min, target);			/* low_pc */
 	write_long(f, max, target);			/* high_pc */
 	write_long(f, num_buckets, target);	/* # of buckets */
-	float sample_rate = sample_num / (duration_ms / 1000.0);
+	float sample_rate = samples->total / (duration_ms / 1000.0);
 	write_long(f, sample_rate, target);
 	write_string(f, "seconds");
 	for (i = 0; i < (15-strlen("seconds")); i++)
@@ -4303,92 +4744,460 @@ static void write_gmon(uint32_t *samples, uint32_t sample_num, const char *filen
 	fclose(f);
 }
 
+/* Leave the target halted or running after profiling, as it was before */
+static int profile_restore_state(struct target *target, bool halted_before_profiling)
+{
+	int retval = target_poll(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (target->state == TARGET_RUNNING && halted_before_profiling) {
+		/* The target was halted before we started and is running now. Halt it,
+		 * for consistency. */
+		retval = target_halt(target);
+		if (retval != ERROR_OK)
+			return retval;
+	} else if (target->state == TARGET_HALTED && !halted_before_profiling) {
+		/* The target was running before we started and is halted now. Resume
+		 * it, for consistency. */
+		retval = target_resume(target, 1, 0, 0, 0);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return target_poll(target);
+}
+
+/* Stacks buffered by the profile command before they are written out */
+#define PROFILE_STACKS_BUFFER_SIZE	1024
+#define PROFILE_STACKS_MAX_DEPTH	64
+
+/* Frame records walked by the profile command. The frame pointer register
+ * points into the frame record of the function: the frame pointer of the
+ * caller and the return address, at the given offsets in words of the size
+ * of the frame pointer, with -fno-omit-frame-pointer. AArch64 and RISC-V
+ * compilers agree on their frame records. ARM ones don't: clang points the
+ * frame pointer to the saved frame pointer, GCC in ARM state to the saved
+ * return address, and GCC in Thumb state below the local variables, where
+ * the frame record can't be found. The ARM layouts are thus checked against
+ * the code: a return address must follow a call instruction. */
+static const struct profile_frame_layout {
+	const char *fp;
+	int fp_offset;
+	int ra_offset;
+	bool check_call;
+} profile_frame_layouts[] = {
+	{ "x29", 0, 1, false },		/* AArch64 */
+	{ "fp", -2, -1, false },	/* RISC-V */
+	{ "r7", 0, 1, true },		/* ARM, Thumb state, clang */
+	{ "r11", 0, 1, true },		/* ARM, ARM state, clang */
+	{ "r11", -1, 0, true },		/* ARM, ARM state, GCC */
+};
+
+/* Stacks sampled by the profile command, appended to the output file each
+ * time the buffer fills up, so that long captures need no more memory */
+struct profile_stacks {
+	FILE *f;
+	unsigned int depth;
+	unsigned int count;
+	/* PROFILE_STACKS_BUFFER_SIZE stacks of depth frames, innermost first */
+	target_addr_t *frames;
+	unsigned int num_frames[PROFILE_STACKS_BUFFER_SIZE];
+};
+
+static int profile_read_reg(struct target *target, const char *name,
+		uint64_t *value, unsigned int *size)
+{
+	struct reg *reg = register_get_by_name(target->reg_cache, name, true);
+	if (!reg)
+		return ERROR_FAIL;
+
+	if (!reg->valid) {
+		int retval = reg->type->get(reg);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	*value = buf_get_u64(reg->value, 0, MIN(reg->size, 64));
+	if (size)
+		*size = reg->size;
+	return ERROR_OK;
+}
+
+static const struct profile_frame_layout *profile_frame_layout(struct target *target)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(profile_frame_layouts); i++) {
+		const struct profile_frame_layout *layout = &profile_frame_layouts[i];
+
+		if (!register_get_by_name(target->reg_cache, layout->fp, true))
+			continue;
+
+		/* x29 in AArch64 state only, an ARMv8 core keeps it in AArch32 state */
+		if (!strcmp(layout->fp, "x29") &&
+				(!is_arm(target_to_arm(target)) ||
+				target_to_arm(target)->core_state != ARM_STATE_AARCH64))
+			continue;
+
+		/* r7 in Thumb state, r11 in ARM state; M profile cores have no CPSR */
+		uint64_t cpsr;
+		if (!strcmp(layout->fp, "r7") &&
+				profile_read_reg(target, "cpsr", &cpsr, NULL) == ERROR_OK &&
+				!(cpsr & 0x20))
+			continue;
+
+		return layout;
+	}
+
+	return NULL;
+}
+
+/* Read the frame record the frame pointer fp points into */
+static int profile_read_frame(struct target *target, const struct profile_frame_layout *layout,
+		uint64_t fp, unsigned int word, uint64_t *caller_fp, uint64_t *ra)
+{
+	/* the saved frame pointer and return address are next to each other */
+	int first = MIN(layout->fp_offset, layout->ra_offset);
+	uint8_t record[16];
+
+	int retval = target_read_buffer(target, fp + (int64_t)first * word, 2 * word, record);
+	if (retval != ERROR_OK)
+		return retval;
+
+	uint8_t *saved_fp = &record[(layout->fp_offset - first) * word];
+	uint8_t *saved_ra = &record[(layout->ra_offset - first) * word];
+	*caller_fp = word == 8 ? target_buffer_get_u64(target, saved_fp)
+			: target_buffer_get_u32(target, saved_fp);
+	*ra = word == 8 ? target_buffer_get_u64(target, saved_ra)
+			: target_buffer_get_u32(target, saved_ra);
+	return ERROR_OK;
+}
+
+/* Whether an ARM return address follows a BL or BLX instruction; the return
+ * addresses of Thumb code have bit 0 set */
+static bool profile_follows_call(struct target *target, uint64_t ra)
+{
+	uint8_t insn[4];
+
+	if (ra < 4 || ra > UINT32_MAX ||
+			target_read_buffer(target, (ra & ~1ull) - 4, 4, insn) != ERROR_OK)
+		return false;
+
+	if (ra & 1) {
+		uint16_t hw1 = target_buffer_get_u16(target, insn);
+		uint16_t hw2 = target_buffer_get_u16(target, insn + 2);
+
+		/* BLX register, then BL and BLX immediate */
+		return (hw2 & 0xff87) == 0x4780 ||
+				((hw1 & 0xf800) == 0xf000 && (hw2 & 0xc000) == 0xc000 &&
+				((hw2 & 0x1000) || !(hw2 & 1)));
+	}
+
+	uint32_t opcode = target_buffer_get_u32(target, insn);
+
+	/* BL, BLX immediate, BLX register */
+	return ((opcode & 0x0f000000) == 0x0b000000 && (opcode >> 28) != 0xf) ||
+			(opcode & 0xfe000000) == 0xfa000000 ||
+			(opcode & 0x0ffffff0) == 0x012fff30;
+}
+
+/* Sample the stack of the halted target: the PC, then the return addresses
+ * found by following the frame pointers, up to depth frames */
+static int profile_unwind(struct target *target, target_addr_t *frames,
+		unsigned int depth, unsigned int *num_frames)
+{
+	uint64_t pc, fp;
+	unsigned int fp_size;
+
+	int retval = profile_read_reg(target, "pc", &pc, NULL);
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Can't read the PC");
+		return retval;
+	}
+
+	frames[0] = pc;
+	*num_frames = 1;
+
+	const struct profile_frame_layout *layout = profile_frame_layout(target);
+	if (!layout || profile_read_reg(target, layout->fp, &fp, &fp_size) != ERROR_OK)
+		return ERROR_OK;
+
+	unsigned int word = fp_size / 8;
+	if (word != 4 && word != 8)
+		return ERROR_OK;
+
+	while (*num_frames < depth && fp) {
+		uint64_t caller_fp, ra;
+		if (profile_read_frame(target, layout, fp, word, &caller_fp, &ra) != ERROR_OK)
+			break;
+
+		if (layout->check_call && !profile_follows_call(target, ra)) {
+			/* the innermost frame tells which of the layouts of this frame
+			 * pointer the code was built with; none, keep the PC only */
+			const struct profile_frame_layout *next = layout + 1;
+			if (*num_frames > 1 ||
+					next == profile_frame_layouts + ARRAY_SIZE(profile_frame_layouts) ||
+					strcmp(next->fp, layout->fp))
+				break;
+			layout = next;
+			continue;
+		}
+		if (!ra)
+			break;
+
+		/* drop the Thumb bit */
+		frames[(*num_frames)++] = ra & ~1ull;
+
+		/* the frames of the callers are further up the stack */
+		if (caller_fp <= fp)
+			break;
+		fp = caller_fp;
+	}
+
+	return ERROR_OK;
+}
+
+/* Append the buffered stacks to the file, in the folded format of
+ * FlameGraph's stackcollapse scripts, outermost frame first */
+static int profile_stacks_flush(struct profile_stacks *stacks)
+{
+	for (unsigned int i = 0; i < stacks->count; i++) {
+		const target_addr_t *frames = &stacks->frames[i * stacks->depth];
+
+		for (unsigned int j = stacks->num_frames[i]; j > 0; j--)
+			fprintf(stacks->f, "%s" TARGET_ADDR_FMT,
+					j == stacks->num_frames[i] ? "" : ";", frames[j - 1]);
+		fprintf(stacks->f, " 1\n");
+	}
+
+	stacks->count = 0;
+
+	if (ferror(stacks->f)) {
+		LOG_ERROR("failed to write the stacks: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+/* Halt the target to sample its stack, then let it run again */
+static int profile_stacks_sample(struct target *target, struct profile_stacks *stacks)
+{
+	int retval = ERROR_OK;
+
+	target_poll(target);
+	if (target->state == TARGET_RUNNING) {
+		retval = target_halt(target);
+		if (retval == ERROR_OK)
+			retval = target_wait_state(target, TARGET_HALTED, 100);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (target->state != TARGET_HALTED) {
+		LOG_TARGET_INFO(target, "Target not halted or running");
+		return ERROR_TARGET_NOT_HALTED;
+	}
+
+	retval = profile_unwind(target, &stacks->frames[stacks->count * stacks->depth],
+			stacks->depth, &stacks->num_frames[stacks->count]);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (++stacks->count == PROFILE_STACKS_BUFFER_SIZE) {
+		retval = profile_stacks_flush(stacks);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* current pc, addr = 0, do not handle breakpoints, not debugging */
+	return target_resume(target, 1, 0, 0, 0);
+}
+
+/* Sample the PC for the given number of seconds, and the stack every
+ * stack_every PC samples if stacks are sampled too */
+static int profile_sample(struct target *target, struct profile_samples *samples,
+		struct profile_stacks *stacks, uint32_t stack_every, uint32_t seconds)
+{
+	uint64_t timeout_ms = timeval_ms() + 1000ull * seconds;
+	uint32_t until_stack = stack_every;
+	uint32_t num_stacks = 0;
+
+	LOG_TARGET_INFO(target, "Starting profiling for %" PRIu32 " seconds...", seconds);
+
+	/**
+	 * Some cores let us sample the PC without the
+	 * annoying halt/resume step; for example, ARMv7 PCSR.
+	 * Provide a way to use that more efficient mechanism.
+	 * It returns when the buffer is full or the time is up.
+	 */
+	for (;;) {
+		uint64_t now_ms = timeval_ms();
+		if (now_ms >= timeout_ms)
+			break;
+
+		uint32_t max_num_samples = PROFILE_SAMPLES_BUFFER_SIZE - samples->count;
+		if (stacks)
+			max_num_samples = MIN(max_num_samples, until_stack);
+
+		uint32_t num_samples;
+		int retval = target_profiling(target, &samples->buffer[samples->count],
+				max_num_samples, &num_samples, DIV_ROUND_UP(timeout_ms - now_ms, 1000));
+		if (retval != ERROR_OK)
+			return retval;
+
+		assert(num_samples <= max_num_samples);
+		samples->count += num_samples;
+		if (samples->count == PROFILE_SAMPLES_BUFFER_SIZE) {
+			retval = profile_samples_flush(samples);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+
+		/* stopped early, the time is up or the target is gone */
+		if (num_samples < max_num_samples)
+			break;
+
+		if (stacks) {
+			until_stack -= num_samples;
+			if (!until_stack) {
+				retval = profile_stacks_sample(target, stacks);
+				if (retval != ERROR_OK)
+					return retval;
+				num_stacks++;
+				until_stack = stack_every;
+			}
+		}
+	}
+
+	int retval = profile_samples_flush(samples);
+	if (retval != ERROR_OK)
+		return retval;
+	if (stacks) {
+		retval = profile_stacks_flush(stacks);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	LOG_TARGET_INFO(target, "Profiling completed. %" PRIu64 " samples, %" PRIu32 " stacks.",
+			samples->total, num_stacks);
+	return ERROR_OK;
+}
+
 /* profiling samples the CPU PC as quickly as OpenOCD is able,
  * which will be used as a random sampling of PC */
 COMMAND_HANDLER(handle_profile_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
 
-	if ((CMD_ARGC != 2) && (CMD_ARGC != 4))
+	if (CMD_ARGC < 2)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
-	const uint32_t MAX_PROFILE_SAMPLE_NUM = 1000000;
 	uint32_t offset;
-	uint32_t num_of_samples;
 	int retval = ERROR_OK;
 	bool halted_before_profiling = target->state == TARGET_HALTED;
 
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], offset);
 
+	unsigned int argp = 2;
 	uint32_t start_address = 0;
 	uint32_t end_address = 0;
 	bool with_range = false;
-	if (CMD_ARGC == 4) {
+	if (CMD_ARGC > argp && strcmp(CMD_ARGV[argp], "-stacks")) {
+		if (CMD_ARGC < argp + 2)
+			return ERROR_COMMAND_SYNTAX_ERROR;
 		with_range = true;
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[2], start_address);
-		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[3], end_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[argp], start_address);
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[argp + 1], end_address);
 		if (start_address > end_address || (end_address - start_address) < 2) {
 			command_print(CMD, "Error: end - start < 2");
 			return ERROR_COMMAND_ARGUMENT_INVALID;
 		}
+		argp += 2;
 	}
 
-	uint32_t *samples = malloc(sizeof(uint32_t) * MAX_PROFILE_SAMPLE_NUM);
+	const char *stacks_filename = NULL;
+	uint32_t stack_every = 100;
+	unsigned int depth = 16;
+	if (CMD_ARGC > argp) {
+		if (strcmp(CMD_ARGV[argp], "-stacks") || CMD_ARGC < argp + 2 || CMD_ARGC > argp + 4)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		stacks_filename = CMD_ARGV[argp + 1];
+		if (CMD_ARGC > argp + 2) {
+			COMMAND_PARSE_NUMBER(u32, CMD_ARGV[argp + 2], stack_every);
+			if (stack_every < 1) {
+				command_print(CMD, "Error: a stack must be sampled every 1 PC sample or more");
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+		if (CMD_ARGC > argp + 3) {
+			COMMAND_PARSE_NUMBER(uint, CMD_ARGV[argp + 3], depth);
+			if (depth < 1 || depth > PROFILE_STACKS_MAX_DEPTH) {
+				command_print(CMD, "Error: depth must be between 1 and %d", PROFILE_STACKS_MAX_DEPTH);
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+		}
+	}
+
+	struct profile_samples *samples = malloc(sizeof(*samples));
 	if (!samples) {
 		LOG_ERROR("No memory to store samples.");
 		return ERROR_FAIL;
 	}
-
-	uint64_t timestart_ms = timeval_ms();
-	/**
-	 * Some cores let us sample the PC without the
-	 * annoying halt/resume step; for example, ARMv7 PCSR.
-	 * Provide a way to use that more efficient mechanism.
-	 */
-	retval = target_profiling(target, samples, MAX_PROFILE_SAMPLE_NUM,
-				&num_of_samples, offset);
-	if (retval != ERROR_OK) {
-		free(samples);
-		return retval;
-	}
-	uint32_t duration_ms = timeval_ms() - timestart_ms;
-
-	assert(num_of_samples <= MAX_PROFILE_SAMPLE_NUM);
-
-	retval = target_poll(target);
-	if (retval != ERROR_OK) {
+	samples->total = 0;
+	samples->count = 0;
+	samples->f = tmpfile();
+	if (!samples->f) {
+		LOG_ERROR("Can't create a temporary file for the samples: %s", strerror(errno));
 		free(samples);
-		return retval;
+		return ERROR_FAIL;
 	}
 
-	if (target->state == TARGET_RUNNING && halted_before_profiling) {
-		/* The target was halted before we started and is running now. Halt it,
-		 * for consistency. */
-		retval = target_halt(target);
-		if (retval != ERROR_OK) {
-			free(samples);
-			return retval;
+	struct profile_stacks stacks = {
+		.depth = depth,
+		.count = 0,
+	};
+	if (stacks_filename) {
+		stacks.frames = malloc(sizeof(*stacks.frames) * PROFILE_STACKS_BUFFER_SIZE * depth);
+		if (!stacks.frames) {
+			LOG_ERROR("No memory to store samples.");
+			retval = ERROR_FAIL;
+			goto done;
 		}
-	} else if (target->state == TARGET_HALTED && !halted_before_profiling) {
-		/* The target was running before we started and is halted now. Resume
-		 * it, for consistency. */
-		retval = target_resume(target, 1, 0, 0, 0);
-		if (retval != ERROR_OK) {
-			free(samples);
-			return retval;
+
+		stacks.f = fopen(stacks_filename, "w");
+		if (!stacks.f) {
+			LOG_ERROR("Can't open %s for writing", stacks_filename);
+			retval = ERROR_FAIL;
+			goto done;
 		}
 	}
 
-	retval = target_poll(target);
-	if (retval != ERROR_OK) {
-		free(samples);
-		return retval;
+	uint64_t timestart_ms = timeval_ms();
+	retval = profile_sample(target, samples, stacks.f ? &stacks : NULL, stack_every, offset);
+	uint32_t duration_ms = timeval_ms() - timestart_ms;
+
+	if (stacks.f && fclose(stacks.f) && retval == ERROR_OK) {
+		LOG_ERROR("failed to write %s: %s", stacks_filename, strerror(errno));
+		retval = ERROR_FAIL;
 	}
+	stacks.f = NULL;
 
-	write_gmon(samples, num_of_samples, CMD_ARGV[1],
-		   with_range, start_address, end_address, target, duration_ms);
+	int restore_retval = profile_restore_state(target, halted_before_profiling);
+	if (retval == ERROR_OK)
+		retval = restore_retval;
+	if (retval != ERROR_OK)
+		goto done;
+
+	write_gmon(samples, CMD_ARGV[1], with_range, start_address, end_address, target, duration_ms);
 	command_print(CMD, "Wrote %s", CMD_ARGV[1]);
+	if (stacks_filename)
+		command_print(CMD, "Wrote %s", stacks_filename);
 
+done:
+	if (stacks.f)
+		fclose(stacks.f);
+	free(stacks.frames);
+	fclose(samples->f);
 	free(samples);
 	return retval;
 }
@@ -5685,6 +6494,9 @@ static const struct command_registration target_instance_command_handlers[] = {
 		.help = "invoke handler for specified event",
 		.usage = "event_name",
 	},
+	{
+		.chain = target_memcache_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -6224,7 +7036,8 @@ COMMAND_HANDLER(handle_fast_load_image_command)
 
 COMMAND_HANDLER(handle_fast_load_command)
 {
-	if (CMD_ARGC > 0)
+	bool delta_mode = CMD_ARGC == 1 && !strcmp(CMD_ARGV[0], "-delta");
+	if (CMD_ARGC > 0 && !delta_mode)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 	if (!fastload) {
 		LOG_ERROR("No image in memory");
@@ -6234,7 +7047,27 @@ COMMAND_HANDLER(handle_fast_load_command)
 	int64_t ms = timeval_ms();
 	int size = 0;
 	int retval = ERROR_OK;
-	for (i = 0; i < fastload_num; i++) {
+	if (delta_mode) {
+		struct target *target = get_current_target(CMD_CTX);
+		struct load_delta_section *delta = calloc(fastload_num, sizeof(*delta));
+		if (!delta) {
+			LOG_ERROR("Unable to allocate memory");
+			return ERROR_FAIL;
+		}
+		for (i = 0; i < fastload_num; i++) {
+			delta[i].address = fastload[i].address;
+			delta[i].length = fastload[i].length;
+			delta[i].data = fastload[i].data;
+			size += fastload[i].length;
+		}
+		uint32_t written;
+		retval = load_delta_write_sections(CMD, target, delta, fastload_num, &written);
+		load_delta_free_sections(delta, fastload_num);
+		if (retval == ERROR_OK)
+			command_print(CMD, "Skipped %" PRIu32 " unchanged bytes", size - written);
+		size = written;
+	}
+	for (i = 0; i < fastload_num && !delta_mode; i++) {
 		struct target *target = get_current_target(CMD_CTX);
 		command_print(CMD, "Write to 0x%08x, length 0x%08x",
 					  (unsigned int)(fastload[i].address),
@@ -6516,14 +7349,16 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.mode = COMMAND_EXEC,
 		.help = "loads active fast load image to current target "
 			"- mainly for profiling purposes",
-		.usage = "",
+		.usage = "['-delta']",
 	},
 	{
 		.name = "profile",
 		.handler = handle_profile_command,
 		.mode = COMMAND_EXEC,
-		.usage = "seconds filename [start end]",
-		.help = "profiling samples the CPU PC",
+		.usage = "seconds filename [start end] "
+			"['-stacks' filename [every [depth]]]",
+		.help = "profiling samples the CPU PC, and optionally its call "
+			"stack, written as folded stacks for flame graphs",
 	},
 	/** @todo don't register virt2phys() unless target supports it */
 	{
@@ -6681,7 +7516,7 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.name = "load_image",
 		.handler = handle_load_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "filename [address ['bin'|'ihex'|'elf'|'s19' "
+		.usage = "['-delta'] filename [address ['bin'|'ihex'|'elf'|'s19' "
 			"[min_address [max_length]]]]",
 	},
 	{
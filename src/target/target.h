@@ -98,6 +98,9 @@ struct gdb_service {
 	/*  element 1 coreid to be displayed at next resume 1 till n 0 means resume
 	 *  all cores core displayed  */
 	int32_t core[2];
+	/* set while GDB debugs the targets in non-stop mode: the cores of an
+	 * SMP group then halt and resume independently */
+	bool non_stop;
 };
 
 /* target back off timer */
@@ -207,6 +210,9 @@ struct target {
 
 	/* The semihosting information, extracted from the target. */
 	struct semihosting *semihosting;
+
+	/* host side cache of the target memory, see "memcache" commands */
+	struct target_memcache *memcache;
 };
 
 struct target_list {
@@ -333,8 +339,8 @@ struct target_timer_callback {
 	enum target_timer_type type;
 	bool removed;
 	int64_t when;	/* output of timeval_ms() */
+	uint64_t seq;	/* registration order, breaks the ties on when */
 	void *priv;
-	struct target_timer_callback *next;
 };
 
 struct target_memory_check_block {
@@ -343,6 +349,13 @@ struct target_memory_check_block {
 	uint32_t result;
 };
 
+/** One block of a scatter-gather memory read, see target_read_memory_sg() */
+struct target_memory_sg {
+	target_addr_t address;
+	uint32_t size;		/* in bytes */
+	uint8_t *buffer;
+};
+
 int target_register_commands(struct command_context *cmd_ctx);
 int target_examine(void);
 
@@ -523,6 +536,16 @@ int target_get_gdb_reg_list_noread(struct target *target,
 		struct reg **reg_list[], int *reg_list_size,
 		enum target_register_class reg_class);
 
+/**
+ * Fill the register cache with the registers of class @a reg_class in one
+ * go, where the target supports it. Nothing to do otherwise, or when all
+ * the registers of the class are already valid.
+ *
+ * This routine is a wrapper for target->type->fetch_registers.
+ */
+int target_fetch_registers(struct target *target,
+		enum target_register_class reg_class);
+
 /**
  * Check if @a target allows GDB connections.
  *
@@ -654,6 +677,16 @@ int target_write_buffer(struct target *target,
 		target_addr_t address, uint32_t size, const uint8_t *buffer);
 int target_read_buffer(struct target *target,
 		target_addr_t address, uint32_t size, uint8_t *buffer);
+
+/**
+ * Read the @a count blocks of @a sg, which don't depend on each other, in
+ * as few adapter round trips as the target can manage. Targets without a
+ * read_memory_sg method get one target_read_buffer() per block.
+ *
+ * On error, the content of all the buffers is undefined.
+ */
+int target_read_memory_sg(struct target *target,
+		const struct target_memory_sg *sg, unsigned int count);
 int target_checksum_memory(struct target *target,
 		target_addr_t address, uint32_t size, uint32_t *crc);
 int target_blank_check_memory(struct target *target,
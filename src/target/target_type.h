@@ -106,6 +106,17 @@ struct target_type {
 			struct reg **reg_list[], int *reg_list_size,
 			enum target_register_class reg_class);
 
+	/**
+	 * Optional. Read the registers of class @a reg_class that are not
+	 * valid yet into the register cache, in as few adapter round trips
+	 * as the target can manage, so that get_gdb_reg_list() finds them
+	 * valid. Registers it cannot read this way are left invalid, for the
+	 * register access methods to read them one at a time.
+	 * Do @b not call this function directly, use target_fetch_registers().
+	 */
+	int (*fetch_registers)(struct target *target,
+			enum target_register_class reg_class);
+
 	/* target memory access
 	* size: 1 = byte (8bit), 2 = half-word (16bit), 4 = word (32bit)
 	* count: number of items of <size>
@@ -124,6 +135,14 @@ struct target_type {
 	int (*write_memory)(struct target *target, target_addr_t address,
 			uint32_t size, uint32_t count, const uint8_t *buffer);
 
+	/**
+	 * Optional. Read the @a count independent blocks of @a sg in a single
+	 * batch of the transport. Do @b not call this function directly, use
+	 * target_read_memory_sg() instead.
+	 */
+	int (*read_memory_sg)(struct target *target,
+			const struct target_memory_sg *sg, unsigned int count);
+
 	/* Default implementation will do some fancy alignment to improve performance, target can override */
 	int (*read_buffer)(struct target *target, target_addr_t address,
 			uint32_t size, uint8_t *buffer);
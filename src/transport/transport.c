@@ -32,6 +32,7 @@
 
 #include <helper/log.h>
 #include <helper/replacements.h>
+#include <helper/time_support.h>
 #include <transport/transport.h>
 
 extern struct command_context *global_cmd_ctx;
@@ -55,6 +56,11 @@ static const char * const *allowed_transports;
 /** * The transport being used for the current OpenOCD session.  */
 static struct transport *session;
 
+/** Traffic counters, see "transport stats". */
+static struct transport_stats stats;
+/** The adapter resends after a WAIT by itself, see transport_stats_retries_unsupported() */
+static bool retries_unsupported;
+
 static int transport_select(struct command_context *ctx, const char *name)
 {
 	/* name may only identify a known transport;
@@ -233,6 +239,152 @@ COMMAND_HANDLER(handle_transport_init)
 	return session->init(CMD_CTX);
 }
 
+/*-----------------------------------------------------------------------*/
+
+/*
+ * Traffic counters
+ */
+
+void transport_stats_flush(int64_t elapsed_us)
+{
+	unsigned int bucket = 0;
+
+	if (elapsed_us < 0)
+		elapsed_us = 0;
+
+	for (uint64_t t = elapsed_us; t && bucket < TRANSPORT_STATS_LATENCY_BUCKETS - 1; t >>= 1)
+		bucket++;
+
+	stats.flushes++;
+	stats.flush_time_us += elapsed_us;
+	if ((uint64_t)elapsed_us > stats.flush_max_us)
+		stats.flush_max_us = elapsed_us;
+	stats.flush_latency[bucket]++;
+}
+
+void transport_stats_scan(unsigned int bits)
+{
+	stats.scans++;
+	stats.bits += bits;
+}
+
+void transport_stats_idle_clocks(unsigned int clocks)
+{
+	stats.idle_clocks += clocks;
+}
+
+void transport_stats_dap_transactions(unsigned int count)
+{
+	stats.dap_transactions += count;
+}
+
+void transport_stats_retry(void)
+{
+	stats.retries++;
+}
+
+void transport_stats_retries_unsupported(void)
+{
+	retries_unsupported = true;
+}
+
+const struct transport_stats *transport_get_stats(void)
+{
+	return &stats;
+}
+
+void transport_reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+/* Lower bound, in us, of a bucket of the latency histogram */
+static uint64_t transport_stats_bucket_us(unsigned int bucket)
+{
+	return bucket ? (uint64_t)1 << (bucket - 1) : 0;
+}
+
+void transport_stats_json(char *buf, int64_t timestamp)
+{
+	char *end = buf + TRANSPORT_STATS_JSON_SIZE;
+	char retries[24] = "null";
+
+	if (!retries_unsupported)
+		snprintf(retries, sizeof(retries), "%" PRIu64, stats.retries);
+
+	buf += snprintf(buf, end - buf, "{\"timestamp_ms\": %" PRId64 ", \"transport\": \"%s\", "
+			"\"flushes\": %" PRIu64 ", \"scans\": %" PRIu64 ", \"bits\": %" PRIu64 ", "
+			"\"idle_clocks\": %" PRIu64 ", \"dap_transactions\": %" PRIu64 ", "
+			"\"retries\": %s, \"flush_time_us\": %" PRIu64 ", "
+			"\"flush_max_us\": %" PRIu64 ", \"flush_latency_us\": {",
+			timestamp, session ? session->name : "",
+			stats.flushes, stats.scans, stats.bits,
+			stats.idle_clocks, stats.dap_transactions,
+			retries, stats.flush_time_us,
+			stats.flush_max_us);
+
+	bool first = true;
+	for (unsigned int i = 0; i < TRANSPORT_STATS_LATENCY_BUCKETS; i++) {
+		if (!stats.flush_latency[i])
+			continue;
+		buf += snprintf(buf, end - buf, "%s\"%" PRIu64 "\": %" PRIu64, first ? "" : ", ",
+				transport_stats_bucket_us(i), stats.flush_latency[i]);
+		first = false;
+	}
+
+	snprintf(buf, end - buf, "}}");
+}
+
+COMMAND_HANDLER(handle_transport_stats)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (!strcmp(CMD_ARGV[0], "reset")) {
+			transport_reset_stats();
+			return ERROR_OK;
+		}
+		if (strcmp(CMD_ARGV[0], "json"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		char buf[TRANSPORT_STATS_JSON_SIZE];
+		transport_stats_json(buf, timeval_ms());
+		command_print(CMD, "%s", buf);
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "flushes:          %" PRIu64, stats.flushes);
+	command_print(CMD, "scans:            %" PRIu64, stats.scans);
+	command_print(CMD, "bits shifted:     %" PRIu64, stats.bits);
+	command_print(CMD, "idle clocks:      %" PRIu64, stats.idle_clocks);
+	command_print(CMD, "DAP transactions: %" PRIu64, stats.dap_transactions);
+	if (retries_unsupported)
+		command_print(CMD, "WAIT retries:     unsupported, done by the adapter");
+	else
+		command_print(CMD, "WAIT retries:     %" PRIu64, stats.retries);
+	command_print(CMD, "flush time:       %" PRIu64 " us (max %" PRIu64 " us, mean %" PRIu64 " us)",
+			stats.flush_time_us, stats.flush_max_us,
+			stats.flushes ? stats.flush_time_us / stats.flushes : 0);
+
+	if (!stats.flushes)
+		return ERROR_OK;
+
+	command_print(CMD, "flush latency histogram:");
+	for (unsigned int i = 0; i < TRANSPORT_STATS_LATENCY_BUCKETS; i++) {
+		if (!stats.flush_latency[i])
+			continue;
+		if (i == TRANSPORT_STATS_LATENCY_BUCKETS - 1)
+			command_print(CMD, "  >= %8" PRIu64 " us: %" PRIu64,
+					transport_stats_bucket_us(i), stats.flush_latency[i]);
+		else
+			command_print(CMD, "  < %9" PRIu64 " us: %" PRIu64,
+					transport_stats_bucket_us(i + 1), stats.flush_latency[i]);
+	}
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_transport_list)
 {
 	if (CMD_ARGC != 0)
@@ -336,6 +488,13 @@ static const struct command_registration transport_commands[] = {
 		.help = "Select this session's transport",
 		.usage = "[transport_name]",
 	},
+	{
+		.name = "stats",
+		.handler = handle_transport_stats,
+		.mode = COMMAND_EXEC,
+		.help = "Display, as text or JSON, or reset the transport traffic counters",
+		.usage = "['reset'|'json']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -354,3 +513,13 @@ int transport_register_commands(struct command_context *ctx)
 {
 	return register_commands(ctx, NULL, transport_group);
 }
+
+/**
+ * Adds commands implemented by other layers to the "transport" group,
+ * e.g. the periodic dump of the counters, driven by a server timer.
+ */
+int transport_register_group_commands(struct command_context *ctx,
+		const struct command_registration *cmds)
+{
+	return register_commands(ctx, "transport", cmds);
+}
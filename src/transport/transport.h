@@ -76,11 +76,69 @@ int transport_register(struct transport *new_transport);
 struct transport *get_current_transport(void);
 
 int transport_register_commands(struct command_context *ctx);
+int transport_register_group_commands(struct command_context *ctx,
+		const struct command_registration *cmds);
 
 COMMAND_HELPER(transport_list_parse, char ***vector);
 
 int allow_transports(struct command_context *ctx, const char * const *vector);
 
+/**
+ * Number of buckets of the flush latency histogram. Bucket 0 counts the
+ * flushes that took less than 1us, bucket n those that took between
+ * 2^(n-1) and 2^n - 1 us; the last bucket also gets all the slower ones.
+ */
+#define TRANSPORT_STATS_LATENCY_BUCKETS 24
+
+/**
+ * Counters of the traffic on the debug transport. They are updated by
+ * the JTAG queue flush, by the SWD run() path and by the DAP layer, so
+ * that a slow session can be told to be bound by round-trips to the
+ * adapter, by the TCK rate or by the host.
+ */
+struct transport_stats {
+	/** number of queue flushes (JTAG execute_queue or SWD run) */
+	uint64_t flushes;
+	/** number of IR/DR scans */
+	uint64_t scans;
+	/** number of bits shifted by the scans */
+	uint64_t bits;
+	/** number of TCK cycles spent in Run-Test/Idle or in a stable state */
+	uint64_t idle_clocks;
+	/** number of DP/AP register accesses queued */
+	uint64_t dap_transactions;
+	/** number of DAP transactions resent after a WAIT response */
+	uint64_t retries;
+	/** total time spent in flushes, in us */
+	uint64_t flush_time_us;
+	/** slowest flush, in us */
+	uint64_t flush_max_us;
+	/** log2 histogram of the flush latency */
+	uint64_t flush_latency[TRANSPORT_STATS_LATENCY_BUCKETS];
+};
+
+void transport_stats_flush(int64_t elapsed_us);
+void transport_stats_scan(unsigned int bits);
+void transport_stats_idle_clocks(unsigned int clocks);
+void transport_stats_dap_transactions(unsigned int count);
+void transport_stats_retry(void);
+/**
+ * Called by the adapters which resend the DAP transactions after a WAIT
+ * in their firmware, out of sight of the host: "retries" is then unknown.
+ */
+void transport_stats_retries_unsupported(void);
+const struct transport_stats *transport_get_stats(void);
+void transport_reset_stats(void);
+
+/** Size of a buffer large enough for transport_stats_json() */
+#define TRANSPORT_STATS_JSON_SIZE 2048
+
+/**
+ * Write the traffic counters, with @a timestamp in ms, as a single line
+ * JSON object into @a buf, which has TRANSPORT_STATS_JSON_SIZE bytes.
+ */
+void transport_stats_json(char *buf, int64_t timestamp);
+
 bool transport_is_jtag(void);
 bool transport_is_swd(void);
 bool transport_is_dapdirect_jtag(void);
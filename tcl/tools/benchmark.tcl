@@ -0,0 +1,86 @@
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+# Description:
+#  Hardware-free benchmark of the host side of the JTAG queue. It runs a
+#  fixed set of workloads, an IR/DR ping-pong, 1 MiB of MEM-AP writes and
+#  a SVF replay, and prints for each one the commands, scans and bits per
+#  second and the host CPU time per queued command.
+#
+# Usage:
+#  With the dummy adapter:
+#   openocd -f tools/benchmark.tcl
+#  With the loopback remote_bitbang server of contrib/remote_bitbang:
+#   remote_bitbang_loopback.py --port 3335 &
+#   openocd -c "set BENCHMARK_ADAPTER remote_bitbang" -f tools/benchmark.tcl
+#  and with the vector extension of the remote_bitbang protocol:
+#   openocd -c "set BENCHMARK_ADAPTER remote_bitbang" \
+#           -c "set BENCHMARK_VECTORS on" -f tools/benchmark.tcl
+#
+# Note:
+#  The MEM-AP workload needs the DAP emulated by the dummy adapter, it is
+#  skipped with remote_bitbang.
+#
+
+if { ![info exists BENCHMARK_ADAPTER] } {
+	set BENCHMARK_ADAPTER dummy
+}
+if { ![info exists BENCHMARK_PORT] } {
+	set BENCHMARK_PORT 3335
+}
+if { ![info exists BENCHMARK_SCANS] } {
+	set BENCHMARK_SCANS 100000
+}
+if { ![info exists BENCHMARK_VECTORS] } {
+	set BENCHMARK_VECTORS off
+}
+
+adapter driver $BENCHMARK_ADAPTER
+transport select jtag
+adapter speed 10000
+
+if { $BENCHMARK_ADAPTER eq "dummy" } {
+	# JTAG-DP answering OK to every transaction
+	dummy dr_capture 2
+} else {
+	remote_bitbang host localhost
+	remote_bitbang port $BENCHMARK_PORT
+	remote_bitbang vectors $BENCHMARK_VECTORS
+}
+
+jtag newtap bench cpu -irlen 4 -ircapture 0xf -irmask 0xf
+if { $BENCHMARK_ADAPTER eq "dummy" } {
+	dap create bench.dap -chain-position bench.cpu
+}
+
+init
+
+# SVF file of long shifts, as used to program FPGAs and CPLDs
+proc benchmark_svf_file { } {
+	set f [file tempfile]
+	set fd [open $f w]
+	set tdi [string repeat a5 512]
+	puts $fd "ENDIR IDLE;\nENDDR IDLE;\nSTATE RESET;\nSTATE IDLE;"
+	for { set i 0 } { $i < 256 } { incr i } {
+		puts $fd "SIR 4 TDI (f);"
+		puts $fd "SDR 4096 TDI ($tdi);"
+		puts $fd "RUNTEST 100 TCK;"
+	}
+	close $fd
+	return $f
+}
+
+echo [benchmark scan bench.cpu $BENCHMARK_SCANS]
+
+if { $BENCHMARK_ADAPTER eq "dummy" } {
+	echo [benchmark memap bench.dap 0x20000000]
+}
+
+set svf [benchmark_svf_file]
+set retval [catch { benchmark svf $svf } result]
+file delete $svf
+if { $retval } {
+	error $result
+}
+echo $result
+
+shutdown